@@ -0,0 +1,706 @@
+#include <cstring>
+#include <ctype.h>
+#include <algorithm>
+#include "ApiConnection.h"
+#include "Metrics.h"
+#include "WireFormat.h"
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#define API_WOULD_BLOCK (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define API_WOULD_BLOCK (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+#endif
+
+namespace {
+
+const char WEBSOCKET_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+const size_t MAX_HANDSHAKE = 8 * 1024;
+const size_t MAX_GATHER = 64; //messages per send call
+
+enum{
+	OpContinuation = 0x0,
+	OpText = 0x1,
+	OpBinary = 0x2,
+	OpClose = 0x8,
+	OpPing = 0x9,
+	OpPong = 0xA
+};
+
+bool setNonBlocking(ApiSocket socket){
+#ifdef _WIN32
+	u_long on = 1;
+	return ioctlsocket(socket, FIONBIO, &on) == 0;
+#else
+	int flags = fcntl(socket, F_GETFL, 0);
+	return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+inline uint32_t rotl(uint32_t value, int bits){
+	return (value << bits) | (value >> (32 - bits));
+}
+
+//only needed for Sec-WebSocket-Accept
+void sha1(const std::string& text, unsigned char digest[20]){
+	uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+	std::string data = text;
+	uint64_t bits = (uint64_t)text.size() * 8;
+	data += (char)0x80;
+	while(data.size() % 64 != 56){
+		data += (char)0;
+	}
+	for(int i = 7; i >= 0; i--){
+		data += (char)((bits >> (i * 8)) & 0xFF);
+	}
+	for(size_t chunk = 0; chunk < data.size(); chunk += 64){
+		uint32_t w[80];
+		for(int i = 0; i < 16; i++){
+			const unsigned char* p = (const unsigned char*)&data[chunk + i * 4];
+			w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+		}
+		for(int i = 16; i < 80; i++){
+			w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		}
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for(int i = 0; i < 80; i++){
+			uint32_t f, k;
+			if(i < 20){ f = (b & c) | (~b & d); k = 0x5A827999; }
+			else if(i < 40){ f = b ^ c ^ d; k = 0x6ED9EBA1; }
+			else if(i < 60){ f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+			else{ f = b ^ c ^ d; k = 0xCA62C1D6; }
+			uint32_t t = rotl(a, 5) + f + e + k + w[i];
+			e = d; d = c; c = rotl(b, 30); b = a; a = t;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+	}
+	for(int i = 0; i < 5; i++){
+		digest[i * 4] = (unsigned char)(h[i] >> 24);
+		digest[i * 4 + 1] = (unsigned char)(h[i] >> 16);
+		digest[i * 4 + 2] = (unsigned char)(h[i] >> 8);
+		digest[i * 4 + 3] = (unsigned char)h[i];
+	}
+}
+
+std::string base64(const unsigned char* data, size_t size){
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string text;
+	for(size_t i = 0; i < size; i += 3){
+		uint32_t chunk = (uint32_t)data[i] << 16;
+		if(i + 1 < size) chunk |= (uint32_t)data[i + 1] << 8;
+		if(i + 2 < size) chunk |= data[i + 2];
+		text += alphabet[(chunk >> 18) & 63];
+		text += alphabet[(chunk >> 12) & 63];
+		text += i + 1 < size ? alphabet[(chunk >> 6) & 63] : '=';
+		text += i + 2 < size ? alphabet[chunk & 63] : '=';
+	}
+	return text;
+}
+
+//splits data into requests: a frame where WIRE_MAGIC starts one, otherwise a line up to '\n'.
+//a whole websocket message is complete and its last line needs no '\n'; otherwise an unfinished
+//request is left for the next read. *used is how much was split off; false on a frame that cannot be accepted
+bool splitRequests(const char* data, size_t size, bool complete, size_t maxFrame, std::vector<ApiRequest>& requests, size_t* used){
+	const char magic[2] = {(char)(WIRE_MAGIC & 0xFF), (char)(WIRE_MAGIC >> 8)};
+	size_t offset = 0;
+	while(offset < size){
+		const char* start = data + offset;
+		size_t left = size - offset;
+		if(start[0] == magic[0] && left < 2 && !complete){
+			break;
+		}
+		if(left >= 2 && start[0] == magic[0] && start[1] == magic[1]){
+			WireHeader header;
+			if(left < WIRE_HEADER_SIZE){
+				if(complete){
+					return false;
+				}
+				break;
+			}
+			if(!wireReadHeader(start, left, header) || header.length > maxFrame){
+				return false;
+			}
+			size_t total = WIRE_HEADER_SIZE + header.length;
+			if(left < total){
+				if(complete){
+					return false;
+				}
+				break;
+			}
+			ApiRequest request = {start, total, true};
+			requests.push_back(request);
+			offset += total;
+			continue;
+		}
+		const char* end = (const char*)std::memchr(start, '\n', left);
+		if(!end && !complete){
+			break;
+		}
+		size_t length = end ? (size_t)(end - start) : left;
+		offset += end ? length + 1 : length;
+		if(length && start[length - 1] == '\r'){
+			length--;
+		}
+		if(length){
+			ApiRequest request = {start, length, false};
+			requests.push_back(request);
+		}
+	}
+	*used = offset;
+	return true;
+}
+
+//value of an http header, case-insensitive name; empty if absent
+std::string headerValue(const std::string& request, const char* name){
+	size_t length = std::strlen(name);
+	size_t line = request.find("\r\n");
+	while(line != std::string::npos && line + 2 < request.size()){
+		size_t start = line + 2;
+		size_t end = request.find("\r\n", start);
+		if(end == std::string::npos){
+			break;
+		}
+		if(end - start > length && request[start + length] == ':'){
+			bool match = true;
+			for(size_t i = 0; i < length && match; i++){
+				match = tolower((unsigned char)request[start + i]) == tolower((unsigned char)name[i]);
+			}
+			if(match){
+				size_t value = start + length + 1;
+				while(value < end && (request[value] == ' ' || request[value] == '\t')){
+					value++;
+				}
+				return request.substr(value, end - value);
+			}
+		}
+		line = end;
+	}
+	return std::string();
+}
+
+}
+
+const char* apiBackpressureName(ApiBackpressure policy){
+	switch(policy){
+	case ApiConflate: return "conflate";
+	case ApiDropOldest: return "drop-oldest";
+	default: return "disconnect";
+	}
+}
+
+bool apiBackpressureFromName(const std::string& name, ApiBackpressure* policy){
+	const ApiBackpressure policies[] = {ApiConflate, ApiDropOldest, ApiDisconnect};
+	for(size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++){
+		if(name == apiBackpressureName(policies[i])){
+			*policy = policies[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+ApiConnection::ApiConnection(ApiSocket socket)
+	: socket(socket), mode(ModeDetecting), consumed(0), outBytes(0), binary(false), policy(ApiConflate),
+	maxSamples(64), maxSampleBytes(4 * 1024 * 1024), queuedSamples(0), queuedSampleBytes(0)
+{
+	std::memset(&stats, 0, sizeof(stats));
+	setNonBlocking(socket);
+}
+
+ApiConnection::~ApiConnection(){
+	close(socket);
+}
+
+bool ApiConnection::receive(std::vector<ApiRequest>& requests){
+	//what the last call handed out has been handled by now
+	in.erase(0, consumed);
+	consumed = 0;
+	assembled.clear();
+	char buffer[16 * 1024];
+	for(;;){
+#ifdef _WIN32
+		int got = ::recv(socket, buffer, sizeof(buffer), 0);
+#else
+		ssize_t got = ::recv(socket, buffer, sizeof(buffer), 0);
+#endif
+		if(got == 0){
+			return false;
+		}
+		if(got < 0){
+			if(API_WOULD_BLOCK){
+				break;
+			}
+			return false;
+		}
+		in.append(buffer, (size_t)got);
+		if((size_t)got < sizeof(buffer)){
+			break;
+		}
+	}
+	if(mode == ModeDetecting && in.size() >= 4){
+		mode = in.compare(0, 4, "GET ") == 0 ? ModeHandshake : ModeLines;
+	}
+	if(mode == ModeHandshake && !parseHandshake()){
+		return false;
+	}
+	if(mode == ModeLines){
+		if(!splitRequests(in.data(), in.size(), false, MAX_LINE, requests, &consumed)){
+			return false;
+		}
+		//what is left is an unfinished line, or an unfinished frame of up to MAX_LINE after its header
+		size_t pending = in.size() - consumed;
+		bool framed = pending > 0 && in[consumed] == (char)(WIRE_MAGIC & 0xFF);
+		return pending <= MAX_LINE + (framed ? WIRE_HEADER_SIZE : 0);
+	}
+	if(mode == ModeWebSocket){
+		return parseFrames(requests);
+	}
+	return mode != ModeClosed || wantsWrite();
+}
+
+bool ApiConnection::parseHandshake(){
+	size_t end = in.find("\r\n\r\n");
+	if(end == std::string::npos){
+		return in.size() <= MAX_HANDSHAKE;
+	}
+	std::string request = in.substr(0, end + 2);
+	in.erase(0, end + 4);
+	std::string key = headerValue(request, "Sec-WebSocket-Key");
+	if(key.empty()){
+		ApiBuffer reply = std::make_shared<std::string>("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+		queue(RAW, NULL, 0, reply);
+		mode = ModeClosed;
+		return true;
+	}
+	unsigned char digest[20];
+	sha1(key + WEBSOCKET_GUID, digest);
+	ApiBuffer reply = std::make_shared<std::string>("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "
+		+ base64(digest, sizeof(digest)) + "\r\n\r\n");
+	queue(RAW, NULL, 0, reply);
+	mode = ModeWebSocket;
+	return true;
+}
+
+bool ApiConnection::parseFrames(std::vector<ApiRequest>& requests){
+	size_t offset = 0;
+	while(in.size() - offset >= 2){
+		unsigned char* head = (unsigned char*)&in[offset];
+		bool fin = (head[0] & 0x80) != 0;
+		int opcode = head[0] & 0x0F;
+		bool masked = (head[1] & 0x80) != 0;
+		uint64_t length = head[1] & 0x7F;
+		size_t header = 2;
+		if(length == 126){
+			if(in.size() - offset < 4){
+				break;
+			}
+			length = ((uint64_t)head[2] << 8) | head[3];
+			header = 4;
+		}
+		else if(length == 127){
+			if(in.size() - offset < 10){
+				break;
+			}
+			length = 0;
+			for(int i = 0; i < 8; i++){
+				length = (length << 8) | head[2 + i];
+			}
+			header = 10;
+		}
+		if(!masked || length > MAX_LINE || message.size() + length > MAX_LINE){
+			return false; //clients must mask (RFC 6455 5.1)
+		}
+		if(in.size() - offset < header + 4 + length){
+			break;
+		}
+		//unmasked where it lies, so an unfragmented message is handed out without a copy
+		const unsigned char* mask = head + header;
+		char* payload = (char*)head + header + 4;
+		for(size_t i = 0; i < (size_t)length; i++){
+			payload[i] = (char)(payload[i] ^ mask[i % 4]);
+		}
+		offset += header + 4 + (size_t)length;
+
+		if(opcode == OpClose){
+			queue(OpClose, NULL, 0, std::make_shared<std::string>(payload, std::min((size_t)length, (size_t)2)));
+			mode = ModeClosed;
+			break;
+		}
+		if(opcode == OpPing){
+			queue(OpPong, NULL, 0, std::make_shared<std::string>(payload, (size_t)length));
+			continue;
+		}
+		if(opcode == OpPong){
+			continue;
+		}
+		if(opcode != OpText && opcode != OpBinary && opcode != OpContinuation){
+			return false;
+		}
+		//a message may carry several requests
+		size_t used;
+		if(fin && message.empty()){
+			if(!splitRequests(payload, (size_t)length, true, MAX_LINE, requests, &used)){
+				return false;
+			}
+			continue;
+		}
+		message.append(payload, (size_t)length);
+		if(fin){
+			assembled.push_back(std::string());
+			assembled.back().swap(message);
+			if(!splitRequests(assembled.back().data(), assembled.back().size(), true, MAX_LINE, requests, &used)){
+				return false;
+			}
+		}
+	}
+	consumed = offset;
+	return true;
+}
+
+void ApiConnection::frame(Segment& segment, int opcode, const char* prefix, size_t prefixSize, const ApiBuffer& body){
+	segment.headSize = 0;
+	segment.body = body;
+	segment.written = 0;
+	unsigned char* head = (unsigned char*)segment.head;
+	if(opcode != RAW){
+		size_t size = prefixSize + (body ? body->size() : 0);
+		head[0] = (unsigned char)(0x80 | opcode);
+		if(size < 126){
+			head[1] = (unsigned char)size;
+			segment.headSize = 2;
+		}
+		else if(size <= 0xFFFF){
+			head[1] = 126;
+			head[2] = (unsigned char)(size >> 8);
+			head[3] = (unsigned char)size;
+			segment.headSize = 4;
+		}
+		else{
+			head[1] = 127;
+			for(int i = 0; i < 8; i++){
+				head[2 + i] = (unsigned char)((uint64_t)size >> ((7 - i) * 8));
+			}
+			segment.headSize = 10;
+		}
+	}
+	std::memcpy(segment.head + segment.headSize, prefix, prefixSize);
+	segment.headSize += prefixSize;
+}
+
+void ApiConnection::queue(int opcode, const char* prefix, size_t prefixSize, const ApiBuffer& body){
+	out.push_back(Segment());
+	Segment& segment = out.back();
+	frame(segment, opcode, prefix, prefixSize, body);
+	segment.stream = 0;
+	segment.queuedNs = Metrics::nowNs();
+	outBytes += segment.size();
+}
+
+void ApiConnection::send(const char* data, size_t size){
+	send(NULL, 0, std::make_shared<std::string>(data, size));
+}
+
+void ApiConnection::send(const char* prefix, size_t prefixSize, const ApiBuffer& body){
+	if(mode == ModeClosed){
+		return;
+	}
+	if(prefixSize > MAX_PREFIX){
+		prefixSize = MAX_PREFIX;
+	}
+	if(mode == ModeWebSocket){
+		queue(binary ? OpBinary : OpText, prefix, prefixSize, body);
+	}
+	else{
+		queue(RAW, prefix, prefixSize, body);
+	}
+}
+
+bool ApiConnection::sendSample(uint32_t stream, const char* prefix, size_t prefixSize, const ApiBuffer& body, int64_t nowNs){
+	if(mode == ModeClosed){
+		return true;
+	}
+	if(prefixSize > MAX_PREFIX){
+		prefixSize = MAX_PREFIX;
+	}
+	int opcode = mode == ModeWebSocket ? (binary ? OpBinary : OpText) : RAW;
+	if(policy == ApiConflate){
+		//replace the unsent sample of this stream in place; it keeps its place in the queue.
+		//not past a reply or schema, which may describe the new sample
+		for(std::deque<Segment>::reverse_iterator it = out.rbegin(); it != out.rend() && it->stream != 0; ++it){
+			if(it->stream == stream && it->written == 0){
+				size_t size = it->size();
+				if(queuedSampleBytes - size + prefixSize + body->size() > maxSampleBytes){
+					//a larger sample that no longer fits: the old one goes and the new one is queued like any other
+					outBytes -= size;
+					queuedSamples--;
+					queuedSampleBytes -= size;
+					stats.conflated++;
+					out.erase(it.base() - 1);
+					break;
+				}
+				frame(*it, opcode, prefix, prefixSize, body);
+				outBytes += it->size() - size;
+				queuedSampleBytes += it->size() - size;
+				stats.conflated++;
+				return true;
+			}
+		}
+	}
+	size_t size = prefixSize + body->size();
+	while(queuedSamples + 1 > maxSamples || queuedSampleBytes + size > maxSampleBytes){
+		if(policy == ApiDisconnect){
+			return false;
+		}
+		if(!dropOldestSample()){
+			break; //only a partly written sample is left
+		}
+	}
+	queue(opcode, prefix, prefixSize, body);
+	out.back().stream = stream;
+	out.back().queuedNs = nowNs;
+	queuedSamples++;
+	queuedSampleBytes += out.back().size();
+	return true;
+}
+
+bool ApiConnection::dropOldestSample(){
+	for(std::deque<Segment>::iterator it = out.begin(); it != out.end(); ++it){
+		if(it->stream != 0 && it->written == 0){
+			size_t size = it->size();
+			outBytes -= size;
+			queuedSamples--;
+			queuedSampleBytes -= size;
+			stats.dropped++;
+			out.erase(it);
+			return true;
+		}
+	}
+	return false;
+}
+
+void ApiConnection::setBackpressure(ApiBackpressure policy, size_t maxMessages, size_t maxBytes){
+	this->policy = policy;
+	maxSamples = maxMessages > 0 ? maxMessages : 1;
+	maxSampleBytes = maxBytes;
+}
+
+ApiConnectionStats ApiConnection::getStats() const{
+	ApiConnectionStats result = stats;
+	result.queuedMessages = out.size();
+	result.queuedBytes = outBytes;
+	result.oldestQueuedNs = out.empty() ? 0 : out.front().queuedNs;
+	return result;
+}
+
+bool ApiConnection::flush(){
+	while(!out.empty()){
+		//one gathering send (writev) for up to MAX_GATHER queued messages, skipping what was already written
+#ifdef _WIN32
+		WSABUF parts[MAX_GATHER * 2];
+#else
+		iovec parts[MAX_GATHER * 2];
+#endif
+		size_t count = 0;
+		size_t wanted = 0;
+		for(size_t i = 0; i < out.size() && i < MAX_GATHER; i++){
+			const Segment& segment = out[i];
+			size_t skip = segment.written;
+			const char* pieces[2] = {segment.head, segment.body ? segment.body->data() : NULL};
+			size_t sizes[2] = {segment.headSize, segment.body ? segment.body->size() : 0};
+			for(int p = 0; p < 2; p++){
+				if(skip >= sizes[p]){
+					skip -= sizes[p];
+					continue;
+				}
+#ifdef _WIN32
+				parts[count].buf = (CHAR*)(pieces[p] + skip);
+				parts[count].len = (ULONG)(sizes[p] - skip);
+#else
+				parts[count].iov_base = (void*)(pieces[p] + skip);
+				parts[count].iov_len = sizes[p] - skip;
+#endif
+				wanted += sizes[p] - skip;
+				count++;
+				skip = 0;
+			}
+		}
+#ifdef _WIN32
+		DWORD written = 0;
+		if(WSASend(socket, parts, (DWORD)count, &written, 0, NULL, NULL) != 0){
+			if(API_WOULD_BLOCK){
+				break;
+			}
+			return false;
+		}
+		size_t sent = written;
+#else
+		msghdr message;
+		std::memset(&message, 0, sizeof(message));
+		message.msg_iov = parts;
+		message.msg_iovlen = count;
+#ifdef MSG_NOSIGNAL
+		ssize_t result = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+#else
+		ssize_t result = ::sendmsg(socket, &message, 0);
+#endif
+		if(result < 0){
+			if(API_WOULD_BLOCK){
+				break;
+			}
+			return false;
+		}
+		size_t sent = (size_t)result;
+#endif
+		outBytes -= sent;
+		bool full = sent < wanted;
+		int64_t nowNs = Metrics::nowNs();
+		while(!out.empty()){
+			Segment& segment = out.front();
+			size_t left = segment.size() - segment.written;
+			if(sent < left){
+				segment.written += sent;
+				break;
+			}
+			sent -= left;
+			if(segment.stream != 0){
+				queuedSamples--;
+				queuedSampleBytes -= segment.size();
+			}
+			stats.sentMessages++;
+			stats.maxLagNs = std::max(stats.maxLagNs, nowNs - segment.queuedNs);
+			out.pop_front();
+		}
+		if(full){
+			break;
+		}
+	}
+	//a refused handshake or a close frame ends the connection once the reply is out
+	return mode != ModeClosed || wantsWrite();
+}
+
+bool ApiConnection::startup(){
+#ifdef _WIN32
+	static bool started = false;
+	if(!started){
+		WSADATA data;
+		started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}
+	return started;
+#else
+	return true;
+#endif
+}
+
+ApiSocket ApiConnection::listenTcp(const std::string& host, int port){
+	ApiSocket listener = ::socket(AF_INET, SOCK_STREAM, 0);
+	if(listener == API_NO_SOCKET){
+		return API_NO_SOCKET;
+	}
+	int on = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons((unsigned short)port);
+	address.sin_addr.s_addr = inet_addr(host.c_str());
+	if(bind(listener, (const sockaddr*)&address, sizeof(address)) != 0 || ::listen(listener, 64) != 0 || !setNonBlocking(listener)){
+		close(listener);
+		return API_NO_SOCKET;
+	}
+	return listener;
+}
+
+ApiSocket ApiConnection::listenUnix(const std::string& path){
+#ifdef _WIN32
+	(void)path;
+	return API_NO_SOCKET;
+#else
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	if(path.size() >= sizeof(address.sun_path)){
+		return API_NO_SOCKET;
+	}
+	ApiSocket listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listener == API_NO_SOCKET){
+		return API_NO_SOCKET;
+	}
+	address.sun_family = AF_UNIX;
+	std::memcpy(address.sun_path, path.c_str(), path.size());
+	unlink(path.c_str()); //left over from a previous run
+	if(bind(listener, (const sockaddr*)&address, sizeof(address)) != 0 || ::listen(listener, 64) != 0 || !setNonBlocking(listener)){
+		close(listener);
+		return API_NO_SOCKET;
+	}
+	return listener;
+#endif
+}
+
+ApiSocket ApiConnection::accept(ApiSocket listener){
+	ApiSocket client = ::accept(listener, NULL, NULL);
+	if(client == API_NO_SOCKET){
+		return API_NO_SOCKET;
+	}
+	int on = 1;
+	setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on)); //fails harmlessly on unix sockets
+	return client;
+}
+
+bool ApiConnection::socketPair(ApiSocket pair[2]){
+	pair[0] = pair[1] = API_NO_SOCKET;
+#ifdef _WIN32
+	//no socketpair on windows: a loopback tcp connection does the same
+	ApiSocket listener = listenTcp("127.0.0.1", 0);
+	sockaddr_in address;
+	int length = sizeof(address);
+	if(listener == API_NO_SOCKET || getsockname(listener, (sockaddr*)&address, &length) != 0){
+		close(listener);
+		return false;
+	}
+	pair[1] = ::socket(AF_INET, SOCK_STREAM, 0);
+	if(pair[1] == API_NO_SOCKET || connect(pair[1], (const sockaddr*)&address, sizeof(address)) != 0){
+		close(listener);
+		close(pair[1]);
+		return false;
+	}
+	for(int tries = 0; tries < 1000 && pair[0] == API_NO_SOCKET; tries++){
+		pair[0] = ::accept(listener, NULL, NULL);
+		if(pair[0] == API_NO_SOCKET){
+			Sleep(1);
+		}
+	}
+	close(listener);
+#else
+	int fds[2];
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0){
+		return false;
+	}
+	pair[0] = fds[0];
+	pair[1] = fds[1];
+#endif
+	if(pair[0] == API_NO_SOCKET || !setNonBlocking(pair[0]) || !setNonBlocking(pair[1])){
+		close(pair[0]);
+		close(pair[1]);
+		return false;
+	}
+	return true;
+}
+
+void ApiConnection::close(ApiSocket socket){
+	if(socket == API_NO_SOCKET){
+		return;
+	}
+#ifdef _WIN32
+	closesocket(socket);
+#else
+	::close(socket);
+#endif
+}
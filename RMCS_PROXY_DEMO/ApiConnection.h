@@ -0,0 +1,136 @@
+#ifndef APICONNECTION_H
+#define APICONNECTION_H
+#include <deque>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <winsock2.h>
+typedef SOCKET ApiSocket;
+#define API_NO_SOCKET INVALID_SOCKET
+#else
+typedef int ApiSocket;
+#define API_NO_SOCKET (-1)
+#endif
+
+//an encoded message body, immutable once queued; one buffer is shared by every connection sending it
+typedef std::shared_ptr<const std::string> ApiBuffer;
+
+//what a connection does with a new sample once its queue is full
+enum ApiBackpressure{
+	ApiConflate,   //a new sample replaces the unsent one of the same stream; the oldest is dropped if still full
+	ApiDropOldest, //the oldest unsent samples are dropped
+	ApiDisconnect  //the connection is closed
+};
+
+const char* apiBackpressureName(ApiBackpressure policy); //"conflate", "drop-oldest", "disconnect"
+bool apiBackpressureFromName(const std::string& name, ApiBackpressure* policy); //false if unknown
+
+//one request as it sits in the connection's buffer: a text line without its newline,
+//or a WireFormat.h frame with its header. valid until the next receive() of the connection
+struct ApiRequest{
+	const char* data;
+	size_t size;
+	bool frame;
+};
+
+struct ApiConnectionStats{
+	uint64_t sentMessages;
+	uint64_t conflated;      //samples replaced by a newer one of their stream before being sent
+	uint64_t dropped;        //samples dropped from a full queue
+	size_t queuedMessages;
+	size_t queuedBytes;
+	int64_t oldestQueuedNs;  //when the oldest unsent message was queued (Metrics::nowNs), 0 if none
+	int64_t maxLagNs;        //longest a message waited in the queue
+};
+
+//one client of the api server: a plain stream socket (tcp or unix) carrying text lines,
+//or the same lines inside websocket text frames when the client opens with an http upgrade.
+//binary WireFormat.h frames may be mixed in: on a plain socket a request starting with WIRE_MAGIC is a frame,
+//over websocket they come in binary messages. non-blocking; only the server thread touches it
+class ApiConnection
+{
+public:
+	explicit ApiConnection(ApiSocket socket);
+	~ApiConnection();
+	ApiSocket getSocket() const { return socket; }
+	bool isWebSocket() const { return mode == ModeWebSocket; }
+
+	//reads what the socket has; complete requests are appended to requests, pointing into the connection's buffer.
+	//false once the peer is gone or broke the protocol
+	bool receive(std::vector<ApiRequest>& requests);
+	//queues one message, copied; framed as a websocket frame once upgraded
+	void send(const char* data, size_t size);
+	void send(const std::string& text) { send(text.data(), text.size()); }
+	//queues prefix + body as one message without copying body; prefix is at most MAX_PREFIX bytes
+	void send(const char* prefix, size_t prefixSize, const ApiBuffer& body);
+	//queues a sample of stream (non-zero) under the backpressure policy; false if the policy says to disconnect
+	bool sendSample(uint32_t stream, const char* prefix, size_t prefixSize, const ApiBuffer& body, int64_t nowNs);
+	//the queue holds at most maxMessages samples and maxBytes of them; replies and schemas are never dropped
+	void setBackpressure(ApiBackpressure policy, size_t maxMessages, size_t maxBytes);
+	ApiBackpressure getBackpressure() const { return policy; }
+	ApiConnectionStats getStats() const;
+	void setBinary(bool binary) { this->binary = binary; } //websocket binary frames instead of text frames
+	bool flush(); //writes as much as the socket takes, gathering queued messages; false on a broken connection
+	size_t pendingBytes() const { return outBytes; }
+	bool wantsWrite() const { return outBytes != 0; }
+
+	static const size_t MAX_PREFIX = 32;
+
+	static bool startup(); //winsock init, once per process
+	static ApiSocket listenTcp(const std::string& host, int port);
+	static ApiSocket listenUnix(const std::string& path); //API_NO_SOCKET on windows
+	static ApiSocket accept(ApiSocket listener);
+	static bool socketPair(ApiSocket pair[2]); //connected, non-blocking; to wake a poll from another thread
+	static void close(ApiSocket socket);
+private:
+	enum Mode{
+		ModeDetecting, //waiting for the first bytes: "GET " starts a websocket handshake
+		ModeLines,
+		ModeHandshake,
+		ModeWebSocket,
+		ModeClosed
+	};
+	static const size_t MAX_LINE = 64 * 1024;
+	static const int RAW = -1; //queue() opcode for bytes sent as they are
+
+	//a queued message: its own small head (websocket header and prefix) and a shared body
+	struct Segment{
+		char head[16 + MAX_PREFIX];
+		size_t headSize;
+		ApiBuffer body;
+		size_t written; //of head + body
+		uint32_t stream; //0: not a sample, never dropped
+		int64_t queuedNs;
+
+		size_t size() const { return headSize + (body ? body->size() : 0); }
+	};
+
+	bool parseHandshake();
+	bool parseFrames(std::vector<ApiRequest>& requests);
+	void queue(int opcode, const char* prefix, size_t prefixSize, const ApiBuffer& body);
+	void frame(Segment& segment, int opcode, const char* prefix, size_t prefixSize, const ApiBuffer& body);
+	bool dropOldestSample();
+
+	ApiSocket socket;
+	Mode mode;
+	std::string in;
+	size_t consumed; //bytes of in the last receive() handed out; they stay until the next one
+	std::string message; //websocket fragments of the current message
+	std::deque<std::string> assembled; //fragmented messages completed by the last receive()
+	std::deque<Segment> out;
+	size_t outBytes;
+	bool binary;
+	ApiBackpressure policy;
+	size_t maxSamples;
+	size_t maxSampleBytes;
+	size_t queuedSamples;
+	size_t queuedSampleBytes;
+	ApiConnectionStats stats;
+
+	ApiConnection(const ApiConnection&);
+	ApiConnection& operator=(const ApiConnection&);
+};
+
+#endif
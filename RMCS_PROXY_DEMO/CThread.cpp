@@ -11,13 +11,17 @@ CThread::CThread(){
 CThread::~CThread(){
 	this->stop();
 	if( this-> t ){
+		//a subclass with a shutdown() has joined already; one whose run() never returns is left running
+		if(t->joinable()){
+			t->detach();
+		}
 		delete t;
 	}
 }  
 void CThread::start(){
 	if(!this-> t ){
-		std::thread t =  std::thread(&CThread::run,this);
-		t.detach() ; //detach the thread, run continue
+		//kept joinable, so shutdown() can wait for run() even if it has not begun yet
+		this->t = new std::thread(&CThread::run,this);
 	}
 }  //start thread
 
@@ -47,18 +51,23 @@ void CThread::timeSleeps(){
 
 } //set sleep time
 void CThread::join(){
-	if(t){
+	if(t && t->joinable() && t->get_id() != std::this_thread::get_id()){
 		t->join();
 	}
 }      //
 bool CThread::swap(CThread* t1 ){
 	if(t && t1->getThread()){
 		t->swap(*(t1->getThread()));
+		return true;
 	}
-
+	return false;
 }	  //swap thread 
-std::thread::id CThread::get_id(){} //thread id
-bool CThread::joinable(){} //
+std::thread::id CThread::get_id(){
+	return t ? t->get_id() : std::thread::id();
+} //thread id
+bool CThread::joinable(){
+	return t && t->joinable();
+} //
 std::thread* CThread::getThread(){
 	return this->t;
 
@@ -11,7 +11,7 @@ public:
 	void start();  //start thread
 	void stop();     //stop thread
 	void timeSleeps(); //set sleep time
-	void join();      //
+	void join();      //waits for run() to return; no-op if never started or called from run() itself
 	bool swap(CThread* t );	  //swap thread 
 	std::thread::id get_id(); //thread id
 	bool joinable(); //
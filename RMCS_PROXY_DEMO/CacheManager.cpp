@@ -0,0 +1,107 @@
+#include "CacheManager.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+CacheManager::CacheManager()
+	: index(std::make_shared<HistoryIndex>())
+{
+}
+
+CacheManager::CacheManager(const HistoryConfig& config)
+	: config(config), index(std::make_shared<HistoryIndex>())
+{
+}
+
+CacheManager::~CacheManager(){
+}
+
+void CacheManager::run(){
+	//history is filled from the feedback thread through onFrame
+}
+
+const HistoryConfig& CacheManager::getHistoryConfig() const{
+	return config;
+}
+
+size_t CacheManager::getHistoryBytes() const{
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(registryLock));
+	return histories.size() * config.bytesPerModule();
+}
+
+std::shared_ptr<const CacheManager::HistoryIndex> CacheManager::registerGroup(const GroupFeedbackFrame& frame){
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(registryLock));
+	std::shared_ptr<HistoryIndex> next = std::make_shared<HistoryIndex>(*std::atomic_load(&index));
+	//modules are looked up by key again, so a reordered group appends each sample to its own module's ring
+	next->groupKeys[frame.groupKey] = frame.moduleKeys;
+	std::vector<ModuleHistory*>& group = next->groups[frame.groupKey];
+	if(!next->latest.count(frame.groupKey)){
+		latestFrames.push_back(std::unique_ptr<std::shared_ptr<const GroupFeedbackFrame> >(new std::shared_ptr<const GroupFeedbackFrame>()));
+		next->latest[frame.groupKey] = latestFrames.back().get();
+	}
+	group.assign(frame.modules.size(), NULL);
+	for(size_t i = 0; i < frame.modules.size(); i++){
+		const std::string& module = (*frame.moduleKeys)[i];
+		std::map<std::string, ModuleHistory*>::iterator found = next->modules.find(module);
+		if(found != next->modules.end()){
+			//a module keeps a single writer: the first group that reported it
+			group[i] = (next->owners[module] == frame.groupKey) ? found->second : NULL;
+			continue;
+		}
+		if(histories.size() >= config.maxModules){
+			continue;
+		}
+		histories.push_back(std::unique_ptr<ModuleHistory>(new ModuleHistory(config.capacity(), config.fields)));
+		group[i] = histories.back().get();
+		next->modules[module] = group[i];
+		next->owners[module] = frame.groupKey;
+	}
+	std::shared_ptr<const HistoryIndex> published = next;
+	std::atomic_store(&index, published);
+	return published;
+}
+
+void CacheManager::onFrame(const GroupFeedbackFrame& frame){
+	METRIC_SCOPE(MetricCachePublish);
+	TRACE_SCOPE("cache_publish");
+	if(!frame.moduleKeys || frame.moduleKeys->size() != frame.modules.size()){
+		return;
+	}
+	std::shared_ptr<const HistoryIndex> current = std::atomic_load(&index);
+	std::map<std::string, std::vector<ModuleHistory*> >::const_iterator group = current->groups.find(frame.groupKey);
+	//module keys are shared per group, so a new pointer means new keys, or at least new to this index
+	if(group == current->groups.end() || current->groupKeys.find(frame.groupKey)->second != frame.moduleKeys){
+		current = registerGroup(frame);
+		group = current->groups.find(frame.groupKey);
+	}
+	const std::vector<ModuleHistory*>& modules = group->second;
+	for(size_t i = 0; i < modules.size(); i++){
+		if(modules[i]){
+			modules[i]->append(frame.timestampUs, frame.modules[i]);
+		}
+	}
+	//one copy per frame, shared by every reader of the latest value
+	std::shared_ptr<const GroupFeedbackFrame> copy = std::make_shared<GroupFeedbackFrame>(frame);
+	std::atomic_store(current->latest.find(frame.groupKey)->second, copy);
+}
+
+std::shared_ptr<const GroupFeedbackFrame> CacheManager::latest(const std::string& groupKey) const{
+	std::shared_ptr<const HistoryIndex> current = std::atomic_load(&index);
+	std::map<std::string, std::shared_ptr<const GroupFeedbackFrame>*>::const_iterator found = current->latest.find(groupKey);
+	if(found == current->latest.end()){
+		return std::shared_ptr<const GroupFeedbackFrame>();
+	}
+	return std::atomic_load(found->second);
+}
+
+bool CacheManager::history(const std::string& module, int64_t sinceUs, const std::vector<FeedbackField>& fields, HistorySnapshot& out) const{
+	std::shared_ptr<const HistoryIndex> current = std::atomic_load(&index);
+	std::map<std::string, ModuleHistory*>::const_iterator found = current->modules.find(module);
+	if(found == current->modules.end()){
+		return false;
+	}
+	return found->second->snapshot(sinceUs, fields, out);
+}
+
+bool CacheManager::lastSeconds(const std::string& module, double seconds, const std::vector<FeedbackField>& fields, HistorySnapshot& out) const{
+	return history(module, FeedBackManager::nowUs() - (int64_t)(seconds * 1e6), fields, out);
+}
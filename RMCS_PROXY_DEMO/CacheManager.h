@@ -1,6 +1,14 @@
 #ifndef CACHEMANAGER_H
 #define CACHEMANAGER_H
 #include "CThread.h"
+#include "HistoryRing.h"
+#include "LockProfile.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 class CacheManager:public CThread
 {
 	/**
@@ -11,10 +19,35 @@ class CacheManager:public CThread
 	*/
 public:
 	CacheManager();
+	CacheManager(const HistoryConfig& config);
 	~CacheManager();
 	void run() override;
+	//FeedBackManager frame handler, runs on the group feedback thread and never waits
+	void onFrame(const GroupFeedbackFrame& frame);
+	//recent history of one module, oldest first; false if unknown module or field not kept
+	bool history(const std::string& module, int64_t sinceUs, const std::vector<FeedbackField>& fields, HistorySnapshot& out) const;
+	bool lastSeconds(const std::string& module, double seconds, const std::vector<FeedbackField>& fields, HistorySnapshot& out) const;
+	//newest frame of a group, shared rather than copied; empty until the group first reports
+	std::shared_ptr<const GroupFeedbackFrame> latest(const std::string& groupKey) const;
+	const HistoryConfig& getHistoryConfig() const;
+	size_t getHistoryBytes() const; //allocated so far, at most maxModules * bytesPerModule
 private:
+	//immutable once published, so readers and the writer look modules up without locks
+	struct HistoryIndex{
+		std::map<std::string, std::vector<ModuleHistory*> > groups; //module order; NULL if owned by another group
+		std::map<std::string, std::shared_ptr<const std::vector<std::string> > > groupKeys; //what groups was built from
+		std::map<std::string, ModuleHistory*> modules;
+		std::map<std::string, std::string> owners; //module -> the group that writes its history
+		std::map<std::string, std::shared_ptr<const GroupFeedbackFrame>*> latest; //swapped with atomic_store
+	};
+	std::shared_ptr<const HistoryIndex> registerGroup(const GroupFeedbackFrame& frame);
 
+	const HistoryConfig config;
+	//swapped with atomic_store; a retired index is freed by whoever drops the last reference to it
+	std::shared_ptr<const HistoryIndex> index;
+	mutable ProxyMutex registryLock; //only taken when a group first reports or its module keys change
+	std::vector<std::unique_ptr<ModuleHistory> > histories;
+	std::vector<std::unique_ptr<std::shared_ptr<const GroupFeedbackFrame> > > latestFrames;
 };
 class CacheConnection{
 	/*
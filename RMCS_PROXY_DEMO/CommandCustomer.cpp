@@ -0,0 +1,83 @@
+#include <iostream>
+#include "CommandCustomer.h"
+#include "FeedBackManager.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+CommandCustomer::CommandCustomer()
+	: journal(NULL), stopping(false)
+{
+}
+
+CommandCustomer::~CommandCustomer(){
+	shutdown();
+}
+
+void CommandCustomer::push(const CommandElement& element){
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(queueLock));
+		commandQueue.push_back(element);
+		commandQueue.back().queuedNs = METRIC_NOW();
+	}
+	queueReady.notify_one();
+}
+
+void CommandCustomer::setJournal(CommandJournal* commandJournal){
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(queueLock));
+	journal = commandJournal;
+}
+
+void CommandCustomer::setSentHandler(CommandSentHandler handler){
+	sentHandler = handler;
+}
+
+void CommandCustomer::run(){
+	TRACE_THREAD("command");
+	std::unique_lock<ProxyMutex> lock(LOCK_SITE(queueLock));
+	for(;;){
+		while(!stopping && commandQueue.empty()){
+			queueReady.wait(lock);
+		}
+		if(commandQueue.empty()){
+			break;
+		}
+		CommandElement element = commandQueue.front();
+		commandQueue.pop_front();
+		METRIC_RECORD(MetricCommandQueueWait, METRIC_NOW() - element.queuedNs);
+		CommandJournal* target = journal;
+		lock.unlock();
+
+		bool ok = false;
+		if(element.group && element.command){
+			TRACE_SCOPE("command");
+			if(element.acknowledge){
+				ok = element.group->sendCommandWithAcknowledgement(*element.command, element.timeoutMs);
+			}
+			else{
+				ok = element.group->sendCommand(*element.command);
+			}
+			if(sentHandler){
+				sentHandler(element, ok);
+			}
+			if(!ok){
+				std::cout<<"command to "<<element.groupKey<<" failed"<<std::endl;
+			}
+			//the journal only takes a reference here; it never delays the next send
+			if(target){
+				target->append(element.groupKey, element.moduleKeys, element.command,
+					FeedBackManager::nowUs(), element.acknowledge, ok);
+			}
+		}
+
+		lock.lock();
+	}
+}
+
+void CommandCustomer::shutdown(){
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(queueLock));
+		stopping = true;
+	}
+	queueReady.notify_all();
+	join();
+}
@@ -1,6 +1,34 @@
 #ifndef COMMANDCUSTOMER_H
 #define COMMANDCUSTOMER_H
 #include "CThread.h"
+#include "CommandJournal.h"
+#include "src/group.hpp"
+#include "LockProfile.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//one entry of the commandQueue
+struct CommandElement{
+	std::string groupKey;
+	std::shared_ptr<const std::vector<std::string> > moduleKeys; //"family/name", same order as the group
+	std::shared_ptr<hebi::Group> group;
+	std::shared_ptr<hebi::GroupCommand> command; //not modified after push
+	bool acknowledge;  //sendCommandWithAcknowledgement instead of sendCommand
+	int timeoutMs;     //only used with acknowledge
+	int64_t createdUs; //when the client asked for it (FeedBackManager::nowUs), 0 if unknown
+	int64_t queuedNs;  //set by push, for the queue wait metric
+
+	CommandElement() : acknowledge(false), timeoutMs(100), createdUs(0), queuedNs(0) {}
+};
+
+//called on the command thread right after each send, with its result
+typedef std::function<void (const CommandElement&, bool)> CommandSentHandler;
+
 class CommandCustomer:public CThread
 {
 
@@ -15,9 +43,18 @@ public:
 	CommandCustomer();
 	~CommandCustomer();
 	void run() override; //дrun
+	void push(const CommandElement& element);
+	void setJournal(CommandJournal* journal); //every sent command is appended after the send; NULL to disable
+	void setSentHandler(CommandSentHandler handler); //set before start()
+	void shutdown(); //send what is queued, stop run() and wait for a start()ed thread
 
 private:
-
+	ProxyMutex queueLock;
+	ProxyCondition queueReady;
+	std::deque<CommandElement> commandQueue;
+	CommandJournal* journal;
+	CommandSentHandler sentHandler;
+	bool stopping;
 };
 
 #endif // !
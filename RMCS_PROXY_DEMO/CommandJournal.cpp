@@ -0,0 +1,560 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#define JOURNAL_OPEN_FLAGS (_O_RDWR | _O_CREAT | _O_BINARY)
+#define fsync _commit
+#define ftruncate _chsize
+#define lseek _lseek
+#define write _write
+#define close _close
+#else
+#include <unistd.h>
+#define JOURNAL_OPEN_FLAGS (O_RDWR | O_CREAT)
+#endif
+#include "CommandJournal.h"
+
+namespace {
+
+const char JOURNAL_MAGIC[4] = {'R', 'M', 'C', 'J'};
+const uint32_t JOURNAL_VERSION = 1;
+const size_t FILE_HEADER_BYTES = 8;
+const size_t RECORD_HEADER_BYTES = 8; //payload length + crc32
+const uint32_t MAX_RECORD_BYTES = 16 * 1024 * 1024;
+
+uint32_t crcTable[256];
+
+void initCrcTable(){
+	for(uint32_t i = 0; i < 256; i++){
+		uint32_t c = i;
+		for(int k = 0; k < 8; k++){
+			c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : (c >> 1);
+		}
+		crcTable[i] = c;
+	}
+}
+
+uint32_t crc32(const char* data, size_t length){
+	static bool ready = (initCrcTable(), true);
+	(void)ready;
+	uint32_t c = 0xFFFFFFFFu;
+	for(size_t i = 0; i < length; i++){
+		c = crcTable[(c ^ (uint8_t)data[i]) & 0xFF] ^ (c >> 8);
+	}
+	return c ^ 0xFFFFFFFFu;
+}
+
+template <class T>
+void put(std::vector<char>& out, T value){
+	const char* bytes = (const char*)&value;
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void putString(std::vector<char>& out, const std::string& text){
+	put<uint16_t>(out, (uint16_t)text.size());
+	out.insert(out.end(), text.begin(), text.end());
+}
+
+//bounds-checked reader over one record payload
+struct Reader{
+	const char* data;
+	size_t size;
+	size_t pos;
+	bool ok;
+
+	template <class T>
+	T get(){
+		T value = T();
+		if(pos + sizeof(T) > size){
+			ok = false;
+			return value;
+		}
+		std::memcpy(&value, data + pos, sizeof(T));
+		pos += sizeof(T);
+		return value;
+	}
+	std::string getString(size_t length){
+		if(pos + length > size){
+			ok = false;
+			return std::string();
+		}
+		std::string text(data + pos, length);
+		pos += length;
+		return text;
+	}
+};
+
+void putField(std::vector<char>& out, uint8_t type, uint8_t field, uint8_t index){
+	put<uint8_t>(out, type);
+	put<uint8_t>(out, field);
+	put<uint8_t>(out, index);
+}
+
+//appends every set field of one module command, returns how many were written
+uint16_t encodeModule(HebiCommandPtr cmd, std::vector<char>& out){
+	uint16_t count = 0;
+	for(int f = CommandFloatVelocity; f <= CommandFloatSpringConstant; f++){
+		if(hebiCommandHasFloat(cmd, (CommandFloatField)f)){
+			putField(out, JournalFloat, (uint8_t)f, 0);
+			put<float>(out, hebiCommandGetFloat(cmd, (CommandFloatField)f));
+			count++;
+		}
+	}
+	if(hebiCommandHasHighResAngle(cmd, CommandHighResAnglePosition)){
+		int64_t revolutions;
+		float offset;
+		hebiCommandGetHighResAngle(cmd, CommandHighResAnglePosition, &revolutions, &offset);
+		putField(out, JournalHighResAngle, CommandHighResAnglePosition, 0);
+		put<int64_t>(out, revolutions);
+		put<float>(out, offset);
+		count++;
+	}
+	for(int n = 1; n <= 9; n++){
+		if(hebiCommandHasNumberedFloat(cmd, CommandNumberedFloatDebug, n)){
+			putField(out, JournalNumberedFloat, CommandNumberedFloatDebug, (uint8_t)n);
+			put<float>(out, hebiCommandGetNumberedFloat(cmd, CommandNumberedFloatDebug, n));
+			count++;
+		}
+	}
+	for(int f = CommandBoolPositionDOnError; f <= CommandBoolTorqueDOnError; f++){
+		if(hebiCommandHasBool(cmd, (CommandBoolField)f)){
+			putField(out, JournalBool, (uint8_t)f, 0);
+			put<uint8_t>(out, (uint8_t)hebiCommandGetBool(cmd, (CommandBoolField)f));
+			count++;
+		}
+	}
+	for(int f = CommandStringName; f <= CommandStringFamily; f++){
+		if(hebiCommandHasString(cmd, (CommandStringField)f)){
+			char buffer[64];
+			if(hebiCommandGetString(cmd, (CommandStringField)f, buffer, sizeof(buffer)) != 0){
+				continue; //names and families are limited to 20 characters
+			}
+			putField(out, JournalString, (uint8_t)f, 0);
+			putString(out, buffer);
+			count++;
+		}
+	}
+	if(hebiCommandHasFlag(cmd, CommandFlagSaveCurrentSettings)){
+		putField(out, JournalFlag, CommandFlagSaveCurrentSettings, 0);
+		count++;
+	}
+	if(hebiCommandHasEnum(cmd, CommandEnumControlStrategy)){
+		putField(out, JournalEnum, CommandEnumControlStrategy, 0);
+		put<int32_t>(out, hebiCommandGetEnum(cmd, CommandEnumControlStrategy));
+		count++;
+	}
+	for(int bank = CommandIoBankA; bank <= CommandIoBankF; bank++){
+		for(unsigned int pin = 1; pin <= 8; pin++){
+			if(hebiCommandHasIoPinInt(cmd, (CommandIoPinBank)bank, pin)){
+				putField(out, JournalIoPinInt, (uint8_t)bank, (uint8_t)pin);
+				put<int64_t>(out, hebiCommandGetIoPinInt(cmd, (CommandIoPinBank)bank, pin));
+				count++;
+			}
+			else if(hebiCommandHasIoPinFloat(cmd, (CommandIoPinBank)bank, pin)){
+				putField(out, JournalIoPinFloat, (uint8_t)bank, (uint8_t)pin);
+				put<float>(out, hebiCommandGetIoPinFloat(cmd, (CommandIoPinBank)bank, pin));
+				count++;
+			}
+		}
+	}
+	if(hebiCommandHasLedModuleControl(cmd, CommandLedLed)){
+		putField(out, JournalLedModuleControl, CommandLedLed, 0);
+		count++;
+	}
+	else if(hebiCommandHasLedColor(cmd, CommandLedLed)){
+		uint8_t r, g, b;
+		hebiCommandGetLedColor(cmd, CommandLedLed, &r, &g, &b);
+		putField(out, JournalLedColor, CommandLedLed, 0);
+		put<uint8_t>(out, r);
+		put<uint8_t>(out, g);
+		put<uint8_t>(out, b);
+		count++;
+	}
+	return count;
+}
+
+bool decodeField(Reader& in, JournalField& field){
+	field.type = in.get<uint8_t>();
+	field.field = in.get<uint8_t>();
+	field.index = in.get<uint8_t>();
+	field.intValue = 0;
+	field.floatValue = 0;
+	field.text.clear();
+	switch(field.type){
+	case JournalFloat:
+	case JournalNumberedFloat:
+	case JournalIoPinFloat:
+		field.floatValue = in.get<float>();
+		break;
+	case JournalHighResAngle:
+		field.intValue = in.get<int64_t>();
+		field.floatValue = in.get<float>();
+		break;
+	case JournalBool:
+		field.intValue = in.get<uint8_t>();
+		break;
+	case JournalString:
+		field.text = in.getString(in.get<uint16_t>());
+		break;
+	case JournalEnum:
+		field.intValue = in.get<int32_t>();
+		break;
+	case JournalIoPinInt:
+		field.intValue = in.get<int64_t>();
+		break;
+	case JournalLedColor:
+		field.intValue = (int64_t)in.get<uint8_t>() << 16;
+		field.intValue |= (int64_t)in.get<uint8_t>() << 8;
+		field.intValue |= (int64_t)in.get<uint8_t>();
+		break;
+	case JournalFlag:
+	case JournalLedModuleControl:
+		break;
+	default:
+		return false;
+	}
+	return in.ok;
+}
+
+bool decodeRecord(const char* data, size_t size, JournalRecord& record){
+	Reader in = {data, size, 0, true};
+	record.sentUs = in.get<int64_t>();
+	uint8_t flags = in.get<uint8_t>();
+	record.acknowledged = (flags & 1) != 0;
+	record.succeeded = (flags & 2) != 0;
+	record.groupKey = in.getString(in.get<uint16_t>());
+	uint16_t modules = in.get<uint16_t>();
+	record.modules.resize(in.ok ? modules : 0);
+	for(size_t m = 0; m < record.modules.size() && in.ok; m++){
+		JournalModuleCommand& module = record.modules[m];
+		module.module = in.getString(in.get<uint16_t>());
+		uint16_t fields = in.get<uint16_t>();
+		module.fields.resize(in.ok ? fields : 0);
+		for(size_t f = 0; f < module.fields.size(); f++){
+			if(!decodeField(in, module.fields[f])){
+				return false;
+			}
+		}
+	}
+	return in.ok && in.pos == size;
+}
+
+//visits every intact record, returns the byte length of the intact prefix (0 if the header is bad)
+size_t scanJournal(const std::string& path, const std::function<void (const JournalRecord&)>* visitor){
+	std::ifstream in(path.c_str(), std::ios::binary);
+	char header[FILE_HEADER_BYTES];
+	if(!in.read(header, FILE_HEADER_BYTES) || std::memcmp(header, JOURNAL_MAGIC, 4) != 0){
+		return 0;
+	}
+	uint32_t version;
+	std::memcpy(&version, header + 4, 4);
+	if(version != JOURNAL_VERSION){
+		return 0;
+	}
+	size_t valid = FILE_HEADER_BYTES;
+	std::vector<char> payload;
+	JournalRecord record;
+	for(;;){
+		uint32_t frame[2];
+		if(!in.read((char*)frame, RECORD_HEADER_BYTES) || frame[0] > MAX_RECORD_BYTES){
+			break;
+		}
+		payload.resize(frame[0]);
+		if(frame[0] && !in.read(&payload[0], frame[0])){
+			break;
+		}
+		if(crc32(payload.empty() ? NULL : &payload[0], payload.size()) != frame[1]){
+			break;
+		}
+		if(visitor){
+			if(!decodeRecord(payload.empty() ? NULL : &payload[0], payload.size(), record)){
+				break;
+			}
+			(*visitor)(record);
+		}
+		valid += RECORD_HEADER_BYTES + frame[0];
+	}
+	return valid;
+}
+
+}
+
+bool JournalField::isSetting() const{
+	switch(type){
+	case JournalFloat:
+		return field != CommandFloatVelocity && field != CommandFloatTorque;
+	case JournalBool:
+	case JournalString:
+	case JournalEnum:
+	case JournalLedColor:
+	case JournalLedModuleControl:
+		return true;
+	default:
+		return false; //position, debug floats, io pins, flags
+	}
+}
+
+CommandJournal::CommandJournal()
+	: fd(-1), fileEnd(0), stopping(false), writtenRecords(0), lostRecords(0)
+{
+}
+
+CommandJournal::~CommandJournal(){
+	shutdown();
+	closeFile();
+}
+
+bool CommandJournal::open(const JournalConfig& journalConfig){
+	closeFile();
+	config = journalConfig;
+	size_t valid = scanJournal(config.path, NULL);
+	fd = ::open(config.path.c_str(), JOURNAL_OPEN_FLAGS, 0644);
+	if(fd < 0){
+		return false;
+	}
+	if(valid == 0){
+		//new or unreadable journal: start over with a fresh header
+		char header[FILE_HEADER_BYTES];
+		std::memcpy(header, JOURNAL_MAGIC, 4);
+		std::memcpy(header + 4, &JOURNAL_VERSION, 4);
+		if(ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0 ||
+			write(fd, header, FILE_HEADER_BYTES) != (int)FILE_HEADER_BYTES){
+			closeFile();
+			return false;
+		}
+		fileEnd = (long)FILE_HEADER_BYTES;
+	}
+	else{
+		//cut off a torn tail so new records follow the last intact one
+		if(ftruncate(fd, (long)valid) != 0 || lseek(fd, (long)valid, SEEK_SET) != (long)valid){
+			closeFile();
+			return false;
+		}
+		fileEnd = (long)valid;
+	}
+	return syncFile();
+}
+
+void CommandJournal::closeFile(){
+	if(fd >= 0){
+		close(fd);
+		fd = -1;
+	}
+}
+
+bool CommandJournal::writeAll(const std::vector<char>& buffer){
+	if(fd < 0){
+		return false;
+	}
+	size_t done = 0;
+	while(done < buffer.size()){
+		long n = (long)write(fd, &buffer[done], (unsigned int)(buffer.size() - done));
+		if(n < 0 && errno == EINTR){
+			continue;
+		}
+		if(n <= 0){
+			//a torn record would end the journal on the next open and hide every record written after it
+			if(ftruncate(fd, fileEnd) != 0 || lseek(fd, fileEnd, SEEK_SET) != fileEnd){
+				std::cout<<"command journal: could not cut back a failed write, journal closed"<<std::endl;
+				closeFile();
+			}
+			return false;
+		}
+		done += (size_t)n;
+	}
+	fileEnd += (long)buffer.size();
+	return true;
+}
+
+bool CommandJournal::syncFile(){
+	return fd >= 0 && fsync(fd) == 0;
+}
+
+void CommandJournal::append(const std::string& groupKey, std::shared_ptr<const std::vector<std::string> > moduleKeys,
+	std::shared_ptr<const hebi::GroupCommand> command, int64_t sentUs, bool acknowledged, bool succeeded){
+	Pending pending;
+	pending.groupKey = groupKey;
+	pending.moduleKeys = moduleKeys;
+	pending.command = command;
+	pending.sentUs = sentUs;
+	pending.acknowledged = acknowledged;
+	pending.succeeded = succeeded;
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(queueLock));
+		queue.push_back(pending);
+	}
+	queueReady.notify_one();
+}
+
+void CommandJournal::encode(const Pending& pending, std::vector<char>& out){
+	size_t start = out.size();
+	out.resize(start + RECORD_HEADER_BYTES);
+	put<int64_t>(out, pending.sentUs);
+	put<uint8_t>(out, (uint8_t)((pending.acknowledged ? 1 : 0) | (pending.succeeded ? 2 : 0)));
+	putString(out, pending.groupKey);
+	size_t moduleCountAt = out.size();
+	put<uint16_t>(out, 0);
+	uint16_t modules = 0;
+	const hebi::GroupCommand& command = *pending.command;
+	for(int i = 0; i < command.size(); i++){
+		size_t moduleStart = out.size();
+		const std::string* key = (pending.moduleKeys && (size_t)i < pending.moduleKeys->size()) ? &(*pending.moduleKeys)[i] : NULL;
+		putString(out, key ? *key : std::string());
+		size_t fieldCountAt = out.size();
+		put<uint16_t>(out, 0);
+		uint16_t fields = encodeModule(hebiGroupCommandGetModuleCommand(command.internal_, i), out);
+		if(fields == 0){
+			out.resize(moduleStart); //nothing was set for this module
+			continue;
+		}
+		std::memcpy(&out[fieldCountAt], &fields, sizeof(fields));
+		modules++;
+	}
+	std::memcpy(&out[moduleCountAt], &modules, sizeof(modules));
+	uint32_t frame[2];
+	frame[0] = (uint32_t)(out.size() - start - RECORD_HEADER_BYTES);
+	frame[1] = crc32(&out[start + RECORD_HEADER_BYTES], frame[0]);
+	std::memcpy(&out[start], frame, RECORD_HEADER_BYTES);
+}
+
+void CommandJournal::run(){
+	std::vector<Pending> batch;
+	std::vector<char> buffer;
+	std::chrono::steady_clock::time_point lastSync = std::chrono::steady_clock::now();
+	bool dirty = false;
+	std::unique_lock<ProxyMutex> lock(LOCK_SITE(queueLock));
+	for(;;){
+		while(!stopping && queue.empty()){
+			queueReady.wait_for(lock, std::chrono::milliseconds(config.syncIntervalMs > 0 ? config.syncIntervalMs : 100));
+			if(dirty && config.sync == JournalSyncInterval){
+				break; //time to sync what is already written
+			}
+		}
+		if(!queue.empty() && !stopping && config.commitDelayMs > 0){
+			//group commit: let concurrent senders join this write
+			queueReady.wait_for(lock, std::chrono::milliseconds(config.commitDelayMs));
+		}
+		batch.swap(queue);
+		bool stop = stopping;
+		lock.unlock();
+
+		buffer.clear();
+		for(size_t i = 0; i < batch.size(); i++){
+			encode(batch[i], buffer);
+		}
+		size_t count = batch.size();
+		size_t lost = 0;
+		batch.clear(); //releases the commands
+		if(!buffer.empty()){
+			if(writeAll(buffer)){
+				dirty = true;
+			}
+			else{
+				std::cout<<"command journal: write failed, "<<count<<" records lost"<<std::endl;
+				lost = count;
+				count = 0;
+			}
+		}
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if(dirty && (stop || config.sync == JournalSyncEveryCommit ||
+			(config.sync == JournalSyncInterval && now - lastSync >= std::chrono::milliseconds(config.syncIntervalMs)))){
+			syncFile();
+			dirty = false;
+			lastSync = now;
+		}
+
+		lock.lock();
+		writtenRecords += count;
+		lostRecords += lost;
+		if(stop && queue.empty()){
+			break;
+		}
+	}
+}
+
+void CommandJournal::shutdown(){
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(queueLock));
+		stopping = true;
+	}
+	queueReady.notify_all();
+	join();
+}
+
+uint64_t CommandJournal::getWrittenRecords() const{
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(queueLock));
+	return writtenRecords;
+}
+
+uint64_t CommandJournal::getLostRecords() const{
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(queueLock));
+	return lostRecords;
+}
+
+bool CommandJournal::replay(const std::string& path, const std::function<void (const JournalRecord&)>& visitor){
+	return scanJournal(path, &visitor) != 0;
+}
+
+bool CommandJournal::reconstruct(const std::string& path, JournalState& state){
+	return replay(path, [&state](const JournalRecord& record){
+		if(!record.succeeded){
+			return;
+		}
+		for(size_t m = 0; m < record.modules.size(); m++){
+			std::map<uint32_t, JournalField>& fields = state[record.modules[m].module];
+			for(size_t f = 0; f < record.modules[m].fields.size(); f++){
+				const JournalField& field = record.modules[m].fields[f];
+				if(!field.isSetting()){
+					continue;
+				}
+				if(field.type == JournalLedColor || field.type == JournalLedModuleControl){
+					//the two led modes replace each other
+					fields.erase(JournalField::makeKey(JournalLedColor, field.field, 0));
+					fields.erase(JournalField::makeKey(JournalLedModuleControl, field.field, 0));
+				}
+				fields[field.key()] = field;
+			}
+		}
+	});
+}
+
+void CommandJournal::restore(const JournalState& state, const std::vector<std::string>& moduleKeys, hebi::GroupCommand& command){
+	for(int i = 0; i < command.size() && (size_t)i < moduleKeys.size(); i++){
+		JournalState::const_iterator module = state.find(moduleKeys[i]);
+		if(module == state.end()){
+			continue;
+		}
+		HebiCommandPtr cmd = hebiGroupCommandGetModuleCommand(command.internal_, i);
+		for(std::map<uint32_t, JournalField>::const_iterator it = module->second.begin(); it != module->second.end(); ++it){
+			const JournalField& field = it->second;
+			if(!field.isSetting()){
+				continue;
+			}
+			switch(field.type){
+			case JournalFloat:
+				hebiCommandSetFloat(cmd, (CommandFloatField)field.field, (float)field.floatValue);
+				break;
+			case JournalBool:
+				hebiCommandSetBool(cmd, (CommandBoolField)field.field, (int)field.intValue);
+				break;
+			case JournalString:
+				hebiCommandSetString(cmd, (CommandStringField)field.field, field.text.c_str());
+				break;
+			case JournalEnum:
+				hebiCommandSetEnum(cmd, (CommandEnumField)field.field, (int)field.intValue);
+				break;
+			case JournalLedColor:
+				hebiCommandSetLedOverrideColor(cmd, (CommandLedField)field.field,
+					(uint8_t)(field.intValue >> 16), (uint8_t)(field.intValue >> 8), (uint8_t)field.intValue);
+				break;
+			case JournalLedModuleControl:
+				hebiCommandSetLedModuleControl(cmd, (CommandLedField)field.field);
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,129 @@
+#ifndef COMMANDJOURNAL_H
+#define COMMANDJOURNAL_H
+#include "CThread.h"
+#include "src/group_command.hpp"
+#include "LockProfile.h"
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//when the journal forces its writes to disk
+enum JournalSyncPolicy{
+	JournalSyncNever,       //leave it to the OS
+	JournalSyncEveryCommit, //fsync after every group commit
+	JournalSyncInterval     //fsync at most every syncIntervalMs
+};
+
+struct JournalConfig{
+	std::string path;
+	JournalSyncPolicy sync;
+	int syncIntervalMs;
+	int commitDelayMs; //how long the writer waits to gather more records into one commit
+
+	JournalConfig() : sync(JournalSyncInterval), syncIntervalMs(100), commitDelayMs(2) {}
+};
+
+//one value that was set in a module command
+enum JournalFieldType{
+	JournalFloat = 1,
+	JournalHighResAngle,
+	JournalNumberedFloat,
+	JournalBool,
+	JournalString,
+	JournalFlag,
+	JournalEnum,
+	JournalIoPinInt,
+	JournalIoPinFloat,
+	JournalLedColor,
+	JournalLedModuleControl
+};
+
+struct JournalField{
+	uint8_t type;   //JournalFieldType
+	uint8_t field;  //the hebi_command.h enum value (bank for io pins)
+	uint8_t index;  //debug channel or io pin number, 0 otherwise
+	int64_t intValue;  //revolutions, bool, enum, io int, packed rgb
+	double floatValue; //float, angle offset, io float
+	std::string text;  //name / family
+
+	//fields with the same key overwrite each other when rebuilding state
+	uint32_t key() const { return makeKey(type, field, index); }
+	//a setting the module keeps (gains, limits, d-on-error, name/family, control strategy, led) rather than a
+	//setpoint (position, velocity, torque), io output, debug value or one-shot flag (save settings)
+	bool isSetting() const;
+	static uint32_t makeKey(uint8_t type, uint8_t field, uint8_t index) { return ((uint32_t)type << 16) | ((uint32_t)field << 8) | index; }
+};
+
+struct JournalModuleCommand{
+	std::string module; //"family/name"
+	std::vector<JournalField> fields;
+};
+
+struct JournalRecord{
+	int64_t sentUs;
+	bool acknowledged; //sent with acknowledgement
+	bool succeeded;    //send (or ack) reported success
+	std::string groupKey;
+	std::vector<JournalModuleCommand> modules;
+};
+
+//per module, the last value written for every setting (JournalField::isSetting)
+typedef std::map<std::string, std::map<uint32_t, JournalField> > JournalState;
+
+class CommandJournal:public CThread
+{
+	//append-only binary journal of every command the proxy sent
+	//records are length + crc32 framed; a torn tail after a crash is cut off on open
+	//append() only queues a reference, encoding and writing happen on the journal thread
+public:
+	CommandJournal();
+	~CommandJournal();
+	bool open(const JournalConfig& config);
+	void run() override;
+	//the command must not be modified after this call; the journal keeps a reference until written
+	void append(const std::string& groupKey, std::shared_ptr<const std::vector<std::string> > moduleKeys,
+		std::shared_ptr<const hebi::GroupCommand> command, int64_t sentUs, bool acknowledged, bool succeeded);
+	void shutdown(); //write everything queued, sync, stop run() and wait for a start()ed thread
+	uint64_t getWrittenRecords() const;
+	uint64_t getLostRecords() const; //records of batches whose write failed
+
+	//walks the journal in order; stops at the first torn or corrupt record
+	static bool replay(const std::string& path, const std::function<void (const JournalRecord&)>& visitor);
+	//last settings of every module, e.g. to restore them without requestInfo; setpoints, io outputs, debug
+	//values and flags are journaled but never part of the state, so restoring neither moves the arm nor saves
+	static bool reconstruct(const std::string& path, JournalState& state);
+	//fills command module i from state[moduleKeys[i]]; modules without state are left untouched, and fields
+	//that are not settings are skipped
+	static void restore(const JournalState& state, const std::vector<std::string>& moduleKeys, hebi::GroupCommand& command);
+private:
+	struct Pending{
+		std::string groupKey;
+		std::shared_ptr<const std::vector<std::string> > moduleKeys;
+		std::shared_ptr<const hebi::GroupCommand> command;
+		int64_t sentUs;
+		bool acknowledged;
+		bool succeeded;
+	};
+	static void encode(const Pending& pending, std::vector<char>& out);
+	//appends buffer after the last intact record; a failed write is cut back off, so the file only ever holds whole records
+	bool writeAll(const std::vector<char>& buffer);
+	bool syncFile();
+	void closeFile();
+
+	JournalConfig config;
+	int fd;
+	long fileEnd; //end of the last intact record, where the next write goes
+	mutable ProxyMutex queueLock;
+	ProxyCondition queueReady;
+	std::vector<Pending> queue;
+	bool stopping;
+	uint64_t writtenRecords;
+	uint64_t lostRecords;
+};
+
+#endif
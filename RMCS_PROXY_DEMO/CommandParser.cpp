@@ -0,0 +1,459 @@
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "CommandParser.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace {
+
+const char* const FIELD_NAMES[WireCommandFieldCount] = {"position", "velocity", "effort"};
+
+const double INT64_LIMIT = 9.2e18; //below 2^63: anything smaller converts to int64_t
+
+//a value the field can hold: finite, whole revolutions within int64_t for a position, within float otherwise.
+//anything else would reach the actuators as inf / NaN, or be undefined in the conversion
+bool inRange(int field, double value){
+	if(!(value - value == 0)){
+		return false; //NaN or inf
+	}
+	if(field == WireCommandPosition){
+		return std::fabs(value / 2.0 / M_PI) < INT64_LIMIT;
+	}
+	return std::fabs(value) <= FLT_MAX;
+}
+
+//the same split as hebi::Command::HighResAngleField::set, without going through the wrapper objects; value must be
+//inRange
+void setValue(HebiCommandPtr command, int field, double value){
+	if(field == WireCommandPosition){
+		double revolutions;
+		double offset = std::modf(value / 2.0 / M_PI, &revolutions) * 2.0 * M_PI;
+		hebiCommandSetHighResAngle(command, CommandHighResAnglePosition, (int64_t)revolutions, (float)offset);
+	}
+	else{
+		hebiCommandSetFloat(command, field == WireCommandVelocity ? CommandFloatVelocity : CommandFloatTorque, (float)value);
+	}
+}
+
+void fill(const CommandTarget& target, std::shared_ptr<hebi::GroupCommand> command, bool acknowledge, int64_t createdUs,
+	CommandElement& element)
+{
+	element.groupKey = target.groupKey;
+	element.moduleKeys = target.moduleKeys;
+	element.group = target.group;
+	element.command = command;
+	element.acknowledge = acknowledge;
+	element.createdUs = createdUs;
+}
+
+//exact in a double
+const double POWERS_OF_TEN[23] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool equals(const char* data, size_t size, const char* text){
+	return std::strlen(text) == size && std::memcmp(data, text, size) == 0;
+}
+
+//a read-only walk over one json line; nothing is copied except a number's few characters
+struct Cursor{
+	const char* p;
+	const char* end;
+
+	void skip(){
+		while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')){
+			p++;
+		}
+	}
+	bool take(char c){
+		skip();
+		if(p < end && *p == c){
+			p++;
+			return true;
+		}
+		return false;
+	}
+	bool word(const char* text, size_t size){
+		skip();
+		if((size_t)(end - p) >= size && std::memcmp(p, text, size) == 0){
+			p += size;
+			return true;
+		}
+		return false;
+	}
+	bool string(const char** data, size_t* size){
+		if(!take('"')){
+			return false;
+		}
+		const char* start = p;
+		while(p < end && *p != '"'){
+			if(*p == '\\'){
+				return false;
+			}
+			p++;
+		}
+		if(p >= end){
+			return false;
+		}
+		*data = start;
+		*size = (size_t)(p - start);
+		p++;
+		return true;
+	}
+	//plain decimals of up to 15 digits are exact as integer / 10^k, one correctly rounded division (the
+	//fast path of Clinger's algorithm); anything else goes to strtod on a terminated copy, the line is not terminated
+	bool number(double* value){
+		skip();
+		const char* start = p;
+		bool negative = p < end && *p == '-';
+		if(negative){
+			p++;
+		}
+		uint64_t mantissa = 0;
+		int digits = 0, scale = 0;
+		bool any = false;
+		while(p < end && *p >= '0' && *p <= '9'){
+			mantissa = mantissa * 10 + (uint64_t)(*p++ - '0');
+			digits += mantissa != 0;
+			any = true;
+		}
+		if(p < end && *p == '.'){
+			p++;
+			while(p < end && *p >= '0' && *p <= '9'){
+				mantissa = mantissa * 10 + (uint64_t)(*p++ - '0');
+				digits += mantissa != 0;
+				scale++;
+				any = true;
+			}
+		}
+		if(any && digits <= 15 && scale <= 22 && (p >= end || (*p != 'e' && *p != 'E'))){
+			double result = scale ? (double)mantissa / POWERS_OF_TEN[scale] : (double)mantissa;
+			*value = negative ? -result : result;
+			return true;
+		}
+		p = start;
+		char text[40];
+		size_t length = 0;
+		while(p < end && length < sizeof(text) - 1 &&
+			((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+		{
+			text[length++] = *p++;
+		}
+		if(length == 0){
+			return false;
+		}
+		text[length] = '\0';
+		char* stop;
+		*value = std::strtod(text, &stop);
+		return stop == text + length;
+	}
+};
+
+}
+
+CommandPool::CommandPool(int modules, size_t capacity)
+	: modules(modules), capacity(capacity), next(0)
+{
+}
+
+std::shared_ptr<hebi::GroupCommand> CommandPool::acquire(){
+	for(size_t i = 0; i < commands.size(); i++){
+		size_t index = (next + i) % commands.size();
+		if(commands[index].use_count() != 1){
+			continue;
+		}
+		//only this thread hands out copies, so nobody can take it again; the fence orders the clears
+		//after the last holder's release of its reference
+		std::atomic_thread_fence(std::memory_order_acquire);
+		next = index + 1;
+		for(int m = 0; m < modules; m++){
+			HebiCommandPtr command = hebiGroupCommandGetModuleCommand(commands[index]->internal_, m);
+			hebiCommandClearHighResAngle(command, CommandHighResAnglePosition);
+			hebiCommandClearFloat(command, CommandFloatVelocity);
+			hebiCommandClearFloat(command, CommandFloatTorque);
+		}
+		return commands[index];
+	}
+	std::shared_ptr<hebi::GroupCommand> command = std::make_shared<hebi::GroupCommand>(modules);
+	if(commands.size() < capacity){
+		commands.push_back(command);
+	}
+	return command;
+}
+
+bool resolveCommandStream(const WireSchemaInfo& schema, const CommandTarget& target, CommandStream& stream, const char** error){
+	const std::vector<std::string>& keys = *target.moduleKeys;
+	if(schema.kind != WireCommand){
+		*error = "not a command schema";
+		return false;
+	}
+	if(schema.fields.empty() || schema.fields.size() > WIRE_MAX_FIELDS){
+		*error = "no fields";
+		return false;
+	}
+	for(size_t f = 0; f < schema.fields.size(); f++){
+		if(schema.fields[f] >= WireCommandFieldCount){
+			*error = "unknown field";
+			return false;
+		}
+	}
+	if(schema.modules.size() > keys.size() || (int)keys.size() != target.pool->getModules()){
+		*error = "module count does not match the group";
+		return false;
+	}
+	stream.target = &target;
+	stream.fields = schema.fields;
+	stream.moduleIndex.clear();
+	if(schema.modules.empty()){
+		for(size_t m = 0; m < keys.size(); m++){
+			stream.moduleIndex.push_back((int)m);
+		}
+		return true;
+	}
+	for(size_t n = 0; n < schema.modules.size(); n++){
+		std::vector<std::string>::const_iterator key = std::find(keys.begin(), keys.end(), schema.modules[n]);
+		if(key == keys.end()){
+			*error = "unknown module";
+			return false;
+		}
+		stream.moduleIndex.push_back((int)(key - keys.begin()));
+	}
+	return true;
+}
+
+bool parseBinaryCommand(const CommandStream& stream, const char* payload, size_t size, CommandElement& element, const char** error){
+	WireSamplesView view;
+	if(!view.parse(payload, size)){
+		*error = "malformed command";
+		return false;
+	}
+	if(view.moduleCount() != stream.moduleIndex.size() || view.fieldCount() != stream.fields.size()){
+		*error = "command does not match its schema";
+		return false;
+	}
+	for(size_t m = 0; m < view.moduleCount(); m++){
+		for(size_t f = 0; f < view.fieldCount(); f++){
+			if(view.has(m, f) && !inRange(stream.fields[f], view.value(m, f))){
+				*error = "value out of range";
+				return false;
+			}
+		}
+	}
+	const CommandTarget& target = *stream.target;
+	std::shared_ptr<hebi::GroupCommand> command = target.pool->acquire();
+	for(size_t m = 0; m < view.moduleCount(); m++){
+		uint32_t present = view.present(m);
+		if(!present){
+			continue;
+		}
+		HebiCommandPtr module = hebiGroupCommandGetModuleCommand(command->internal_, stream.moduleIndex[m]);
+		for(size_t f = 0; f < view.fieldCount(); f++){
+			if(present & (1u << f)){
+				setValue(module, stream.fields[f], view.value(m, f));
+			}
+		}
+	}
+	fill(target, command, (view.flags() & WireFlagAcknowledge) != 0, view.timeUs(), element);
+	return true;
+}
+
+JsonCommandParser::JsonCommandParser(){
+}
+
+bool JsonCommandParser::parse(const char* text, size_t size, const std::vector<const CommandTarget*>& targets,
+	CommandElement& element, const char** error)
+{
+	bool present[WireCommandFieldCount] = {false};
+	for(int f = 0; f < WireCommandFieldCount; f++){
+		columns[f].clear();
+	}
+	modules.clear();
+	const char* group = NULL;
+	size_t groupSize = 0;
+	bool listed = false;
+	bool acknowledge = false;
+	double createdUs = 0;
+
+	*error = "malformed command";
+	Cursor cursor = {text, text + size};
+	if(!cursor.take('{')){
+		return false;
+	}
+	if(!cursor.take('}')){
+		for(;;){
+			const char* key;
+			size_t keySize;
+			if(!cursor.string(&key, &keySize) || !cursor.take(':')){
+				return false;
+			}
+			if(equals(key, keySize, "group")){
+				if(!cursor.string(&group, &groupSize)){
+					return false;
+				}
+			}
+			else if(equals(key, keySize, "modules")){
+				listed = true;
+				if(!cursor.take('[')){
+					return false;
+				}
+				if(!cursor.take(']')){
+					for(;;){
+						Name name;
+						if(!cursor.string(&name.data, &name.size)){
+							return false;
+						}
+						modules.push_back(name);
+						if(cursor.take(']')){
+							break;
+						}
+						if(!cursor.take(',')){
+							return false;
+						}
+					}
+				}
+			}
+			else if(equals(key, keySize, "ack")){
+				if(cursor.word("true", 4)){
+					acknowledge = true;
+				}
+				else if(!cursor.word("false", 5)){
+					return false;
+				}
+			}
+			else if(equals(key, keySize, "t")){
+				if(!cursor.number(&createdUs)){
+					return false;
+				}
+			}
+			else{
+				int field = 0;
+				while(field < WireCommandFieldCount && !equals(key, keySize, FIELD_NAMES[field])){
+					field++;
+				}
+				if(field == WireCommandFieldCount){
+					*error = "unknown key";
+					return false;
+				}
+				present[field] = true;
+				std::vector<double>& column = columns[field];
+				if(!cursor.take('[')){
+					return false;
+				}
+				if(!cursor.take(']')){
+					for(;;){
+						double value;
+						if(cursor.word("null", 4)){
+							column.push_back(NAN);
+						}
+						else if(cursor.number(&value)){
+							column.push_back(value);
+						}
+						else{
+							return false;
+						}
+						if(cursor.take(']')){
+							break;
+						}
+						if(!cursor.take(',')){
+							return false;
+						}
+					}
+				}
+			}
+			if(cursor.take('}')){
+				break;
+			}
+			if(!cursor.take(',')){
+				return false;
+			}
+		}
+	}
+	cursor.skip();
+	if(cursor.p != cursor.end){
+		return false;
+	}
+
+	//every size is checked before a command is taken
+	const CommandTarget* target = NULL;
+	for(size_t t = 0; t < targets.size() && !target; t++){
+		if(group && targets[t]->groupKey.size() == groupSize && std::memcmp(targets[t]->groupKey.data(), group, groupSize) == 0){
+			target = targets[t];
+		}
+	}
+	if(!target){
+		*error = "unknown group";
+		return false;
+	}
+	const std::vector<std::string>& keys = *target->moduleKeys;
+	size_t count = listed ? modules.size() : keys.size();
+	if(count == 0 || count > keys.size() || (int)keys.size() != target->pool->getModules()){
+		*error = "module count does not match the group";
+		return false;
+	}
+	bool any = false;
+	for(int f = 0; f < WireCommandFieldCount; f++){
+		if(present[f] && columns[f].size() != count){
+			*error = "values do not match the modules";
+			return false;
+		}
+		any = any || present[f];
+	}
+	if(!any){
+		*error = "no values";
+		return false;
+	}
+	moduleIndex.resize(count);
+	for(size_t n = 0; n < count; n++){
+		if(!listed){
+			moduleIndex[n] = (int)n;
+			continue;
+		}
+		//clients usually list the modules in group order: try that position first
+		const Name& name = modules[n];
+		int index = -1;
+		for(size_t k = 0; k < keys.size() && index < 0; k++){
+			size_t m = (n + k) % keys.size();
+			if(keys[m].size() == name.size && std::memcmp(keys[m].data(), name.data, name.size) == 0){
+				index = (int)m;
+			}
+		}
+		if(index < 0){
+			*error = "unknown module";
+			return false;
+		}
+		moduleIndex[n] = index;
+	}
+	//null (NaN) leaves a value unset; numbers strtod took to inf, or too large for the field, are refused
+	for(int f = 0; f < WireCommandFieldCount; f++){
+		for(size_t n = 0; present[f] && n < count; n++){
+			if(columns[f][n] == columns[f][n] && !inRange(f, columns[f][n])){
+				*error = "value out of range";
+				return false;
+			}
+		}
+	}
+	if(!(createdUs - createdUs == 0) || std::fabs(createdUs) >= INT64_LIMIT){
+		*error = "value out of range";
+		return false;
+	}
+
+	std::shared_ptr<hebi::GroupCommand> command = target->pool->acquire();
+	for(size_t n = 0; n < count; n++){
+		HebiCommandPtr module = hebiGroupCommandGetModuleCommand(command->internal_, moduleIndex[n]);
+		for(int f = 0; f < WireCommandFieldCount; f++){
+			if(present[f] && columns[f][n] == columns[f][n]){
+				setValue(module, f, columns[f][n]);
+			}
+		}
+	}
+	fill(*target, command, acknowledge, (int64_t)createdUs, element);
+	*error = NULL;
+	return true;
+}
@@ -0,0 +1,70 @@
+#ifndef COMMANDPARSER_H
+#define COMMANDPARSER_H
+#include "CommandCustomer.h"
+#include "WireFormat.h"
+#include "src/group_command.hpp"
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+//reusable hebi::GroupCommand of one group size. a command goes back to the pool once every holder
+//(command queue, journal) has dropped it; acquire() hands it out again with position, velocity and
+//torque cleared, the only fields the parsers set. acquire() is for one thread, the holders may be any
+class CommandPool
+{
+public:
+	CommandPool(int modules, size_t capacity);
+	std::shared_ptr<hebi::GroupCommand> acquire(); //past capacity a fresh command that is not kept
+	int getModules() const { return modules; }
+	size_t getSize() const { return commands.size(); }
+private:
+	int modules;
+	size_t capacity;
+	size_t next; //where the search for a free command starts
+	std::vector<std::shared_ptr<hebi::GroupCommand> > commands;
+};
+
+//a group clients may command
+struct CommandTarget{
+	std::string groupKey;
+	std::shared_ptr<hebi::Group> group; //may be empty in tests: the parsers only need the module keys
+	std::shared_ptr<const std::vector<std::string> > moduleKeys; //"family/name" in group order
+	std::shared_ptr<CommandPool> pool;  //sized to the group
+};
+
+//a binary command stream as its WireSchema declared it
+struct CommandStream{
+	const CommandTarget* target;
+	std::vector<int> moduleIndex; //per record, the module in the group
+	std::vector<uint8_t> fields;  //per column, a WireCommandField
+};
+
+//checks a WireCommand schema against the group and maps its modules; *error is a literal on failure
+bool resolveCommandStream(const WireSchemaInfo& schema, const CommandTarget& target, CommandStream& stream, const char** error);
+
+//writes a WireCommand payload into element, reading the values where they lie in the frame.
+//the record and column counts are checked against the stream before a command is taken from the pool
+bool parseBinaryCommand(const CommandStream& stream, const char* payload, size_t size, CommandElement& element, const char** error);
+
+//one json command per line, parsed in place:
+//	{"group":"arm","modules":["arm/a",...],"position":[...],"velocity":[...],"effort":[...],"ack":false,"t":us}
+//modules defaults to the whole group in order; null leaves a value unset; strings must not use escapes.
+//values are gathered in columns kept between calls and written once every size has been checked
+class JsonCommandParser
+{
+public:
+	JsonCommandParser();
+	bool parse(const char* text, size_t size, const std::vector<const CommandTarget*>& targets,
+		CommandElement& element, const char** error);
+private:
+	struct Name{
+		const char* data;
+		size_t size;
+	};
+	std::vector<double> columns[WireCommandFieldCount]; //NaN where the json had null
+	std::vector<Name> modules;
+	std::vector<int> moduleIndex;
+};
+
+#endif
@@ -0,0 +1,593 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include "DataBaseManager.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+namespace {
+
+const char SEGMENT_MAGIC[4] = {'R', 'M', 'S', 'G'};
+const uint16_t SEGMENT_VERSION = 1;
+const uint16_t TIMESTAMP_COLUMN = 0xFFFF;
+
+//on-disk layout: header, column directory, then the columns back to back
+struct SegmentHeader{
+	char magic[4];
+	uint16_t version;
+	uint16_t columnCount;
+	uint32_t sampleCount;
+	uint32_t reserved;
+	int64_t startUs;
+	int64_t endUs;
+};
+
+struct ColumnEntry{
+	uint16_t field;
+	uint16_t encoding; //0: raw int64 / float64
+	uint32_t reserved;
+	uint64_t offset;
+};
+
+}
+
+DataBaseConnection::DataBaseConnection()
+	: nextSegmentId(0), maxSegmentSamples(4096), maxSegmentSpanUs(60 * 1000000LL)
+{
+}
+
+DataBaseConnection::~DataBaseConnection(){
+}
+
+void DataBaseConnection::setSegmentLimits(size_t maxSamples, int64_t maxSpanUs){
+	maxSegmentSamples = maxSamples;
+	maxSegmentSpanUs = maxSpanUs;
+}
+
+bool DataBaseConnection::init(const std::string& rootDir){
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(indexLock));
+	root = rootDir;
+	segments.clear();
+	groupModules.clear();
+	nextSegmentId = 0;
+
+	std::ifstream index((root + "/segments.idx").c_str());
+	std::string line;
+	while(std::getline(index, line)){
+		std::istringstream fields(line);
+		std::string kind;
+		std::getline(fields, kind, '\t');
+		if(kind == "S"){
+			std::string module, start, end, count;
+			SegmentInfo info;
+			std::getline(fields, module, '\t');
+			std::getline(fields, start, '\t');
+			std::getline(fields, end, '\t');
+			std::getline(fields, count, '\t');
+			std::getline(fields, info.file, '\t');
+			if(info.file.empty()){
+				continue; //torn last line
+			}
+			info.startUs = std::strtoll(start.c_str(), NULL, 10);
+			info.endUs = std::strtoll(end.c_str(), NULL, 10);
+			info.sampleCount = (uint32_t)std::strtoul(count.c_str(), NULL, 10);
+			segments[module].push_back(info);
+			uint64_t id = std::strtoull(info.file.c_str() + 4, NULL, 10); //"seg_<id>.dat"
+			if(id >= nextSegmentId){
+				nextSegmentId = id + 1;
+			}
+		}
+		else if(kind == "G"){
+			std::string group, module;
+			std::getline(fields, group, '\t');
+			std::getline(fields, module, '\t');
+			groupModules[group].insert(module);
+		}
+	}
+	for(std::map<std::string, std::vector<SegmentInfo> >::iterator it = segments.begin(); it != segments.end(); ++it){
+		std::sort(it->second.begin(), it->second.end(),
+			[](const SegmentInfo& a, const SegmentInfo& b){ return a.startUs < b.startUs; });
+	}
+
+	//make sure the directory is writable before the writer thread relies on it
+	FILE* probe = std::fopen((root + "/segments.idx").c_str(), "ab");
+	if(!probe){
+		return false;
+	}
+	std::fclose(probe);
+	return true;
+}
+
+bool DataBaseConnection::appendIndexLine(const std::string& line){
+	FILE* index = std::fopen((root + "/segments.idx").c_str(), "ab");
+	if(!index){
+		return false;
+	}
+	bool ok = std::fwrite(line.data(), 1, line.size(), index) == line.size();
+	ok = (std::fclose(index) == 0) && ok;
+	return ok;
+}
+
+bool DataBaseConnection::insert(const GroupFeedbackFrame& frame){
+	if(!frame.moduleKeys || frame.moduleKeys->size() != frame.modules.size()){
+		return false;
+	}
+	bool ok = true;
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(indexLock));
+		std::set<std::string>& known = groupModules[frame.groupKey];
+		for(size_t i = 0; i < frame.moduleKeys->size(); i++){
+			const std::string& module = (*frame.moduleKeys)[i];
+			if(known.insert(module).second){
+				ok = appendIndexLine("G\t" + frame.groupKey + "\t" + module + "\n") && ok;
+			}
+		}
+	}
+	for(size_t i = 0; i < frame.modules.size(); i++){
+		const std::string& module = (*frame.moduleKeys)[i];
+		OpenSegment& open = openSegments[module];
+		if(!open.timestamps.empty() && frame.timestampUs < open.timestamps.back()){
+			continue; //segments are kept time-ordered; late samples are dropped
+		}
+		open.timestamps.push_back(frame.timestampUs);
+		const FeedbackSample& sample = frame.modules[i];
+		for(int f = 0; f < FieldCount; f++){
+			open.columns[f].push_back(sample.values[f]);
+		}
+		if(open.timestamps.size() >= maxSegmentSamples ||
+			open.timestamps.back() - open.timestamps.front() >= maxSegmentSpanUs){
+			ok = sealSegment(module, open) && ok;
+		}
+	}
+	return ok;
+}
+
+bool DataBaseConnection::flush(){
+	bool ok = true;
+	for(std::map<std::string, OpenSegment>::iterator it = openSegments.begin(); it != openSegments.end(); ++it){
+		if(!it->second.timestamps.empty()){
+			ok = sealSegment(it->first, it->second) && ok;
+		}
+	}
+	return ok;
+}
+
+bool DataBaseConnection::sealSegment(const std::string& module, OpenSegment& segment){
+	SegmentInfo info;
+	info.startUs = segment.timestamps.front();
+	info.endUs = segment.timestamps.back();
+	info.sampleCount = (uint32_t)segment.timestamps.size();
+	char name[32];
+	std::snprintf(name, sizeof(name), "seg_%012llu.dat", (unsigned long long)nextSegmentId++);
+	info.file = name;
+
+	SegmentHeader header;
+	std::memcpy(header.magic, SEGMENT_MAGIC, sizeof(header.magic));
+	header.version = SEGMENT_VERSION;
+	header.columnCount = FieldCount + 1;
+	header.sampleCount = info.sampleCount;
+	header.reserved = 0;
+	header.startUs = info.startUs;
+	header.endUs = info.endUs;
+
+	ColumnEntry directory[FieldCount + 1];
+	uint64_t offset = sizeof(SegmentHeader) + sizeof(directory);
+	uint64_t columnBytes = (uint64_t)info.sampleCount * 8;
+	for(int c = 0; c <= FieldCount; c++){
+		directory[c].field = (c == 0) ? TIMESTAMP_COLUMN : (uint16_t)(c - 1);
+		directory[c].encoding = 0;
+		directory[c].reserved = 0;
+		directory[c].offset = offset;
+		offset += columnBytes;
+	}
+
+	//the data file is complete before the index points at it
+	FILE* out = std::fopen((root + "/" + info.file).c_str(), "wb");
+	if(!out){
+		return false;
+	}
+	bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1;
+	ok = ok && std::fwrite(directory, sizeof(directory), 1, out) == 1;
+	ok = ok && std::fwrite(&segment.timestamps[0], 8, info.sampleCount, out) == info.sampleCount;
+	for(int f = 0; f < FieldCount && ok; f++){
+		ok = std::fwrite(&segment.columns[f][0], 8, info.sampleCount, out) == info.sampleCount;
+	}
+	ok = (std::fclose(out) == 0) && ok;
+
+	segment.timestamps.clear();
+	for(int f = 0; f < FieldCount; f++){
+		segment.columns[f].clear();
+	}
+	if(!ok){
+		std::remove((root + "/" + info.file).c_str());
+		return false;
+	}
+
+	std::ostringstream line;
+	line<<"S\t"<<module<<"\t"<<info.startUs<<"\t"<<info.endUs<<"\t"<<info.sampleCount<<"\t"<<info.file<<"\n";
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(indexLock));
+	if(!appendIndexLine(line.str())){
+		return false;
+	}
+	std::vector<SegmentInfo>& list = segments[module];
+	list.insert(std::upper_bound(list.begin(), list.end(), info,
+		[](const SegmentInfo& a, const SegmentInfo& b){ return a.startUs < b.startUs; }), info);
+	return true;
+}
+
+namespace {
+
+//a segment file read without a stdio buffer, so every read lands straight in its destination
+class SegmentFile{
+public:
+	explicit SegmentFile(const std::string& path) : file(std::fopen(path.c_str(), "rb")) {
+		if(file){
+			std::setvbuf(file, NULL, _IONBF, 0);
+		}
+	}
+	~SegmentFile(){
+		if(file){
+			std::fclose(file);
+		}
+	}
+	bool read(uint64_t offset, void* out, size_t bytes){
+		return file && std::fseek(file, (long)offset, SEEK_SET) == 0 && std::fread(out, 1, bytes, file) == bytes;
+	}
+private:
+	SegmentFile(const SegmentFile&);
+	SegmentFile& operator=(const SegmentFile&);
+	FILE* file;
+};
+
+//checks the header and finds each column; columnOf[FieldCount] is the timestamps
+bool openSegment(SegmentFile& in, SegmentHeader& header, ColumnEntry directory[FieldCount + 1],
+	const ColumnEntry* columnOf[FieldCount + 1])
+{
+	if(!in.read(0, &header, sizeof(header)) ||
+		std::memcmp(header.magic, SEGMENT_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != SEGMENT_VERSION || header.columnCount > FieldCount + 1){
+		return false;
+	}
+	if(!in.read(sizeof(header), directory, sizeof(ColumnEntry) * header.columnCount)){
+		return false;
+	}
+	std::fill(columnOf, columnOf + FieldCount + 1, (const ColumnEntry*)NULL);
+	for(size_t c = 0; c < header.columnCount; c++){
+		if(directory[c].field == TIMESTAMP_COLUMN){
+			columnOf[FieldCount] = &directory[c];
+		}
+		else if(directory[c].field < FieldCount){
+			columnOf[directory[c].field] = &directory[c];
+		}
+	}
+	return columnOf[FieldCount] != NULL;
+}
+
+//rows [first, first + count) of the query fields, written from row at of columns; a missing field reads as NaN
+bool readRows(SegmentFile& in, const ColumnEntry* const* columnOf, const std::vector<FeedbackField>& fields,
+	size_t first, size_t count, std::vector<std::vector<double> >& columns, size_t at)
+{
+	for(size_t q = 0; q < fields.size(); q++){
+		double* out = columns[q].data() + at;
+		const ColumnEntry* entry = columnOf[fields[q]];
+		if(!entry){
+			std::fill(out, out + count, std::numeric_limits<double>::quiet_NaN());
+			continue;
+		}
+		if(!in.read(entry->offset + first * 8, out, 8 * count)){
+			return false;
+		}
+	}
+	return true;
+}
+
+//closes one bucket of a downsampled series: its start time and the mean of each column, NaN if it had no value
+void appendBucket(TelemetrySeries& series, int64_t timestampUs, const std::vector<double>& sum,
+	const std::vector<int>& count)
+{
+	series.timestamps.push_back(timestampUs);
+	for(size_t c = 0; c < series.columns.size(); c++){
+		series.columns[c].push_back(count[c] ? sum[c] / count[c] : std::numeric_limits<double>::quiet_NaN());
+	}
+}
+
+}
+
+bool DataBaseConnection::sliceSegment(const SegmentInfo& segment, const TelemetryQuery& query, size_t& first,
+	size_t& count) const
+{
+	SegmentFile in(root + "/" + segment.file);
+	SegmentHeader header;
+	ColumnEntry directory[FieldCount + 1];
+	const ColumnEntry* columnOf[FieldCount + 1];
+	if(!openSegment(in, header, directory, columnOf)){
+		return false;
+	}
+
+	//the time index: timestamps are sorted, so only the matching slice of each column is read
+	std::vector<int64_t> timestamps(header.sampleCount);
+	if(header.sampleCount && !in.read(columnOf[FieldCount]->offset, &timestamps[0], 8 * (size_t)header.sampleCount)){
+		return false;
+	}
+	first = std::lower_bound(timestamps.begin(), timestamps.end(), query.startUs) - timestamps.begin();
+	size_t last = std::lower_bound(timestamps.begin(), timestamps.end(), query.endUs) - timestamps.begin();
+	count = first < last ? last - first : 0;
+	return true;
+}
+
+bool DataBaseConnection::readSlice(const SegmentInfo& segment, const TelemetryQuery& query, size_t first, size_t count,
+	TelemetrySeries& out, size_t at) const
+{
+	SegmentFile in(root + "/" + segment.file);
+	SegmentHeader header;
+	ColumnEntry directory[FieldCount + 1];
+	const ColumnEntry* columnOf[FieldCount + 1];
+	if(!openSegment(in, header, directory, columnOf) || header.sampleCount != segment.sampleCount ||
+		first + count > header.sampleCount){
+		return false;
+	}
+	if(!in.read(columnOf[FieldCount]->offset + first * 8, out.timestamps.data() + at, 8 * count)){
+		return false;
+	}
+	return readRows(in, columnOf, query.fields, first, count, out.columns, at);
+}
+
+bool DataBaseConnection::query(const TelemetryQuery& query, ThreadPool& pool, TelemetryResult& result){
+	result.fields = query.fields;
+	if(query.endUs <= query.startUs){
+		result.series.clear();
+		return true;
+	}
+
+	//pick the overlapping segments under the lock, read them without it
+	std::set<std::string> modules(query.modules.begin(), query.modules.end());
+	std::vector<std::vector<SegmentInfo> > perModule;
+	size_t used = 0;
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(indexLock));
+		for(size_t g = 0; g < query.groups.size(); g++){
+			std::map<std::string, std::set<std::string> >::const_iterator it = groupModules.find(query.groups[g]);
+			if(it != groupModules.end()){
+				modules.insert(it->second.begin(), it->second.end());
+			}
+		}
+		for(std::set<std::string>::const_iterator m = modules.begin(); m != modules.end(); ++m){
+			//series left from an earlier query keep their capacity
+			if(used == result.series.size()){
+				result.series.push_back(TelemetrySeries());
+			}
+			TelemetrySeries& series = result.series[used++];
+			series.module = *m;
+			series.columns.resize(query.fields.size());
+			perModule.push_back(std::vector<SegmentInfo>());
+			std::map<std::string, std::vector<SegmentInfo> >::const_iterator it = segments.find(*m);
+			if(it == segments.end()){
+				continue;
+			}
+			const std::vector<SegmentInfo>& list = it->second;
+			//segments of one module do not overlap; skip those ending before the range
+			std::vector<SegmentInfo>::const_iterator s = std::lower_bound(list.begin(), list.end(), query.startUs,
+				[](const SegmentInfo& info, int64_t t){ return info.endUs < t; });
+			for(; s != list.end() && s->startUs < query.endUs; ++s){
+				perModule.back().push_back(*s);
+			}
+		}
+	}
+	result.series.resize(used);
+
+	//segments inside the range are taken whole from the index; only the one or two at its ends are opened
+	//to find their slice, so every series is sized exactly once before any column is read
+	struct SegmentTask{
+		size_t module;
+		const SegmentInfo* segment;
+		bool whole;
+		size_t first; //rows [first, first + count) of the segment are in the range
+		size_t count;
+		size_t at;    //first row in the module's series
+	};
+	std::vector<SegmentTask> tasks;
+	std::vector<size_t> moduleTasks(perModule.size() + 1, 0); //tasks of module m are [moduleTasks[m], moduleTasks[m + 1])
+	for(size_t m = 0; m < perModule.size(); m++){
+		moduleTasks[m] = tasks.size();
+		for(size_t s = 0; s < perModule[m].size(); s++){
+			const SegmentInfo& info = perModule[m][s];
+			SegmentTask task = {m, &info, info.startUs >= query.startUs && info.endUs < query.endUs, 0, info.sampleCount, 0};
+			tasks.push_back(task);
+		}
+	}
+	moduleTasks[perModule.size()] = tasks.size();
+	std::vector<char> failed(tasks.size(), 0);
+	pool.parallelFor(tasks.size(), [&](size_t t){
+		if(!tasks[t].whole){
+			failed[t] = sliceSegment(*tasks[t].segment, query, tasks[t].first, tasks[t].count) ? 0 : 1;
+		}
+	});
+	if(std::find(failed.begin(), failed.end(), 1) != failed.end()){
+		return false;
+	}
+
+	//tasks are ordered by module then segment start, so consecutive offsets keep time order
+	std::vector<size_t> moduleRows(perModule.size(), 0);
+	for(size_t t = 0; t < tasks.size(); t++){
+		tasks[t].at = moduleRows[tasks[t].module];
+		moduleRows[tasks[t].module] += tasks[t].count;
+	}
+
+	if(query.resolutionUs <= 0){
+		pool.parallelFor(result.series.size(), [&](size_t m){
+			TelemetrySeries& series = result.series[m];
+			series.timestamps.resize(moduleRows[m]);
+			for(size_t q = 0; q < series.columns.size(); q++){
+				series.columns[q].resize(moduleRows[m]);
+			}
+		});
+		pool.parallelFor(tasks.size(), [&](size_t t){
+			if(tasks[t].count){
+				failed[t] = readSlice(*tasks[t].segment, query, tasks[t].first, tasks[t].count,
+					result.series[tasks[t].module], tasks[t].at) ? 0 : 1;
+			}
+		});
+		return std::find(failed.begin(), failed.end(), 1) == failed.end();
+	}
+
+	//downsampled: each module's segments are read in time order through one segment sized buffer and folded into
+	//bucket means as they come, so its raw samples are never held at once
+	const int64_t bucketCount = (query.endUs - query.startUs + query.resolutionUs - 1) / query.resolutionUs;
+	pool.parallelFor(result.series.size(), [&](size_t m){
+		TelemetrySeries& series = result.series[m];
+		size_t columns = query.fields.size();
+		size_t most = std::min(moduleRows[m], (size_t)bucketCount);
+		series.timestamps.clear();
+		series.timestamps.reserve(most);
+		for(size_t c = 0; c < columns; c++){
+			series.columns[c].clear();
+			series.columns[c].reserve(most);
+		}
+		size_t largest = 0;
+		for(size_t t = moduleTasks[m]; t < moduleTasks[m + 1]; t++){
+			largest = std::max(largest, tasks[t].count);
+		}
+		TelemetrySeries slice;
+		slice.timestamps.resize(largest);
+		slice.columns.assign(columns, std::vector<double>(largest));
+		std::vector<double> sum(columns);
+		std::vector<int> count(columns);
+		int64_t bucket = -1;
+		for(size_t t = moduleTasks[m]; t < moduleTasks[m + 1]; t++){
+			if(!tasks[t].count){
+				continue;
+			}
+			if(!readSlice(*tasks[t].segment, query, tasks[t].first, tasks[t].count, slice, 0)){
+				failed[t] = 1;
+				return;
+			}
+			for(size_t i = 0; i < tasks[t].count; i++){
+				int64_t b = (slice.timestamps[i] - query.startUs) / query.resolutionUs;
+				if(b != bucket){
+					if(bucket >= 0){
+						appendBucket(series, query.startUs + bucket * query.resolutionUs, sum, count);
+					}
+					bucket = b;
+					std::fill(sum.begin(), sum.end(), 0.0);
+					std::fill(count.begin(), count.end(), 0);
+				}
+				for(size_t c = 0; c < columns; c++){
+					double v = slice.columns[c][i];
+					if(!std::isnan(v)){
+						sum[c] += v;
+						count[c]++;
+					}
+				}
+			}
+		}
+		if(bucket >= 0){
+			appendBucket(series, query.startUs + bucket * query.resolutionUs, sum, count);
+		}
+	});
+	return std::find(failed.begin(), failed.end(), 1) == failed.end();
+}
+
+DataBaseManager::DataBaseManager()
+	: maxQueueDelayUs(DEFAULT_MAX_QUEUE_DELAY_MS * 1000), stopping(false), droppedFrames(0)
+{
+}
+
+DataBaseManager::~DataBaseManager(){
+	shutdown();
+}
+
+bool DataBaseManager::init(const std::string& localRoot){
+	return local.init(localRoot);
+}
+
+void DataBaseManager::push(const GroupFeedbackFrame& frame){
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(queueLock));
+		if(queue.size() >= MAX_QUEUED_FRAMES){
+			queue.pop_front();
+			droppedFrames++;
+		}
+		queue.push_back(QueuedFrame());
+		queue.back().frame = frame;
+		queue.back().queuedUs = FeedBackManager::nowUs();
+	}
+	queueReady.notify_one();
+}
+
+uint64_t DataBaseManager::getDroppedFrames() const{
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(queueLock));
+	return droppedFrames;
+}
+
+bool DataBaseManager::query(const TelemetryQuery& query, TelemetryResult& result){
+	return local.query(query, queryPool, result);
+}
+
+void DataBaseManager::setInsertedHandler(FeedbackFrameHandler handler){
+	insertedHandler = handler;
+}
+
+void DataBaseManager::setMaxQueueDelayMs(int64_t ms){
+	maxQueueDelayUs = ms * 1000;
+}
+
+size_t DataBaseManager::insertBatch(const std::deque<QueuedFrame>& batch){
+	if(batch.empty()){
+		return 0;
+	}
+	METRIC_SCOPE(MetricDatabaseFlush);
+	TRACE_SCOPE("database_flush");
+	size_t expired = 0;
+	for(size_t i = 0; i < batch.size(); i++){
+		//checked per frame, inserting the front of a large batch ages its tail
+		if(maxQueueDelayUs > 0 && FeedBackManager::nowUs() - batch[i].queuedUs > maxQueueDelayUs){
+			expired++;
+			continue;
+		}
+		local.insert(batch[i].frame);
+		if(insertedHandler){
+			insertedHandler(batch[i].frame);
+		}
+	}
+	return expired;
+}
+
+void DataBaseManager::run(){
+	TRACE_THREAD("database");
+	std::unique_lock<ProxyMutex> lock(LOCK_SITE(queueLock));
+	std::deque<QueuedFrame> batch;
+	while(!stopping){
+		//frames pushed while the last batch was written must not wait for the timeout
+		if(queue.empty()){
+			queueReady.wait_for(lock, std::chrono::milliseconds(100));
+		}
+		batch.swap(queue);
+		lock.unlock();
+		size_t expired = insertBatch(batch);
+		batch.clear();
+		lock.lock();
+		droppedFrames += expired;
+	}
+	batch.swap(queue);
+	lock.unlock();
+	size_t expired = insertBatch(batch);
+	local.flush();
+	lock.lock();
+	droppedFrames += expired;
+}
+
+void DataBaseManager::shutdown(){
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(queueLock));
+		stopping = true;
+	}
+	queueReady.notify_all();
+	//a run() that has not begun yet finds stopping set, drains the queue and returns
+	join();
+}
@@ -1,6 +1,88 @@
 #ifndef DATABASEMANAGER_H
 #define DATABASEMANAGER_H
 #include "CThread.h"
+#include "FeedBackManager.h"
+#include "ThreadPool.h"
+#include "LockProfile.h"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+//a time-range read over persisted feedback
+struct TelemetryQuery{
+	std::vector<std::string> groups;   //expanded to every module seen in the group
+	std::vector<std::string> modules;  //"family/name"
+	std::vector<FeedbackField> fields; //only these columns are read from disk
+	int64_t startUs;                   //inclusive
+	int64_t endUs;                     //exclusive
+	int64_t resolutionUs;              //0: raw samples, otherwise mean per bucket
+
+	TelemetryQuery() : startUs(0), endUs(0), resolutionUs(0) {}
+};
+
+//columnar result for one module
+struct TelemetrySeries{
+	std::string module;
+	std::vector<int64_t> timestamps;
+	std::vector<std::vector<double> > columns; //one per query field, each as long as timestamps
+};
+
+struct TelemetryResult{
+	std::vector<FeedbackField> fields;
+	std::vector<TelemetrySeries> series; //one per module, sorted by module key
+};
+
+class DataBaseConnection{
+	//װ˶ݿӣȡconnection
+	//initݿ,
+	//insertд
+	//
+	//local store: every module gets column-oriented segment files (timestamps plus one column
+	//per FeedbackField); segments.idx lists each sealed segment with its time range
+public:
+	DataBaseConnection();
+	~DataBaseConnection();
+	bool init(const std::string& root); //root must exist; loads segments.idx if present
+	bool insert(const GroupFeedbackFrame& frame); //writer thread only
+	bool flush(); //seal every open segment, writer thread only
+	//only sealed segments are visible; may run concurrently with the writer.
+	//the vectors of result are reused, so a caller that keeps one TelemetryResult across queries
+	//does not allocate (or fault in) its columns again
+	bool query(const TelemetryQuery& query, ThreadPool& pool, TelemetryResult& result);
+	void setSegmentLimits(size_t maxSamples, int64_t maxSpanUs);
+private:
+	struct SegmentInfo{
+		int64_t startUs;
+		int64_t endUs;
+		uint32_t sampleCount;
+		std::string file;
+	};
+	struct OpenSegment{
+		std::vector<int64_t> timestamps;
+		std::vector<double> columns[FieldCount];
+	};
+	bool sealSegment(const std::string& module, OpenSegment& segment);
+	bool appendIndexLine(const std::string& line);
+	//rows [first, first + count) of segment that fall in the query range, found from its timestamps
+	bool sliceSegment(const SegmentInfo& segment, const TelemetryQuery& query, size_t& first, size_t& count) const;
+	//those rows into out, which is already sized, from row at
+	bool readSlice(const SegmentInfo& segment, const TelemetryQuery& query, size_t first, size_t count,
+		TelemetrySeries& out, size_t at) const;
+
+	std::string root;
+	ProxyMutex indexLock; //segments, groupModules and segments.idx
+	std::map<std::string, std::vector<SegmentInfo> > segments; //per module, sorted by startUs
+	std::map<std::string, std::set<std::string> > groupModules;
+	std::map<std::string, OpenSegment> openSegments; //writer thread only
+	uint64_t nextSegmentId;
+	size_t maxSegmentSamples;
+	int64_t maxSegmentSpanUs;
+};
+
 class DataBaseManager:public CThread
 {
 	//Ǹ߳
@@ -17,21 +99,37 @@ public:
 	DataBaseManager();
 	~DataBaseManager();
 	void run() override;
+	bool init(const std::string& localRoot);
+	void push(const GroupFeedbackFrame& frame); //called from the feedback consumers
+	bool query(const TelemetryQuery& query, TelemetryResult& result); //called from ServerApiManager
+	//called on the database thread after each frame is inserted, e.g. by latency probes; set before start()
+	void setInsertedHandler(FeedbackFrameHandler handler);
+	//a frame queued longer than this is dropped instead of inserted, so a database thread that falls behind
+	//catches up rather than lagging ever further; 0 = no time bound. set before start()
+	void setMaxQueueDelayMs(int64_t ms);
+	void shutdown(); //stop run() after flushing the queue and open segments, and wait for a start()ed thread
+	//frames dropped because MAX_QUEUED_FRAMES were waiting or they waited longer than the max queue delay
+	uint64_t getDroppedFrames() const;
 private:
+	static const size_t MAX_QUEUED_FRAMES = 65536;
+	static const int64_t DEFAULT_MAX_QUEUE_DELAY_MS = 250;
+	struct QueuedFrame{
+		GroupFeedbackFrame frame;
+		int64_t queuedUs;
+	};
+	size_t insertBatch(const std::deque<QueuedFrame>& batch); //returns the frames dropped as too old
 
-
-
-};
-class DataBaseConnection{
-	//װ˶ݿӣȡconnection
-	//initݿ,
-	//insertд
-
-
-
-
+	DataBaseConnection local;
+	ThreadPool queryPool;
+	mutable ProxyMutex queueLock;
+	ProxyCondition queueReady;
+	std::deque<QueuedFrame> queue;
+	FeedbackFrameHandler insertedHandler;
+	int64_t maxQueueDelayUs;
+	bool stopping;
+	uint64_t droppedFrames;
 };
 
 
 
-#endif // !
\ No newline at end of file
+#endif // !
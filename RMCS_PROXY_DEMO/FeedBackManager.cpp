@@ -0,0 +1,148 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include "FeedBackManager.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+static const char* const fieldNames[FieldCount] = {
+	"position",
+	"velocity",
+	"torque",
+	"positionCommand",
+	"velocityCommand",
+	"torqueCommand",
+	"deflection",
+	"deflectionVelocity",
+	"motorVelocity",
+	"motorCurrent",
+	"motorSensorTemperature",
+	"motorWindingCurrent",
+	"motorWindingTemperature",
+	"motorHousingTemperature",
+	"boardTemperature",
+	"processorTemperature",
+	"voltage",
+	"accelerometerX",
+	"accelerometerY",
+	"accelerometerZ",
+	"gyroX",
+	"gyroY",
+	"gyroZ"
+};
+
+const char* feedbackFieldName(FeedbackField field){
+	if(field < 0 || field >= FieldCount){
+		return "";
+	}
+	return fieldNames[field];
+}
+
+bool feedbackFieldFromName(const std::string& name, FeedbackField* field){
+	for(int i = 0; i < FieldCount; i++){
+		if(name == fieldNames[i]){
+			*field = (FeedbackField)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+//field wrapper types are protected inside hebi::Feedback, so let the compiler deduce them
+template <class T>
+static inline void setScalar(FeedbackSample& sample, FeedbackField field, const T& value){
+	if(value){
+		sample.values[field] = value.get();
+		sample.present |= (1u << field);
+	}
+}
+
+template <class T>
+static inline void setVector(FeedbackSample& sample, FeedbackField first, const T& value){
+	if(value){
+		hebi::Vector3f v = value.get();
+		sample.values[first] = v.getX();
+		sample.values[first + 1] = v.getY();
+		sample.values[first + 2] = v.getZ();
+		sample.present |= (7u << first);
+	}
+}
+
+FeedBackManager::FeedBackManager(){
+}
+
+FeedBackManager::~FeedBackManager(){
+}
+
+void FeedBackManager::addFrameHandler(FeedbackFrameHandler handler){
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(handlerLock));
+	handlers.push_back(handler);
+}
+
+void FeedBackManager::clearFrameHandlers(){
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(handlerLock));
+	handlers.clear();
+}
+
+void FeedBackManager::onGroupFeedback(const std::string& groupKey, std::shared_ptr<const std::vector<std::string> > moduleKeys, const hebi::GroupFeedback& feedback){
+	METRIC_SCOPE(MetricFeedbackDecode);
+	TRACE_SCOPE("feedback_decode");
+	GroupFeedbackFrame frame;
+	frame.groupKey = groupKey;
+	frame.moduleKeys = moduleKeys;
+	frame.timestampUs = nowUs();
+	decode(feedback, frame);
+	dispatch(frame);
+}
+
+void FeedBackManager::dispatch(const GroupFeedbackFrame& frame){
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(handlerLock));
+	for(size_t i = 0; i < handlers.size(); i++){
+		try
+		{
+			handlers[i](frame);
+		}
+		catch (std::exception& e)
+		{
+			std::cout<<e.what()<<std::endl;
+		}
+	}
+}
+
+void FeedBackManager::decode(const hebi::GroupFeedback& feedback, GroupFeedbackFrame& frame){
+	int size = feedback.size();
+	frame.modules.resize(size);
+	for(int i = 0; i < size; i++){
+		const hebi::Feedback& fbk = feedback[i];
+		FeedbackSample& sample = frame.modules[i];
+		sample.present = 0;
+		for(int f = 0; f < FieldCount; f++){
+			sample.values[f] = std::numeric_limits<double>::quiet_NaN();
+		}
+		setScalar(sample, FieldPosition, fbk.actuator().position());
+		setScalar(sample, FieldVelocity, fbk.actuator().velocity());
+		setScalar(sample, FieldTorque, fbk.actuator().torque());
+		setScalar(sample, FieldPositionCommand, fbk.actuator().positionCommand());
+		setScalar(sample, FieldVelocityCommand, fbk.actuator().velocityCommand());
+		setScalar(sample, FieldTorqueCommand, fbk.actuator().torqueCommand());
+		setScalar(sample, FieldDeflection, fbk.actuator().deflection());
+		setScalar(sample, FieldDeflectionVelocity, fbk.actuator().deflectionVelocity());
+		setScalar(sample, FieldMotorVelocity, fbk.actuator().motorVelocity());
+		setScalar(sample, FieldMotorCurrent, fbk.actuator().motorCurrent());
+		setScalar(sample, FieldMotorSensorTemperature, fbk.actuator().motorSensorTemperature());
+		setScalar(sample, FieldMotorWindingCurrent, fbk.actuator().motorWindingCurrent());
+		setScalar(sample, FieldMotorWindingTemperature, fbk.actuator().motorWindingTemperature());
+		setScalar(sample, FieldMotorHousingTemperature, fbk.actuator().motorHousingTemperature());
+		setScalar(sample, FieldBoardTemperature, fbk.boardTemperature());
+		setScalar(sample, FieldProcessorTemperature, fbk.processorTemperature());
+		setScalar(sample, FieldVoltage, fbk.voltage());
+		setVector(sample, FieldAccelerometerX, fbk.imu().accelerometer());
+		setVector(sample, FieldGyroX, fbk.imu().gyro());
+	}
+}
+
+int64_t FeedBackManager::nowUs(){
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
@@ -1,6 +1,62 @@
 #ifndef	FEEDBACKMANAGER_H
 #define FEEDBACKMANAGER_H
 #include "src/group_feedback.hpp"
+#include "LockProfile.h"
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//readable feedback fields, one column per field in the database
+enum FeedbackField{
+	FieldPosition,
+	FieldVelocity,
+	FieldTorque,
+	FieldPositionCommand,
+	FieldVelocityCommand,
+	FieldTorqueCommand,
+	FieldDeflection,
+	FieldDeflectionVelocity,
+	FieldMotorVelocity,
+	FieldMotorCurrent,
+	FieldMotorSensorTemperature,
+	FieldMotorWindingCurrent,
+	FieldMotorWindingTemperature,
+	FieldMotorHousingTemperature,
+	FieldBoardTemperature,
+	FieldProcessorTemperature,
+	FieldVoltage,
+	FieldAccelerometerX,
+	FieldAccelerometerY,
+	FieldAccelerometerZ,
+	FieldGyroX,
+	FieldGyroY,
+	FieldGyroZ,
+	FieldCount
+};
+
+const char* feedbackFieldName(FeedbackField field); //"position", "velocity", ...
+bool feedbackFieldFromName(const std::string& name, FeedbackField* field); //false if unknown
+
+//readable feedback of one module
+struct FeedbackSample{
+	uint32_t present;          //bit i set if values[i] is valid
+	double values[FieldCount]; //NaN when absent
+
+	bool has(FeedbackField field) const { return (present & (1u << field)) != 0; }
+};
+
+//readable feedback of one group at one receive time
+struct GroupFeedbackFrame{
+	std::string groupKey;
+	std::shared_ptr<const std::vector<std::string> > moduleKeys; //"family/name", same order as modules
+	int64_t timestampUs;       //receive time, microseconds since epoch
+	std::vector<FeedbackSample> modules;
+};
+
+typedef std::function<void (const GroupFeedbackFrame&)> FeedbackFrameHandler;
 
 class FeedBackManager{
 	//еfeedbackѾ
@@ -9,15 +65,19 @@ class FeedBackManager{
 	//1.ҪfeedBackQueue
 	//2.Ҫǵ
 	//
-	typedef struct feedback_ele{
-
-
-
-	};
-
-
-
-
+public:
+	FeedBackManager();
+	~FeedBackManager();
+	void addFrameHandler(FeedbackFrameHandler handler); //consumers: cache, database...
+	void clearFrameHandlers();
+	//called from the group feedback thread; decodes and hands the frame to every consumer
+	void onGroupFeedback(const std::string& groupKey, std::shared_ptr<const std::vector<std::string> > moduleKeys, const hebi::GroupFeedback& feedback);
+	void dispatch(const GroupFeedbackFrame& frame);
 
+	static void decode(const hebi::GroupFeedback& feedback, GroupFeedbackFrame& frame);
+	static int64_t nowUs(); //wall clock, microseconds since epoch
+private:
+	ProxyMutex handlerLock;
+	std::vector<FeedbackFrameHandler> handlers;
 };
-#endif
\ No newline at end of file
+#endif
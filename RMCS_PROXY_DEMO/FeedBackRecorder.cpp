@@ -0,0 +1,344 @@
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include "FeedBackRecorder.h"
+
+namespace {
+
+const char RECORDING_MAGIC[4] = {'R', 'M', 'F', 'R'};
+const uint32_t RECORDING_VERSION = 1;
+const char RECORD_KEYS = 'K';  //group key and its module keys
+const char RECORD_FRAME = 'F'; //one frame, only present values are stored
+const size_t FLUSH_BYTES = 1 << 16;
+
+template <class T>
+void put(std::vector<char>& out, T value){
+	const char* bytes = (const char*)&value;
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void putString(std::vector<char>& out, const std::string& text){
+	put<uint16_t>(out, (uint16_t)text.size());
+	out.insert(out.end(), text.begin(), text.end());
+}
+
+template <class T>
+bool get(std::istream& in, T& value){
+	return (bool)in.read((char*)&value, sizeof(T));
+}
+
+bool getString(std::istream& in, std::string& text){
+	uint16_t length;
+	if(!get(in, length)){
+		return false;
+	}
+	text.resize(length);
+	return length == 0 || (bool)in.read(&text[0], length);
+}
+
+}
+
+FeedBackRecorder::FeedBackRecorder()
+	: recording(false), stopping(false), nextKeysId(0), recordedFrames(0)
+{
+}
+
+FeedBackRecorder::~FeedBackRecorder(){
+	close();
+}
+
+bool FeedBackRecorder::open(const std::string& path){
+	close();
+	file.clear();
+	file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+	if(!file){
+		return false;
+	}
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(bufferLock));
+	keyTables.clear();
+	nextKeysId = 0;
+	buffer.clear();
+	buffer.reserve(2 * FLUSH_BYTES);
+	buffer.insert(buffer.end(), RECORDING_MAGIC, RECORDING_MAGIC + 4);
+	put<uint32_t>(buffer, RECORDING_VERSION);
+	stopping = false;
+	recording = true;
+	writer = std::thread(&FeedBackRecorder::writeLoop, this);
+	return true;
+}
+
+void FeedBackRecorder::close(){
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(bufferLock));
+		if(!recording){
+			return;
+		}
+		recording = false;
+		stopping = true;
+		if(!buffer.empty()){
+			full.push_back(std::vector<char>());
+			full.back().swap(buffer);
+		}
+	}
+	flushReady.notify_one();
+	writer.join();
+	file.close();
+}
+
+void FeedBackRecorder::writeLoop(){
+	std::vector<std::vector<char> > batch;
+	std::unique_lock<ProxyMutex> lock(LOCK_SITE(bufferLock));
+	for(;;){
+		while(!stopping && full.empty()){
+			flushReady.wait(lock);
+		}
+		if(full.empty()){
+			break; //stopping, and everything is written
+		}
+		batch.swap(full);
+		lock.unlock();
+		for(size_t i = 0; i < batch.size(); i++){
+			file.write(&batch[i][0], batch[i].size());
+			batch[i].clear();
+		}
+		lock.lock();
+		for(size_t i = 0; i < batch.size(); i++){
+			spare.push_back(std::vector<char>());
+			spare.back().swap(batch[i]);
+		}
+		batch.clear();
+	}
+	file.flush();
+}
+
+uint64_t FeedBackRecorder::getRecordedFrames() const{
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(bufferLock));
+	return recordedFrames;
+}
+
+uint32_t FeedBackRecorder::keysId(const GroupFeedbackFrame& frame){
+	std::map<std::string, KeyTable>::iterator it = keyTables.find(frame.groupKey);
+	if(it != keyTables.end()){
+		KeyTable& table = it->second;
+		if(table.moduleKeys == frame.moduleKeys){
+			return table.id;
+		}
+		static const std::vector<std::string> none;
+		if((table.moduleKeys ? *table.moduleKeys : none) == (frame.moduleKeys ? *frame.moduleKeys : none)){
+			table.moduleKeys = frame.moduleKeys; //same keys in a new vector; compare by pointer from here on
+			return table.id;
+		}
+	}
+	//first frame of the group, or its modules changed: frames from here on refer to a new table
+	uint32_t id = nextKeysId++;
+	KeyTable& table = keyTables[frame.groupKey];
+	table.id = id;
+	table.moduleKeys = frame.moduleKeys;
+	put<char>(buffer, RECORD_KEYS);
+	put<uint32_t>(buffer, id);
+	putString(buffer, frame.groupKey);
+	size_t count = frame.moduleKeys ? frame.moduleKeys->size() : 0;
+	put<uint16_t>(buffer, (uint16_t)count);
+	for(size_t i = 0; i < count; i++){
+		putString(buffer, (*frame.moduleKeys)[i]);
+	}
+	return id;
+}
+
+void FeedBackRecorder::onFrame(const GroupFeedbackFrame& frame){
+	std::unique_lock<ProxyMutex> lock(LOCK_SITE(bufferLock));
+	if(!recording){
+		return;
+	}
+	uint32_t id = keysId(frame);
+	put<char>(buffer, RECORD_FRAME);
+	put<uint32_t>(buffer, id);
+	put<int64_t>(buffer, frame.timestampUs);
+	put<uint16_t>(buffer, (uint16_t)frame.modules.size());
+	for(size_t m = 0; m < frame.modules.size(); m++){
+		const FeedbackSample& sample = frame.modules[m];
+		put<uint32_t>(buffer, sample.present);
+		for(int f = 0; f < FieldCount; f++){
+			if(sample.has((FeedbackField)f)){
+				put<double>(buffer, sample.values[f]);
+			}
+		}
+	}
+	recordedFrames++;
+	if(buffer.size() >= FLUSH_BYTES){
+		//hand the buffer over and go on with a written one; only the writer waits on the disk
+		full.push_back(std::vector<char>());
+		full.back().swap(buffer);
+		if(!spare.empty()){
+			buffer.swap(spare.back());
+			spare.pop_back();
+		}
+		else{
+			buffer.reserve(2 * FLUSH_BYTES);
+		}
+		lock.unlock();
+		flushReady.notify_one();
+	}
+}
+
+FeedBackReplayer::FeedBackReplayer(FeedBackManager& manager)
+	: manager(manager), speed(1.0), rebase(true), loops(1),
+	stopping(false), finished(false), replayedFrames(0), maxLateUs(0)
+{
+}
+
+FeedBackReplayer::~FeedBackReplayer(){
+	shutdown();
+}
+
+bool FeedBackReplayer::load(const std::string& path){
+	std::ifstream in(path.c_str(), std::ios::binary);
+	char magic[4];
+	uint32_t version;
+	if(!in.read(magic, 4) || std::memcmp(magic, RECORDING_MAGIC, 4) != 0 || !get(in, version) || version != RECORDING_VERSION){
+		return false;
+	}
+	frames.clear();
+	std::vector<std::string> groupKeys;
+	std::vector<std::shared_ptr<const std::vector<std::string> > > moduleKeys;
+	char type;
+	while(get(in, type)){
+		uint32_t id;
+		if(!get(in, id)){
+			break;
+		}
+		if(type == RECORD_KEYS){
+			std::string groupKey;
+			uint16_t count;
+			if(!getString(in, groupKey) || !get(in, count)){
+				break;
+			}
+			std::shared_ptr<std::vector<std::string> > keys = std::make_shared<std::vector<std::string> >(count);
+			for(size_t i = 0; i < count; i++){
+				getString(in, (*keys)[i]);
+			}
+			if(id >= groupKeys.size()){
+				groupKeys.resize(id + 1);
+				moduleKeys.resize(id + 1);
+			}
+			groupKeys[id] = groupKey;
+			moduleKeys[id] = keys;
+		}
+		else if(type == RECORD_FRAME && id < groupKeys.size()){
+			GroupFeedbackFrame frame;
+			uint16_t count;
+			if(!get(in, frame.timestampUs) || !get(in, count)){
+				break;
+			}
+			frame.groupKey = groupKeys[id];
+			frame.moduleKeys = moduleKeys[id];
+			frame.modules.resize(count);
+			for(size_t m = 0; m < count; m++){
+				FeedbackSample& sample = frame.modules[m];
+				get(in, sample.present);
+				for(int f = 0; f < FieldCount; f++){
+					sample.values[f] = std::numeric_limits<double>::quiet_NaN();
+					if(sample.has((FeedbackField)f)){
+						get(in, sample.values[f]);
+					}
+				}
+			}
+			if(!in){
+				break; //recording was cut short
+			}
+			frames.push_back(frame);
+		}
+		else{
+			break;
+		}
+	}
+	return !frames.empty();
+}
+
+void FeedBackReplayer::setSpeed(double replaySpeed){
+	speed = replaySpeed;
+}
+
+void FeedBackReplayer::setRebaseTimestamps(bool rebaseTimestamps){
+	rebase = rebaseTimestamps;
+}
+
+void FeedBackReplayer::setLoops(int replayLoops){
+	loops = replayLoops;
+}
+
+void FeedBackReplayer::run(){
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(stateLock));
+		finished = false;
+	}
+	int64_t lastOffset = 0;
+	for(int loop = 0; loop < loops && !frames.empty(); loop++){
+		const int64_t firstUs = frames.front().timestampUs;
+		const int64_t startUs = FeedBackManager::nowUs();
+		//timestamps keep increasing across loops
+		const int64_t shift = rebase ? startUs - firstUs : lastOffset;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		GroupFeedbackFrame frame;
+		for(size_t i = 0; i < frames.size(); i++){
+			{
+				std::lock_guard<ProxyMutex> lock(LOCK_SITE(stateLock));
+				if(stopping){
+					loop = loops;
+					break;
+				}
+			}
+			const GroupFeedbackFrame& recorded = frames[i];
+			if(speed > 0){
+				//one schedule for all groups keeps their relative timing
+				std::chrono::steady_clock::time_point due = start +
+					std::chrono::microseconds((int64_t)((recorded.timestampUs - firstUs) / speed));
+				std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				if(now < due){
+					std::this_thread::sleep_until(due);
+				}
+				else{
+					int64_t late = std::chrono::duration_cast<std::chrono::microseconds>(now - due).count();
+					std::lock_guard<ProxyMutex> lock(LOCK_SITE(stateLock));
+					if(late > maxLateUs){
+						maxLateUs = late;
+					}
+				}
+			}
+			frame.groupKey = recorded.groupKey;
+			frame.moduleKeys = recorded.moduleKeys;
+			frame.modules = recorded.modules;
+			frame.timestampUs = recorded.timestampUs + shift;
+			manager.dispatch(frame);
+			std::lock_guard<ProxyMutex> lock(LOCK_SITE(stateLock));
+			replayedFrames++;
+		}
+		lastOffset = shift + frames.back().timestampUs - firstUs + 1;
+	}
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(stateLock));
+	finished = true;
+}
+
+void FeedBackReplayer::shutdown(){
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(stateLock));
+		stopping = true;
+	}
+	join();
+}
+
+bool FeedBackReplayer::isFinished() const{
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(stateLock));
+	return finished;
+}
+
+uint64_t FeedBackReplayer::getReplayedFrames() const{
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(stateLock));
+	return replayedFrames;
+}
+
+int64_t FeedBackReplayer::getMaxLateUs() const{
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(stateLock));
+	return maxLateUs;
+}
@@ -0,0 +1,85 @@
+#ifndef FEEDBACKRECORDER_H
+#define FEEDBACKRECORDER_H
+#include "CThread.h"
+#include "FeedBackManager.h"
+#include "LockProfile.h"
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+//captures every frame FeedBackManager dispatches, with its receive timestamp
+//add onFrame as a frame handler; frames of all groups go to one file in arrival order
+//onFrame only encodes into memory; a full buffer is handed to a writer thread of the recorder, so the
+//feedback thread never waits on the disk
+class FeedBackRecorder
+{
+public:
+	FeedBackRecorder();
+	~FeedBackRecorder();
+	bool open(const std::string& path);
+	void onFrame(const GroupFeedbackFrame& frame);
+	void close(); //writes everything recorded so far and stops the writer
+	uint64_t getRecordedFrames() const;
+private:
+	//writes a key table the first time a group is seen and again whenever its module keys change
+	uint32_t keysId(const GroupFeedbackFrame& frame);
+	void writeLoop();
+
+	mutable ProxyMutex bufferLock;
+	ProxyCondition flushReady;
+	std::vector<char> buffer;               //being filled by onFrame
+	std::vector<std::vector<char> > full;   //waiting for the writer, oldest first
+	std::vector<std::vector<char> > spare;  //written, kept for their capacity
+	bool recording;
+	bool stopping;
+	struct KeyTable{
+		uint32_t id;
+		std::shared_ptr<const std::vector<std::string> > moduleKeys; //held, so a pointer match is never a reused address
+	};
+	std::map<std::string, KeyTable> keyTables; //current table of each group
+	uint32_t nextKeysId;
+	uint64_t recordedFrames;
+	std::ofstream file; //only the writer thread touches it while recording
+	std::thread writer;
+};
+
+//feeds a recording back into FeedBackManager::dispatch, i.e. to the same consumers
+//(cache, database, ...) the live group feedback threads reach
+class FeedBackReplayer:public CThread
+{
+public:
+	explicit FeedBackReplayer(FeedBackManager& manager);
+	~FeedBackReplayer();
+	bool load(const std::string& path); //whole recording is kept in memory so disk never paces the replay
+	//1.0 = recorded speed, N = N times faster, 0 = as fast as the consumers take it
+	void setSpeed(double speed);
+	//shift timestamps so the first frame is stamped with the replay start time (default on)
+	void setRebaseTimestamps(bool rebase);
+	void setLoops(int loops); //how many times to play the recording, default 1
+	void run() override;
+	void shutdown(); //stop run() after the current frame and wait for a start()ed thread
+	bool isFinished() const;
+	uint64_t getReplayedFrames() const;
+	int64_t getMaxLateUs() const; //worst delay behind the schedule, shows when consumers cannot keep up
+	size_t frameCount() const { return frames.size(); }
+	const std::vector<GroupFeedbackFrame>& getFrames() const { return frames; }
+private:
+	FeedBackManager& manager;
+	std::vector<GroupFeedbackFrame> frames;
+	double speed;
+	bool rebase;
+	int loops;
+	mutable ProxyMutex stateLock;
+	bool stopping;
+	bool finished;
+	uint64_t replayedFrames;
+	int64_t maxLateUs;
+};
+
+#endif
@@ -0,0 +1,271 @@
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include "FeedbackBus.h"
+#include "Metrics.h"
+#include "Trace.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifndef _WIN32
+//shared futex: the waiters are other processes. a reader counts itself in waiters before it checks published, and the
+//fence orders the caller's store before the count is read: either it sees the new sample or it is woken
+void wakeReaders(FeedbackBusState& state){
+	state.wake.fetch_add(1, std::memory_order_release);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(state.waiters.load(std::memory_order_relaxed) != 0){
+		syscall(SYS_futex, (uint32_t*)&state.wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	}
+}
+#endif
+
+}
+
+FeedbackBusConfig::FeedbackBusConfig()
+	: prefix("rmcs"), capacity(256)
+{
+}
+
+FeedbackBus::FeedbackBus()
+	: index(NULL), published(0), registerFailures(0)
+{
+	indexes.push_back(std::unique_ptr<const RegionIndex>(new RegionIndex()));
+	index.store(indexes.back().get());
+}
+
+FeedbackBus::FeedbackBus(const FeedbackBusConfig& config)
+	: config(config), index(NULL), published(0), registerFailures(0)
+{
+	indexes.push_back(std::unique_ptr<const RegionIndex>(new RegionIndex()));
+	index.store(indexes.back().get());
+}
+
+FeedbackBus::~FeedbackBus(){
+	for(size_t i = 0; i < regions.size(); i++){
+		closeRegion(*regions[i]);
+	}
+}
+
+std::string FeedbackBus::regionName(const std::string& prefix, const std::string& groupKey){
+	std::string name = "/" + prefix + "." + groupKey;
+	for(size_t i = 1; i < name.size(); i++){
+		char c = name[i];
+		if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.')){
+			name[i] = '_';
+		}
+	}
+	return name;
+}
+
+size_t FeedbackBus::getRegionCount() const{
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(registryLock));
+	size_t open = 0;
+	for(size_t i = 0; i < regions.size(); i++){
+		open += regions[i]->base ? 1 : 0;
+	}
+	return open;
+}
+
+uint64_t FeedbackBus::getPublished() const{
+	return published.load(std::memory_order_relaxed);
+}
+
+uint64_t FeedbackBus::getRegisterFailures() const{
+	return registerFailures.load(std::memory_order_relaxed);
+}
+
+FeedbackBus::Region* FeedbackBus::createRegion(const GroupFeedbackFrame& frame){
+#ifdef _WIN32
+	(void)frame;
+	return NULL;
+#else
+	const std::vector<std::string>& keys = *frame.moduleKeys;
+	size_t moduleCount = keys.size();
+	size_t namesSize = 0;
+	for(size_t m = 0; m < moduleCount; m++){
+		namesSize += keys[m].size() + 1;
+	}
+	for(int f = 0; f < FieldCount; f++){
+		namesSize += std::strlen(feedbackFieldName((FeedbackField)f)) + 1;
+	}
+	size_t capacity = config.capacity ? config.capacity : 1;
+	size_t namesOffset = FEEDBACK_BUS_STATE + feedbackBusAlign(sizeof(FeedbackBusState));
+	size_t slotsOffset = feedbackBusAlign(namesOffset + namesSize);
+	size_t slotSize = feedbackBusSlotSize(moduleCount, FieldCount);
+	size_t size = slotsOffset + capacity * slotSize;
+
+	std::unique_ptr<Region> region(new Region());
+	region->name = regionName(config.prefix, frame.groupKey);
+	region->moduleKeys = frame.moduleKeys;
+	//a region left by an earlier run goes away; its readers keep their mapping until they reopen
+	shm_unlink(region->name.c_str());
+	int fd = shm_open(region->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if(fd < 0){
+		return NULL;
+	}
+	void* base = MAP_FAILED;
+	if(ftruncate(fd, (off_t)size) == 0){
+		base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	::close(fd);
+	if(base == MAP_FAILED){
+		shm_unlink(region->name.c_str());
+		return NULL;
+	}
+	region->base = (char*)base;
+	region->size = size;
+	region->state = new (region->base + FEEDBACK_BUS_STATE) FeedbackBusState();
+	region->state->writing.store(0);
+	region->state->published.store(0);
+	region->state->wake.store(0);
+	region->state->closed.store(0);
+	region->state->waiters.store(0);
+	region->slots = region->base + slotsOffset;
+	region->slotSize = slotSize;
+	region->capacity = capacity;
+	region->valuesOffset = feedbackBusValuesOffset(moduleCount);
+	region->moduleCount = moduleCount;
+
+	char* names = region->base + namesOffset;
+	for(size_t m = 0; m < moduleCount; m++){
+		std::memcpy(names, keys[m].c_str(), keys[m].size() + 1);
+		names += keys[m].size() + 1;
+	}
+	for(int f = 0; f < FieldCount; f++){
+		const char* name = feedbackFieldName((FeedbackField)f);
+		std::memcpy(names, name, std::strlen(name) + 1);
+		names += std::strlen(name) + 1;
+	}
+	//touch every slot now so the feedback thread never takes the page faults
+	std::memset(region->slots, 0, capacity * slotSize);
+
+	FeedbackBusHeader* header = new (region->base) FeedbackBusHeader();
+	header->version = FEEDBACK_BUS_VERSION;
+	header->moduleCount = (uint32_t)moduleCount;
+	header->fieldCount = (uint32_t)FieldCount;
+	header->capacity = (uint32_t)capacity;
+	header->publisherPid = (int32_t)getpid();
+	header->regionSize = size;
+	header->namesOffset = namesOffset;
+	header->namesSize = namesSize;
+	header->slotsOffset = slotsOffset;
+	header->slotSize = slotSize;
+	header->createdUs = FeedBackManager::nowUs();
+	std::strncpy(header->groupKey, frame.groupKey.c_str(), FEEDBACK_BUS_GROUP_SIZE - 1);
+	header->magic.store(FEEDBACK_BUS_MAGIC, std::memory_order_release);
+	regions.push_back(std::move(region));
+	return regions.back().get();
+#endif
+}
+
+void FeedbackBus::closeRegion(Region& region){
+#ifndef _WIN32
+	if(!region.base){
+		return;
+	}
+	region.state->closed.store(1, std::memory_order_release);
+	wakeReaders(*region.state);
+	shm_unlink(region.name.c_str());
+	munmap(region.base, region.size);
+	region.base = NULL;
+#else
+	(void)region;
+#endif
+}
+
+FeedbackBus::Region* FeedbackBus::registerGroup(const GroupFeedbackFrame& frame){
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(registryLock));
+	const RegionIndex* current = index.load(std::memory_order_acquire);
+	std::unique_ptr<RegionIndex> next(new RegionIndex(*current));
+	Region*& slot = (*next)[frame.groupKey];
+	bool failedBefore = slot && !slot->base;
+	if(slot){
+		//the module keys changed: readers of the old region see it closed and reopen the name, keeping their own
+		//mapping until then. frames of one group are published one at a time, so nothing writes into the old
+		//region any more and it is unmapped and unlinked here, before the new one takes its name
+		closeRegion(*slot);
+	}
+	Region* region = createRegion(frame);
+	if(!region){
+		registerFailures.fetch_add(1, std::memory_order_relaxed);
+		if(failedBefore){
+			//still failing: the placeholder already in the index just waits for its next retry
+			slot->retryAtUs = FeedBackManager::nowUs() + REGISTER_RETRY_US;
+			return NULL;
+		}
+		std::cout<<"feedback bus: could not create "<<regionName(config.prefix, frame.groupKey)<<": "
+			<<std::strerror(errno)<<", retrying every "<<REGISTER_RETRY_US / 1000<<" ms"<<std::endl;
+		std::unique_ptr<Region> failed(new Region());
+		failed->name = regionName(config.prefix, frame.groupKey);
+		failed->moduleKeys = frame.moduleKeys;
+		failed->retryAtUs = FeedBackManager::nowUs() + REGISTER_RETRY_US;
+		regions.push_back(std::move(failed));
+		region = regions.back().get();
+	}
+	slot = region;
+	indexes.push_back(std::unique_ptr<const RegionIndex>(next.release()));
+	index.store(indexes.back().get(), std::memory_order_release);
+	return region->base ? region : NULL;
+}
+
+void FeedbackBus::onFrame(const GroupFeedbackFrame& frame){
+	METRIC_SCOPE(MetricBusPublish);
+	TRACE_SCOPE("bus_publish");
+	if(!frame.moduleKeys || frame.moduleKeys->size() != frame.modules.size()){
+		return;
+	}
+	const RegionIndex* current = index.load(std::memory_order_acquire);
+	RegionIndex::const_iterator found = current->find(frame.groupKey);
+	Region* region = found != current->end() ? found->second : NULL;
+	if(region && region->moduleKeys != frame.moduleKeys){
+		if(*region->moduleKeys != *frame.moduleKeys){
+			region = NULL; //reordered, added or removed modules: the names in the region are stale
+		}
+		else{
+			region->moduleKeys = frame.moduleKeys; //same keys in a new vector; compare by pointer from here on
+		}
+	}
+	if(region && !region->base && FeedBackManager::nowUs() >= region->retryAtUs){
+		region = NULL;
+	}
+	if(!region){
+		region = registerGroup(frame);
+	}
+	else if(!region->base){
+		return; //creating it failed, not yet time to retry
+	}
+	if(!region){
+		return;
+	}
+#ifndef _WIN32
+	FeedbackBusState& state = *region->state;
+	uint64_t n = state.published.load(std::memory_order_relaxed);
+	char* slot = region->slots + (size_t)(n % region->capacity) * region->slotSize;
+	//announce which slot is about to be overwritten before touching it
+	state.writing.store(n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(slot, &frame.timestampUs, sizeof(int64_t));
+	uint32_t* present = (uint32_t*)(slot + sizeof(int64_t));
+	double* values = (double*)(slot + region->valuesOffset);
+	size_t modules = region->moduleCount;
+	for(size_t m = 0; m < modules; m++){
+		const FeedbackSample& sample = frame.modules[m];
+		present[m] = sample.present;
+		for(int f = 0; f < FieldCount; f++){
+			values[f * modules + m] = sample.values[f];
+		}
+	}
+	state.published.store(n + 1, std::memory_order_release);
+	wakeReaders(state);
+	published.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
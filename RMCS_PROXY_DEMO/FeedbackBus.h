@@ -0,0 +1,74 @@
+#ifndef FEEDBACKBUS_H
+#define FEEDBACKBUS_H
+#include "FeedBackManager.h"
+#include "FeedbackBusLayout.h"
+#include "LockProfile.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct FeedbackBusConfig{
+	std::string prefix; //regions are "/<prefix>.<group>"
+	size_t capacity;    //samples of history per group, the latest included
+
+	FeedbackBusConfig();
+};
+
+//publishes every group's feedback into POSIX shared memory for other processes on the host
+//(see FeedbackBusLayout.h, read it with FeedbackBusReader). add onFrame as a frame handler; a group's region
+//is created the first time it reports, and again if its module keys change (the old one is closed, unmapped
+//and unlinked). a region that cannot be created is logged, counted and retried once per REGISTER_RETRY_US.
+//frames of one group must come one at a time, as FeedBackManager::dispatch delivers them.
+//publishing never waits and readers cannot slow it down. unavailable on windows: onFrame does nothing there
+class FeedbackBus
+{
+public:
+	FeedbackBus();
+	explicit FeedbackBus(const FeedbackBusConfig& config);
+	~FeedbackBus(); //closes and unlinks every region
+	void onFrame(const GroupFeedbackFrame& frame);
+	const FeedbackBusConfig& getConfig() const { return config; }
+	size_t getRegionCount() const; //open regions, one per group that has reported
+	uint64_t getPublished() const; //samples, every group
+	uint64_t getRegisterFailures() const; //regions that could not be created, retries included
+	//"/<prefix>.<group>", characters other than letters, digits, '-' and '_' replaced by '_'
+	static std::string regionName(const std::string& prefix, const std::string& groupKey);
+private:
+	static const int64_t REGISTER_RETRY_US = 1000000;
+	//base is NULL for a region that was closed, or for a group whose region could not be created; that
+	//placeholder stays in the index until retryAtUs. moduleKeys and retryAtUs belong to the group's frames
+	struct Region{
+		std::string name;
+		std::shared_ptr<const std::vector<std::string> > moduleKeys; //the keys the region was built with
+		int64_t retryAtUs;
+		char* base;
+		size_t size;
+		FeedbackBusState* state;
+		char* slots;
+		size_t slotSize;
+		size_t capacity;
+		size_t valuesOffset;
+		size_t moduleCount;
+	};
+	//immutable once published, like CacheManager's index
+	typedef std::map<std::string, Region*> RegionIndex;
+
+	Region* registerGroup(const GroupFeedbackFrame& frame);
+	Region* createRegion(const GroupFeedbackFrame& frame);
+	static void closeRegion(Region& region);
+
+	const FeedbackBusConfig config;
+	std::atomic<const RegionIndex*> index;
+	mutable ProxyMutex registryLock; //only taken when a group first reports, changes its modules or retries
+	std::vector<std::unique_ptr<Region> > regions; //closed ones stay, with base NULL, for retired indexes
+	std::vector<std::unique_ptr<const RegionIndex> > indexes; //retired ones stay alive for onFrame callers
+	std::atomic<uint64_t> published;
+	std::atomic<uint64_t> registerFailures;
+
+	FeedbackBus(const FeedbackBus&);
+	FeedbackBus& operator=(const FeedbackBus&);
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef FEEDBACKBUSLAYOUT_H
+#define FEEDBACKBUSLAYOUT_H
+#include <atomic>
+#include <stdint.h>
+
+//memory layout of one group's feedback bus region, the contract between FeedbackBus (the proxy) and
+//FeedbackBusReader (other processes on the host). the region is "/<prefix>.<group>" in POSIX shared memory:
+//
+//  0                      FeedbackBusHeader, constant once magic is set
+//  FEEDBACK_BUS_STATE     FeedbackBusState, the publisher's counters, on cache lines of their own
+//  namesOffset            module keys, then field names, each '\0' terminated
+//  slotsOffset            capacity slots of slotSize bytes; sample n lives in slot n % capacity
+//
+//a slot: int64_t timestampUs, uint32_t present[moduleCount] (bit f: field f is valid), padded to 8 bytes,
+//then double values[fieldCount][moduleCount], a column of modules per field, NaN where absent.
+//
+//the ring follows ModuleHistory: the publisher announces sample n in writing (n + 1) before it touches the slot
+//and counts it in published once written. a reader of sample n checks n < published before and
+//writing <= n + capacity after reading it; otherwise the slot was being overwritten and the read is discarded.
+//wake changes after every sample and on close: it is the futex word readers sleep on. a reader counts itself in
+//waiters before it checks published and sleeps, and the publisher only makes the wake syscall while waiters is not 0;
+//a reader that cannot write the region never sleeps on wake for long.
+//all offsets are from the region start; little-endian, the publisher's and the readers' host
+const uint32_t FEEDBACK_BUS_MAGIC = 0x53424652; //"RFBS"
+const uint32_t FEEDBACK_BUS_VERSION = 2;
+const size_t FEEDBACK_BUS_STATE = 256;
+const size_t FEEDBACK_BUS_GROUP_SIZE = 128; //group key, '\0' terminated
+const size_t FEEDBACK_BUS_ALIGN = 64;
+
+struct FeedbackBusHeader{
+	std::atomic<uint32_t> magic; //stored last, with release, once everything else is in place
+	uint32_t version;
+	uint32_t moduleCount;
+	uint32_t fieldCount;
+	uint32_t capacity;
+	int32_t publisherPid;
+	uint64_t regionSize;
+	uint64_t namesOffset;
+	uint64_t namesSize;
+	uint64_t slotsOffset;
+	uint64_t slotSize;
+	int64_t createdUs;   //microseconds since epoch
+	char groupKey[FEEDBACK_BUS_GROUP_SIZE];
+};
+
+struct FeedbackBusState{
+	std::atomic<uint64_t> writing;   //index + 1 of the sample being written
+	std::atomic<uint64_t> published; //samples fully written
+	std::atomic<uint32_t> wake;
+	std::atomic<uint32_t> closed;    //set when the publisher left the region for good
+	std::atomic<uint32_t> waiters;   //readers that may be asleep on wake
+};
+
+static_assert(sizeof(FeedbackBusHeader) <= FEEDBACK_BUS_STATE, "feedback bus header overlaps its state");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "feedback bus counters must be lock-free to be shared");
+
+inline size_t feedbackBusAlign(size_t size){
+	return (size + FEEDBACK_BUS_ALIGN - 1) & ~(FEEDBACK_BUS_ALIGN - 1);
+}
+
+inline size_t feedbackBusValuesOffset(size_t moduleCount){
+	return (sizeof(int64_t) + sizeof(uint32_t) * moduleCount + 7) & ~(size_t)7;
+}
+
+inline size_t feedbackBusSlotSize(size_t moduleCount, size_t fieldCount){
+	return feedbackBusAlign(feedbackBusValuesOffset(moduleCount) + sizeof(double) * fieldCount * moduleCount);
+}
+
+#endif
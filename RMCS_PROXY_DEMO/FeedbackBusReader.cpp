@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include "FeedbackBusReader.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+//same naming as FeedbackBus::regionName, repeated so clients need nothing from the proxy
+std::string regionName(const std::string& prefix, const std::string& groupKey){
+	std::string name = "/" + prefix + "." + groupKey;
+	for(size_t i = 1; i < name.size(); i++){
+		char c = name[i];
+		if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.')){
+			name[i] = '_';
+		}
+	}
+	return name;
+}
+
+int64_t monotonicUs(){
+#ifdef _WIN32
+	return 0;
+#else
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+//sleeps of a reader that cannot count itself in waiters are cut to this, as the publisher may never wake it
+const int64_t UNCOUNTED_WAIT_US = 1000;
+
+//a reader in FeedbackBusState::waiters for its scope; the fence pairs with the publisher's in wakeReaders
+class WaiterCount{
+public:
+	explicit WaiterCount(std::atomic<uint32_t>* waiters) : waiters(waiters) {
+		if(waiters){
+			waiters->fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+	}
+	~WaiterCount(){
+		if(waiters){
+			waiters->fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+private:
+	std::atomic<uint32_t>* waiters;
+
+	WaiterCount(const WaiterCount&);
+	WaiterCount& operator=(const WaiterCount&);
+};
+
+}
+
+FeedbackBusView::FeedbackBusView()
+	: state(NULL), slot(NULL), index(0), modules(0), fields(0), capacity(0), valuesOffset(0)
+{
+}
+
+int64_t FeedbackBusView::getTimestampUs() const{
+	int64_t timestampUs;
+	std::memcpy(&timestampUs, slot, sizeof(timestampUs));
+	return timestampUs;
+}
+
+Eigen::Map<const Eigen::VectorXd> FeedbackBusView::field(int field) const{
+	return Eigen::Map<const Eigen::VectorXd>((const double*)(slot + valuesOffset) + field * modules, modules);
+}
+
+Eigen::Map<const Eigen::MatrixXd> FeedbackBusView::values() const{
+	return Eigen::Map<const Eigen::MatrixXd>((const double*)(slot + valuesOffset), modules, fields);
+}
+
+bool FeedbackBusView::isValid() const{
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return state && state->writing.load(std::memory_order_relaxed) <= index + capacity;
+}
+
+FeedbackBusReader::FeedbackBusReader()
+	: base(NULL), size(0), header(NULL), state(NULL), stateMapping(NULL), waiters(NULL), slots(NULL), slotSize(0), capacity(0),
+	modules(0), fields(0)
+{
+}
+
+FeedbackBusReader::~FeedbackBusReader(){
+	close();
+}
+
+bool FeedbackBusReader::open(const std::string& groupKey, const std::string& prefix){
+	close();
+#ifdef _WIN32
+	(void)groupKey;
+	(void)prefix;
+	return false;
+#else
+	std::string name = regionName(prefix, groupKey);
+	//read-write only to count this reader in waiters; a reader without write access polls instead
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	bool writable = fd >= 0;
+	if(!writable){
+		fd = shm_open(name.c_str(), O_RDONLY, 0);
+	}
+	if(fd < 0){
+		return false;
+	}
+	struct stat info;
+	void* mapped = MAP_FAILED;
+	if(fstat(fd, &info) == 0 && (size_t)info.st_size >= FEEDBACK_BUS_STATE + sizeof(FeedbackBusState)){
+		mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	if(mapped != MAP_FAILED && writable){
+		//a second, writable mapping of just the page with the publisher's counters
+		void* counters = mmap(NULL, FEEDBACK_BUS_STATE + sizeof(FeedbackBusState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(counters != MAP_FAILED){
+			stateMapping = (char*)counters;
+			waiters = &((FeedbackBusState*)(stateMapping + FEEDBACK_BUS_STATE))->waiters;
+		}
+	}
+	::close(fd);
+	if(mapped == MAP_FAILED){
+		return false;
+	}
+	base = (const char*)mapped;
+	size = (size_t)info.st_size;
+	header = (const FeedbackBusHeader*)base;
+	//not ready until magic is set; every other header field is in place by then
+	if(header->magic.load(std::memory_order_acquire) != FEEDBACK_BUS_MAGIC || header->version != FEEDBACK_BUS_VERSION ||
+		header->regionSize > size || header->capacity == 0 || header->fieldCount > 32 ||
+		header->namesOffset + header->namesSize > header->slotsOffset ||
+		header->slotSize < feedbackBusSlotSize(header->moduleCount, header->fieldCount) ||
+		header->slotsOffset + header->capacity * header->slotSize > header->regionSize)
+	{
+		close();
+		return false;
+	}
+	state = (const FeedbackBusState*)(base + FEEDBACK_BUS_STATE);
+	slots = base + header->slotsOffset;
+	slotSize = (size_t)header->slotSize;
+	capacity = header->capacity;
+	modules = header->moduleCount;
+	fields = header->fieldCount;
+	this->groupKey.assign(header->groupKey, strnlen(header->groupKey, FEEDBACK_BUS_GROUP_SIZE));
+	const char* names = base + header->namesOffset;
+	const char* end = names + header->namesSize;
+	while(names < end && moduleKeys.size() + fieldNames.size() < modules + fields){
+		size_t length = strnlen(names, (size_t)(end - names));
+		std::vector<std::string>& list = moduleKeys.size() < modules ? moduleKeys : fieldNames;
+		list.push_back(std::string(names, length));
+		names += length + 1;
+	}
+	if(moduleKeys.size() != modules || fieldNames.size() != fields){
+		close();
+		return false;
+	}
+	return true;
+#endif
+}
+
+void FeedbackBusReader::close(){
+#ifndef _WIN32
+	if(base){
+		munmap((void*)base, size);
+	}
+	if(stateMapping){
+		munmap(stateMapping, FEEDBACK_BUS_STATE + sizeof(FeedbackBusState));
+	}
+#endif
+	base = NULL;
+	stateMapping = NULL;
+	waiters = NULL;
+	size = 0;
+	header = NULL;
+	state = NULL;
+	slots = NULL;
+	moduleKeys.clear();
+	fieldNames.clear();
+	groupKey.clear();
+}
+
+bool FeedbackBusReader::isClosed() const{
+	if(!state || state->closed.load(std::memory_order_acquire)){
+		return true;
+	}
+#ifndef _WIN32
+	//a proxy that crashed never sets closed
+	if(kill(header->publisherPid, 0) != 0 && errno == ESRCH){
+		return true;
+	}
+#endif
+	return false;
+}
+
+int FeedbackBusReader::moduleIndex(const std::string& moduleKey) const{
+	for(size_t m = 0; m < moduleKeys.size(); m++){
+		if(moduleKeys[m] == moduleKey){
+			return (int)m;
+		}
+	}
+	return -1;
+}
+
+int FeedbackBusReader::fieldIndex(const std::string& name) const{
+	for(size_t f = 0; f < fieldNames.size(); f++){
+		if(fieldNames[f] == name){
+			return (int)f;
+		}
+	}
+	return -1;
+}
+
+uint64_t FeedbackBusReader::getPublished() const{
+	return state ? state->published.load(std::memory_order_acquire) : 0;
+}
+
+uint64_t FeedbackBusReader::getOldest() const{
+	if(!state){
+		return 0;
+	}
+	uint64_t writing = state->writing.load(std::memory_order_acquire);
+	return writing > capacity ? writing - capacity : 0;
+}
+
+bool FeedbackBusReader::wait(uint64_t seen, int64_t timeoutUs){
+	if(!state){
+		return false;
+	}
+#ifdef _WIN32
+	(void)seen;
+	(void)timeoutUs;
+	return false;
+#else
+	int64_t deadlineUs = timeoutUs < 0 ? -1 : monotonicUs() + timeoutUs;
+	//counted before published is checked, so a publisher that does not see this reader has already published
+	WaiterCount waiter(waiters);
+	for(;;){
+		//read the word before the counter: a sample published in between changes it and the futex returns at once
+		uint32_t word = state->wake.load(std::memory_order_acquire);
+		if(state->published.load(std::memory_order_acquire) > seen){
+			return true;
+		}
+		if(state->closed.load(std::memory_order_acquire)){
+			return false;
+		}
+		timespec timeout;
+		timespec* limit = NULL;
+		int64_t sleepUs = waiters ? -1 : UNCOUNTED_WAIT_US;
+		if(deadlineUs >= 0){
+			int64_t leftUs = deadlineUs - monotonicUs();
+			if(leftUs <= 0){
+				return false;
+			}
+			sleepUs = sleepUs < 0 ? leftUs : std::min(sleepUs, leftUs);
+		}
+		if(sleepUs >= 0){
+			timeout.tv_sec = (time_t)(sleepUs / 1000000);
+			timeout.tv_nsec = (long)(sleepUs % 1000000) * 1000;
+			limit = &timeout;
+		}
+		syscall(SYS_futex, (const uint32_t*)&state->wake, FUTEX_WAIT, word, limit, NULL, 0);
+	}
+#endif
+}
+
+bool FeedbackBusReader::view(uint64_t n, FeedbackBusView& out) const{
+	if(!state || n >= state->published.load(std::memory_order_acquire)){
+		return false;
+	}
+	FeedbackBusView sample;
+	sample.state = state;
+	sample.slot = slots + (size_t)(n % capacity) * slotSize;
+	sample.index = n;
+	sample.modules = modules;
+	sample.fields = fields;
+	sample.capacity = capacity;
+	sample.valuesOffset = feedbackBusValuesOffset(modules);
+	if(!sample.isValid()){
+		return false;
+	}
+	out = sample;
+	return true;
+}
+
+bool FeedbackBusReader::latest(FeedbackBusView& out) const{
+	uint64_t published = getPublished();
+	return published != 0 && view(published - 1, out);
+}
+
+bool FeedbackBusReader::copy(uint64_t n, FeedbackBusSample& out) const{
+	FeedbackBusView sample;
+	if(!view(n, sample)){
+		return false;
+	}
+	out.index = n;
+	out.timestampUs = sample.getTimestampUs();
+	out.present.assign(sample.present(), sample.present() + modules);
+	out.values = sample.values();
+	return sample.isValid();
+}
+
+bool FeedbackBusReader::copyLatest(FeedbackBusSample& out) const{
+	//the newest sample is only overwritten capacity samples later, so one retry is plenty unless capacity is tiny
+	for(int attempt = 0; attempt < 4; attempt++){
+		uint64_t published = getPublished();
+		if(published == 0){
+			return false;
+		}
+		if(copy(published - 1, out)){
+			return true;
+		}
+	}
+	return false;
+}
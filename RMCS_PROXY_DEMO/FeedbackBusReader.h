@@ -0,0 +1,100 @@
+#ifndef FEEDBACKBUSREADER_H
+#define FEEDBACKBUSREADER_H
+#include "FeedbackBusLayout.h"
+#include "src/Eigen/Dense"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//client side of the feedback bus, for processes on the proxy's host; needs only this file, FeedbackBusReader.cpp,
+//FeedbackBusLayout.h and Eigen. it maps a group's region read-only and never writes to it, so readers cannot
+//disturb the proxy or each other. samples are numbered from 0 in publish order; the last capacity of them are kept
+
+//one sample in place in the shared region: nothing is copied. the publisher may overwrite it once capacity newer
+//samples follow, so check isValid() after reading and drop what was read if it is false
+class FeedbackBusView
+{
+public:
+	FeedbackBusView();
+	uint64_t getIndex() const { return index; }
+	int64_t getTimestampUs() const; //receive time in the proxy, microseconds since epoch
+	size_t getModuleCount() const { return modules; }
+	bool has(size_t module, int field) const { return (present()[module] & (1u << field)) != 0; }
+	//one value per module in group order, NaN where the module did not report the field
+	Eigen::Map<const Eigen::VectorXd> field(int field) const;
+	//modules x fields, a column per field
+	Eigen::Map<const Eigen::MatrixXd> values() const;
+	bool isValid() const;
+private:
+	friend class FeedbackBusReader;
+	const uint32_t* present() const { return (const uint32_t*)(slot + sizeof(int64_t)); }
+
+	const FeedbackBusState* state;
+	const char* slot;
+	uint64_t index;
+	size_t modules;
+	size_t fields;
+	size_t capacity;
+	size_t valuesOffset;
+};
+
+//one sample copied out of the region; reuse it to keep reads allocation-free
+struct FeedbackBusSample{
+	uint64_t index;
+	int64_t timestampUs;
+	std::vector<uint32_t> present; //per module, bit f: field f is valid
+	Eigen::MatrixXd values;        //modules x fields, a column per field
+};
+
+class FeedbackBusReader
+{
+public:
+	FeedbackBusReader();
+	~FeedbackBusReader();
+	//maps "/<prefix>.<group>"; false while the proxy has not published the group yet,
+	//or if the region has a layout version this reader does not know
+	bool open(const std::string& groupKey, const std::string& prefix = "rmcs");
+	void close();
+	bool isOpen() const { return base != NULL; }
+	//the publisher closed the region or its process is gone; open() again to follow a restarted proxy
+	bool isClosed() const;
+
+	const std::string& getGroupKey() const { return groupKey; }
+	const std::vector<std::string>& getModuleKeys() const { return moduleKeys; } //"family/name", group order
+	const std::vector<std::string>& getFieldNames() const { return fieldNames; } //column order: "position", ...
+	int moduleIndex(const std::string& moduleKey) const; //-1 if not in the group
+	int fieldIndex(const std::string& name) const;       //-1 if the proxy does not publish it
+	size_t getCapacity() const { return capacity; }
+
+	uint64_t getPublished() const; //samples so far; the newest is getPublished() - 1
+	uint64_t getOldest() const;    //oldest sample not yet overwritten
+	//sleeps until more than seen samples are published; false on timeout (negative: none) or when the region closes.
+	//a reader that could only open the region read-only wakes every millisecond to check instead
+	bool wait(uint64_t seen, int64_t timeoutUs = -1);
+	//sample n in place; false if it is not published yet or already overwritten
+	bool view(uint64_t n, FeedbackBusView& out) const;
+	bool latest(FeedbackBusView& out) const;
+	//sample n copied out and checked; false if it is not published yet or was overwritten
+	bool copy(uint64_t n, FeedbackBusSample& out) const;
+	bool copyLatest(FeedbackBusSample& out) const;
+private:
+	const char* base;
+	size_t size;
+	const FeedbackBusHeader* header;
+	const FeedbackBusState* state;
+	char* stateMapping;               //writable mapping of the counters, NULL if the region is read-only to us
+	std::atomic<uint32_t>* waiters;   //in stateMapping
+	const char* slots;
+	size_t slotSize;
+	size_t capacity;
+	size_t modules;
+	size_t fields;
+	std::string groupKey;
+	std::vector<std::string> moduleKeys;
+	std::vector<std::string> fieldNames;
+
+	FeedbackBusReader(const FeedbackBusReader&);
+	FeedbackBusReader& operator=(const FeedbackBusReader&);
+};
+
+#endif
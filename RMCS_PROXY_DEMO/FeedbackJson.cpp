@@ -0,0 +1,278 @@
+#include <cmath>
+#include <cstring>
+#include "FeedbackJson.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace {
+
+const JsonKey K_T("t");
+const JsonKey K_MODULES("modules");
+const JsonKey K_MODULE("module");
+const JsonKey K_ACTUATOR("actuator");
+const JsonKey K_IMU("imu");
+const JsonKey K_IO("io");
+const JsonKey K_DEBUG("debug");
+const JsonKey K_LED("led");
+const JsonKey K_POSITION("position");
+const JsonKey K_POSITION_COMMAND("positionCommand");
+const JsonKey K_ACCELEROMETER("accelerometer");
+const JsonKey K_GYRO("gyro");
+const JsonKey K_CONTROL_STRATEGY("controlStrategy");
+const JsonKey K_SAVE_CURRENT_SETTINGS("saveCurrentSettings");
+
+//FeedbackFloatField order; the first three sit at the top level, the rest under "actuator"
+const int FEEDBACK_TOP_FLOATS = FeedbackFloatVoltage + 1;
+const JsonKey FEEDBACK_FLOATS[] = {
+	JsonKey("boardTemperature"),
+	JsonKey("processorTemperature"),
+	JsonKey("voltage"),
+	JsonKey("velocity"),
+	JsonKey("torque"),
+	JsonKey("velocityCommand"),
+	JsonKey("torqueCommand"),
+	JsonKey("deflection"),
+	JsonKey("deflectionVelocity"),
+	JsonKey("motorVelocity"),
+	JsonKey("motorCurrent"),
+	JsonKey("motorSensorTemperature"),
+	JsonKey("motorWindingCurrent"),
+	JsonKey("motorWindingTemperature"),
+	JsonKey("motorHousingTemperature")
+};
+
+const JsonKey IO_BANKS[] = {
+	JsonKey("a"), JsonKey("b"), JsonKey("c"), JsonKey("d"), JsonKey("e"), JsonKey("f")
+};
+
+//io pins 1-8 and debug channels 1-9
+const JsonKey CHANNELS[] = {
+	JsonKey("0"), JsonKey("1"), JsonKey("2"), JsonKey("3"), JsonKey("4"),
+	JsonKey("5"), JsonKey("6"), JsonKey("7"), JsonKey("8"), JsonKey("9")
+};
+
+//InfoFloatField order
+const JsonKey INFO_FLOATS[] = {
+	JsonKey("positionKp"), JsonKey("positionKi"), JsonKey("positionKd"), JsonKey("positionFeedForward"),
+	JsonKey("positionDeadZone"), JsonKey("positionIClamp"), JsonKey("positionPunch"),
+	JsonKey("positionMinTarget"), JsonKey("positionMaxTarget"), JsonKey("positionTargetLowpass"),
+	JsonKey("positionMinOutput"), JsonKey("positionMaxOutput"), JsonKey("positionOutputLowpass"),
+	JsonKey("velocityKp"), JsonKey("velocityKi"), JsonKey("velocityKd"), JsonKey("velocityFeedForward"),
+	JsonKey("velocityDeadZone"), JsonKey("velocityIClamp"), JsonKey("velocityPunch"),
+	JsonKey("velocityMinTarget"), JsonKey("velocityMaxTarget"), JsonKey("velocityTargetLowpass"),
+	JsonKey("velocityMinOutput"), JsonKey("velocityMaxOutput"), JsonKey("velocityOutputLowpass"),
+	JsonKey("torqueKp"), JsonKey("torqueKi"), JsonKey("torqueKd"), JsonKey("torqueFeedForward"),
+	JsonKey("torqueDeadZone"), JsonKey("torqueIClamp"), JsonKey("torquePunch"),
+	JsonKey("torqueMinTarget"), JsonKey("torqueMaxTarget"), JsonKey("torqueTargetLowpass"),
+	JsonKey("torqueMinOutput"), JsonKey("torqueMaxOutput"), JsonKey("torqueOutputLowpass"),
+	JsonKey("springConstant")
+};
+
+const JsonKey INFO_BOOLS[] = {
+	JsonKey("positionDOnError"), JsonKey("velocityDOnError"), JsonKey("torqueDOnError")
+};
+
+const JsonKey INFO_STRINGS[] = {
+	JsonKey("name"), JsonKey("family")
+};
+
+//the api limits names and families to 20 characters
+const int MAX_STRING = 64;
+
+void writeFloat(JsonWriter& w, const JsonKey& key, float value){
+	w.key(key);
+	w.number(value);
+}
+
+void writeAngle(JsonWriter& w, const JsonKey& key, HebiFeedbackPtr feedback, FeedbackHighResAngleField field){
+	if(hebiFeedbackHasHighResAngle(feedback, field)){
+		int64_t revolutions;
+		float offset;
+		hebiFeedbackGetHighResAngle(feedback, field, &revolutions, &offset);
+		w.key(key);
+		w.number((double)revolutions * 2.0 * M_PI + (double)offset);
+	}
+}
+
+void writeVector(JsonWriter& w, const JsonKey& key, HebiFeedbackPtr feedback, FeedbackVector3fField field){
+	if(hebiFeedbackHasVector3f(feedback, field)){
+		HebiVector3f v = hebiFeedbackGetVector3f(feedback, field);
+		w.key(key);
+		w.beginArray();
+		w.number(v.x);
+		w.number(v.y);
+		w.number(v.z);
+		w.endArray();
+	}
+}
+
+void writeColor(JsonWriter& w, uint8_t r, uint8_t g, uint8_t b){
+	w.key(K_LED);
+	w.beginArray();
+	w.integer(r);
+	w.integer(g);
+	w.integer(b);
+	w.endArray();
+}
+
+//opens an object member that closeOptional() takes back again if nothing was written into it
+JsonWriter::Mark openOptional(JsonWriter& w, const JsonKey& key, size_t* start){
+	JsonWriter::Mark mark = w.mark();
+	w.key(key);
+	w.beginObject();
+	*start = w.size();
+	return mark;
+}
+
+void closeOptional(JsonWriter& w, const JsonWriter::Mark& mark, size_t start){
+	if(w.size() == start){
+		w.rewind(mark);
+	}
+	else{
+		w.endObject();
+	}
+}
+
+//the members of one module's feedback, inside an object the caller opened
+void feedbackMembers(JsonWriter& w, HebiFeedbackPtr feedback){
+	for(int f = 0; f < FEEDBACK_TOP_FLOATS; f++){
+		if(hebiFeedbackHasFloat(feedback, (FeedbackFloatField)f)){
+			writeFloat(w, FEEDBACK_FLOATS[f], hebiFeedbackGetFloat(feedback, (FeedbackFloatField)f));
+		}
+	}
+
+	size_t start;
+	JsonWriter::Mark mark = openOptional(w, K_ACTUATOR, &start);
+	writeAngle(w, K_POSITION, feedback, FeedbackHighResAnglePosition);
+	for(int f = FEEDBACK_TOP_FLOATS; f <= FeedbackFloatMotorHousingTemperature; f++){
+		if(hebiFeedbackHasFloat(feedback, (FeedbackFloatField)f)){
+			writeFloat(w, FEEDBACK_FLOATS[f], hebiFeedbackGetFloat(feedback, (FeedbackFloatField)f));
+		}
+	}
+	writeAngle(w, K_POSITION_COMMAND, feedback, FeedbackHighResAnglePositionCommand);
+	closeOptional(w, mark, start);
+
+	mark = openOptional(w, K_IMU, &start);
+	writeVector(w, K_ACCELEROMETER, feedback, FeedbackVector3fAccelerometer);
+	writeVector(w, K_GYRO, feedback, FeedbackVector3fGyro);
+	closeOptional(w, mark, start);
+
+	mark = openOptional(w, K_IO, &start);
+	for(int bank = FeedbackIoBankA; bank <= FeedbackIoBankF; bank++){
+		size_t bankStart;
+		JsonWriter::Mark bankMark = openOptional(w, IO_BANKS[bank], &bankStart);
+		for(unsigned int pin = 1; pin <= 8; pin++){
+			if(hebiFeedbackHasIoPinInt(feedback, (FeedbackIoPinBank)bank, pin)){
+				w.key(CHANNELS[pin]);
+				w.integer(hebiFeedbackGetIoPinInt(feedback, (FeedbackIoPinBank)bank, pin));
+			}
+			else if(hebiFeedbackHasIoPinFloat(feedback, (FeedbackIoPinBank)bank, pin)){
+				writeFloat(w, CHANNELS[pin], hebiFeedbackGetIoPinFloat(feedback, (FeedbackIoPinBank)bank, pin));
+			}
+		}
+		closeOptional(w, bankMark, bankStart);
+	}
+	closeOptional(w, mark, start);
+
+	mark = openOptional(w, K_DEBUG, &start);
+	for(int n = 1; n <= 9; n++){
+		if(hebiFeedbackHasNumberedFloat(feedback, FeedbackNumberedFloatDebug, n)){
+			writeFloat(w, CHANNELS[n], hebiFeedbackGetNumberedFloat(feedback, FeedbackNumberedFloatDebug, n));
+		}
+	}
+	closeOptional(w, mark, start);
+
+	if(hebiFeedbackHasLedColor(feedback, FeedbackLedLed)){
+		uint8_t r, g, b;
+		hebiFeedbackGetLedColor(feedback, FeedbackLedLed, &r, &g, &b);
+		writeColor(w, r, g, b);
+	}
+}
+
+void infoMembers(JsonWriter& w, HebiInfoPtr info){
+	char text[MAX_STRING];
+	for(int s = InfoStringName; s <= InfoStringFamily; s++){
+		//a string too long for the buffer is left out rather than allocated for
+		if(hebiInfoHasString(info, (InfoStringField)s) && hebiInfoGetString(info, (InfoStringField)s, text, MAX_STRING) == 0){
+			w.key(INFO_STRINGS[s]);
+			w.string(text, std::strlen(text));
+		}
+	}
+	for(int f = InfoFloatPositionKp; f <= InfoFloatSpringConstant; f++){
+		if(hebiInfoHasFloat(info, (InfoFloatField)f)){
+			writeFloat(w, INFO_FLOATS[f], hebiInfoGetFloat(info, (InfoFloatField)f));
+		}
+	}
+	for(int f = InfoBoolPositionDOnError; f <= InfoBoolTorqueDOnError; f++){
+		if(hebiInfoHasBool(info, (InfoBoolField)f)){
+			w.key(INFO_BOOLS[f]);
+			w.boolean(hebiInfoGetBool(info, (InfoBoolField)f) != 0);
+		}
+	}
+	if(hebiInfoHasEnum(info, InfoEnumControlStrategy)){
+		w.key(K_CONTROL_STRATEGY);
+		w.integer(hebiInfoGetEnum(info, InfoEnumControlStrategy));
+	}
+	if(hebiInfoHasFlag(info, InfoFlagSaveCurrentSettings)){
+		w.key(K_SAVE_CURRENT_SETTINGS);
+		w.boolean(true);
+	}
+	if(hebiInfoHasLedColor(info, InfoLedLed)){
+		uint8_t r, g, b;
+		hebiInfoGetLedColor(info, InfoLedLed, &r, &g, &b);
+		writeColor(w, r, g, b);
+	}
+}
+
+}
+
+void writeFeedback(JsonWriter& w, HebiFeedbackPtr feedback){
+	w.beginObject();
+	feedbackMembers(w, feedback);
+	w.endObject();
+}
+
+void writeInfo(JsonWriter& w, HebiInfoPtr info){
+	w.beginObject();
+	infoMembers(w, info);
+	w.endObject();
+}
+
+void writeGroupFeedback(JsonWriter& w, const hebi::GroupFeedback& feedback,
+	const std::vector<std::string>* moduleKeys, int64_t timestampUs)
+{
+	w.beginObject();
+	w.key(K_T);
+	w.integer(timestampUs);
+	w.key(K_MODULES);
+	w.beginArray();
+	int count = hebiGroupFeedbackGetNumModules(feedback.internal_);
+	for(int m = 0; m < count; m++){
+		w.beginObject();
+		w.key(K_MODULE);
+		if(moduleKeys && (size_t)m < moduleKeys->size()){
+			w.string((*moduleKeys)[m].data(), (*moduleKeys)[m].size());
+		}
+		else{
+			w.integer(m);
+		}
+		feedbackMembers(w, hebiGroupFeedbackGetModuleFeedback(feedback.internal_, m));
+		w.endObject();
+	}
+	w.endArray();
+	w.endObject();
+}
+
+void writeGroupInfo(JsonWriter& w, const hebi::GroupInfo& info){
+	w.beginObject();
+	w.key(K_MODULES);
+	w.beginArray();
+	int count = hebiGroupInfoGetNumModules(info.internal_);
+	for(int m = 0; m < count; m++){
+		writeInfo(w, hebiGroupInfoGetModuleInfo(info.internal_, m));
+	}
+	w.endArray();
+	w.endObject();
+}
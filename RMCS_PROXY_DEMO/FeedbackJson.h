@@ -0,0 +1,30 @@
+#ifndef FEEDBACKJSON_H
+#define FEEDBACKJSON_H
+#include "src/group_feedback.hpp"
+#include "src/group_info.hpp"
+#include "JsonWriter.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//json snapshots of hebi messages, read through the C API so nothing is copied on the way.
+//only the fields the module reported are written; objects left empty are dropped.
+//
+//feedback follows the hebi::Feedback layout:
+//	{"boardTemperature":..,"processorTemperature":..,"voltage":..,
+//	 "actuator":{"position":..,"velocity":..,"torque":..,...},
+//	 "imu":{"accelerometer":[x,y,z],"gyro":[x,y,z]},
+//	 "io":{"a":{"1":..,...},...,"f":{..}},"debug":{"1":..,...,"9":..},"led":[r,g,b]}
+//info has the settings flat, named after the C enums:
+//	{"name":..,"family":..,"positionKp":..,...,"springConstant":..,"positionDOnError":true,...,
+//	 "controlStrategy":3,"saveCurrentSettings":true,"led":[r,g,b]}
+void writeFeedback(JsonWriter& w, HebiFeedbackPtr feedback);
+void writeInfo(JsonWriter& w, HebiInfoPtr info);
+
+//{"t":timestampUs,"modules":[{"module":"family/name",..feedback..},..]}; without moduleKeys the module is its index
+void writeGroupFeedback(JsonWriter& w, const hebi::GroupFeedback& feedback,
+	const std::vector<std::string>* moduleKeys, int64_t timestampUs);
+//{"modules":[{..info..},..]}
+void writeGroupInfo(JsonWriter& w, const hebi::GroupInfo& info);
+
+#endif
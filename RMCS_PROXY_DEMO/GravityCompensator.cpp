@@ -0,0 +1,225 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "GravityCompensator.h"
+#include "LockProfile.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+const int64_t DEFAULT_DEADLINE_US = 1000; //when the group has no feedback rate yet
+
+struct GravityCompensator::Mailbox{
+	ProxyMutex lock;
+	ProxyCondition ready;
+	Eigen::VectorXd positions;
+	int64_t arrivedNs;
+	bool valid;    //every module reported a position
+	bool fresh;    //not taken by the compute thread yet
+	bool open;     //the handler copies frames in; false while stopped
+	bool stopping; //the compute thread exits
+	std::atomic<uint64_t> frames;
+	std::atomic<uint64_t> overruns;
+
+	explicit Mailbox(int modules)
+		: positions(Eigen::VectorXd::Zero(modules)), arrivedNs(0), valid(false), fresh(false),
+		open(false), stopping(false), frames(0), overruns(0) {}
+};
+
+GravityCompensatorConfig::GravityCompensatorConfig()
+	: cpu(-1), deadlineUs(0), gravity(0, 0, -9.81)
+{
+}
+
+GravityCompensator::GravityCompensator(const std::shared_ptr<hebi::Group>& group, const hebi::kinematics::Kinematics& arm,
+	const GravityCompensatorConfig& config)
+	: group(group), dynamics(Dynamics::create(arm)), config(config), mailbox(new Mailbox(group ? group->size() : 0)),
+	subscribed(false), running(false), pinned(false), deadlineUs(0)
+{
+	if(dynamics){
+		dynamics->setGravity(config.gravity);
+	}
+	resetStats();
+}
+
+GravityCompensator::~GravityCompensator(){
+	stop();
+}
+
+bool GravityCompensator::start(){
+	if(running || !group || !dynamics || (int)dynamics->getDoFCount() != group->size()){
+		return false;
+	}
+	deadlineUs = config.deadlineUs;
+	if(deadlineUs <= 0){
+		float hz = group->getFeedbackFrequencyHz();
+		deadlineUs = hz > 0 ? (int64_t)(1e6 / hz) : DEFAULT_DEADLINE_US;
+	}
+	if(!subscribed){
+		//the handler holds the mailbox, not this object, so it may outlive the compensator
+		std::shared_ptr<Mailbox> box = mailbox;
+		group->addFeedbackHandler([box](const hebi::GroupFeedback* feedback){
+			int64_t arrived = Metrics::nowNs();
+			{
+				std::lock_guard<ProxyMutex> guard(LOCK_SITE(box->lock));
+				if(!box->open){
+					return;
+				}
+				if(box->fresh){
+					box->overruns++;
+				}
+				bool valid = feedback->size() == box->positions.size();
+				for(int i = 0; valid && i < feedback->size(); i++){
+					const auto& position = (*feedback)[i].actuator().position();
+					valid = (bool)position;
+					if(valid){
+						box->positions[i] = position.get();
+					}
+				}
+				box->valid = valid;
+				box->arrivedNs = arrived;
+				box->fresh = true;
+				box->frames++;
+			}
+			box->ready.notify_one();
+		});
+		subscribed = true;
+	}
+	{
+		std::lock_guard<ProxyMutex> guard(LOCK_SITE(mailbox->lock));
+		mailbox->fresh = false;
+		mailbox->stopping = false;
+		mailbox->open = true;
+	}
+	thread = std::thread(&GravityCompensator::run, this);
+	running = true;
+	return true;
+}
+
+void GravityCompensator::stop(){
+	if(!running){
+		return;
+	}
+	{
+		std::lock_guard<ProxyMutex> guard(LOCK_SITE(mailbox->lock));
+		mailbox->open = false;
+		mailbox->stopping = true;
+	}
+	mailbox->ready.notify_all();
+	thread.join();
+	running = false;
+}
+
+GravityCompensatorStats GravityCompensator::getStats() const{
+	GravityCompensatorStats stats;
+	stats.frames = mailbox->frames;
+	stats.sent = counters.sent;
+	stats.sendFailures = counters.sendFailures;
+	stats.deadlineMisses = counters.deadlineMisses;
+	stats.overruns = mailbox->overruns;
+	stats.invalid = counters.invalid;
+	stats.lastComputeNs = counters.lastComputeNs;
+	stats.maxComputeNs = counters.maxComputeNs;
+	stats.lastCycleNs = counters.lastCycleNs;
+	stats.maxCycleNs = counters.maxCycleNs;
+	stats.pinned = pinned;
+	return stats;
+}
+
+void GravityCompensator::resetStats(){
+	mailbox->frames = 0;
+	mailbox->overruns = 0;
+	counters.sent = 0;
+	counters.sendFailures = 0;
+	counters.deadlineMisses = 0;
+	counters.invalid = 0;
+	counters.lastComputeNs = 0;
+	counters.maxComputeNs = 0;
+	counters.lastCycleNs = 0;
+	counters.maxCycleNs = 0;
+}
+
+bool GravityCompensator::pin(int cpu){
+	if(cpu < 0){
+		return false;
+	}
+#ifdef _WIN32
+	if(cpu >= (int)(sizeof(DWORD_PTR) * 8)){
+		return false;
+	}
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#else
+	if(cpu >= CPU_SETSIZE){
+		return false;
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+void GravityCompensator::run(){
+	TRACE_THREAD("gravity");
+	pinned = pin(config.cpu);
+	//everything the loop touches is sized here, once
+	const int modules = group->size();
+	Dynamics::Workspace workspace(*dynamics);
+	Eigen::VectorXd positions = Eigen::VectorXd::Zero(modules);
+	Eigen::VectorXd torques = Eigen::VectorXd::Zero(modules);
+	hebi::GroupCommand command(modules);
+	const int64_t deadlineNs = deadlineUs * 1000;
+
+	std::unique_lock<ProxyMutex> lock(LOCK_SITE(mailbox->lock));
+	for(;;){
+		while(!mailbox->stopping && !mailbox->fresh){
+			mailbox->ready.wait(lock);
+		}
+		if(mailbox->stopping){
+			break;
+		}
+		mailbox->fresh = false;
+		bool valid = mailbox->valid;
+		int64_t arrivedNs = mailbox->arrivedNs;
+		positions = mailbox->positions;
+		lock.unlock();
+
+		if(!valid){
+			counters.invalid++;
+		}
+		else{
+			TRACE_SCOPE("gravity_compensation");
+			int64_t start = Metrics::nowNs();
+			dynamics->getGravityTorques(positions, torques, workspace);
+			for(int i = 0; i < modules; i++){
+				command[i].actuator().torque().set((float)torques[i]);
+			}
+			int64_t computed = Metrics::nowNs();
+			bool ok = group->sendCommand(command);
+			int64_t sent = Metrics::nowNs();
+			METRIC_RECORD(MetricGravityCompute, computed - start);
+			METRIC_RECORD(MetricGravityCycle, sent - arrivedNs);
+
+			counters.lastComputeNs = computed - start;
+			if(computed - start > counters.maxComputeNs){
+				counters.maxComputeNs = computed - start;
+			}
+			counters.lastCycleNs = sent - arrivedNs;
+			if(sent - arrivedNs > counters.maxCycleNs){
+				counters.maxCycleNs = sent - arrivedNs;
+			}
+			if(sent - arrivedNs > deadlineNs){
+				counters.deadlineMisses++;
+			}
+			if(ok){
+				counters.sent++;
+			}
+			else{
+				counters.sendFailures++;
+			}
+		}
+		lock.lock();
+	}
+}
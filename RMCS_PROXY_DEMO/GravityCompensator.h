@@ -0,0 +1,90 @@
+#ifndef GRAVITYCOMPENSATOR_H
+#define GRAVITYCOMPENSATOR_H
+#include "src/group.hpp"
+#include "src/inverse_dynamics.hpp"
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <thread>
+
+struct GravityCompensatorConfig{
+	int cpu;                 //core the compute thread is pinned to, -1 to leave it to the scheduler
+	int64_t deadlineUs;      //feedback to sent command; 0 for one feedback period, from the group's rate at start()
+	Eigen::Vector3d gravity; //world frame, m/s^2
+
+	GravityCompensatorConfig();
+};
+
+struct GravityCompensatorStats{
+	uint64_t frames;          //feedback frames handed to the compute thread
+	uint64_t sent;            //torque commands sent
+	uint64_t sendFailures;
+	uint64_t deadlineMisses;  //commands sent more than deadlineUs after their feedback arrived
+	uint64_t overruns;        //frames replaced by a newer one before the compute thread took them
+	uint64_t invalid;         //frames without a position for every module, nothing sent
+	int64_t lastComputeNs;    //gravity torques of the last frame into the command
+	int64_t maxComputeNs;
+	int64_t lastCycleNs;      //feedback handler entered to the return of sendCommand, last frame
+	int64_t maxCycleNs;
+	bool pinned;              //the compute thread runs on config.cpu
+};
+
+//gravity compensation stage of a control loop: on every feedback of a group, the torques that hold the arm
+//up at the reported positions (hebi::kinematics::InverseDynamics::getGravityTorques) go back to the group as
+//a torque-only GroupCommand, through Group::sendCommand
+//
+//the feedback handler only copies the positions out; a thread of its own, pinned to one core if asked,
+//computes and sends. if a newer frame arrives first, the older one is dropped and counted as an overrun.
+//nothing allocates between start() and stop(). the modules of the group are the joints of the chain, in order
+//
+//compute and cycle times are also recorded as MetricGravityCompute and MetricGravityCycle
+class GravityCompensator
+{
+public:
+	//the chain's dynamic model is built here (later changes to arm are not seen)
+	GravityCompensator(const std::shared_ptr<hebi::Group>& group, const hebi::kinematics::Kinematics& arm,
+		const GravityCompensatorConfig& config = GravityCompensatorConfig());
+	~GravityCompensator(); //stop()
+	//false if the chain has no dynamic model (see InverseDynamics::create), its dof count is not the group's
+	//size, or it is already running. the first start() adds a feedback handler to the group; it stays for the
+	//group's lifetime and does nothing while stopped, also after this object is gone
+	bool start();
+	void stop(); //no command is sent once this returns
+	bool isRunning() const { return running; }
+	int64_t getDeadlineUs() const { return deadlineUs; }
+	GravityCompensatorStats getStats() const;
+	void resetStats();
+private:
+	//the latest positions, shared with the group's feedback handler
+	struct Mailbox;
+	struct Counters{ //frames are counted in the mailbox, where the handler hands them over
+		std::atomic<uint64_t> sent;
+		std::atomic<uint64_t> sendFailures;
+		std::atomic<uint64_t> deadlineMisses;
+		std::atomic<uint64_t> invalid;
+		std::atomic<int64_t> lastComputeNs;
+		std::atomic<int64_t> maxComputeNs;
+		std::atomic<int64_t> lastCycleNs;
+		std::atomic<int64_t> maxCycleNs;
+	};
+	typedef hebi::kinematics::InverseDynamics<> Dynamics;
+
+	void run();
+	static bool pin(int cpu); //the calling thread
+
+	std::shared_ptr<hebi::Group> group;
+	std::unique_ptr<Dynamics> dynamics;
+	GravityCompensatorConfig config;
+	std::shared_ptr<Mailbox> mailbox;
+	bool subscribed;
+	bool running;
+	std::atomic<bool> pinned;
+	int64_t deadlineUs;
+	Counters counters;
+	std::thread thread;
+
+	GravityCompensator(const GravityCompensator&);
+	GravityCompensator& operator=(const GravityCompensator&);
+};
+
+#endif
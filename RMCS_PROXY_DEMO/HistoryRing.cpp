@@ -0,0 +1,119 @@
+#include <cmath>
+#include <cstring>
+#include "HistoryRing.h"
+
+HistoryConfig::HistoryConfig()
+	: windowUs(10 * 1000000LL), maxRateHz(1000.0), maxModules(256)
+{
+	fields.push_back(FieldPosition);
+	fields.push_back(FieldVelocity);
+	fields.push_back(FieldTorque);
+}
+
+size_t HistoryConfig::capacity() const{
+	return (size_t)std::ceil(windowUs * 1e-6 * maxRateHz) + 1;
+}
+
+size_t HistoryConfig::bytesPerModule() const{
+	return capacity() * (sizeof(int64_t) + sizeof(double) * fields.size());
+}
+
+ModuleHistory::ModuleHistory(size_t capacity, const std::vector<FeedbackField>& fields)
+	: capacity(capacity), fields(fields),
+	timestamps(capacity), values(capacity * fields.size()),
+	writing(0), published(0)
+{
+	for(int f = 0; f < FieldCount; f++){
+		columnOf[f] = -1;
+	}
+	for(size_t i = 0; i < fields.size(); i++){
+		columnOf[fields[i]] = (int)i;
+	}
+}
+
+void ModuleHistory::append(int64_t timestampUs, const FeedbackSample& sample){
+	uint64_t index = published.load(std::memory_order_relaxed);
+	size_t slot = (size_t)(index % capacity);
+	//announce which slot is about to be overwritten before touching it
+	writing.store(index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	timestamps[slot] = timestampUs;
+	for(size_t i = 0; i < fields.size(); i++){
+		values[i * capacity + slot] = sample.values[fields[i]];
+	}
+	published.store(index + 1, std::memory_order_release);
+}
+
+size_t ModuleHistory::firstAtOrAfter(uint64_t begin, uint64_t end, int64_t sinceUs) const{
+	//timestamps are appended in order, so the ring is sorted from begin to end
+	while(begin < end){
+		uint64_t mid = begin + (end - begin) / 2;
+		if(timestamps[(size_t)(mid % capacity)] < sinceUs){
+			begin = mid + 1;
+		}
+		else{
+			end = mid;
+		}
+	}
+	return (size_t)begin;
+}
+
+void ModuleHistory::copyRange(uint64_t begin, uint64_t end, const int* columns, HistorySnapshot& out) const{
+	size_t count = (size_t)(end - begin);
+	size_t slot = (size_t)(begin % capacity);
+	size_t head = capacity - slot < count ? capacity - slot : count; //before the wrap
+	size_t tail = count - head;
+	out.timestamps.resize(count);
+	std::memcpy(&out.timestamps[0], &timestamps[slot], head * sizeof(int64_t));
+	if(tail){
+		std::memcpy(&out.timestamps[head], &timestamps[0], tail * sizeof(int64_t));
+	}
+	for(size_t c = 0; c < out.columns.size(); c++){
+		const double* column = &values[columns[c] * capacity];
+		out.columns[c].resize(count);
+		std::memcpy(&out.columns[c][0], column + slot, head * sizeof(double));
+		if(tail){
+			std::memcpy(&out.columns[c][head], column, tail * sizeof(double));
+		}
+	}
+}
+
+bool ModuleHistory::snapshot(int64_t sinceUs, const std::vector<FeedbackField>& requested, HistorySnapshot& out) const{
+	int columns[FieldCount];
+	if(requested.size() > (size_t)FieldCount){
+		return false;
+	}
+	for(size_t i = 0; i < requested.size(); i++){
+		columns[i] = columnOf[requested[i]];
+		if(columns[i] < 0){
+			return false;
+		}
+	}
+	out.columns.resize(requested.size());
+
+	uint64_t end = published.load(std::memory_order_acquire);
+	uint64_t begin = end > capacity ? end - capacity : 0;
+	begin = firstAtOrAfter(begin, end, sinceUs);
+	if(begin < end){
+		copyRange(begin, end, columns, out);
+	}
+	else{
+		out.timestamps.clear();
+		for(size_t c = 0; c < out.columns.size(); c++){
+			out.columns[c].clear();
+		}
+	}
+
+	//anything the writer may have overwritten while we copied is dropped from the front
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t writer = writing.load(std::memory_order_relaxed);
+	uint64_t valid = writer > capacity ? writer - capacity : 0;
+	if(valid > begin && begin < end){
+		size_t drop = (size_t)(valid - begin) < out.size() ? (size_t)(valid - begin) : out.size();
+		out.timestamps.erase(out.timestamps.begin(), out.timestamps.begin() + drop);
+		for(size_t c = 0; c < out.columns.size(); c++){
+			out.columns[c].erase(out.columns[c].begin(), out.columns[c].begin() + drop);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,55 @@
+#ifndef HISTORYRING_H
+#define HISTORYRING_H
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+#include "FeedBackManager.h"
+
+//how much recent feedback the cache keeps; memory is fixed when a module is first seen
+struct HistoryConfig{
+	int64_t windowUs;                  //the "last N seconds"
+	double maxRateHz;                  //highest feedback rate that must fit in the window
+	size_t maxModules;                 //modules past this get no history
+	std::vector<FeedbackField> fields; //one ring per field, sharing the timestamp ring
+
+	HistoryConfig();
+	size_t capacity() const; //samples per module
+	size_t bytesPerModule() const;
+};
+
+//copy of a module's recent history; reuse one to keep reads allocation-free
+struct HistorySnapshot{
+	std::vector<int64_t> timestamps;
+	std::vector<std::vector<double> > columns; //one per requested field, contiguous, oldest first
+
+	size_t size() const { return timestamps.size(); }
+};
+
+//time-indexed ring of one module's feedback
+//single writer (the feedback thread of the group owning the module), any number of readers;
+//appends never wait and readers never block the writer
+class ModuleHistory
+{
+public:
+	ModuleHistory(size_t capacity, const std::vector<FeedbackField>& fields);
+	void append(int64_t timestampUs, const FeedbackSample& sample);
+	//samples with timestamp >= sinceUs; false if a requested field is not kept
+	bool snapshot(int64_t sinceUs, const std::vector<FeedbackField>& fields, HistorySnapshot& out) const;
+private:
+	size_t firstAtOrAfter(uint64_t begin, uint64_t end, int64_t sinceUs) const;
+	void copyRange(uint64_t begin, uint64_t end, const int* columns, HistorySnapshot& out) const;
+
+	const size_t capacity;
+	std::vector<FeedbackField> fields;
+	int columnOf[FieldCount]; //-1 if the field is not kept
+	std::vector<int64_t> timestamps;
+	std::vector<double> values; //column-major, capacity per kept field
+	std::atomic<uint64_t> writing;   //index of the sample being written, seqlock style
+	std::atomic<uint64_t> published; //samples fully written
+
+	ModuleHistory(const ModuleHistory&);
+	ModuleHistory& operator=(const ModuleHistory&);
+};
+
+#endif
@@ -0,0 +1,483 @@
+#include <algorithm>
+#include <cstring>
+#include "JsonWriter.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+//shortest round-trip formatting with Grisu2 (Loitsch, "Printing floating-point numbers quickly and accurately").
+//it finds the shortest digits inside the rounding interval of the value; the interval is taken from the
+//precision the value was stored with, so a float gets float digits and a double double digits
+
+//10^K as a normalized 64 bit significand and binary exponent, K = -348 + 8 * i
+const uint64_t CACHED_POWER_F[] = {
+	0xFA8FD5A0081C0288ULL, 0xBAAEE17FA23EBF76ULL, 0x8B16FB203055AC76ULL, 0xCF42894A5DCE35EAULL,
+	0x9A6BB0AA55653B2DULL, 0xE61ACF033D1A45DFULL, 0xAB70FE17C79AC6CAULL, 0xFF77B1FCBEBCDC4FULL,
+	0xBE5691EF416BD60CULL, 0x8DD01FAD907FFC3CULL, 0xD3515C2831559A83ULL, 0x9D71AC8FADA6C9B5ULL,
+	0xEA9C227723EE8BCBULL, 0xAECC49914078536DULL, 0x823C12795DB6CE57ULL, 0xC21094364DFB5637ULL,
+	0x9096EA6F3848984FULL, 0xD77485CB25823AC7ULL, 0xA086CFCD97BF97F4ULL, 0xEF340A98172AACE5ULL,
+	0xB23867FB2A35B28EULL, 0x84C8D4DFD2C63F3BULL, 0xC5DD44271AD3CDBAULL, 0x936B9FCEBB25C996ULL,
+	0xDBAC6C247D62A584ULL, 0xA3AB66580D5FDAF6ULL, 0xF3E2F893DEC3F126ULL, 0xB5B5ADA8AAFF80B8ULL,
+	0x87625F056C7C4A8BULL, 0xC9BCFF6034C13053ULL, 0x964E858C91BA2655ULL, 0xDFF9772470297EBDULL,
+	0xA6DFBD9FB8E5B88FULL, 0xF8A95FCF88747D94ULL, 0xB94470938FA89BCFULL, 0x8A08F0F8BF0F156BULL,
+	0xCDB02555653131B6ULL, 0x993FE2C6D07B7FACULL, 0xE45C10C42A2B3B06ULL, 0xAA242499697392D3ULL,
+	0xFD87B5F28300CA0EULL, 0xBCE5086492111AEBULL, 0x8CBCCC096F5088CCULL, 0xD1B71758E219652CULL,
+	0x9C40000000000000ULL, 0xE8D4A51000000000ULL, 0xAD78EBC5AC620000ULL, 0x813F3978F8940984ULL,
+	0xC097CE7BC90715B3ULL, 0x8F7E32CE7BEA5C70ULL, 0xD5D238A4ABE98068ULL, 0x9F4F2726179A2245ULL,
+	0xED63A231D4C4FB27ULL, 0xB0DE65388CC8ADA8ULL, 0x83C7088E1AAB65DBULL, 0xC45D1DF942711D9AULL,
+	0x924D692CA61BE758ULL, 0xDA01EE641A708DEAULL, 0xA26DA3999AEF774AULL, 0xF209787BB47D6B85ULL,
+	0xB454E4A179DD1877ULL, 0x865B86925B9BC5C2ULL, 0xC83553C5C8965D3DULL, 0x952AB45CFA97A0B3ULL,
+	0xDE469FBD99A05FE3ULL, 0xA59BC234DB398C25ULL, 0xF6C69A72A3989F5CULL, 0xB7DCBF5354E9BECEULL,
+	0x88FCF317F22241E2ULL, 0xCC20CE9BD35C78A5ULL, 0x98165AF37B2153DFULL, 0xE2A0B5DC971F303AULL,
+	0xA8D9D1535CE3B396ULL, 0xFB9B7CD9A4A7443CULL, 0xBB764C4CA7A44410ULL, 0x8BAB8EEFB6409C1AULL,
+	0xD01FEF10A657842CULL, 0x9B10A4E5E9913129ULL, 0xE7109BFBA19C0C9DULL, 0xAC2820D9623BF429ULL,
+	0x80444B5E7AA7CF85ULL, 0xBF21E44003ACDD2DULL, 0x8E679C2F5E44FF8FULL, 0xD433179D9C8CB841ULL,
+	0x9E19DB92B4E31BA9ULL, 0xEB96BF6EBADF77D9ULL, 0xAF87023B9BF0EE6BULL
+};
+const int16_t CACHED_POWER_E[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+	-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+	-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+	-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+	56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+	694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+	1013, 1039, 1066
+};
+
+const uint64_t POW10[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+	1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+	1000000000000000000ULL, 10000000000000000000ULL
+};
+
+//x != 0
+inline int leadingZeros(uint64_t x){
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanReverse64(&index, x);
+	return 63 - (int)index;
+#elif defined(__GNUC__)
+	return __builtin_clzll(x);
+#else
+	int n = 0;
+	while(!(x & (1ULL << 63))){
+		x <<= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+//f * 2^e without rounding, the "do-it-yourself floating point" of the paper
+struct DiyFp{
+	uint64_t f;
+	int e;
+
+	DiyFp() : f(0), e(0) {}
+	DiyFp(uint64_t f, int e) : f(f), e(e) {}
+
+	//upper 64 bits of the 128 bit product, rounded
+	DiyFp operator*(const DiyFp& rhs) const{
+		const uint64_t M32 = 0xFFFFFFFFULL;
+		uint64_t a = f >> 32, b = f & M32, c = rhs.f >> 32, d = rhs.f & M32;
+		uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+		uint64_t middle = (bd >> 32) + (ad & M32) + (bc & M32) + (1ULL << 31);
+		return DiyFp(ac + (ad >> 32) + (bc >> 32) + (middle >> 32), e + rhs.e + 64);
+	}
+
+	DiyFp normalize() const{
+		int shift = leadingZeros(f);
+		return DiyFp(f << shift, e - shift);
+	}
+};
+
+DiyFp cachedPower(int e, int* K){
+	//the power that brings a product with exponent e into [-60, -32]
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = (int)dk;
+	if(dk - k > 0.0){
+		k++;
+	}
+	unsigned index = (unsigned)((k >> 3) + 1);
+	*K = -(-348 + (int)(index << 3));
+	return DiyFp(CACHED_POWER_F[index], CACHED_POWER_E[index]);
+}
+
+int decimalDigits(uint32_t n){
+	if(n < 10) return 1;
+	if(n < 100) return 2;
+	if(n < 1000) return 3;
+	if(n < 10000) return 4;
+	if(n < 100000) return 5;
+	if(n < 1000000) return 6;
+	if(n < 10000000) return 7;
+	if(n < 100000000) return 8;
+	return 9;
+}
+
+//moves the last digit down while that brings it closer to the value and stays inside the interval
+void round(char* digits, int length, uint64_t delta, uint64_t rest, uint64_t tenKappa, uint64_t distance){
+	while(rest < distance && delta - rest >= tenKappa &&
+		(rest + tenKappa < distance || distance - rest > rest + tenKappa - distance))
+	{
+		digits[length - 1]--;
+		rest += tenKappa;
+	}
+}
+
+//the digits of the scaled upper bound, as few as keep the result inside the interval of width delta
+void generate(const DiyFp& w, const DiyFp& upper, uint64_t delta, char* digits, int* length, int* K){
+	const DiyFp one(1ULL << -upper.e, upper.e);
+	const uint64_t distance = upper.f - w.f;
+	uint32_t p1 = (uint32_t)(upper.f >> -one.e);
+	uint64_t p2 = upper.f & (one.f - 1);
+	int kappa = decimalDigits(p1);
+	*length = 0;
+	while(kappa > 0){
+		//constant divisors, the compiler turns them into multiplications
+		uint32_t d;
+		switch(kappa){
+		case 9: d = p1 / 100000000; p1 %= 100000000; break;
+		case 8: d = p1 / 10000000; p1 %= 10000000; break;
+		case 7: d = p1 / 1000000; p1 %= 1000000; break;
+		case 6: d = p1 / 100000; p1 %= 100000; break;
+		case 5: d = p1 / 10000; p1 %= 10000; break;
+		case 4: d = p1 / 1000; p1 %= 1000; break;
+		case 3: d = p1 / 100; p1 %= 100; break;
+		case 2: d = p1 / 10; p1 %= 10; break;
+		default: d = p1; p1 = 0; break;
+		}
+		if(d || *length){
+			digits[(*length)++] = (char)('0' + d);
+		}
+		kappa--;
+		uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+		if(rest <= delta){
+			*K += kappa;
+			round(digits, *length, delta, rest, POW10[kappa] << -one.e, distance);
+			return;
+		}
+	}
+	for(;;){
+		p2 *= 10;
+		delta *= 10;
+		char d = (char)(p2 >> -one.e);
+		if(d || *length){
+			digits[(*length)++] = (char)('0' + d);
+		}
+		p2 &= one.f - 1;
+		kappa--;
+		if(p2 < delta){
+			*K += kappa;
+			int index = -kappa;
+			round(digits, *length, delta, p2, one.f, distance * (index < 20 ? POW10[index] : 0));
+			return;
+		}
+	}
+}
+
+char* writeExponent(int K, char* out){
+	if(K < 0){
+		*out++ = '-';
+		K = -K;
+	}
+	if(K >= 100){
+		*out++ = (char)('0' + K / 100);
+		K %= 100;
+		*out++ = (char)('0' + K / 10);
+		*out++ = (char)('0' + K % 10);
+	}
+	else if(K >= 10){
+		*out++ = (char)('0' + K / 10);
+		*out++ = (char)('0' + K % 10);
+	}
+	else{
+		*out++ = (char)('0' + K);
+	}
+	return out;
+}
+
+//digits * 10^k as a json number: plain up to 21 integer digits and down to 1e-6, otherwise with an exponent
+char* place(char* digits, int length, int k){
+	const int kk = length + k; //10^(kk-1) <= v < 10^kk
+	if(k >= 0 && kk <= 21){
+		for(int i = length; i < kk; i++){
+			digits[i] = '0';
+		}
+		return digits + kk;
+	}
+	if(kk > 0 && kk <= 21){
+		std::memmove(digits + kk + 1, digits + kk, (size_t)(length - kk));
+		digits[kk] = '.';
+		return digits + length + 1;
+	}
+	if(kk > -6 && kk <= 0){
+		const int offset = 2 - kk;
+		std::memmove(digits + offset, digits, (size_t)length);
+		digits[0] = '0';
+		digits[1] = '.';
+		for(int i = 2; i < offset; i++){
+			digits[i] = '0';
+		}
+		return digits + length + offset;
+	}
+	if(length == 1){
+		digits[1] = 'e';
+		return writeExponent(kk - 1, digits + 2);
+	}
+	std::memmove(digits + 2, digits + 1, (size_t)(length - 1));
+	digits[1] = '.';
+	digits[length + 1] = 'e';
+	return writeExponent(kk - 1, digits + length + 2);
+}
+
+//f * 2^e with a significandBits wide stored significand (23 or 52); f != 0
+size_t shortest(uint64_t f, int e, int significandBits, bool negative, char* out){
+	const uint64_t hidden = 1ULL << significandBits;
+	//the interval of values that read back as this one: halfway to each neighbour
+	const DiyFp upper = DiyFp((f << 1) + 1, e - 1).normalize();
+	//the gap below a power of two is half as wide
+	DiyFp lower = f == hidden ? DiyFp((f << 2) - 1, e - 2) : DiyFp((f << 1) - 1, e - 1);
+	lower.f <<= lower.e - upper.e;
+	lower.e = upper.e;
+
+	int K;
+	const DiyFp power = cachedPower(upper.e, &K);
+	const DiyFp w = DiyFp(f, e).normalize() * power;
+	DiyFp high = upper * power;
+	DiyFp low = lower * power;
+	low.f++;
+	high.f--;
+
+	char buffer[32];
+	char* digits = buffer;
+	if(negative){
+		*digits++ = '-';
+	}
+	int length;
+	generate(w, high, high.f - low.f, digits, &length, &K);
+	char* end = place(digits, length, K);
+	size_t size = (size_t)(end - buffer);
+	std::memcpy(out, buffer, size);
+	return size;
+}
+
+const char HEX[] = "0123456789abcdef";
+
+}
+
+JsonKey::JsonKey(const char* name){
+	size_t size = std::strlen(name);
+	if(size > MAX_NAME){
+		size = MAX_NAME;
+	}
+	token[0] = '"';
+	std::memcpy(token + 1, name, size);
+	token[size + 1] = '"';
+	token[size + 2] = ':';
+	token[size + 3] = '\0';
+	length = size + 3;
+}
+
+size_t JsonWriter::formatDouble(double value, char* out){
+	uint64_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	bool negative = (bits >> 63) != 0;
+	int biased = (int)((bits >> 52) & 0x7FF);
+	uint64_t significand = bits & ((1ULL << 52) - 1);
+	if(biased == 0x7FF){
+		std::memcpy(out, "null", 4);
+		return 4;
+	}
+	if(biased == 0 && significand == 0){
+		out[0] = '0';
+		return 1;
+	}
+	if(biased){
+		return shortest(significand | (1ULL << 52), biased - 1075, 52, negative, out);
+	}
+	return shortest(significand, -1074, 52, negative, out);
+}
+
+size_t JsonWriter::formatFloat(float value, char* out){
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	bool negative = (bits >> 31) != 0;
+	int biased = (int)((bits >> 23) & 0xFF);
+	uint32_t significand = bits & ((1u << 23) - 1);
+	if(biased == 0xFF){
+		std::memcpy(out, "null", 4);
+		return 4;
+	}
+	if(biased == 0 && significand == 0){
+		out[0] = '0';
+		return 1;
+	}
+	if(biased){
+		return shortest(significand | (1u << 23), biased - 150, 23, negative, out);
+	}
+	return shortest(significand, -149, 23, negative, out);
+}
+
+JsonWriter::JsonWriter(std::string& out)
+	: out(out), used(out.size()), comma(false)
+{
+}
+
+void JsonWriter::clear(){
+	used = 0;
+	comma = false;
+}
+
+void JsonWriter::finish(){
+	out.resize(used);
+}
+
+char* JsonWriter::reserve(size_t size){
+	if(used + size > out.size()){
+		//resize within the capacity does not allocate; past it the buffer doubles
+		out.resize(std::max(std::max(used + size, out.capacity()), 2 * out.size()));
+	}
+	return &out[used];
+}
+
+void JsonWriter::separate(){
+	if(comma){
+		*reserve(1) = ',';
+		used++;
+	}
+}
+
+void JsonWriter::beginObject(){
+	separate();
+	*reserve(1) = '{';
+	used++;
+	comma = false;
+}
+
+void JsonWriter::endObject(){
+	*reserve(1) = '}';
+	used++;
+	comma = true;
+}
+
+void JsonWriter::beginArray(){
+	separate();
+	*reserve(1) = '[';
+	used++;
+	comma = false;
+}
+
+void JsonWriter::endArray(){
+	*reserve(1) = ']';
+	used++;
+	comma = true;
+}
+
+void JsonWriter::key(const JsonKey& key){
+	separate();
+	std::memcpy(reserve(key.size()), key.text(), key.size());
+	used += key.size();
+	comma = false;
+}
+
+void JsonWriter::key(const char* name, size_t length){
+	string(name, length);
+	*reserve(1) = ':';
+	used++;
+	comma = false;
+}
+
+void JsonWriter::number(double value){
+	separate();
+	char* p = reserve(32);
+	//feedback arrives as float: print the float digits when the double holds one exactly
+	float narrow = (float)value;
+	if((double)narrow == value){
+		used += formatFloat(narrow, p);
+	}
+	else{
+		used += formatDouble(value, p);
+	}
+	comma = true;
+}
+
+void JsonWriter::integer(int64_t value){
+	separate();
+	char* p = reserve(24);
+	uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+	if(value < 0){
+		*p++ = '-';
+		used++;
+	}
+	char digits[20];
+	size_t count = 0;
+	do{
+		digits[count++] = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	} while(magnitude);
+	for(size_t i = 0; i < count; i++){
+		p[i] = digits[count - 1 - i];
+	}
+	used += count;
+	comma = true;
+}
+
+void JsonWriter::boolean(bool value){
+	raw(value ? "true" : "false", value ? 4 : 5);
+}
+
+void JsonWriter::null(){
+	raw("null", 4);
+}
+
+void JsonWriter::string(const char* text, size_t length){
+	separate();
+	char* p = reserve(2 + 6 * length);
+	char* start = p;
+	*p++ = '"';
+	for(size_t i = 0; i < length; i++){
+		unsigned char c = (unsigned char)text[i];
+		if(c == '"' || c == '\\'){
+			*p++ = '\\';
+			*p++ = (char)c;
+		}
+		else if(c < 0x20){
+			*p++ = '\\';
+			*p++ = 'u';
+			*p++ = '0';
+			*p++ = '0';
+			*p++ = HEX[c >> 4];
+			*p++ = HEX[c & 15];
+		}
+		else{
+			*p++ = (char)c;
+		}
+	}
+	*p++ = '"';
+	used += (size_t)(p - start);
+	comma = true;
+}
+
+void JsonWriter::raw(const char* text, size_t length){
+	separate();
+	std::memcpy(reserve(length), text, length);
+	used += length;
+	comma = true;
+}
+
+JsonWriter::Mark JsonWriter::mark() const{
+	Mark mark;
+	mark.used = used;
+	mark.comma = comma;
+	return mark;
+}
+
+void JsonWriter::rewind(const Mark& mark){
+	used = mark.used;
+	comma = mark.comma;
+}
@@ -0,0 +1,68 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+#include <stdint.h>
+#include <string>
+
+//an object key with its quotes and colon already in place, built once: "\"name\":"
+class JsonKey
+{
+public:
+	explicit JsonKey(const char* name);
+	const char* text() const { return token; }
+	size_t size() const { return length; }
+private:
+	static const size_t MAX_NAME = 60;
+	char token[MAX_NAME + 4];
+	size_t length;
+};
+
+//streaming json into a caller-owned std::string; clear() keeps its capacity, so once the buffer
+//has grown to the largest document nothing allocates. commas are placed by the writer.
+//the string holds spare bytes past size() while writing: call finish() before using it
+//numbers are written in the shortest form that reads back to the same value: a double that is
+//exactly a float (every hebi feedback field) is written as the shortest float, e.g. 0.1 not 0.100000001
+class JsonWriter
+{
+public:
+	explicit JsonWriter(std::string& out); //appends to what out already holds
+	void clear();  //starts a new document in the same buffer
+	void finish(); //trims the buffer to what was written; the writer may go on afterwards
+	size_t size() const { return used; }
+
+	void beginObject();
+	void endObject();
+	void beginArray();
+	void endArray();
+	void key(const JsonKey& key);
+	void key(const char* name, size_t length); //escaped like a string
+	void number(double value);    //NaN and infinities are null
+	void integer(int64_t value);
+	void boolean(bool value);
+	void null();
+	void string(const char* text, size_t length);
+	void raw(const char* text, size_t length); //already valid json, e.g. a cached fragment
+
+	//where an optional member starts, to drop it again if it turned out empty
+	struct Mark{
+		size_t used;
+		bool comma;
+	};
+	Mark mark() const;
+	void rewind(const Mark& mark);
+
+	//writes the shortest round-trip digits of value to out, no terminator; returns the length (at most 25)
+	static size_t formatDouble(double value, char* out);
+	static size_t formatFloat(float value, char* out);
+private:
+	char* reserve(size_t size);
+	void separate();
+
+	std::string& out;
+	size_t used;
+	bool comma; //a value was written at this level, the next one needs a comma
+
+	JsonWriter(const JsonWriter&);
+	JsonWriter& operator=(const JsonWriter&);
+};
+
+#endif
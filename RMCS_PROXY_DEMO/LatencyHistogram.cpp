@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <limits>
+#include "LatencyHistogram.h"
+
+static int highestBit(uint64_t value){
+	int bit = 0;
+	while(value >>= 1){
+		bit++;
+	}
+	return bit;
+}
+
+LatencyHistogram::LatencyHistogram(int64_t maxValue)
+	: maxValue(maxValue > SUB_BUCKET_MASK ? maxValue : SUB_BUCKET_MASK)
+{
+	counts.resize(indexOf(this->maxValue) + 1);
+	reset();
+}
+
+size_t LatencyHistogram::indexOf(int64_t value) const{
+	//bucket b holds [2048 << (b - 1), 2048 << b) at a resolution of 1 << b
+	int bucket = highestBit((uint64_t)(value | SUB_BUCKET_MASK)) - SUB_BUCKET_HALF_MAGNITUDE;
+	int64_t subBucket = value >> bucket;
+	return (size_t)(((int64_t)bucket << SUB_BUCKET_HALF_MAGNITUDE) + subBucket);
+}
+
+int64_t LatencyHistogram::valueAt(size_t index) const{
+	int64_t bucket = (int64_t)(index >> SUB_BUCKET_HALF_MAGNITUDE) - 1;
+	int64_t subBucket = (int64_t)(index & (SUB_BUCKET_HALF_COUNT - 1)) + SUB_BUCKET_HALF_COUNT;
+	if(bucket < 0){
+		subBucket -= SUB_BUCKET_HALF_COUNT;
+		bucket = 0;
+	}
+	return subBucket << bucket;
+}
+
+int64_t LatencyHistogram::highestEquivalent(int64_t value) const{
+	int bucket = highestBit((uint64_t)(value | SUB_BUCKET_MASK)) - SUB_BUCKET_HALF_MAGNITUDE;
+	return value + ((int64_t)1 << bucket) - 1;
+}
+
+void LatencyHistogram::record(int64_t value){
+	if(value < 0){
+		value = 0;
+	}
+	else if(value > maxValue){
+		value = maxValue;
+	}
+	counts[indexOf(value)]++;
+	total++;
+	sum += (double)value;
+	if(value < minRecorded){
+		minRecorded = value;
+	}
+	if(value > maxRecorded){
+		maxRecorded = value;
+	}
+}
+
+void LatencyHistogram::add(const LatencyHistogram& other){
+	for(size_t i = 0; i < other.counts.size(); i++){
+		if(other.counts[i]){
+			counts[indexOf(other.valueAt(i) < maxValue ? other.valueAt(i) : maxValue)] += other.counts[i];
+		}
+	}
+	total += other.total;
+	sum += other.sum;
+	if(other.total && other.minRecorded < minRecorded){
+		minRecorded = other.minRecorded;
+	}
+	if(other.maxRecorded > maxRecorded){
+		maxRecorded = other.maxRecorded;
+	}
+}
+
+void LatencyHistogram::reset(){
+	for(size_t i = 0; i < counts.size(); i++){
+		counts[i] = 0;
+	}
+	total = 0;
+	sum = 0;
+	minRecorded = std::numeric_limits<int64_t>::max();
+	maxRecorded = 0;
+}
+
+int64_t LatencyHistogram::min() const{
+	return total ? minRecorded : 0;
+}
+
+double LatencyHistogram::mean() const{
+	return total ? sum / (double)total : 0.0;
+}
+
+int64_t LatencyHistogram::percentile(double percent) const{
+	if(total == 0){
+		return 0;
+	}
+	if(percent >= 100.0){
+		return maxRecorded;
+	}
+	uint64_t wanted = (uint64_t)(percent / 100.0 * (double)total + 0.5);
+	if(wanted < 1){
+		wanted = 1;
+	}
+	uint64_t seen = 0;
+	for(size_t i = 0; i < counts.size(); i++){
+		seen += counts[i];
+		if(seen >= wanted){
+			int64_t value = highestEquivalent(valueAt(i));
+			return value < maxRecorded ? value : maxRecorded;
+		}
+	}
+	return maxRecorded;
+}
+
+std::string LatencyHistogram::toJson() const{
+	char text[256];
+	std::snprintf(text, sizeof(text),
+		"{\"count\":%llu,\"mean\":%.1f,\"p50\":%lld,\"p90\":%lld,\"p99\":%lld,\"p999\":%lld,\"max\":%lld}",
+		(unsigned long long)total, mean(), (long long)percentile(50), (long long)percentile(90),
+		(long long)percentile(99), (long long)percentile(99.9), (long long)maxRecorded);
+	return text;
+}
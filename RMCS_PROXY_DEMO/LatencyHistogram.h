@@ -0,0 +1,40 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//HDR-style histogram: constant relative precision (3 significant digits) from 1 up to maxValue
+//record() is a couple of shifts and an increment; not thread safe, merge per-thread copies with add()
+class LatencyHistogram
+{
+public:
+	explicit LatencyHistogram(int64_t maxValue = 3600LL * 1000000); //one hour in microseconds
+	void record(int64_t value);   //negative values count as 0, values past maxValue as maxValue
+	void add(const LatencyHistogram& other);
+	void reset();
+	uint64_t count() const { return total; }
+	int64_t min() const;
+	int64_t max() const { return maxRecorded; }
+	double mean() const;
+	int64_t percentile(double percent) const; //highest value equivalent to the given percentile, 0..100
+	//{"count":..,"mean":..,"p50":..,"p90":..,"p99":..,"p999":..,"max":..}
+	std::string toJson() const;
+private:
+	size_t indexOf(int64_t value) const;
+	int64_t valueAt(size_t index) const;
+	int64_t highestEquivalent(int64_t value) const;
+
+	static const int SUB_BUCKET_HALF_MAGNITUDE = 10; //2048 sub-buckets: 3 significant digits
+	static const int64_t SUB_BUCKET_HALF_COUNT = 1 << SUB_BUCKET_HALF_MAGNITUDE;
+	static const int64_t SUB_BUCKET_MASK = (SUB_BUCKET_HALF_COUNT << 1) - 1;
+
+	int64_t maxValue;
+	std::vector<uint64_t> counts;
+	uint64_t total;
+	int64_t minRecorded;
+	int64_t maxRecorded;
+	double sum;
+};
+
+#endif
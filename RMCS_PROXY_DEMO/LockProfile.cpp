@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <vector>
+#include "LockProfile.h"
+#include "Metrics.h"
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define LOCK_THREAD_LOCAL __declspec(thread)
+#else
+#define LOCK_THREAD_LOCAL thread_local
+#endif
+
+const int LOCK_SITES = 16;
+const int LOCK_TOP_SITES = 5;
+
+struct LockSiteStats{
+	std::atomic<const char*> site; //"file:line" literal, NULL while the slot is free
+	std::atomic<uint64_t> contended;
+	std::atomic<uint64_t> waitNs;
+};
+
+//shared by every mutex of the same name, e.g. all ThreadPool::taskLock instances
+struct LockStats{
+	std::string name;
+	std::atomic<uint64_t> acquisitions;
+	std::atomic<uint64_t> contended;
+	std::atomic<uint64_t> waitNs;
+	std::atomic<uint64_t> holdNs;
+	std::atomic<uint64_t> waitBuckets[METRIC_BUCKETS];
+	std::atomic<uint64_t> holdBuckets[METRIC_BUCKETS];
+	LockSiteStats sites[LOCK_SITES];
+
+	explicit LockStats(const std::string& name) : name(name), acquisitions(0), contended(0), waitNs(0), holdNs(0){
+		for(int b = 0; b < METRIC_BUCKETS; b++){
+			waitBuckets[b].store(0, std::memory_order_relaxed);
+			holdBuckets[b].store(0, std::memory_order_relaxed);
+		}
+		for(int s = 0; s < LOCK_SITES; s++){
+			sites[s].site.store(NULL, std::memory_order_relaxed);
+			sites[s].contended.store(0, std::memory_order_relaxed);
+			sites[s].waitNs.store(0, std::memory_order_relaxed);
+		}
+	}
+};
+
+namespace {
+
+struct PendingSite{
+	const char* file;
+	const char* expression;
+	const char* site;
+};
+
+LOCK_THREAD_LOCAL PendingSite pending = {NULL, NULL, NULL};
+
+//stats are never freed, so a lock that comes and goes (ParallelForState) keeps adding to the same entry
+std::mutex registryLock;
+std::map<std::string, LockStats*>& registry(){
+	static std::map<std::string, LockStats*> stats;
+	return stats;
+}
+
+const char* baseName(const char* path){
+	const char* base = path;
+	for(const char* c = path; *c; c++){
+		if(*c == '/' || *c == '\\'){
+			base = c + 1;
+		}
+	}
+	return base;
+}
+
+//"CommandCustomer::queueLock" for queueLock taken in CommandCustomer.cpp
+LockStats* statsFor(const char* file, const char* expression){
+	std::string name = "unnamed";
+	if(file && expression){
+		name = baseName(file);
+		size_t dot = name.rfind('.');
+		if(dot != std::string::npos){
+			name.erase(dot);
+		}
+		name += "::";
+		name += expression;
+	}
+	std::lock_guard<std::mutex> lock(registryLock);
+	LockStats*& stats = registry()[name];
+	if(!stats){
+		stats = new LockStats(name);
+	}
+	return stats;
+}
+
+void recordSite(LockStats& stats, const char* site, uint64_t waitNs){
+	if(!site){
+		site = "unknown";
+	}
+	for(int s = 0; s < LOCK_SITES; s++){
+		const char* current = stats.sites[s].site.load(std::memory_order_acquire);
+		if(!current){
+			const char* expected = NULL;
+			if(stats.sites[s].site.compare_exchange_strong(expected, site)){
+				current = site;
+			}
+			else{
+				current = expected;
+			}
+		}
+		if(current == site || std::strcmp(current, site) == 0){
+			stats.sites[s].contended.fetch_add(1, std::memory_order_relaxed);
+			stats.sites[s].waitNs.fetch_add(waitNs, std::memory_order_relaxed);
+			return;
+		}
+	}
+}
+
+void fillSummary(const std::atomic<uint64_t>* buckets, uint64_t sumNs, MetricSummary& out){
+	std::memset(&out, 0, sizeof(out));
+	out.sumNs = sumNs;
+	for(int b = 0; b < METRIC_BUCKETS; b++){
+		out.buckets[b] = buckets[b].load(std::memory_order_relaxed);
+		out.count += out.buckets[b];
+	}
+}
+
+struct SiteTotal{
+	const char* site;
+	uint64_t contended;
+	uint64_t waitNs;
+
+	bool operator<(const SiteTotal& other) const { return waitNs > other.waitNs; }
+};
+
+}
+
+ProfiledMutex::ProfiledMutex()
+	: stats(NULL), lockedNs(0)
+{
+}
+
+ProfiledMutex::~ProfiledMutex(){
+}
+
+ProfiledMutex& ProfiledMutex::at(ProfiledMutex& mutex, const char* file, const char* expression, const char* site){
+	pending.file = file;
+	pending.expression = expression;
+	pending.site = site;
+	return mutex;
+}
+
+void ProfiledMutex::lock(){
+	if(mutex.try_lock()){
+		acquired(0, 0);
+		return;
+	}
+	int64_t start = Metrics::nowNs();
+	mutex.lock();
+	acquired(start, Metrics::nowNs());
+}
+
+bool ProfiledMutex::try_lock(){
+	if(!mutex.try_lock()){
+		return false;
+	}
+	acquired(0, 0);
+	return true;
+}
+
+//startNs is 0 when the lock was free; the stats are only written while holding the mutex
+void ProfiledMutex::acquired(int64_t startNs, int64_t nowNs){
+	PendingSite site = pending;
+	pending.site = NULL;
+	if(!stats){
+		stats = statsFor(site.site ? site.file : NULL, site.site ? site.expression : NULL);
+	}
+	uint64_t waitNs = startNs ? (uint64_t)(nowNs - startNs) : 0;
+	stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+	stats->waitBuckets[Metrics::bucketOf((int64_t)waitNs)].fetch_add(1, std::memory_order_relaxed);
+	if(startNs){
+		stats->contended.fetch_add(1, std::memory_order_relaxed);
+		stats->waitNs.fetch_add(waitNs, std::memory_order_relaxed);
+		recordSite(*stats, site.site, waitNs);
+	}
+	lockedNs = startNs ? nowNs : Metrics::nowNs();
+}
+
+void ProfiledMutex::unlock(){
+	int64_t heldNs = Metrics::nowNs() - lockedNs;
+	stats->holdNs.fetch_add((uint64_t)heldNs, std::memory_order_relaxed);
+	stats->holdBuckets[Metrics::bucketOf(heldNs)].fetch_add(1, std::memory_order_relaxed);
+	mutex.unlock();
+}
+
+std::string ProfiledMutex::scrape(){
+	std::vector<LockStats*> locks;
+	{
+		std::lock_guard<std::mutex> lock(registryLock);
+		std::map<std::string, LockStats*>::const_iterator it;
+		for(it = registry().begin(); it != registry().end(); ++it){
+			locks.push_back(it->second);
+		}
+	}
+	std::string text;
+	if(locks.empty()){
+		return text;
+	}
+	MetricSummary summaryOf;
+	text += "# TYPE rmcs_lock_wait_seconds summary\n";
+	for(size_t l = 0; l < locks.size(); l++){
+		fillSummary(locks[l]->waitBuckets, locks[l]->waitNs.load(std::memory_order_relaxed), summaryOf);
+		Metrics::appendSummary(text, "rmcs_lock_wait_seconds", "lock=\"" + locks[l]->name + "\"", summaryOf);
+	}
+	text += "# TYPE rmcs_lock_hold_seconds summary\n";
+	for(size_t l = 0; l < locks.size(); l++){
+		fillSummary(locks[l]->holdBuckets, locks[l]->holdNs.load(std::memory_order_relaxed), summaryOf);
+		Metrics::appendSummary(text, "rmcs_lock_hold_seconds", "lock=\"" + locks[l]->name + "\"", summaryOf);
+	}
+	char line[256];
+	text += "# TYPE rmcs_lock_contended_total counter\n";
+	for(size_t l = 0; l < locks.size(); l++){
+		std::snprintf(line, sizeof(line), "rmcs_lock_contended_total{lock=\"%s\"} %llu\n",
+			locks[l]->name.c_str(), (unsigned long long)locks[l]->contended.load(std::memory_order_relaxed));
+		text += line;
+	}
+	//top sites by total wait; a relock at the end of a condition wait has no site and shows as "unknown"
+	std::string siteWaits = "# TYPE rmcs_lock_site_wait_seconds_total counter\n";
+	std::string siteCounts = "# TYPE rmcs_lock_site_contended_total counter\n";
+	for(size_t l = 0; l < locks.size(); l++){
+		std::vector<SiteTotal> sites;
+		for(int s = 0; s < LOCK_SITES; s++){
+			SiteTotal total;
+			total.site = locks[l]->sites[s].site.load(std::memory_order_acquire);
+			if(!total.site){
+				break;
+			}
+			total.contended = locks[l]->sites[s].contended.load(std::memory_order_relaxed);
+			total.waitNs = locks[l]->sites[s].waitNs.load(std::memory_order_relaxed);
+			sites.push_back(total);
+		}
+		std::sort(sites.begin(), sites.end());
+		for(size_t s = 0; s < sites.size() && s < (size_t)LOCK_TOP_SITES; s++){
+			std::snprintf(line, sizeof(line), "{lock=\"%s\",site=\"%s\"} ", locks[l]->name.c_str(), baseName(sites[s].site));
+			std::string labels = line;
+			std::snprintf(line, sizeof(line), "%.9f\n", sites[s].waitNs * 1e-9);
+			siteWaits += "rmcs_lock_site_wait_seconds_total" + labels + line;
+			std::snprintf(line, sizeof(line), "%llu\n", (unsigned long long)sites[s].contended);
+			siteCounts += "rmcs_lock_site_contended_total" + labels + line;
+		}
+	}
+	text += siteWaits;
+	text += siteCounts;
+	return text;
+}
@@ -0,0 +1,50 @@
+#ifndef LOCKPROFILE_H
+#define LOCKPROFILE_H
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+//contention profile of the proxy locks: acquire wait and hold time histograms per lock,
+//and the call sites that waited longest. declare locks as ProxyMutex and take them through LOCK_SITE:
+//	std::lock_guard<ProxyMutex> lock(LOCK_SITE(queueLock));
+//define RMCS_NO_LOCK_PROFILE to get plain std::mutex / std::condition_variable back at zero cost
+
+struct LockStats;
+
+class ProfiledMutex
+{
+public:
+	ProfiledMutex();
+	~ProfiledMutex();
+	void lock();
+	bool try_lock();
+	void unlock();
+
+	//remembers where the next lock() on this thread comes from; used through LOCK_SITE
+	static ProfiledMutex& at(ProfiledMutex& mutex, const char* file, const char* expression, const char* site);
+	//prometheus text: wait/hold summaries per lock and wait totals of its top contending sites
+	static std::string scrape();
+private:
+	void acquired(int64_t startNs, int64_t nowNs);
+
+	std::mutex mutex;
+	LockStats* stats;  //resolved on the first lock that names it; then only touched while held
+	int64_t lockedNs;
+
+	ProfiledMutex(const ProfiledMutex&);
+	ProfiledMutex& operator=(const ProfiledMutex&);
+};
+
+#ifndef RMCS_NO_LOCK_PROFILE
+typedef ProfiledMutex ProxyMutex;
+typedef std::condition_variable_any ProxyCondition;
+#define LOCK_SITE_STR_(x) #x
+#define LOCK_SITE_STR(x) LOCK_SITE_STR_(x)
+#define LOCK_SITE(m) ProfiledMutex::at((m), __FILE__, #m, __FILE__ ":" LOCK_SITE_STR(__LINE__))
+#else
+typedef std::mutex ProxyMutex;
+typedef std::condition_variable ProxyCondition;
+#define LOCK_SITE(m) (m)
+#endif
+
+#endif
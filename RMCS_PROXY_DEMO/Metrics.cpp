@@ -0,0 +1,190 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Metrics.h"
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define METRICS_THREAD_LOCAL __declspec(thread)
+#else
+#define METRICS_THREAD_LOCAL thread_local
+#endif
+
+namespace {
+
+//written by one thread only; the atomics only make the concurrent reads well defined
+struct ThreadMetrics{
+	std::atomic<uint64_t> counts[MetricCount];
+	std::atomic<uint64_t> sums[MetricCount];
+	std::atomic<uint64_t> buckets[MetricCount][METRIC_BUCKETS];
+
+	ThreadMetrics(){
+		for(int m = 0; m < MetricCount; m++){
+			counts[m].store(0, std::memory_order_relaxed);
+			sums[m].store(0, std::memory_order_relaxed);
+			for(int b = 0; b < METRIC_BUCKETS; b++){
+				buckets[m][b].store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+};
+
+inline void bump(std::atomic<uint64_t>& counter, uint64_t amount){
+	counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+//blocks of exited threads stay registered so their counts are not lost
+std::mutex registryLock;
+std::vector<ThreadMetrics*>& registry(){
+	static std::vector<ThreadMetrics*> blocks;
+	return blocks;
+}
+
+METRICS_THREAD_LOCAL ThreadMetrics* threadMetrics = NULL;
+
+ThreadMetrics* localMetrics(){
+	if(!threadMetrics){
+		ThreadMetrics* block = new ThreadMetrics();
+		std::lock_guard<std::mutex> lock(registryLock);
+		registry().push_back(block);
+		threadMetrics = block;
+	}
+	return threadMetrics;
+}
+
+inline int highestBit(uint64_t value){
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(value);
+#else
+	int bit = 0;
+	while(value >>= 1){
+		bit++;
+	}
+	return bit;
+#endif
+}
+
+const char* const metricNames[MetricCount] = {
+	"feedback_dispatch",
+	"feedback_decode",
+	"cache_publish",
+	"command_queue_wait",
+	"send_command",
+	"send_command_ack",
+	"database_flush",
+	"api_query",
+	"api_fan_out",
+	"api_command",
+	"bus_publish",
+	"gravity_compute",
+	"gravity_cycle"
+};
+
+}
+
+int64_t Metrics::nowNs(){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int Metrics::bucketOf(int64_t ns){
+	if(ns < 8){
+		return ns < 0 ? 0 : (int)ns;
+	}
+	int exponent = highestBit((uint64_t)ns);
+	int bucket = (exponent - 2) * 8 + (int)((ns >> (exponent - 3)) & 7);
+	return bucket < METRIC_BUCKETS ? bucket : METRIC_BUCKETS - 1;
+}
+
+int64_t Metrics::bucketUpperNs(int bucket){
+	if(bucket < 8){
+		return bucket;
+	}
+	int exponent = bucket / 8 + 2;
+	int64_t sub = bucket % 8;
+	return ((8 + sub + 1) << (exponent - 3)) - 1;
+}
+
+void Metrics::record(MetricId id, int64_t ns){
+	ThreadMetrics* block = localMetrics();
+	bump(block->counts[id], 1);
+	bump(block->sums[id], ns > 0 ? (uint64_t)ns : 0);
+	bump(block->buckets[id][bucketOf(ns)], 1);
+}
+
+void Metrics::summary(MetricId id, MetricSummary& out){
+	std::memset(&out, 0, sizeof(out));
+	std::lock_guard<std::mutex> lock(registryLock);
+	const std::vector<ThreadMetrics*>& blocks = registry();
+	for(size_t t = 0; t < blocks.size(); t++){
+		out.count += blocks[t]->counts[id].load(std::memory_order_relaxed);
+		out.sumNs += blocks[t]->sums[id].load(std::memory_order_relaxed);
+		for(int b = 0; b < METRIC_BUCKETS; b++){
+			out.buckets[b] += blocks[t]->buckets[id][b].load(std::memory_order_relaxed);
+		}
+	}
+}
+
+const char* Metrics::name(MetricId id){
+	return id >= 0 && id < MetricCount ? metricNames[id] : "";
+}
+
+std::string Metrics::scrape(){
+	std::string text;
+	MetricSummary summaryOf;
+	for(int m = 0; m < MetricCount; m++){
+		summary((MetricId)m, summaryOf);
+		std::string metric = std::string("rmcs_") + metricNames[m] + "_seconds";
+		text += "# TYPE " + metric + " summary\n";
+		appendSummary(text, metric, "", summaryOf);
+	}
+	return text;
+}
+
+void Metrics::appendSummary(std::string& text, const std::string& metric, const std::string& labels, const MetricSummary& summary){
+	static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+	const char* separator = labels.empty() ? "" : ",";
+	char line[64];
+	for(size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++){
+		std::snprintf(line, sizeof(line), "quantile=\"%g\"} %.9f\n", quantiles[q], summary.percentileNs(quantiles[q] * 100.0) * 1e-9);
+		text += metric + "{" + labels + separator + line;
+	}
+	std::string suffix = labels.empty() ? " " : "{" + labels + "} ";
+	std::snprintf(line, sizeof(line), "%.9f\n", summary.sumNs * 1e-9);
+	text += metric + "_sum" + suffix + line;
+	std::snprintf(line, sizeof(line), "%llu\n", (unsigned long long)summary.count);
+	text += metric + "_count" + suffix + line;
+}
+
+double MetricSummary::meanNs() const{
+	return count ? (double)sumNs / (double)count : 0.0;
+}
+
+int64_t MetricSummary::percentileNs(double percent) const{
+	if(count == 0){
+		return 0;
+	}
+	uint64_t wanted = (uint64_t)(percent / 100.0 * (double)count + 0.5);
+	if(wanted < 1){
+		wanted = 1;
+	}
+	uint64_t seen = 0;
+	for(int b = 0; b < METRIC_BUCKETS; b++){
+		seen += buckets[b];
+		if(seen >= wanted){
+			return Metrics::bucketUpperNs(b);
+		}
+	}
+	return maxNs();
+}
+
+int64_t MetricSummary::maxNs() const{
+	for(int b = METRIC_BUCKETS - 1; b >= 0; b--){
+		if(buckets[b]){
+			return Metrics::bucketUpperNs(b);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,80 @@
+#ifndef METRICS_H
+#define METRICS_H
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+//hot-path metrics: every thread records into its own block, readers sum the blocks
+//a record is two clock reads plus a few uncontended stores; define RMCS_NO_METRICS to compile it all out
+
+enum MetricId{
+	MetricFeedbackDispatch,  //hebi::Group::callAttachedHandlers, all handlers of one group feedback
+	MetricFeedbackDecode,    //FeedBackManager::onGroupFeedback, decode and dispatch to the consumers
+	MetricCachePublish,      //CacheManager::onFrame
+	MetricCommandQueueWait,  //CommandCustomer::push until the command thread takes it
+	MetricSendCommand,       //hebi::Group::sendCommand
+	MetricSendCommandAck,    //hebi::Group::sendCommandWithAcknowledgement
+	MetricDatabaseFlush,     //DataBaseManager, one batch of frames written
+	MetricApiQuery,          //ServerApiManager::queryTelemetry
+	MetricApiFanOut,         //one frame delivered to every API subscriber
+	MetricApiCommand,        //one client command parsed into a GroupCommand and queued
+	MetricBusPublish,        //FeedbackBus::onFrame, one frame into shared memory and readers woken
+	MetricGravityCompute,    //GravityCompensator, gravity torques of one feedback frame into its command
+	MetricGravityCycle,      //GravityCompensator, feedback handler entered to the return of sendCommand
+	MetricCount
+};
+
+//log-linear buckets: 8 per power of two, i.e. within 12.5%, up to 2^40 ns
+const int METRIC_BUCKETS = 312;
+
+struct MetricSummary{
+	uint64_t count;
+	uint64_t sumNs;
+	uint64_t buckets[METRIC_BUCKETS];
+
+	double meanNs() const;
+	int64_t percentileNs(double percent) const; //upper edge of the bucket holding the percentile
+	int64_t maxNs() const;                      //upper edge of the highest used bucket
+};
+
+class Metrics
+{
+public:
+	static int64_t nowNs(); //monotonic
+	static void record(MetricId id, int64_t ns);
+	static void summary(MetricId id, MetricSummary& out); //sum over every thread that recorded
+	static const char* name(MetricId id);
+	//prometheus text exposition: a summary per metric, in seconds
+	static std::string scrape();
+	//quantile, _sum and _count lines of one prometheus summary; labels like lock="x", may be empty
+	static void appendSummary(std::string& text, const std::string& metric, const std::string& labels, const MetricSummary& summary);
+	static int bucketOf(int64_t ns);
+	static int64_t bucketUpperNs(int bucket);
+};
+
+//times the enclosing scope
+class MetricScope
+{
+public:
+	explicit MetricScope(MetricId id) : id(id), start(Metrics::nowNs()) {}
+	~MetricScope() { Metrics::record(id, Metrics::nowNs() - start); }
+private:
+	MetricId id;
+	int64_t start;
+	MetricScope(const MetricScope&);
+	MetricScope& operator=(const MetricScope&);
+};
+
+#ifndef RMCS_NO_METRICS
+#define METRIC_CONCAT_(a, b) a##b
+#define METRIC_CONCAT(a, b) METRIC_CONCAT_(a, b)
+#define METRIC_SCOPE(id) MetricScope METRIC_CONCAT(metricScope, __LINE__)(id)
+#define METRIC_NOW() Metrics::nowNs()
+#define METRIC_RECORD(id, ns) Metrics::record(id, ns)
+#else
+#define METRIC_SCOPE(id) ((void)0)
+#define METRIC_NOW() ((int64_t)0)
+#define METRIC_RECORD(id, ns) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,778 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#ifdef _WIN32
+#define poll WSAPoll
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include "ServerApiManager.h"
+#include "JsonWriter.h"
+#include "LockProfile.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+namespace {
+
+const int MAX_POLL_MS = 10; //also how long shutdown() may wait for the loop
+const int64_t STATS_PERIOD_NS = 100 * 1000000LL;
+const size_t COMMAND_POOL_SIZE = 64; //per group: queued commands plus the ones the journal still holds
+
+const JsonKey K_T("t");
+const JsonKey K_V("v");
+const JsonKey K_GROUP("group");
+const JsonKey K_MODULES("modules");
+const JsonKey K_FIELDS("fields");
+
+std::vector<std::string> split(const std::string& text, char separator){
+	std::vector<std::string> items;
+	std::stringstream stream(text);
+	std::string item;
+	while(std::getline(stream, item, separator)){
+		if(!item.empty()){
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+void appendQuoted(std::string& out, const std::string& text){
+	out += '"';
+	for(size_t i = 0; i < text.size(); i++){
+		char c = text[i];
+		if(c == '"' || c == '\\'){
+			out += '\\';
+			out += c;
+		}
+		else if((unsigned char)c < 0x20){
+			char escaped[8];
+			std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+			out += escaped;
+		}
+		else{
+			out += c;
+		}
+	}
+	out += '"';
+}
+
+void appendId(std::string& out, uint32_t id){
+	char text[16];
+	int length = std::snprintf(text, sizeof(text), "%u", id);
+	out.append(text, (size_t)length);
+}
+
+}
+
+ServerApiManager::ServerApiManager(DataBaseManager& dataBaseManager, CacheManager& cacheManager)
+	: dataBaseManager(dataBaseManager), cacheManager(cacheManager), commandCustomer(NULL), commandsAccepted(0),
+	commandsRejected(0), nextClientId(1), clientCount(0), wakePending(false),
+	statsPublishedNs(0), stopping(false)
+{
+	wake[0] = wake[1] = API_NO_SOCKET;
+}
+
+ServerApiManager::~ServerApiManager(){
+	shutdown();
+	for(size_t i = 0; i < listeners.size(); i++){
+		ApiConnection::close(listeners[i]);
+	}
+	ApiConnection::close(wake[0]);
+	ApiConnection::close(wake[1]);
+#ifndef _WIN32
+	if(!config.unixPath.empty() && !listeners.empty()){
+		unlink(config.unixPath.c_str());
+	}
+#endif
+}
+
+bool ServerApiManager::listen(const ApiServerConfig& serverConfig){
+	config = serverConfig;
+	if(!ApiConnection::startup() || !ApiConnection::socketPair(wake)){
+		return false;
+	}
+	if(config.tcpPort > 0){
+		ApiSocket listener = ApiConnection::listenTcp(config.tcpHost, config.tcpPort);
+		if(listener == API_NO_SOCKET){
+			std::cout<<"api: cannot listen on "<<config.tcpHost<<":"<<config.tcpPort<<std::endl;
+			return false;
+		}
+		listeners.push_back(listener);
+	}
+	if(!config.unixPath.empty()){
+		ApiSocket listener = ApiConnection::listenUnix(config.unixPath);
+		if(listener == API_NO_SOCKET){
+			std::cout<<"api: cannot listen on "<<config.unixPath<<std::endl;
+			return false;
+		}
+		listeners.push_back(listener);
+	}
+	return !listeners.empty();
+}
+
+size_t ServerApiManager::getClientCount() const{
+	return clientCount.load(std::memory_order_relaxed);
+}
+
+bool ServerApiManager::queryTelemetry(const TelemetryQuery& query, TelemetryResult& result){
+	METRIC_SCOPE(MetricApiQuery);
+	TRACE_SCOPE("api_query");
+	return dataBaseManager.query(query, result);
+}
+
+std::vector<ApiClientStats> ServerApiManager::getClientStats() const{
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(statsLock));
+	return clientStats;
+}
+
+void ServerApiManager::onFrame(const GroupFeedbackFrame&){
+	if(wake[1] != API_NO_SOCKET && !wakePending.exchange(true)){
+		::send(wake[1], "w", 1, 0);
+	}
+}
+
+std::string ServerApiManager::scrapeMetrics() const{
+	std::string text = Metrics::scrape() + ProfiledMutex::scrape();
+	std::vector<ApiClientStats> stats = getClientStats();
+	uint64_t conflated = 0, dropped = 0;
+	size_t queuedBytes = 0;
+	int64_t lagNs = 0;
+	for(size_t c = 0; c < stats.size(); c++){
+		conflated += stats[c].connection.conflated;
+		dropped += stats[c].connection.dropped;
+		queuedBytes += stats[c].connection.queuedBytes;
+		lagNs = std::max(lagNs, stats[c].lagNs);
+	}
+	char lines[1024];
+	std::snprintf(lines, sizeof(lines),
+		"# TYPE rmcs_api_clients gauge\nrmcs_api_clients %zu\n"
+		"# TYPE rmcs_api_queued_bytes gauge\nrmcs_api_queued_bytes %zu\n"
+		"# TYPE rmcs_api_max_lag_seconds gauge\nrmcs_api_max_lag_seconds %.6f\n"
+		"# TYPE rmcs_api_conflated_total counter\nrmcs_api_conflated_total %llu\n"
+		"# TYPE rmcs_api_dropped_total counter\nrmcs_api_dropped_total %llu\n"
+		"# TYPE rmcs_api_commands_total counter\nrmcs_api_commands_total %llu\n"
+		"# TYPE rmcs_api_commands_rejected_total counter\nrmcs_api_commands_rejected_total %llu\n"
+		"# TYPE rmcs_database_dropped_frames_total counter\nrmcs_database_dropped_frames_total %llu\n",
+		stats.size(), queuedBytes, (double)lagNs * 1e-9, (unsigned long long)conflated, (unsigned long long)dropped,
+		(unsigned long long)commandsAccepted.load(), (unsigned long long)commandsRejected.load(),
+		(unsigned long long)dataBaseManager.getDroppedFrames());
+	return text + lines;
+}
+
+std::string ServerApiManager::traceJson(double lastSeconds) const{
+	return Trace::chromeJson(lastSeconds);
+}
+
+void ServerApiManager::run(){
+	TRACE_THREAD("api");
+	if(stopping){
+		return;
+	}
+	std::vector<pollfd> fds;
+	std::vector<ApiRequest> requests;
+	int64_t nextNs = Metrics::nowNs();
+	//fds: the wake socket, the listeners, then the clients
+	const size_t first = 1 + listeners.size();
+	while(!stopping){
+		fds.resize(first + clients.size());
+		fds[0].fd = wake[0];
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		for(size_t i = 0; i < listeners.size(); i++){
+			fds[1 + i].fd = listeners[i];
+			fds[1 + i].events = POLLIN;
+			fds[1 + i].revents = 0;
+		}
+		for(size_t c = 0; c < clients.size(); c++){
+			pollfd& fd = fds[first + c];
+			fd.fd = clients[c]->connection->getSocket();
+			fd.events = (short)(POLLIN | (clients[c]->connection->wantsWrite() ? POLLOUT : 0));
+			fd.revents = 0;
+		}
+		int64_t waitNs = nextNs - Metrics::nowNs();
+		int timeoutMs = waitNs <= 0 ? 0 : (int)((waitNs + 999999) / 1000000);
+		if(timeoutMs > MAX_POLL_MS){
+			timeoutMs = MAX_POLL_MS;
+		}
+		if(poll(&fds[0], (unsigned long)fds.size(), timeoutMs) < 0){
+			continue;
+		}
+
+		if(fds[0].revents & POLLIN){
+			//cleared before draining, so a frame published meanwhile wakes the next poll
+			wakePending = false;
+			char drain[64];
+			while(::recv(wake[0], drain, sizeof(drain), 0) > 0){
+			}
+		}
+		size_t known = clients.size();
+		for(size_t i = 0; i < listeners.size(); i++){
+			if(fds[1 + i].revents & POLLIN){
+				accept(listeners[i]);
+			}
+		}
+		std::vector<bool> closed(clients.size(), false);
+		for(size_t c = 0; c < known; c++){
+			short revents = fds[first + c].revents;
+			if(revents & (POLLIN | POLLHUP | POLLERR)){
+				requests.clear();
+				bool alive = clients[c]->connection->receive(requests);
+				for(size_t r = 0; r < requests.size(); r++){
+					handleRequest(*clients[c], requests[r]);
+				}
+				closed[c] = !alive;
+			}
+		}
+
+		int64_t nowNs = Metrics::nowNs();
+		nextNs = fanOut(nowNs);
+
+		for(size_t c = 0; c < clients.size(); c++){
+			ApiConnection& connection = *clients[c]->connection;
+			if(!closed[c] && connection.wantsWrite()){
+				closed[c] = !connection.flush();
+			}
+			if(!closed[c] && clients[c]->closing){
+				std::cout<<"api: disconnecting client "<<clients[c]->id<<", its queue is full"<<std::endl;
+				closed[c] = true;
+			}
+			//samples are held to maxPendingBytes by the client's policy, the rest are replies it does not read
+			if(!closed[c] && connection.pendingBytes() > 2 * config.maxPendingBytes){
+				std::cout<<"api: dropping client "<<clients[c]->id<<", "<<connection.pendingBytes()<<" bytes behind"<<std::endl;
+				closed[c] = true;
+			}
+		}
+		for(size_t c = clients.size(); c-- > 0;){
+			if(closed[c]){
+				for(size_t s = 0; s < clients[c]->subscriptions.size(); s++){
+					release(clients[c]->subscriptions[s].stream);
+				}
+				clients.erase(clients.begin() + c);
+			}
+		}
+		clientCount.store(clients.size(), std::memory_order_relaxed);
+		if(nowNs - statsPublishedNs >= STATS_PERIOD_NS){
+			publishStats(nowNs);
+		}
+	}
+
+	clients.clear();
+	publishStats(Metrics::nowNs());
+	streams.clear();
+	feeds.clear();
+	clientCount.store(0, std::memory_order_relaxed);
+}
+
+void ServerApiManager::shutdown(){
+	stopping = true;
+	join(); //the loop sees stopping within MAX_POLL_MS
+}
+
+void ServerApiManager::accept(ApiSocket listener){
+	for(;;){
+		ApiSocket socket = ApiConnection::accept(listener);
+		if(socket == API_NO_SOCKET){
+			return;
+		}
+		if(clients.size() >= config.maxClients){
+			ApiConnection::close(socket);
+			continue;
+		}
+		std::unique_ptr<Client> client(new Client());
+		client->id = nextClientId++;
+		client->connection.reset(new ApiConnection(socket));
+		client->connection->setBackpressure(config.backpressure, config.maxQueuedSamples, config.maxPendingBytes);
+		client->binary = false;
+		client->closing = false;
+		clients.push_back(std::move(client));
+	}
+}
+
+void ServerApiManager::setCommandCustomer(CommandCustomer* customer){
+	commandCustomer = customer;
+}
+
+void ServerApiManager::addCommandGroup(const std::string& groupKey, std::shared_ptr<hebi::Group> group,
+	std::shared_ptr<const std::vector<std::string> > moduleKeys)
+{
+	CommandTarget& target = commandTargets[groupKey];
+	target.groupKey = groupKey;
+	target.group = group;
+	target.moduleKeys = moduleKeys;
+	target.pool = std::make_shared<CommandPool>((int)moduleKeys->size(), COMMAND_POOL_SIZE);
+	commandTargetList.clear();
+	for(std::map<std::string, CommandTarget>::const_iterator t = commandTargets.begin(); t != commandTargets.end(); ++t){
+		commandTargetList.push_back(&t->second);
+	}
+}
+
+//commands are parsed where they lie in the connection's buffer; only control lines become strings
+void ServerApiManager::handleRequest(Client& client, const ApiRequest& request){
+	if(request.frame){
+		handleFrame(client, request);
+		return;
+	}
+	if(request.data[0] != '{'){
+		handleLine(client, std::string(request.data, request.size));
+		return;
+	}
+	METRIC_SCOPE(MetricApiCommand);
+	CommandElement element;
+	const char* error;
+	if(!jsonCommands.parse(request.data, request.size, commandTargetList, element, &error)){
+		rejectCommand(client, 0, error);
+		return;
+	}
+	command(client, 0, element);
+}
+
+void ServerApiManager::handleFrame(Client& client, const ApiRequest& request){
+	WireHeader header;
+	wireReadHeader(request.data, request.size, header); //checked by the connection
+	const char* payload = request.data + WIRE_HEADER_SIZE;
+	if(header.type == WireSchema){
+		WireSchemaInfo schema;
+		if(!wireDecodeSchema(payload, header.length, schema)){
+			rejectCommand(client, header.stream, "malformed schema");
+			return;
+		}
+		std::map<std::string, CommandTarget>::const_iterator target = commandTargets.find(schema.group);
+		if(target == commandTargets.end()){
+			rejectCommand(client, header.stream, "unknown group");
+			return;
+		}
+		CommandStream stream;
+		const char* error;
+		if(!resolveCommandStream(schema, target->second, stream, &error)){
+			rejectCommand(client, header.stream, error);
+			return;
+		}
+		client.commandStreams[header.stream] = stream;
+		return;
+	}
+	if(header.type != WireCommand){
+		rejectCommand(client, header.stream, "unexpected frame");
+		return;
+	}
+	METRIC_SCOPE(MetricApiCommand);
+	std::map<uint32_t, CommandStream>::const_iterator stream = client.commandStreams.find(header.stream);
+	if(stream == client.commandStreams.end()){
+		rejectCommand(client, header.stream, "no schema for this stream");
+		return;
+	}
+	CommandElement element;
+	const char* error;
+	if(!parseBinaryCommand(stream->second, payload, header.length, element, &error)){
+		rejectCommand(client, header.stream, error);
+		return;
+	}
+	command(client, header.stream, element);
+}
+
+void ServerApiManager::command(Client& client, uint32_t stream, CommandElement& element){
+	if(!commandCustomer){
+		rejectCommand(client, stream, "commands are disabled");
+		return;
+	}
+	if(element.createdUs == 0){
+		element.createdUs = FeedBackManager::nowUs();
+	}
+	commandCustomer->push(element);
+	commandsAccepted++;
+}
+
+void ServerApiManager::rejectCommand(Client& client, uint32_t stream, const char* error){
+	commandsRejected++;
+	scratch = "{\"error\":";
+	appendQuoted(scratch, error);
+	scratch += ",\"command\":";
+	appendId(scratch, stream);
+	scratch += "}\n";
+	reply(client, scratch);
+}
+
+void ServerApiManager::handleLine(Client& client, const std::string& line){
+	std::vector<std::string> words = split(line, ' ');
+	if(words.empty()){
+		return;
+	}
+	if(words[0] == "subscribe"){
+		subscribe(client, words);
+	}
+	else if(words[0] == "unsubscribe" && words.size() == 2){
+		unsubscribe(client, (uint32_t)std::strtoul(words[1].c_str(), NULL, 10));
+	}
+	else if(words[0] == "format" && words.size() == 2 && (words[1] == "json" || words[1] == "binary")){
+		if(!client.subscriptions.empty()){
+			reply(client, "{\"error\":\"format must be set before subscribing\"}\n");
+			return;
+		}
+		client.binary = words[1] == "binary";
+		client.connection->setBinary(client.binary);
+		reply(client, "{\"ok\":0}\n");
+	}
+	else if(words[0] == "policy" && words.size() == 2){
+		ApiBackpressure policy;
+		if(!apiBackpressureFromName(words[1], &policy)){
+			reply(client, "{\"error\":\"unknown policy\"}\n");
+			return;
+		}
+		client.connection->setBackpressure(policy, config.maxQueuedSamples, config.maxPendingBytes);
+		reply(client, "{\"ok\":0}\n");
+	}
+	else if(words[0] == "stats"){
+		ApiClientStats stats = statsOf(client, Metrics::nowNs());
+		char text[320];
+		std::snprintf(text, sizeof(text),
+			"{\"client\":%u,\"policy\":\"%s\",\"subscriptions\":%zu,\"queued\":%zu,\"queuedBytes\":%zu,"
+			"\"lagUs\":%lld,\"maxLagUs\":%lld,\"sent\":%llu,\"conflated\":%llu,\"dropped\":%llu}\n",
+			stats.client, apiBackpressureName(stats.backpressure), stats.subscriptions,
+			stats.connection.queuedMessages, stats.connection.queuedBytes,
+			(long long)(stats.lagNs / 1000), (long long)(stats.connection.maxLagNs / 1000),
+			(unsigned long long)stats.connection.sentMessages, (unsigned long long)stats.connection.conflated,
+			(unsigned long long)stats.connection.dropped);
+		reply(client, text);
+	}
+	else if(words[0] == "metrics"){
+		reply(client, scrapeMetrics());
+	}
+	else{
+		reply(client, "{\"error\":\"unknown request\"}\n");
+	}
+}
+
+void ServerApiManager::reply(Client& client, const std::string& json){
+	if(client.binary){
+		sendMessage(client, 0, WireText, std::make_shared<std::string>(json));
+	}
+	else{
+		client.connection->send(json);
+	}
+}
+
+void ServerApiManager::subscribe(Client& client, const std::vector<std::string>& words){
+	uint32_t id = words.size() > 1 ? (uint32_t)std::strtoul(words[1].c_str(), NULL, 10) : 0;
+	const char* error = NULL;
+	std::vector<FeedbackField> fields;
+	double rateHz = words.size() > 3 ? std::atof(words[3].c_str()) : 0;
+	if(words.size() < 5 || words.size() > 6 || !(rateHz > 0)){
+		error = "usage: subscribe <id> <group> <rateHz> <fields> [modules]";
+	}
+	else{
+		std::vector<std::string> fieldNames = split(words[4], ',');
+		for(size_t f = 0; f < fieldNames.size() && !error; f++){
+			FeedbackField field;
+			if(feedbackFieldFromName(fieldNames[f], &field)){
+				fields.push_back(field);
+			}
+			else{
+				error = "unknown field";
+			}
+		}
+		if(fields.empty() && !error){
+			error = "no fields";
+		}
+		if(fields.size() > WIRE_MAX_FIELDS && !error){
+			error = "too many fields";
+		}
+	}
+	for(size_t s = 0; s < client.subscriptions.size() && !error; s++){
+		if(client.subscriptions[s].id == id){
+			error = "id in use";
+		}
+	}
+	scratch.clear();
+	if(error){
+		scratch += "{\"error\":";
+		appendQuoted(scratch, error);
+		scratch += ",\"id\":";
+		appendId(scratch, id);
+		scratch += "}\n";
+		reply(client, scratch);
+		return;
+	}
+	if(rateHz > config.maxRateHz){
+		rateHz = config.maxRateHz;
+	}
+
+	//the same words ask for the same stream
+	std::string key = (client.binary ? "binary " : "json ") + words[2] + " " + words[4] + (words.size() == 6 ? " " + words[5] : "");
+	std::map<std::string, Stream>::iterator stream = streams.find(key);
+	if(stream == streams.end()){
+		std::map<std::string, GroupFeed>::iterator feed = feeds.find(words[2]);
+		if(feed == feeds.end()){
+			GroupFeed created;
+			created.streams = 0;
+			feed = feeds.insert(std::make_pair(words[2], created)).first;
+		}
+		feed->second.streams++;
+		Stream created;
+		created.key = key;
+		created.feed = &feed->second;
+		created.binary = client.binary;
+		created.groupKey = words[2];
+		created.fields = fields;
+		if(words.size() == 6){
+			created.modules = split(words[5], ',');
+		}
+		created.subscribers = 0;
+		stream = streams.insert(std::make_pair(key, created)).first;
+	}
+	stream->second.subscribers++;
+
+	Subscription subscription;
+	subscription.id = id;
+	subscription.stream = &stream->second;
+	subscription.limiter.periodNs = (int64_t)(1e9 / rateHz);
+	subscription.limiter.dueNs = 0;
+	client.subscriptions.push_back(subscription);
+	scratch += "{\"ok\":";
+	appendId(scratch, id);
+	scratch += "}\n";
+	reply(client, scratch);
+}
+
+void ServerApiManager::unsubscribe(Client& client, uint32_t id){
+	for(size_t s = 0; s < client.subscriptions.size(); s++){
+		if(client.subscriptions[s].id == id){
+			release(client.subscriptions[s].stream);
+			client.subscriptions.erase(client.subscriptions.begin() + s);
+			scratch = "{\"ok\":";
+			appendId(scratch, id);
+			scratch += "}\n";
+			reply(client, scratch);
+			return;
+		}
+	}
+	scratch = "{\"error\":\"no such subscription\",\"id\":";
+	appendId(scratch, id);
+	scratch += "}\n";
+	reply(client, scratch);
+}
+
+void ServerApiManager::release(Stream* stream){
+	if(--stream->subscribers > 0){
+		return;
+	}
+	GroupFeed* feed = stream->feed;
+	std::string groupKey = stream->groupKey;
+	streams.erase(stream->key);
+	if(--feed->streams == 0){
+		feeds.erase(groupKey);
+	}
+}
+
+int64_t ServerApiManager::fanOut(int64_t nowNs){
+	int64_t nextNs = nowNs + (int64_t)MAX_POLL_MS * 1000000;
+	for(std::map<std::string, GroupFeed>::iterator feed = feeds.begin(); feed != feeds.end(); ++feed){
+		feed->second.frame = cacheManager.latest(feed->first);
+	}
+	//most wakeups find nothing to send: a frame of a group nobody watches, or limiters still closed
+	bool ready = false;
+	for(size_t c = 0; c < clients.size(); c++){
+		for(size_t s = 0; s < clients[c]->subscriptions.size(); s++){
+			const Subscription& subscription = clients[c]->subscriptions[s];
+			const std::shared_ptr<const GroupFeedbackFrame>& frame = subscription.stream->feed->frame;
+			if(!frame || frame == subscription.sent){
+				continue;
+			}
+			if(subscription.limiter.readyNs() <= nowNs){
+				ready = true;
+			}
+			else{
+				nextNs = std::min(nextNs, subscription.limiter.readyNs());
+			}
+		}
+	}
+	if(!ready){
+		return nextNs;
+	}
+
+	METRIC_SCOPE(MetricApiFanOut);
+	TRACE_SCOPE("api_fan_out");
+	for(size_t c = 0; c < clients.size(); c++){
+		Client& client = *clients[c];
+		for(size_t s = 0; s < client.subscriptions.size() && !client.closing; s++){
+			Subscription& subscription = client.subscriptions[s];
+			Stream& stream = *subscription.stream;
+			const std::shared_ptr<const GroupFeedbackFrame>& frame = stream.feed->frame;
+			if(!frame || frame == subscription.sent || subscription.limiter.readyNs() > nowNs){
+				continue;
+			}
+			if(stream.encoded != frame){
+				encode(stream, frame);
+			}
+			if(subscription.sentSchema != stream.schema){
+				sendMessage(client, subscription.id, WireSchema, stream.schema);
+				subscription.sentSchema = stream.schema;
+			}
+			if(!sendMessage(client, subscription.id, WireFeedback, stream.sample)){
+				client.closing = true;
+			}
+			subscription.limiter.take(nowNs);
+			subscription.sent = frame;
+		}
+	}
+	return nextNs;
+}
+
+void ServerApiManager::publishStats(int64_t nowNs){
+	std::vector<ApiClientStats> stats(clients.size());
+	for(size_t c = 0; c < clients.size(); c++){
+		stats[c] = statsOf(*clients[c], nowNs);
+	}
+	std::lock_guard<ProxyMutex> lock(LOCK_SITE(statsLock));
+	clientStats.swap(stats);
+	statsPublishedNs = nowNs;
+}
+
+ApiClientStats ServerApiManager::statsOf(const Client& client, int64_t nowNs) const{
+	ApiClientStats stats;
+	stats.client = client.id;
+	stats.webSocket = client.connection->isWebSocket();
+	stats.binary = client.binary;
+	stats.subscriptions = client.subscriptions.size();
+	stats.backpressure = client.connection->getBackpressure();
+	stats.connection = client.connection->getStats();
+	stats.lagNs = stats.connection.oldestQueuedNs ? nowNs - stats.connection.oldestQueuedNs : 0;
+	return stats;
+}
+
+//the body of a message, shared by every subscriber; the per-subscription part goes in front of it in sendMessage
+void ServerApiManager::encode(Stream& stream, const std::shared_ptr<const GroupFeedbackFrame>& encoded){
+	const GroupFeedbackFrame& frame = *encoded;
+	if(frame.moduleKeys != stream.resolvedKeys || !stream.schema){
+		resolve(stream, frame);
+	}
+	std::shared_ptr<std::string> body = std::make_shared<std::string>();
+	if(stream.binary){
+		wireEncodeFeedback(*body, frame, stream.moduleIndex, stream.fields);
+	}
+	else{
+		//only the requested modules and fields are written; absent ones are null.
+		//the last body's size is a good guess for this one, so the writer does not grow the buffer
+		if(stream.sample){
+			body->reserve(stream.sample->size());
+		}
+		JsonWriter w(*body);
+		w.key(K_T);
+		w.integer(frame.timestampUs);
+		w.key(K_V);
+		w.beginArray();
+		for(size_t n = 0; n < stream.moduleIndex.size(); n++){
+			int index = stream.moduleIndex[n];
+			if(index < 0 || (size_t)index >= frame.modules.size()){
+				w.null();
+				continue;
+			}
+			const FeedbackSample& sample = frame.modules[index];
+			w.beginArray();
+			for(size_t f = 0; f < stream.fields.size(); f++){
+				if(sample.has(stream.fields[f])){
+					w.number(sample.values[stream.fields[f]]);
+				}
+				else{
+					w.null();
+				}
+			}
+			w.endArray();
+		}
+		w.endArray();
+		w.endObject(); //closes the object the subscription prefix opened
+		w.finish();
+		*body += '\n';
+	}
+	stream.sample = body;
+	stream.encoded = encoded;
+}
+
+//maps the requested modules to frame indices and encodes the schema describing the result
+void ServerApiManager::resolve(Stream& stream, const GroupFeedbackFrame& frame){
+	stream.resolvedKeys = frame.moduleKeys;
+	stream.moduleIndex.clear();
+	std::vector<std::string> names;
+	if(frame.moduleKeys && stream.modules.empty()){
+		names = *frame.moduleKeys;
+	}
+	else if(stream.modules.empty()){
+		for(size_t m = 0; m < frame.modules.size(); m++){
+			std::ostringstream name;
+			name<<m;
+			names.push_back(name.str());
+		}
+	}
+	else{
+		names = stream.modules;
+	}
+	for(size_t n = 0; n < names.size(); n++){
+		int index = -1;
+		if(stream.modules.empty()){
+			index = (int)n;
+		}
+		else if(frame.moduleKeys){
+			for(size_t m = 0; m < frame.moduleKeys->size(); m++){
+				if((*frame.moduleKeys)[m] == names[n]){
+					index = (int)m;
+					break;
+				}
+			}
+		}
+		stream.moduleIndex.push_back(index);
+	}
+
+	std::shared_ptr<std::string> body = std::make_shared<std::string>();
+	if(stream.binary){
+		std::vector<uint8_t> fields(stream.fields.begin(), stream.fields.end());
+		wireEncodeSchema(*body, WireFeedback, stream.groupKey, names, fields.empty() ? NULL : &fields[0], fields.size());
+	}
+	else{
+		JsonWriter w(*body);
+		w.key(K_GROUP);
+		w.string(stream.groupKey.data(), stream.groupKey.size());
+		w.key(K_MODULES);
+		w.beginArray();
+		for(size_t n = 0; n < names.size(); n++){
+			w.string(names[n].data(), names[n].size());
+		}
+		w.endArray();
+		w.key(K_FIELDS);
+		w.beginArray();
+		for(size_t f = 0; f < stream.fields.size(); f++){
+			const char* name = feedbackFieldName(stream.fields[f]);
+			w.string(name, std::strlen(name));
+		}
+		w.endArray();
+		w.endObject();
+		w.finish();
+		*body += '\n';
+	}
+	stream.schema = body;
+}
+
+//queues the subscription's own prefix and the shared body as one message; false if the client's policy disconnects it
+bool ServerApiManager::sendMessage(Client& client, uint32_t id, uint8_t type, const ApiBuffer& body){
+	char prefix[ApiConnection::MAX_PREFIX];
+	size_t size;
+	if(client.binary){
+		wireWriteHeader(prefix, type, id, (uint32_t)body->size());
+		size = WIRE_HEADER_SIZE;
+	}
+	else if(type == WireText){
+		client.connection->send(NULL, 0, body);
+		return true;
+	}
+	else{
+		size = (size_t)std::snprintf(prefix, sizeof(prefix), type == WireSchema ? "{\"schema\":%u," : "{\"sub\":%u,", id);
+	}
+	if(type == WireFeedback){
+		return client.connection->sendSample(id + 1, prefix, size, body, Metrics::nowNs());
+	}
+	client.connection->send(prefix, size, body);
+	return true;
+}
@@ -1,7 +1,174 @@
 #ifndef SERVERAPIMANAGER_H
 #define SERVERAPIMANAGER_H
+#include "ApiConnection.h"
+#include "CThread.h"
+#include "CacheManager.h"
+#include "CommandCustomer.h"
+#include "CommandParser.h"
+#include "DataBaseManager.h"
+#include "LockProfile.h"
+#include "WireFormat.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
+struct ApiServerConfig{
+	std::string unixPath; //empty: no unix socket
+	std::string tcpHost;  //loopback by default, the api is meant for local clients
+	int tcpPort;          //0: no tcp socket
+	size_t maxClients;
+	double maxRateHz;     //requested rates are capped to this
+	ApiBackpressure backpressure; //policy of new clients, each may pick its own
+	size_t maxQueuedSamples;      //per client, before the policy applies
+	size_t maxPendingBytes;       //of queued samples per client; twice this in unread replies disconnects
 
+	ApiServerConfig() : tcpHost("127.0.0.1"), tcpPort(0), maxClients(256), maxRateHz(1000),
+		backpressure(ApiConflate), maxQueuedSamples(64), maxPendingBytes(4 * 1024 * 1024) {}
+};
 
+//one client as seen by the server thread, refreshed every STATS_PERIOD_MS
+struct ApiClientStats{
+	uint32_t client;
+	bool webSocket;
+	bool binary;
+	size_t subscriptions;
+	ApiBackpressure backpressure;
+	ApiConnectionStats connection;
+	int64_t lagNs; //how long the oldest unsent message has been queued
+};
 
-#endif
\ No newline at end of file
+class ServerApiManager:public CThread
+{
+	//api exposed to clients of the proxy
+	//history requests are answered from the local database
+	//live feedback is pushed to subscribers from the CacheManager's latest frame of each group
+	//
+	//clients send text lines, over tcp, a unix socket or websocket frames:
+	//	format json|binary   (before subscribing; json is the default)
+	//	subscribe <id> <group> <rateHz> <field,field,...> [family/name,family/name,...]
+	//	unsubscribe <id>
+	//	policy conflate|drop-oldest|disconnect   (what happens to samples this client does not read fast enough)
+	//	stats     (this client's queue, lag and drop counters)
+	//	metrics
+	//json clients get json lines back: {"ok":id} or {"error":"...","id":id}, then per subscription
+	//	{"schema":id,"group":"...","modules":[...],"fields":[...]}   when the module list is known or changes
+	//	{"sub":id,"t":us,"v":[[field values of module 0],...]}         at most rateHz, as soon as a new frame is in
+	//binary clients get the same as WireFormat.h frames: replies as WireText, then WireSchema and WireFeedback with stream = id
+	//
+	//commands go to the CommandCustomer of setCommandCustomer, for groups registered with addCommandGroup:
+	//	json: a line holding one object, see JsonCommandParser
+	//	binary: a WireSchema frame of kind WireCommand declares stream id's group, fields and modules, then WireCommand frames on it
+	//nothing is sent back for an accepted command; a rejected one gets {"error":"...","command":stream} (0 for json)
+	//
+	//subscriptions asking for the same group, format, fields and modules share a stream:
+	//each new frame is encoded once per stream and the buffer is queued on every subscriber's connection
+public:
+	ServerApiManager(DataBaseManager& dataBaseManager, CacheManager& cacheManager);
+	~ServerApiManager();
+	bool listen(const ApiServerConfig& config); //opens the sockets; call before run()
+	void run() override;
+	void shutdown(); //closes every client, stops run() and waits for a start()ed thread
+	size_t getClientCount() const;
+	std::vector<ApiClientStats> getClientStats() const;
+	//wakes the fan-out for a frame just published to the CacheManager; without it samples go out within MAX_POLL_MS
+	void onFrame(const GroupFeedbackFrame& frame);
+	//columnar time-range read; false if a segment could not be read
+	bool queryTelemetry(const TelemetryQuery& query, TelemetryResult& result);
+	//hot-path latency summaries and lock contention in prometheus text format
+	//stage values are empty if built with RMCS_NO_METRICS, locks are left out with RMCS_NO_LOCK_PROFILE
+	std::string scrapeMetrics() const;
+	//chrome trace of the proxy threads over the last seconds; no spans unless Trace::setEnabled(true)
+	std::string traceJson(double lastSeconds) const;
+	//where client commands go; set both before run(). without a customer commands are rejected
+	void setCommandCustomer(CommandCustomer* commandCustomer);
+	void addCommandGroup(const std::string& groupKey, std::shared_ptr<hebi::Group> group,
+		std::shared_ptr<const std::vector<std::string> > moduleKeys);
+private:
+	//latest frame of one group, fetched from the cache once per fan-out however many streams read it
+	struct GroupFeed{
+		std::shared_ptr<const GroupFeedbackFrame> frame;
+		int streams;
+	};
+	struct Stream{
+		std::string key;
+		GroupFeed* feed;
+		bool binary;
+		std::string groupKey;
+		std::vector<std::string> modules; //empty: every module of the group
+		std::vector<FeedbackField> fields;
+		std::shared_ptr<const std::vector<std::string> > resolvedKeys; //module keys moduleIndex was built from
+		std::vector<int> moduleIndex; //per module of the schema, its index in the frame, -1 if absent
+		ApiBuffer schema;  //replaced whenever the module list is resolved again
+		ApiBuffer sample;  //encoding of encoded
+		std::shared_ptr<const GroupFeedbackFrame> encoded;
+		int subscribers;
+	};
+	//generic cell rate algorithm: at most one sample per period on average, a burst of two to absorb jitter
+	struct RateLimiter{
+		int64_t periodNs;
+		int64_t dueNs; //theoretical time of the next sample
+
+		int64_t readyNs() const { return dueNs - periodNs; }
+		void take(int64_t nowNs) { dueNs = (dueNs > nowNs ? dueNs : nowNs) + periodNs; }
+	};
+	struct Subscription{
+		uint32_t id;
+		Stream* stream;
+		RateLimiter limiter;
+		std::shared_ptr<const GroupFeedbackFrame> sent; //last frame pushed
+		ApiBuffer sentSchema;
+	};
+	struct Client{
+		uint32_t id;
+		std::unique_ptr<ApiConnection> connection;
+		bool binary;
+		bool closing; //its policy asked for a disconnect
+		std::vector<Subscription> subscriptions;
+		std::map<uint32_t, CommandStream> commandStreams; //binary command streams by id
+	};
+
+	void accept(ApiSocket listener);
+	void handleRequest(Client& client, const ApiRequest& request);
+	void handleLine(Client& client, const std::string& line);
+	void handleFrame(Client& client, const ApiRequest& request);
+	void command(Client& client, uint32_t stream, CommandElement& element);
+	void rejectCommand(Client& client, uint32_t stream, const char* error);
+	void reply(Client& client, const std::string& json);
+	void subscribe(Client& client, const std::vector<std::string>& words);
+	void unsubscribe(Client& client, uint32_t id);
+	void release(Stream* stream);
+	int64_t fanOut(int64_t nowNs); //returns when a rate limiter lets the next waiting sample go
+	void publishStats(int64_t nowNs);
+	ApiClientStats statsOf(const Client& client, int64_t nowNs) const;
+	void encode(Stream& stream, const std::shared_ptr<const GroupFeedbackFrame>& frame);
+	void resolve(Stream& stream, const GroupFeedbackFrame& frame);
+	bool sendMessage(Client& client, uint32_t id, uint8_t type, const ApiBuffer& body);
+
+	DataBaseManager& dataBaseManager;
+	CacheManager& cacheManager;
+	ApiServerConfig config;
+	std::vector<ApiSocket> listeners;
+	std::vector<std::unique_ptr<Client> > clients; //server thread only
+	std::map<std::string, GroupFeed> feeds;
+	std::map<std::string, Stream> streams;
+	CommandCustomer* commandCustomer;
+	std::map<std::string, CommandTarget> commandTargets;
+	std::vector<const CommandTarget*> commandTargetList; //the same, for the json parser
+	JsonCommandParser jsonCommands;
+	std::atomic<uint64_t> commandsAccepted;
+	std::atomic<uint64_t> commandsRejected;
+	uint32_t nextClientId;
+	std::string scratch;
+	std::atomic<size_t> clientCount;
+	ApiSocket wake[2]; //onFrame writes to wake[1] to interrupt the poll
+	std::atomic<bool> wakePending;
+	mutable ProxyMutex statsLock;
+	std::vector<ApiClientStats> clientStats;
+	int64_t statsPublishedNs;
+	std::atomic<bool> stopping;
+};
+
+
+#endif
@@ -0,0 +1,128 @@
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(size_t threadCount)
+	: stopping(false)
+{
+	if(threadCount == 0){
+		threadCount = std::thread::hardware_concurrency();
+		if(threadCount == 0){
+			threadCount = 2;
+		}
+	}
+	for(size_t i = 0; i < threadCount; i++){
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool(){
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(taskLock));
+		stopping = true;
+	}
+	taskReady.notify_all();
+	for(size_t i = 0; i < workers.size(); i++){
+		workers[i].join();
+	}
+}
+
+size_t ThreadPool::size() const{
+	return workers.size();
+}
+
+void ThreadPool::submit(std::function<void ()> task){
+	{
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(taskLock));
+		tasks.push_back(task);
+	}
+	taskReady.notify_one();
+}
+
+void ThreadPool::workerLoop(){
+	for(;;){
+		std::function<void ()> task;
+		{
+			std::unique_lock<ProxyMutex> lock(LOCK_SITE(taskLock));
+			while(!stopping && tasks.empty()){
+				taskReady.wait(lock);
+			}
+			if(tasks.empty()){
+				return; //stopping and drained
+			}
+			task = tasks.front();
+			tasks.pop_front();
+		}
+		try
+		{
+			task();
+		}
+		catch (std::exception& e)
+		{
+			std::cout<<e.what()<<std::endl;
+		}
+	}
+}
+
+namespace {
+//shared between the caller and the helper tasks of one parallelFor
+struct ParallelForState{
+	std::atomic<size_t> next;
+	size_t count;
+	const std::function<void (size_t)>* body;
+	ProxyMutex doneLock;
+	ProxyCondition doneSignal;
+	size_t running;
+	std::exception_ptr error; //the first exception body threw, under doneLock
+};
+
+//runs indices until none are left; an exception ends the whole loop and is kept for the caller
+void drain(ParallelForState& state){
+	try
+	{
+		for(size_t i = state.next++; i < state.count; i = state.next++){
+			(*state.body)(i);
+		}
+	}
+	catch (...)
+	{
+		state.next = state.count;
+		std::lock_guard<ProxyMutex> lock(LOCK_SITE(state.doneLock));
+		if(!state.error){
+			state.error = std::current_exception();
+		}
+	}
+}
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void (size_t)>& body){
+	if(count == 0){
+		return;
+	}
+	std::shared_ptr<ParallelForState> state(new ParallelForState());
+	state->next = 0;
+	state->count = count;
+	state->body = &body;
+	size_t helpers = workers.size() < count - 1 ? workers.size() : count - 1;
+	state->running = helpers;
+	for(size_t i = 0; i < helpers; i++){
+		submit([state](){
+			drain(*state);
+			std::lock_guard<ProxyMutex> lock(LOCK_SITE(state->doneLock));
+			if(--state->running == 0){
+				state->doneSignal.notify_all();
+			}
+		});
+	}
+	drain(*state);
+	std::unique_lock<ProxyMutex> lock(LOCK_SITE(state->doneLock));
+	while(state->running != 0){
+		state->doneSignal.wait(lock);
+	}
+	//body is only rethrown once no helper can still call it
+	if(state->error){
+		std::rethrow_exception(state->error);
+	}
+}
@@ -0,0 +1,36 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "LockProfile.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//fixed size pool of worker threads, shared by the managers for parallel work
+class ThreadPool
+{
+public:
+	explicit ThreadPool(size_t threadCount = 0); //0: one thread per core
+	~ThreadPool();
+	void submit(std::function<void ()> task); //fire and forget
+	//runs body(0..count-1) on the pool and the calling thread, returns when all are done. if body throws, the
+	//remaining indices are skipped and the first exception is rethrown here once every thread has stopped
+	void parallelFor(size_t count, const std::function<void (size_t)>& body);
+	size_t size() const;
+private:
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void ()> > tasks;
+	ProxyMutex taskLock;
+	ProxyCondition taskReady;
+	bool stopping;
+
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+};
+
+#endif
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Trace.h"
+#include "Metrics.h"
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL thread_local
+#endif
+
+namespace {
+
+struct TraceEvent{
+	std::atomic<const char*> name;
+	std::atomic<int64_t> beginNs;
+	std::atomic<int64_t> endNs;
+};
+
+//single writer ring; a reader copies it and then drops whatever the writer may have overwritten meanwhile.
+//every thread that names itself or records gets a block, but only one that records while tracing is on pays for the ring
+struct ThreadTrace{
+	int tid;
+	std::atomic<const char*> name;
+	std::atomic<uint64_t> head; //events ever written
+	std::atomic<TraceEvent*> events; //RING_EVENTS of them once the first span is recorded, never freed
+
+	explicit ThreadTrace(int tid) : tid(tid), name(NULL), head(0), events(NULL) {}
+};
+
+struct CopiedEvent{
+	const char* name;
+	int64_t beginNs;
+	int64_t endNs;
+};
+
+std::atomic<bool> tracing(false);
+
+//blocks of exited threads stay registered so their last spans can still be dumped
+std::mutex registryLock;
+std::vector<ThreadTrace*>& registry(){
+	static std::vector<ThreadTrace*> blocks;
+	return blocks;
+}
+
+TRACE_THREAD_LOCAL ThreadTrace* threadTrace = NULL;
+
+ThreadTrace* localTrace(){
+	if(!threadTrace){
+		std::lock_guard<std::mutex> lock(registryLock);
+		ThreadTrace* block = new ThreadTrace((int)registry().size() + 1);
+		registry().push_back(block);
+		threadTrace = block;
+	}
+	return threadTrace;
+}
+
+//names are only ever appended, so span ends read them without the lock
+const int MAX_DEADLINES = 16;
+struct Deadline{
+	char name[64];
+	std::atomic<int64_t> ns;
+};
+Deadline deadlines[MAX_DEADLINES];
+std::atomic<int> deadlineCount(0);
+std::mutex deadlineLock;
+std::atomic<uint64_t> misses(0);
+
+struct DumpWatcher{
+	std::mutex lock;
+	std::condition_variable wake;
+	std::thread thread;
+	std::string directory;
+	double lastSeconds;
+	bool stopping;
+	bool running;
+
+	DumpWatcher() : lastSeconds(0), stopping(false), running(false) {}
+};
+DumpWatcher watcher;
+
+void copyRing(const ThreadTrace& block, int64_t sinceNs, std::vector<CopiedEvent>& out){
+	uint64_t head = block.head.load(std::memory_order_acquire);
+	const TraceEvent* events = block.events.load(std::memory_order_acquire);
+	if(!events){
+		return;
+	}
+	uint64_t first = head > (uint64_t)Trace::RING_EVENTS ? head - Trace::RING_EVENTS : 0;
+	size_t start = out.size();
+	for(uint64_t i = first; i < head; i++){
+		const TraceEvent& event = events[i % Trace::RING_EVENTS];
+		CopiedEvent copy;
+		copy.name = event.name.load(std::memory_order_relaxed);
+		copy.beginNs = event.beginNs.load(std::memory_order_relaxed);
+		copy.endNs = event.endNs.load(std::memory_order_relaxed);
+		out.push_back(copy);
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t after = block.head.load(std::memory_order_relaxed);
+	//event after may be half written over event after - RING_EVENTS, so only events from after - RING_EVENTS + 1 on are whole
+	uint64_t valid = after + 1 > (uint64_t)Trace::RING_EVENTS ? after + 1 - Trace::RING_EVENTS : 0;
+	size_t dropped = valid > first ? (size_t)std::min<uint64_t>(valid - first, head - first) : 0;
+	out.erase(out.begin() + start, out.begin() + start + dropped);
+	size_t kept = start;
+	for(size_t i = start; i < out.size(); i++){
+		if(out[i].endNs >= sinceNs){
+			out[kept++] = out[i];
+		}
+	}
+	out.resize(kept);
+}
+
+void appendEscaped(std::string& text, const char* value){
+	for(const char* c = value; *c; c++){
+		if(*c == '"' || *c == '\\'){
+			text += '\\';
+		}
+		text += *c;
+	}
+}
+
+void watchLoop(){
+	std::unique_lock<std::mutex> lock(watcher.lock);
+	uint64_t seen = misses.load();
+	int64_t lastDumpNs = 0;
+	while(!watcher.stopping){
+		watcher.wake.wait_for(lock, std::chrono::milliseconds(20));
+		uint64_t now = misses.load();
+		if(now == seen || Metrics::nowNs() - lastDumpNs < 1000000000LL){
+			continue;
+		}
+		//let the spans around the miss finish before taking the window
+		watcher.wake.wait_for(lock, std::chrono::milliseconds(100));
+		seen = misses.load();
+		lastDumpNs = Metrics::nowNs();
+		char file[64];
+		std::snprintf(file, sizeof(file), "/trace-%lld.json", (long long)lastDumpNs);
+		std::string path = watcher.directory + file;
+		double seconds = watcher.lastSeconds;
+		lock.unlock();
+		if(!Trace::writeChromeJson(path, seconds)){
+			std::cout<<"cannot write trace "<<path<<std::endl;
+		}
+		lock.lock();
+	}
+	watcher.running = false;
+}
+
+}
+
+int64_t TraceScope::beginNow(){
+	return Metrics::nowNs();
+}
+
+void Trace::setEnabled(bool on){
+	tracing.store(on, std::memory_order_relaxed);
+}
+
+bool Trace::enabled(){
+	return tracing.load(std::memory_order_relaxed);
+}
+
+void Trace::setThreadName(const char* name){
+	localTrace()->name.store(name, std::memory_order_relaxed);
+}
+
+void Trace::span(const char* name, int64_t beginNs, int64_t endNs){
+	ThreadTrace* block = localTrace();
+	TraceEvent* events = block->events.load(std::memory_order_relaxed);
+	if(!events){
+		if(!enabled()){
+			return;
+		}
+		//published before the first head, so a reader that sees an event sees the ring
+		events = new TraceEvent[RING_EVENTS];
+		block->events.store(events, std::memory_order_release);
+	}
+	uint64_t head = block->head.load(std::memory_order_relaxed);
+	TraceEvent& event = events[head % RING_EVENTS];
+	event.name.store(name, std::memory_order_relaxed);
+	event.beginNs.store(beginNs, std::memory_order_relaxed);
+	event.endNs.store(endNs, std::memory_order_relaxed);
+	block->head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::end(const char* name, int64_t beginNs){
+	int64_t endNs = Metrics::nowNs();
+	span(name, beginNs, endNs);
+	int count = deadlineCount.load(std::memory_order_acquire);
+	for(int i = 0; i < count; i++){
+		if(std::strcmp(deadlines[i].name, name) == 0){
+			int64_t limit = deadlines[i].ns.load(std::memory_order_relaxed);
+			if(limit > 0 && endNs - beginNs > limit){
+				misses.fetch_add(1, std::memory_order_relaxed);
+			}
+			return;
+		}
+	}
+}
+
+std::string Trace::chromeJson(double lastSeconds){
+	int64_t sinceNs = Metrics::nowNs() - (int64_t)(lastSeconds * 1e9);
+	std::vector<ThreadTrace*> blocks;
+	{
+		std::lock_guard<std::mutex> lock(registryLock);
+		blocks = registry();
+	}
+	std::string text = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+	char line[192];
+	std::vector<CopiedEvent> events;
+	for(size_t t = 0; t < blocks.size(); t++){
+		const char* threadName = blocks[t]->name.load(std::memory_order_relaxed);
+		if(threadName){
+			text += first ? "\n" : ",\n";
+			first = false;
+			std::snprintf(line, sizeof(line), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", blocks[t]->tid);
+			text += line;
+			appendEscaped(text, threadName);
+			text += "\"}}";
+		}
+		events.clear();
+		copyRing(*blocks[t], sinceNs, events);
+		for(size_t e = 0; e < events.size(); e++){
+			text += first ? "\n" : ",\n";
+			first = false;
+			text += "{\"name\":\"";
+			appendEscaped(text, events[e].name);
+			std::snprintf(line, sizeof(line), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				blocks[t]->tid, events[e].beginNs * 1e-3, (events[e].endNs - events[e].beginNs) * 1e-3);
+			text += line;
+		}
+	}
+	text += "\n]}\n";
+	return text;
+}
+
+bool Trace::writeChromeJson(const std::string& path, double lastSeconds){
+	std::string text = chromeJson(lastSeconds);
+	std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+	out.write(text.data(), text.size());
+	return (bool)out;
+}
+
+void Trace::setDeadline(const char* name, int64_t ns){
+	std::lock_guard<std::mutex> lock(deadlineLock);
+	int count = deadlineCount.load(std::memory_order_relaxed);
+	for(int i = 0; i < count; i++){
+		if(std::strcmp(deadlines[i].name, name) == 0){
+			deadlines[i].ns.store(ns, std::memory_order_relaxed);
+			return;
+		}
+	}
+	if(ns <= 0 || count >= MAX_DEADLINES || std::strlen(name) >= sizeof(deadlines[count].name)){
+		return;
+	}
+	std::strcpy(deadlines[count].name, name);
+	deadlines[count].ns.store(ns, std::memory_order_relaxed);
+	deadlineCount.store(count + 1, std::memory_order_release);
+}
+
+uint64_t Trace::missedDeadlines(){
+	return misses.load(std::memory_order_relaxed);
+}
+
+bool Trace::startDeadlineDumps(const std::string& directory, double lastSeconds){
+	std::lock_guard<std::mutex> lock(watcher.lock);
+	if(watcher.running){
+		return false;
+	}
+	if(watcher.thread.joinable()){
+		watcher.thread.join();
+	}
+	watcher.directory = directory;
+	watcher.lastSeconds = lastSeconds;
+	watcher.stopping = false;
+	watcher.running = true;
+	watcher.thread = std::thread(watchLoop);
+	return true;
+}
+
+void Trace::stopDeadlineDumps(){
+	{
+		std::lock_guard<std::mutex> lock(watcher.lock);
+		watcher.stopping = true;
+	}
+	watcher.wake.notify_all();
+	if(watcher.thread.joinable()){
+		watcher.thread.join();
+	}
+}
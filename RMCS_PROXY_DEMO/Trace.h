@@ -0,0 +1,60 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdint.h>
+#include <string>
+
+//span timeline of the proxy threads, for looking at how they interleave around a latency spike
+//every thread writes begin/end pairs into its own ring, so a span costs two clock reads and three stores
+//off by default; while off a span is a single relaxed load. define RMCS_NO_TRACE to compile it all out
+
+class Trace
+{
+public:
+	//per thread, so "last N seconds" is bounded by how busy a thread is. allocated on the thread's first span
+	//while tracing is on; until then a span recorded with tracing off is dropped
+	static const int RING_EVENTS = 16384;
+
+	static void setEnabled(bool on);
+	static bool enabled();
+	static void setThreadName(const char* name); //string literal, shown as the thread's row
+	static void span(const char* name, int64_t beginNs, int64_t endNs); //name must be a string literal
+	static void end(const char* name, int64_t beginNs); //span up to now, and its deadline check
+
+	//chrome://tracing / Perfetto JSON of the spans that ended in the last seconds
+	static std::string chromeJson(double lastSeconds);
+	static bool writeChromeJson(const std::string& path, double lastSeconds);
+
+	//a span called name longer than ns counts as a missed deadline; ns <= 0 removes it
+	static void setDeadline(const char* name, int64_t ns);
+	static uint64_t missedDeadlines();
+	//background thread that dumps the last seconds to directory/trace-<ns>.json shortly after a miss, at most once a second;
+	//<ns> is Metrics::nowNs, the clock of the spans
+	static bool startDeadlineDumps(const std::string& directory, double lastSeconds);
+	static void stopDeadlineDumps();
+};
+
+//traces the enclosing scope while tracing is on
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* name) : name(name), begin(Trace::enabled() ? beginNow() : 0) {}
+	~TraceScope() { if(begin) Trace::end(name, begin); }
+private:
+	static int64_t beginNow();
+	const char* name;
+	int64_t begin;
+	TraceScope(const TraceScope&);
+	TraceScope& operator=(const TraceScope&);
+};
+
+#ifndef RMCS_NO_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_THREAD(name) Trace::setThreadName(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,183 @@
+#include <cmath>
+#include <cstring>
+#include "WireFormat.h"
+
+namespace {
+
+template<typename T>
+inline void store(char* out, T value){
+	std::memcpy(out, &value, sizeof(T));
+}
+
+template<typename T>
+inline T load(const char* in){
+	T value;
+	std::memcpy(&value, in, sizeof(T));
+	return value;
+}
+
+}
+
+void wireWriteHeader(char* out, uint8_t type, uint32_t stream, uint32_t length){
+	store<uint16_t>(out, WIRE_MAGIC);
+	store<uint8_t>(out + 2, WIRE_VERSION);
+	store<uint8_t>(out + 3, type);
+	store<uint32_t>(out + 4, stream);
+	store<uint32_t>(out + 8, length);
+}
+
+bool wireReadHeader(const char* data, size_t size, WireHeader& header){
+	if(size < WIRE_HEADER_SIZE || load<uint16_t>(data) != WIRE_MAGIC){
+		return false;
+	}
+	header.version = load<uint8_t>(data + 2);
+	header.type = load<uint8_t>(data + 3);
+	header.stream = load<uint32_t>(data + 4);
+	header.length = load<uint32_t>(data + 8);
+	return header.version == WIRE_VERSION;
+}
+
+void wireEncodeSchema(std::string& out, uint8_t kind, const std::string& group,
+	const std::vector<std::string>& modules, const uint8_t* fields, size_t fieldCount)
+{
+	size_t size = 6 + group.size() + fieldCount;
+	for(size_t m = 0; m < modules.size(); m++){
+		size += 2 + modules[m].size();
+	}
+	size_t offset = out.size();
+	out.resize(offset + size);
+	char* p = &out[offset];
+	store<uint8_t>(p, kind);
+	store<uint8_t>(p + 1, (uint8_t)fieldCount);
+	store<uint16_t>(p + 2, (uint16_t)modules.size());
+	store<uint16_t>(p + 4, (uint16_t)group.size());
+	p += 6;
+	std::memcpy(p, group.data(), group.size());
+	p += group.size();
+	std::memcpy(p, fields, fieldCount);
+	p += fieldCount;
+	for(size_t m = 0; m < modules.size(); m++){
+		store<uint16_t>(p, (uint16_t)modules[m].size());
+		std::memcpy(p + 2, modules[m].data(), modules[m].size());
+		p += 2 + modules[m].size();
+	}
+}
+
+bool wireDecodeSchema(const char* payload, size_t size, WireSchemaInfo& schema){
+	if(size < 6){
+		return false;
+	}
+	schema.kind = load<uint8_t>(payload);
+	size_t fieldCount = load<uint8_t>(payload + 1);
+	size_t moduleCount = load<uint16_t>(payload + 2);
+	size_t groupLength = load<uint16_t>(payload + 4);
+	size_t offset = 6;
+	if(fieldCount > WIRE_MAX_FIELDS || size - offset < groupLength + fieldCount){
+		return false;
+	}
+	schema.group.assign(payload + offset, groupLength);
+	offset += groupLength;
+	schema.fields.assign((const uint8_t*)payload + offset, (const uint8_t*)payload + offset + fieldCount);
+	offset += fieldCount;
+	schema.modules.resize(moduleCount);
+	for(size_t m = 0; m < moduleCount; m++){
+		if(size - offset < 2){
+			return false;
+		}
+		size_t length = load<uint16_t>(payload + offset);
+		offset += 2;
+		if(size - offset < length){
+			return false;
+		}
+		schema.modules[m].assign(payload + offset, length);
+		offset += length;
+	}
+	return offset == size;
+}
+
+void wireEncodeFeedback(std::string& out, const GroupFeedbackFrame& frame,
+	const std::vector<int>& moduleIndex, const std::vector<FeedbackField>& fields)
+{
+	size_t recordSize = wireRecordSize(fields.size());
+	size_t offset = out.size();
+	out.resize(offset + WIRE_SAMPLES_HEADER_SIZE + moduleIndex.size() * recordSize);
+	char* p = &out[offset];
+	store<int64_t>(p, frame.timestampUs);
+	store<uint16_t>(p + 8, (uint16_t)moduleIndex.size());
+	store<uint16_t>(p + 10, (uint16_t)fields.size());
+	store<uint32_t>(p + 12, 0);
+	p += WIRE_SAMPLES_HEADER_SIZE;
+	for(size_t m = 0; m < moduleIndex.size(); m++, p += recordSize){
+		int index = moduleIndex[m];
+		uint32_t present = 0;
+		if(index < 0 || (size_t)index >= frame.modules.size()){
+			for(size_t f = 0; f < fields.size(); f++){
+				store<double>(p + 8 + 8 * f, NAN);
+			}
+		}
+		else{
+			const FeedbackSample& sample = frame.modules[index];
+			for(size_t f = 0; f < fields.size(); f++){
+				if(sample.has(fields[f])){
+					present |= 1u << f;
+				}
+				store<double>(p + 8 + 8 * f, sample.values[fields[f]]);
+			}
+		}
+		store<uint32_t>(p, present);
+		store<uint32_t>(p + 4, 0);
+	}
+}
+
+void wireEncodeSamples(std::string& out, int64_t timeUs, uint32_t flags, size_t moduleCount, size_t fieldCount,
+	const uint32_t* present, const double* values)
+{
+	size_t recordSize = wireRecordSize(fieldCount);
+	size_t offset = out.size();
+	out.resize(offset + WIRE_SAMPLES_HEADER_SIZE + moduleCount * recordSize);
+	char* p = &out[offset];
+	store<int64_t>(p, timeUs);
+	store<uint16_t>(p + 8, (uint16_t)moduleCount);
+	store<uint16_t>(p + 10, (uint16_t)fieldCount);
+	store<uint32_t>(p + 12, flags);
+	p += WIRE_SAMPLES_HEADER_SIZE;
+	for(size_t m = 0; m < moduleCount; m++, p += recordSize){
+		store<uint32_t>(p, present[m]);
+		store<uint32_t>(p + 4, 0);
+		std::memcpy(p + 8, values + m * fieldCount, fieldCount * sizeof(double));
+	}
+}
+
+bool WireSamplesView::parse(const char* payload, size_t size){
+	data = NULL;
+	modules = 0;
+	fields = 0;
+	if(size < WIRE_SAMPLES_HEADER_SIZE){
+		return false;
+	}
+	size_t moduleCount = load<uint16_t>(payload + 8);
+	size_t fieldCount = load<uint16_t>(payload + 10);
+	if(fieldCount > WIRE_MAX_FIELDS || size != WIRE_SAMPLES_HEADER_SIZE + moduleCount * wireRecordSize(fieldCount)){
+		return false;
+	}
+	data = payload;
+	modules = moduleCount;
+	fields = fieldCount;
+	return true;
+}
+
+int64_t WireSamplesView::timeUs() const{
+	return load<int64_t>(data);
+}
+
+uint32_t WireSamplesView::flags() const{
+	return load<uint32_t>(data + 12);
+}
+
+uint32_t WireSamplesView::present(size_t module) const{
+	return load<uint32_t>(record(module));
+}
+
+double WireSamplesView::value(size_t module, size_t field) const{
+	return load<double>(record(module) + 8 + 8 * field);
+}
@@ -0,0 +1,101 @@
+#ifndef WIREFORMAT_H
+#define WIREFORMAT_H
+#include "FeedBackManager.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//binary frames of the api, version 1. integers and doubles are little-endian, as on every host the proxy runs on
+//
+//every frame is a 12 byte header followed by length payload bytes:
+//	uint16 magic (WIRE_MAGIC), uint8 version, uint8 type (WireType), uint32 stream, uint32 length
+//stream is the subscription id for feedback and the client's command stream id for commands.
+//
+//a WireSchema payload describes the columns of one stream and comes before its first samples:
+//	uint8 kind (WireFeedback or WireCommand), uint8 fieldCount, uint16 moduleCount,
+//	uint16 groupLength, group bytes, fieldCount x uint8 field (FeedbackField or WireCommandField),
+//	moduleCount x (uint16 length, "family/name" bytes)
+//
+//WireFeedback and WireCommand payloads share one fixed-offset layout:
+//	int64 timeUs (receive time of feedback, creation time of a command), uint16 moduleCount,
+//	uint16 fieldCount, uint32 flags, then per module at 16 + m * wireRecordSize(fieldCount):
+//	uint32 present (bit f set if column f is valid), uint32 reserved, double values[fieldCount] (NaN when absent)
+//a module of the schema that is missing from the group has present == 0.
+
+const uint16_t WIRE_MAGIC = 0x5752; //"RW"
+const uint8_t WIRE_VERSION = 1;
+const size_t WIRE_HEADER_SIZE = 12;
+const size_t WIRE_SAMPLES_HEADER_SIZE = 16;
+const size_t WIRE_MAX_FIELDS = 32; //width of the presence bitmap
+
+enum WireType{
+	WireText = 1, //a json line: replies to requests, metrics
+	WireSchema,
+	WireFeedback,
+	WireCommand
+};
+
+enum WireFlags{
+	WireFlagAcknowledge = 1 //command: send with acknowledgement
+};
+
+//columns a command stream may set
+enum WireCommandField{
+	WireCommandPosition,
+	WireCommandVelocity,
+	WireCommandEffort,
+	WireCommandFieldCount
+};
+
+struct WireHeader{
+	uint8_t version;
+	uint8_t type;
+	uint32_t stream;
+	uint32_t length;
+};
+
+struct WireSchemaInfo{
+	uint8_t kind;
+	std::string group;
+	std::vector<uint8_t> fields;
+	std::vector<std::string> modules;
+};
+
+inline size_t wireRecordSize(size_t fieldCount) { return 8 + 8 * fieldCount; }
+
+void wireWriteHeader(char* out, uint8_t type, uint32_t stream, uint32_t length);
+//false if size is too short or the bytes are not a frame of this version
+bool wireReadHeader(const char* data, size_t size, WireHeader& header);
+
+void wireEncodeSchema(std::string& out, uint8_t kind, const std::string& group,
+	const std::vector<std::string>& modules, const uint8_t* fields, size_t fieldCount);
+bool wireDecodeSchema(const char* payload, size_t size, WireSchemaInfo& schema);
+
+//appends the samples payload of the modules at moduleIndex (-1: absent) restricted to fields
+void wireEncodeFeedback(std::string& out, const GroupFeedbackFrame& frame,
+	const std::vector<int>& moduleIndex, const std::vector<FeedbackField>& fields);
+//appends a samples payload from row-major values, moduleCount x fieldCount, and one presence word per module
+void wireEncodeSamples(std::string& out, int64_t timeUs, uint32_t flags, size_t moduleCount, size_t fieldCount,
+	const uint32_t* present, const double* values);
+
+//reads a samples payload in place; the bytes must outlive the view
+class WireSamplesView
+{
+public:
+	WireSamplesView() : data(NULL), modules(0), fields(0) {}
+	bool parse(const char* payload, size_t size); //false if the sizes do not add up
+	int64_t timeUs() const;
+	uint32_t flags() const;
+	size_t moduleCount() const { return modules; }
+	size_t fieldCount() const { return fields; }
+	uint32_t present(size_t module) const;
+	bool has(size_t module, size_t field) const { return (present(module) & (1u << field)) != 0; }
+	double value(size_t module, size_t field) const;
+	const char* record(size_t module) const { return data + WIRE_SAMPLES_HEADER_SIZE + module * wireRecordSize(fields); }
+private:
+	const char* data;
+	size_t modules;
+	size_t fields;
+};
+
+#endif
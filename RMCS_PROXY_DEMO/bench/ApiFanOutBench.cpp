@@ -0,0 +1,400 @@
+//cost of pushing live feedback to many ServerApiManager subscribers over a unix socket
+//
+//every client subscribes to the same group, fields and rate, so they all share one stream:
+//the server encodes each frame once and queues the same buffer on every connection.
+//reported per format and client count:
+//  server cpu   cpu time of the api thread over the run, in percent of one core
+//  fanOut       duration of one fan-out tick (MetricApiFanOut), queueing a frame for every client
+//  latency      frame published into the CacheManager until a client has read it, microseconds
+//with --stalled, that many more clients subscribe and never read: their queues must stay bounded
+//by the backpressure policy while the reading clients keep their latency.
+//  stalled      largest queue of a stalled client in the server, and its conflated + dropped samples
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -pthread -I. -Isrc -idirafter include bench/ApiFanOutBench.cpp
+//    CacheManager.cpp HistoryRing.cpp DataBaseManager.cpp ThreadPool.cpp ServerApiManager.cpp ApiConnection.cpp
+//    WireFormat.cpp JsonWriter.cpp CommandParser.cpp CommandCustomer.cpp CommandJournal.cpp FeedBackManager.cpp
+//    FeedBackRecorder.cpp CThread.cpp LatencyHistogram.cpp Metrics.cpp Trace.cpp LockProfile.cpp sim/*.cpp src/*.cpp
+//    -Llib/linux_x86-64 -l:libhebi.so.0.16 -o fanout_bench
+//
+//usage: fanout_bench [--clients 100,1000] [--formats json,binary] [--modules 30] [--fields position,velocity,torque]
+//                    [--rate 500] [--seconds 3] [--readers 4] [--stalled 0] [--policy conflate]
+//                    [--socket /tmp/rmcs_fanout_bench.sock]
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CacheManager.h"
+#include "DataBaseManager.h"
+#include "LatencyHistogram.h"
+#include "Metrics.h"
+#include "ServerApiManager.h"
+#include "WireFormat.h"
+
+namespace {
+
+struct Options{
+	std::vector<size_t> clientCounts;
+	std::vector<std::string> formats;
+	size_t modules;
+	std::string fields;
+	double rateHz;
+	double seconds;
+	size_t readers;
+	size_t stalled;
+	ApiBackpressure policy;
+	std::string socketPath;
+
+	Options() : modules(30), fields("position,velocity,torque"), rateHz(500), seconds(3), readers(4), stalled(0),
+		policy(ApiConflate), socketPath("/tmp/rmcs_fanout_bench.sock") {}
+};
+
+std::vector<std::string> parseWords(const std::string& text){
+	std::vector<std::string> words;
+	std::stringstream items(text);
+	std::string item;
+	while(std::getline(items, item, ',')){
+		if(!item.empty()){
+			words.push_back(item);
+		}
+	}
+	return words;
+}
+
+bool parse(int argc, char** argv, Options& options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(i + 1 >= argc){
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--clients"){
+			std::vector<std::string> counts = parseWords(value);
+			for(size_t c = 0; c < counts.size(); c++){
+				options.clientCounts.push_back((size_t)std::atol(counts[c].c_str()));
+			}
+		}
+		else if(arg == "--formats") options.formats = parseWords(value);
+		else if(arg == "--modules") options.modules = (size_t)std::atol(value.c_str());
+		else if(arg == "--fields") options.fields = value;
+		else if(arg == "--rate") options.rateHz = std::atof(value.c_str());
+		else if(arg == "--seconds") options.seconds = std::atof(value.c_str());
+		else if(arg == "--readers") options.readers = (size_t)std::atol(value.c_str());
+		else if(arg == "--stalled") options.stalled = (size_t)std::atol(value.c_str());
+		else if(arg == "--policy"){
+			if(!apiBackpressureFromName(value, &options.policy)){
+				return false;
+			}
+		}
+		else if(arg == "--socket") options.socketPath = value;
+		else return false;
+	}
+	if(options.clientCounts.empty()){
+		options.clientCounts.push_back(100);
+		options.clientCounts.push_back(1000);
+	}
+	if(options.formats.empty()){
+		options.formats = parseWords("json,binary");
+	}
+	return options.rateHz > 0 && options.seconds > 0 && options.readers > 0;
+}
+
+int64_t nowUs(){
+	return Metrics::nowNs() / 1000;
+}
+
+//one subscriber: its socket and the bytes of a message not yet complete
+struct BenchClient{
+	int socket;
+	std::string in;
+};
+
+//drains a slice of the clients and times every sample it sees
+struct Reader{
+	std::vector<BenchClient*> clients;
+	bool binary;
+	LatencyHistogram latency;
+	uint64_t samples;
+	uint64_t bytes;
+	std::thread thread;
+
+	Reader() : binary(false), samples(0), bytes(0) {}
+
+	void consume(BenchClient& client, int64_t receivedUs){
+		std::string& in = client.in;
+		size_t offset = 0;
+		if(binary){
+			WireHeader header;
+			while(wireReadHeader(in.data() + offset, in.size() - offset, header) && in.size() - offset >= WIRE_HEADER_SIZE + header.length){
+				const char* payload = in.data() + offset + WIRE_HEADER_SIZE;
+				if(header.type == WireFeedback){
+					WireSamplesView view;
+					if(view.parse(payload, header.length)){
+						latency.record(receivedUs - view.timeUs());
+						samples++;
+					}
+				}
+				offset += WIRE_HEADER_SIZE + header.length;
+			}
+		}
+		else{
+			for(;;){
+				size_t end = in.find('\n', offset);
+				if(end == std::string::npos){
+					break;
+				}
+				if(in.compare(offset, 7, "{\"sub\":") == 0){
+					size_t t = in.find("\"t\":", offset);
+					if(t != std::string::npos && t < end){
+						latency.record(receivedUs - std::atoll(in.c_str() + t + 4));
+						samples++;
+					}
+				}
+				offset = end + 1;
+			}
+		}
+		in.erase(0, offset);
+	}
+
+	void run(const std::atomic<bool>& stopping){
+		std::vector<pollfd> fds(clients.size());
+		for(size_t c = 0; c < clients.size(); c++){
+			fds[c].fd = clients[c]->socket;
+			fds[c].events = POLLIN;
+		}
+		char buffer[64 * 1024];
+		while(!stopping){
+			if(poll(&fds[0], fds.size(), 10) <= 0){
+				continue;
+			}
+			for(size_t c = 0; c < fds.size(); c++){
+				if(!(fds[c].revents & POLLIN)){
+					continue;
+				}
+				ssize_t got = recv(fds[c].fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+				if(got > 0){
+					bytes += (uint64_t)got;
+					clients[c]->in.append(buffer, (size_t)got);
+					consume(*clients[c], nowUs());
+				}
+			}
+		}
+	}
+};
+
+int connectUnix(const std::string& path){
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+	if(fd < 0 || connect(fd, (const sockaddr*)&address, sizeof(address)) != 0){
+		if(fd >= 0){
+			close(fd);
+		}
+		return -1;
+	}
+	return fd;
+}
+
+GroupFeedbackFrame makeFrame(size_t modules){
+	GroupFeedbackFrame frame;
+	frame.groupKey = "bench";
+	std::shared_ptr<std::vector<std::string> > keys = std::make_shared<std::vector<std::string> >();
+	frame.modules.resize(modules);
+	for(size_t m = 0; m < modules; m++){
+		std::ostringstream name;
+		name<<"arm/j"<<m;
+		keys->push_back(name.str());
+		FeedbackSample& sample = frame.modules[m];
+		sample.present = 0;
+		for(int f = 0; f < FieldCount; f++){
+			sample.values[f] = NAN;
+		}
+	}
+	frame.moduleKeys = keys;
+	return frame;
+}
+
+double threadCpuSeconds(std::thread& thread){
+	clockid_t clock;
+	timespec time;
+	if(pthread_getcpuclockid(thread.native_handle(), &clock) != 0 || clock_gettime(clock, &time) != 0){
+		return 0;
+	}
+	return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+MetricSummary difference(const MetricSummary& after, const MetricSummary& before){
+	MetricSummary summary;
+	summary.count = after.count - before.count;
+	summary.sumNs = after.sumNs - before.sumNs;
+	for(int b = 0; b < METRIC_BUCKETS; b++){
+		summary.buckets[b] = after.buckets[b] - before.buckets[b];
+	}
+	return summary;
+}
+
+bool runOnce(const Options& options, const std::string& format, size_t clientCount){
+	CacheManager cache;
+	DataBaseManager database;
+	ServerApiManager api(database, cache);
+	ApiServerConfig config;
+	config.unixPath = options.socketPath;
+	config.maxClients = clientCount + options.stalled;
+	config.maxRateHz = options.rateHz;
+	config.backpressure = options.policy;
+	if(!api.listen(config)){
+		return false;
+	}
+	std::thread apiThread(&ServerApiManager::run, &api);
+
+	std::ostringstream request;
+	if(format == "binary"){
+		request<<"format binary\n";
+	}
+	request<<"subscribe 1 bench "<<options.rateHz<<" "<<options.fields<<"\n";
+	std::vector<BenchClient> clients(clientCount);
+	for(size_t c = 0; c < clientCount; c++){
+		clients[c].socket = connectUnix(options.socketPath);
+		if(clients[c].socket < 0 || send(clients[c].socket, request.str().data(), request.str().size(), MSG_NOSIGNAL) < 0){
+			std::cerr<<"cannot connect client "<<c<<std::endl;
+			return false;
+		}
+	}
+	std::vector<int> stalled(options.stalled);
+	for(size_t c = 0; c < stalled.size(); c++){
+		stalled[c] = connectUnix(options.socketPath);
+		if(stalled[c] < 0 || send(stalled[c], request.str().data(), request.str().size(), MSG_NOSIGNAL) < 0){
+			std::cerr<<"cannot connect stalled client "<<c<<std::endl;
+			return false;
+		}
+	}
+	std::vector<Reader> readers(options.readers);
+	for(size_t c = 0; c < clientCount; c++){
+		readers[c % readers.size()].clients.push_back(&clients[c]);
+	}
+	std::atomic<bool> stopping(false);
+	for(size_t r = 0; r < readers.size(); r++){
+		readers[r].binary = format == "binary";
+		if(!readers[r].clients.empty()){
+			readers[r].thread = std::thread(&Reader::run, &readers[r], std::ref(stopping));
+		}
+	}
+	while(api.getClientCount() < clientCount + stalled.size()){
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	GroupFeedbackFrame frame = makeFrame(options.modules);
+	MetricSummary fanOutBefore;
+	Metrics::summary(MetricApiFanOut, fanOutBefore);
+	double cpuBefore = threadCpuSeconds(apiThread);
+	int64_t periodUs = (int64_t)(1e6 / options.rateHz);
+	int64_t startUs = nowUs();
+	int64_t nextUs = startUs;
+	uint64_t frames = 0;
+	while(nowUs() - startUs < (int64_t)(options.seconds * 1e6)){
+		for(size_t m = 0; m < frame.modules.size(); m++){
+			FeedbackSample& sample = frame.modules[m];
+			sample.present = (1u << FieldPosition) | (1u << FieldVelocity) | (1u << FieldTorque);
+			sample.values[FieldPosition] = std::sin(0.001 * (double)frames + (double)m);
+			sample.values[FieldVelocity] = std::cos(0.001 * (double)frames + (double)m);
+			sample.values[FieldTorque] = 0.25 * (double)m;
+		}
+		frame.timestampUs = nowUs();
+		cache.onFrame(frame);
+		api.onFrame(frame);
+		frames++;
+		nextUs += periodUs;
+		int64_t waitUs = nextUs - nowUs();
+		if(waitUs > 0){
+			std::this_thread::sleep_for(std::chrono::microseconds(waitUs));
+		}
+	}
+	double elapsed = (double)(nowUs() - startUs) * 1e-6;
+	std::this_thread::sleep_for(std::chrono::milliseconds(100)); //let the last frames arrive
+	double cpu = threadCpuSeconds(apiThread) - cpuBefore;
+	MetricSummary fanOutAfter;
+	Metrics::summary(MetricApiFanOut, fanOutAfter);
+	MetricSummary fanOut = difference(fanOutAfter, fanOutBefore);
+	std::this_thread::sleep_for(std::chrono::milliseconds(150)); //a fresh client stats snapshot
+	std::vector<ApiClientStats> clientStats = api.getClientStats();
+	size_t stalledQueue = 0;
+	uint64_t stalledShed = 0;
+	size_t disconnected = clientCount + stalled.size() - clientStats.size();
+	for(size_t c = 0; c < clientStats.size(); c++){
+		//the stalled clients connected last
+		if(clientStats[c].client > clientCount){
+			stalledQueue = std::max(stalledQueue, clientStats[c].connection.queuedBytes);
+			stalledShed += clientStats[c].connection.conflated + clientStats[c].connection.dropped;
+		}
+	}
+
+	stopping = true;
+	LatencyHistogram latency;
+	uint64_t samples = 0;
+	uint64_t bytes = 0;
+	for(size_t r = 0; r < readers.size(); r++){
+		if(readers[r].thread.joinable()){
+			readers[r].thread.join();
+		}
+		latency.add(readers[r].latency);
+		samples += readers[r].samples;
+		bytes += readers[r].bytes;
+	}
+	api.shutdown();
+	apiThread.join();
+	for(size_t c = 0; c < clientCount; c++){
+		close(clients[c].socket);
+	}
+	for(size_t c = 0; c < stalled.size(); c++){
+		close(stalled[c]);
+	}
+
+	std::printf("%-6s clients %5zu  frames %6llu  delivered %5.1f%%  %8.1f MB/s  server cpu %5.1f%%"
+		"  fanOut p50 %7.1f p99 %7.1f us  latency p50 %6lld p99 %6lld max %7lld us\n",
+		format.c_str(), clientCount, (unsigned long long)frames,
+		100.0 * (double)samples / (double)(frames * clientCount), (double)bytes / elapsed / 1e6, 100.0 * cpu / elapsed,
+		(double)fanOut.percentileNs(50) / 1000, (double)fanOut.percentileNs(99) / 1000,
+		(long long)latency.percentile(50), (long long)latency.percentile(99), (long long)latency.max());
+	if(!stalled.empty()){
+		std::printf("       stalled %5zu  policy %s  largest queue %zu bytes  shed %llu samples  disconnected %zu\n",
+			stalled.size(), apiBackpressureName(options.policy), stalledQueue, (unsigned long long)stalledShed, disconnected);
+	}
+	std::fflush(stdout);
+	return true;
+}
+
+}
+
+int main(int argc, char** argv){
+	Options options;
+	if(!parse(argc, argv, options)){
+		std::cerr<<"usage: fanout_bench [--clients 100,1000] [--formats json,binary] [--modules 30]"
+			" [--fields position,velocity,torque] [--rate 500] [--seconds 3] [--readers 4] [--stalled 0]"
+			" [--policy conflate|drop-oldest|disconnect] [--socket path]"<<std::endl;
+		return 1;
+	}
+	for(size_t c = 0; c < options.clientCounts.size(); c++){
+		for(size_t f = 0; f < options.formats.size(); f++){
+			if(!runOnce(options, options.formats[f], options.clientCounts[c])){
+				std::cerr<<"run failed: "<<options.formats[f]<<" "<<options.clientCounts[c]<<" clients"<<std::endl;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,445 @@
+//client command ingest on one core: bytes of a client's commands in, queued GroupCommands out
+//
+//  json parse     JsonCommandParser on a line, into a pooled GroupCommand
+//  binary parse   parseBinaryCommand on a WireCommand frame, into a pooled GroupCommand
+//  json socket    the same lines through an ApiConnection over a socket pair: recv, split, parse
+//  binary socket  the same frames through an ApiConnection
+//  json naive     the obvious way, for comparison: line copied into std::string, numbers through
+//                 std::istringstream into std::vector and Eigen::VectorXd, a new GroupCommand with its bulk setters
+//every parsed command is checked against the values that were sent. the last --hold commands are kept
+//alive, like the command queue and journal would, so the pool has to find free ones.
+//first, commands with a value no field can hold (1e400, NaN, inf, a position past int64_t revolutions, a
+//velocity past float) must fail in both formats without taking a command from the pool
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -pthread -I. -Isrc -idirafter include bench/CommandIngestBench.cpp CommandParser.cpp
+//    ApiConnection.cpp WireFormat.cpp Metrics.cpp sim/SimMessages.cpp src/group_command.cpp src/command.cpp -o ingest_bench
+//
+//usage: ingest_bench [--modules 1,30,100] [--fields 3] [--commands 200000] [--hold 8]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include "ApiConnection.h"
+#include "CommandParser.h"
+#include "sim/SimMessages.h"
+
+namespace {
+
+struct Options{
+	std::vector<size_t> moduleCounts;
+	size_t fieldCount;
+	size_t commands;
+	size_t hold;
+
+	Options() : fieldCount(3), commands(200000), hold(8) {}
+};
+
+std::vector<size_t> parseList(const std::string& text){
+	std::vector<size_t> values;
+	std::stringstream items(text);
+	std::string item;
+	while(std::getline(items, item, ',')){
+		if(!item.empty()){
+			values.push_back((size_t)std::atol(item.c_str()));
+		}
+	}
+	return values;
+}
+
+bool parse(int argc, char** argv, Options& options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(i + 1 >= argc){
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--modules") options.moduleCounts = parseList(value);
+		else if(arg == "--fields") options.fieldCount = (size_t)std::atol(value.c_str());
+		else if(arg == "--commands") options.commands = (size_t)std::atol(value.c_str());
+		else if(arg == "--hold") options.hold = (size_t)std::atol(value.c_str());
+		else return false;
+	}
+	if(options.moduleCounts.empty()){
+		options.moduleCounts = parseList("1,30,100");
+	}
+	return options.fieldCount >= 1 && options.fieldCount <= WireCommandFieldCount && options.commands > 0;
+}
+
+double nowNs(){
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* const FIELD_NAMES[WireCommandFieldCount] = {"position", "velocity", "effort"};
+
+//value of module m, field f in the command numbered n; exact in float so the check can compare
+double valueOf(size_t n, size_t m, size_t f){
+	return (double)(int)((n * 7 + m * 3 + f) % 4096) * 0.25 - 100.0;
+}
+
+std::string jsonLine(const CommandTarget& target, size_t n, size_t fieldCount){
+	std::ostringstream line;
+	line<<"{\"group\":\""<<target.groupKey<<"\",\"modules\":[";
+	for(size_t m = 0; m < target.moduleKeys->size(); m++){
+		line<<(m ? "," : "")<<"\""<<(*target.moduleKeys)[m]<<"\"";
+	}
+	line<<"]";
+	for(size_t f = 0; f < fieldCount; f++){
+		line<<",\""<<FIELD_NAMES[f]<<"\":[";
+		for(size_t m = 0; m < target.moduleKeys->size(); m++){
+			line<<(m ? "," : "")<<valueOf(n, m, f);
+		}
+		line<<"]";
+	}
+	line<<"}\n";
+	return line.str();
+}
+
+std::string binaryFrame(size_t modules, size_t n, size_t fieldCount){
+	std::vector<uint32_t> present(modules, (1u << fieldCount) - 1);
+	std::vector<double> values(modules * fieldCount);
+	for(size_t m = 0; m < modules; m++){
+		for(size_t f = 0; f < fieldCount; f++){
+			values[m * fieldCount + f] = valueOf(n, m, f);
+		}
+	}
+	std::string payload;
+	wireEncodeSamples(payload, (int64_t)n + 1, 0, modules, fieldCount, &present[0], &values[0]);
+	std::string frame(WIRE_HEADER_SIZE, '\0');
+	wireWriteHeader(&frame[0], WireCommand, 1, (uint32_t)payload.size());
+	return frame + payload;
+}
+
+bool check(const CommandElement& element, size_t n, size_t fieldCount){
+	const hebi::GroupCommand& command = *element.command;
+	for(int m = 0; m < command.size(); m++){
+		HebiCommandPtr module = hebiGroupCommandGetModuleCommand(command.internal_, m);
+		for(size_t f = 0; f < fieldCount; f++){
+			double value;
+			if(f == WireCommandPosition){
+				int64_t revolutions;
+				float offset;
+				hebiCommandGetHighResAngle(module, CommandHighResAnglePosition, &revolutions, &offset);
+				value = simJoinAngle(revolutions, offset);
+			}
+			else{
+				value = hebiCommandGetFloat(module, f == WireCommandVelocity ? CommandFloatVelocity : CommandFloatTorque);
+			}
+			if(std::fabs(value - valueOf(n, (size_t)m, f)) > 1e-4){
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+//what the command queue and journal would still hold
+struct Holder{
+	std::deque<CommandElement> held;
+	size_t hold;
+
+	void keep(const CommandElement& element){
+		held.push_back(element);
+		if(held.size() > hold){
+			held.pop_front();
+		}
+	}
+};
+
+//parses the n-th json command the obvious way and builds a fresh command with the bulk setters
+std::shared_ptr<hebi::GroupCommand> naive(const char* data, size_t size, const CommandTarget& target){
+	std::string line(data, size);
+	std::shared_ptr<hebi::GroupCommand> command = std::make_shared<hebi::GroupCommand>(target.pool->getModules());
+	for(int f = 0; f < WireCommandFieldCount; f++){
+		std::string key = std::string("\"") + FIELD_NAMES[f] + "\":[";
+		size_t start = line.find(key);
+		if(start == std::string::npos){
+			continue;
+		}
+		start += key.size();
+		std::string list = line.substr(start, line.find(']', start) - start);
+		std::vector<double> values;
+		std::istringstream items(list);
+		std::string item;
+		while(std::getline(items, item, ',')){
+			values.push_back(std::strtod(item.c_str(), NULL));
+		}
+		Eigen::VectorXd vector(values.size());
+		for(size_t i = 0; i < values.size(); i++){
+			vector[i] = values[i];
+		}
+		if(f == WireCommandPosition) command->setPosition(vector);
+		else if(f == WireCommandVelocity) command->setVelocity(vector);
+		else command->setTorque(vector);
+	}
+	return command;
+}
+
+void report(const char* name, size_t modules, size_t bytes, size_t commands, double elapsedNs){
+	double perCommand = elapsedNs / (double)commands;
+	std::printf("%-14s modules %4zu  bytes %6zu  %8.2f us/command  %9.0f commands/s  %7.1f MB/s\n",
+		name, modules, bytes, perCommand / 1e3, 1e9 / perCommand, (double)bytes * 1e3 / perCommand);
+}
+
+//parses what the connection has received; false on a command that fails or does not match what was sent
+bool drain(ApiConnection& connection, std::vector<ApiRequest>& requests, JsonCommandParser& parser,
+	const std::vector<const CommandTarget*>& targets, const CommandStream& stream, size_t variants, size_t fieldCount,
+	Holder& holder, size_t* parsed)
+{
+	requests.clear();
+	connection.receive(requests);
+	for(size_t r = 0; r < requests.size(); r++, (*parsed)++){
+		const ApiRequest& request = requests[r];
+		CommandElement element;
+		const char* error;
+		bool ok = request.frame ?
+			parseBinaryCommand(stream, request.data + WIRE_HEADER_SIZE, request.size - WIRE_HEADER_SIZE, element, &error) :
+			parser.parse(request.data, request.size, targets, element, &error);
+		if(!ok || !check(element, *parsed % variants, fieldCount)){
+			return false;
+		}
+		holder.keep(element);
+	}
+	return true;
+}
+
+//writes the messages through a socket pair in batches and ingests them with an ApiConnection on the same thread
+bool throughSocket(const std::vector<std::string>& messages, size_t commands, const std::vector<const CommandTarget*>& targets,
+	const CommandStream& stream, size_t fieldCount, Holder& holder, double* elapsedNs)
+{
+	ApiSocket pair[2];
+	if(!ApiConnection::socketPair(pair)){
+		return false;
+	}
+	bool ok = true;
+	{
+		ApiConnection connection(pair[0]);
+		JsonCommandParser parser;
+		std::vector<ApiRequest> requests;
+		std::string batch;
+		size_t sent = 0, parsed = 0;
+		double start = nowNs();
+		while(parsed < commands && ok){
+			batch.clear();
+			while(sent < commands && batch.size() < 64 * 1024){
+				batch += messages[sent % messages.size()];
+				sent++;
+			}
+			size_t offset = 0;
+			while(offset < batch.size() && ok){
+				ssize_t wrote = ::send(pair[1], batch.data() + offset, batch.size() - offset, 0);
+				if(wrote > 0){
+					offset += (size_t)wrote;
+				}
+				else{
+					//socket buffer full
+					ok = drain(connection, requests, parser, targets, stream, messages.size(), fieldCount, holder, &parsed);
+				}
+			}
+			while(parsed < sent && ok){
+				ok = drain(connection, requests, parser, targets, stream, messages.size(), fieldCount, holder, &parsed);
+			}
+		}
+		*elapsedNs = nowNs() - start;
+	}
+	ApiConnection::close(pair[1]);
+	return ok;
+}
+
+//one bad value in an otherwise valid command of two modules; json gets the value's text, binary its double
+struct BadValue{
+	const char* json;
+	double binary;
+	size_t field;
+};
+
+bool rejectsBadValues(){
+	CommandTarget target;
+	target.groupKey = "arm";
+	target.moduleKeys = std::make_shared<std::vector<std::string> >(std::vector<std::string>{"arm/j0", "arm/j1"});
+	target.pool = std::make_shared<CommandPool>(2, 64);
+	std::vector<const CommandTarget*> targets(1, &target);
+	WireSchemaInfo schema;
+	schema.kind = WireCommand;
+	schema.group = target.groupKey;
+	for(size_t f = 0; f < WireCommandFieldCount; f++){
+		schema.fields.push_back((uint8_t)f);
+	}
+	CommandStream stream;
+	const char* error;
+	if(!resolveCommandStream(schema, target, stream, &error)){
+		return false;
+	}
+
+	const BadValue bad[] = {
+		{"1e400", HUGE_VAL, WireCommandPosition},
+		{"-1e400", -HUGE_VAL, WireCommandVelocity},
+		{"1e400", HUGE_VAL, WireCommandEffort},
+		{"NaN", NAN, WireCommandPosition},
+		{"NaN", NAN, WireCommandEffort},
+		{"inf", INFINITY, WireCommandPosition},
+		{"-inf", -INFINITY, WireCommandVelocity},
+		{"1e20", 1e20, WireCommandPosition},
+		{"1e39", 1e39, WireCommandVelocity},
+	};
+	JsonCommandParser parser;
+	bool ok = true;
+	for(size_t b = 0; b < sizeof(bad) / sizeof(bad[0]); b++){
+		std::ostringstream line;
+		line<<"{\"group\":\"arm\"";
+		for(size_t f = 0; f < WireCommandFieldCount; f++){
+			line<<",\""<<FIELD_NAMES[f]<<"\":[1.5,"<<(f == bad[b].field ? bad[b].json : "2")<<"]";
+		}
+		line<<"}";
+		std::string text = line.str();
+		CommandElement element;
+		if(parser.parse(text.data(), text.size(), targets, element, &error)){
+			std::fprintf(stderr, "json accepted %s as %s\n", bad[b].json, FIELD_NAMES[bad[b].field]);
+			ok = false;
+		}
+
+		uint32_t present[2] = {(1u << WireCommandFieldCount) - 1, (1u << WireCommandFieldCount) - 1};
+		double values[2 * WireCommandFieldCount];
+		for(size_t i = 0; i < 2 * WireCommandFieldCount; i++){
+			values[i] = 1.5;
+		}
+		values[WireCommandFieldCount + bad[b].field] = bad[b].binary;
+		std::string payload;
+		wireEncodeSamples(payload, 1, 0, 2, WireCommandFieldCount, present, values);
+		if(parseBinaryCommand(stream, payload.data(), payload.size(), element, &error)){
+			std::fprintf(stderr, "binary accepted %s as %s\n", bad[b].json, FIELD_NAMES[bad[b].field]);
+			ok = false;
+		}
+	}
+	if(target.pool->getSize() != 0){
+		std::fprintf(stderr, "a rejected command took %zu commands from the pool\n", target.pool->getSize());
+		ok = false;
+	}
+	//null still leaves a value unset
+	std::string nulls = "{\"group\":\"arm\",\"position\":[null,1],\"velocity\":[2,null]}";
+	CommandElement element;
+	if(!parser.parse(nulls.data(), nulls.size(), targets, element, &error)){
+		std::fprintf(stderr, "json refused null: %s\n", error);
+		ok = false;
+	}
+	return ok;
+}
+
+}
+
+int main(int argc, char** argv){
+	Options options;
+	if(!parse(argc, argv, options)){
+		std::fprintf(stderr, "usage: ingest_bench [--modules 1,30,100] [--fields 3] [--commands 200000] [--hold 8]\n");
+		return 1;
+	}
+	ApiConnection::startup();
+	if(!rejectsBadValues()){
+		return 1;
+	}
+	std::printf("out of range values rejected in both formats\n");
+	const size_t VARIANTS = 16; //distinct commands, cycled
+	for(size_t i = 0; i < options.moduleCounts.size(); i++){
+		size_t modules = options.moduleCounts[i];
+		CommandTarget target;
+		target.groupKey = "arm";
+		std::shared_ptr<std::vector<std::string> > keys = std::make_shared<std::vector<std::string> >();
+		for(size_t m = 0; m < modules; m++){
+			std::ostringstream key;
+			key<<"arm/j"<<m;
+			keys->push_back(key.str());
+		}
+		target.moduleKeys = keys;
+		target.pool = std::make_shared<CommandPool>((int)modules, 64);
+		std::vector<const CommandTarget*> targets(1, &target);
+
+		WireSchemaInfo schema;
+		schema.kind = WireCommand;
+		schema.group = target.groupKey;
+		for(size_t f = 0; f < options.fieldCount; f++){
+			schema.fields.push_back((uint8_t)f);
+		}
+		CommandStream stream;
+		const char* error;
+		if(!resolveCommandStream(schema, target, stream, &error)){
+			std::fprintf(stderr, "schema: %s\n", error);
+			return 1;
+		}
+
+		std::vector<std::string> lines, frames;
+		for(size_t n = 0; n < VARIANTS; n++){
+			lines.push_back(jsonLine(target, n, options.fieldCount));
+			frames.push_back(binaryFrame(modules, n, options.fieldCount));
+		}
+
+		Holder holder;
+		holder.hold = options.hold;
+		JsonCommandParser parser;
+		bool ok = true;
+		double start = nowNs();
+		for(size_t n = 0; n < options.commands && ok; n++){
+			const std::string& line = lines[n % VARIANTS];
+			CommandElement element;
+			ok = parser.parse(line.data(), line.size() - 1, targets, element, &error);
+			holder.keep(element);
+		}
+		double elapsed = nowNs() - start;
+		for(size_t n = 0; n < VARIANTS && ok; n++){
+			CommandElement element;
+			ok = parser.parse(lines[n].data(), lines[n].size() - 1, targets, element, &error) && check(element, n, options.fieldCount);
+		}
+		if(!ok){
+			std::fprintf(stderr, "json parse failed\n");
+			return 1;
+		}
+		report("json parse", modules, lines[0].size(), options.commands, elapsed);
+
+		start = nowNs();
+		for(size_t n = 0; n < options.commands && ok; n++){
+			const std::string& frame = frames[n % VARIANTS];
+			CommandElement element;
+			ok = parseBinaryCommand(stream, frame.data() + WIRE_HEADER_SIZE, frame.size() - WIRE_HEADER_SIZE, element, &error);
+			holder.keep(element);
+		}
+		elapsed = nowNs() - start;
+		for(size_t n = 0; n < VARIANTS && ok; n++){
+			CommandElement element;
+			ok = parseBinaryCommand(stream, frames[n].data() + WIRE_HEADER_SIZE, frames[n].size() - WIRE_HEADER_SIZE, element, &error) &&
+				check(element, n, options.fieldCount);
+		}
+		if(!ok){
+			std::fprintf(stderr, "binary parse failed\n");
+			return 1;
+		}
+		report("binary parse", modules, frames[0].size(), options.commands, elapsed);
+
+		if(!throughSocket(lines, options.commands, targets, stream, options.fieldCount, holder, &elapsed)){
+			std::fprintf(stderr, "json socket failed\n");
+			return 1;
+		}
+		report("json socket", modules, lines[0].size(), options.commands, elapsed);
+		if(!throughSocket(frames, options.commands, targets, stream, options.fieldCount, holder, &elapsed)){
+			std::fprintf(stderr, "binary socket failed\n");
+			return 1;
+		}
+		report("binary socket", modules, frames[0].size(), options.commands, elapsed);
+
+		size_t naiveCommands = options.commands / 10 + 1;
+		start = nowNs();
+		for(size_t n = 0; n < naiveCommands; n++){
+			const std::string& line = lines[n % VARIANTS];
+			CommandElement element;
+			element.command = naive(line.data(), line.size() - 1, target);
+			holder.keep(element);
+		}
+		report("json naive", modules, lines[0].size(), naiveCommands, nowNs() - start);
+		std::printf("pool: %zu commands for %zu modules\n", target.pool->getSize(), modules);
+	}
+	return 0;
+}
@@ -0,0 +1,187 @@
+//CommandJournal::reconstruct / restore only bring back settings
+//
+//a journal of two modules gets, over a few records, settings (gains, a limit, d-on-error, name, control strategy,
+//led color) mixed with setpoints (position, velocity, torque), io outputs, debug floats and the save flag;
+//one failed send is journaled too. the restored command must hold exactly the last successful settings,
+//and none of the rest.
+//then a write is made to fail partway (RLIMIT_FSIZE): the torn bytes must be cut back off, so a record
+//written after it is still found on reconstruct
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -pthread -I. -Isrc -idirafter include bench/CommandJournalCheck.cpp CommandJournal.cpp
+//    CThread.cpp LockProfile.cpp Metrics.cpp sim/SimMessages.cpp src/group_command.cpp src/command.cpp
+//    -o journal_check
+//
+//usage: journal_check [--path /tmp/journal_check.rmcj]
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "CommandJournal.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what){
+	if(!ok){
+		std::printf("FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+long fileSize(const std::string& path){
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 ? (long)info.st_size : -1;
+}
+
+//polls until the journal has written or lost count records
+bool waitForRecords(const CommandJournal& journal, uint64_t count){
+	for(int i = 0; i < 1000; i++){
+		if(journal.getWrittenRecords() + journal.getLostRecords() >= count){
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	return false;
+}
+
+std::shared_ptr<hebi::GroupCommand> newCommand(){
+	return std::make_shared<hebi::GroupCommand>(2);
+}
+
+HebiCommandPtr module(const std::shared_ptr<hebi::GroupCommand>& command, int i){
+	return hebiGroupCommandGetModuleCommand(command->internal_, i);
+}
+
+}
+
+int main(int argc, char** argv){
+	std::string path = "/tmp/journal_check.rmcj";
+	if(argc == 3 && std::string(argv[1]) == "--path"){
+		path = argv[2];
+	}
+	else if(argc != 1){
+		std::fprintf(stderr, "usage: journal_check [--path /tmp/journal_check.rmcj]\n");
+		return 1;
+	}
+	std::remove(path.c_str());
+	std::shared_ptr<const std::vector<std::string> > keys(new std::vector<std::string>{"Arm/base", "Arm/elbow"});
+
+	CommandJournal journal;
+	JournalConfig config;
+	config.path = path;
+	config.sync = JournalSyncEveryCommit;
+	if(!journal.open(config)){
+		std::printf("could not open %s\n", path.c_str());
+		return 1;
+	}
+	journal.start();
+
+	//settings with a setpoint, as a client would send them
+	std::shared_ptr<hebi::GroupCommand> first = newCommand();
+	hebiCommandSetFloat(module(first, 0), CommandFloatPositionKp, 5);
+	hebiCommandSetFloat(module(first, 0), CommandFloatTorqueMaxOutput, 3);
+	hebiCommandSetHighResAngle(module(first, 0), CommandHighResAnglePosition, 2, 0.25f);
+	hebiCommandSetFloat(module(first, 1), CommandFloatVelocity, 1.5f);
+	hebiCommandSetBool(module(first, 1), CommandBoolVelocityDOnError, 1);
+	hebiCommandSetString(module(first, 1), CommandStringName, "elbow2");
+	journal.append("Arm", keys, first, 1, true, true);
+
+	//the control loop: setpoints, io, debug, and a save
+	std::shared_ptr<hebi::GroupCommand> second = newCommand();
+	for(int i = 0; i < 2; i++){
+		hebiCommandSetHighResAngle(module(second, i), CommandHighResAnglePosition, 0, 1.0f);
+		hebiCommandSetFloat(module(second, i), CommandFloatVelocity, -2);
+		hebiCommandSetFloat(module(second, i), CommandFloatTorque, 4);
+		hebiCommandSetNumberedFloat(module(second, i), CommandNumberedFloatDebug, 3, 7);
+		hebiCommandSetIoPinInt(module(second, i), CommandIoBankA, 1, 1);
+		hebiCommandSetIoPinFloat(module(second, i), CommandIoBankB, 2, 0.5f);
+		hebiCommandSetFlag(module(second, i), CommandFlagSaveCurrentSettings, 1);
+	}
+	hebiCommandSetEnum(module(second, 0), CommandEnumControlStrategy, 3);
+	hebiCommandSetLedOverrideColor(module(second, 1), CommandLedLed, 10, 20, 30);
+	journal.append("Arm", keys, second, 2, true, true);
+
+	//a failed send changes nothing
+	std::shared_ptr<hebi::GroupCommand> failed = newCommand();
+	hebiCommandSetFloat(module(failed, 0), CommandFloatPositionKp, 99);
+	journal.append("Arm", keys, failed, 3, true, false);
+
+	journal.shutdown();
+	check(journal.getWrittenRecords() == 3, "every record written");
+
+	JournalState state;
+	check(CommandJournal::reconstruct(path, state), "reconstruct");
+	check(state.size() == 2, "both modules have state");
+	check(state["Arm/base"].size() == 3, "base: kp, torque max output, control strategy");
+	check(state["Arm/elbow"].size() == 3, "elbow: d-on-error, name, led");
+
+	hebi::GroupCommand restored(2);
+	CommandJournal::restore(state, *keys, restored);
+	HebiCommandPtr base = hebiGroupCommandGetModuleCommand(restored.internal_, 0);
+	HebiCommandPtr elbow = hebiGroupCommandGetModuleCommand(restored.internal_, 1);
+
+	check(hebiCommandHasFloat(base, CommandFloatPositionKp) && hebiCommandGetFloat(base, CommandFloatPositionKp) == 5,
+		"base kp restored from the successful send");
+	check(hebiCommandHasFloat(base, CommandFloatTorqueMaxOutput), "base torque max output restored");
+	check(hebiCommandHasEnum(base, CommandEnumControlStrategy) && hebiCommandGetEnum(base, CommandEnumControlStrategy) == 3,
+		"base control strategy restored");
+	check(hebiCommandHasBool(elbow, CommandBoolVelocityDOnError), "elbow d-on-error restored");
+	check(hebiCommandHasString(elbow, CommandStringName), "elbow name restored");
+	check(hebiCommandHasLedColor(elbow, CommandLedLed), "elbow led restored");
+
+	for(int i = 0; i < 2; i++){
+		HebiCommandPtr cmd = hebiGroupCommandGetModuleCommand(restored.internal_, i);
+		check(!hebiCommandHasHighResAngle(cmd, CommandHighResAnglePosition), "no position setpoint");
+		check(!hebiCommandHasFloat(cmd, CommandFloatVelocity), "no velocity setpoint");
+		check(!hebiCommandHasFloat(cmd, CommandFloatTorque), "no torque setpoint");
+		check(!hebiCommandHasNumberedFloat(cmd, CommandNumberedFloatDebug, 3), "no debug float");
+		check(!hebiCommandHasIoPinInt(cmd, CommandIoBankA, 1), "no io int output");
+		check(!hebiCommandHasIoPinFloat(cmd, CommandIoBankB, 2), "no io float output");
+		check(!hebiCommandHasFlag(cmd, CommandFlagSaveCurrentSettings), "no save flag");
+	}
+
+	//a torn write between two good ones
+	std::remove(path.c_str());
+	CommandJournal torn;
+	if(!torn.open(config)){
+		std::printf("could not open %s\n", path.c_str());
+		return 1;
+	}
+	torn.start();
+	std::shared_ptr<hebi::GroupCommand> before = newCommand();
+	hebiCommandSetFloat(module(before, 0), CommandFloatPositionKp, 7);
+	torn.append("Arm", keys, before, 1, true, true);
+	check(waitForRecords(torn, 1), "first record written");
+	long intact = fileSize(path);
+	std::signal(SIGXFSZ, SIG_IGN);
+	struct rlimit limit;
+	getrlimit(RLIMIT_FSIZE, &limit);
+	struct rlimit tight = limit;
+	tight.rlim_cur = (rlim_t)intact + 16; //the next record gets partway
+	check(setrlimit(RLIMIT_FSIZE, &tight) == 0, "set a file size limit");
+	std::shared_ptr<hebi::GroupCommand> large = newCommand();
+	hebiCommandSetString(module(large, 1), CommandStringName, std::string(200, 'x').c_str());
+	torn.append("Arm", keys, large, 2, true, true);
+	check(waitForRecords(torn, 2) && torn.getLostRecords() == 1, "the torn record is reported lost");
+	check(fileSize(path) == intact, "the torn bytes are cut back off");
+	setrlimit(RLIMIT_FSIZE, &limit);
+	std::shared_ptr<hebi::GroupCommand> after = newCommand();
+	hebiCommandSetFloat(module(after, 1), CommandFloatVelocityKp, 3);
+	torn.append("Arm", keys, after, 3, true, true);
+	torn.shutdown();
+	check(torn.getWrittenRecords() == 2, "records around the torn one written");
+	JournalState tornState;
+	check(CommandJournal::reconstruct(path, tornState), "reconstruct after a torn write");
+	check(tornState["Arm/base"].size() == 1 && tornState["Arm/elbow"].size() == 1,
+		"the record after the torn write survives");
+
+	std::remove(path.c_str());
+	std::printf("%s\n", failures ? "journal restore check failed" : "journal restore check passed");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+//InverseDynamics on a 6 dof arm of X5 actuators and links, with a payload at the tip
+//
+//checks, each against finite differences of energies taken from the C API's frames (Kinematics::getFK):
+//  gravity      getGravityTorques against the gradient of the potential energy of every body's center of mass
+//  mass matrix  1/2 qd' M(q) qd against the kinetic energy of every body, each moving with its input frame
+//  coriolis     getTorques(q, qd, 0) - g(q) against dM/dt qd - 1/2 d(qd' M qd)/dq, from the mass matrix
+//  full         getTorques(q, qd, qdd) against M qdd + coriolis + gravity
+//  fixed        InverseDynamics<6> against InverseDynamics<>
+//then times each, fixed size and dynamic size
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -pthread -I. -Isrc -idirafter include bench/DynamicsBench.cpp src/kinematics.cpp
+//    ThreadPool.cpp LockProfile.cpp Metrics.cpp -Llib/linux_x86-64 -l:libhebi.so.0.16 -o dynamics_bench
+//
+//usage: dynamics_bench [--iterations 200000]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include "inverse_dynamics.hpp"
+#include "kinematics.hpp"
+
+namespace {
+
+using hebi::kinematics::InverseDynamics;
+using hebi::kinematics::KinematicBody;
+using hebi::kinematics::Kinematics;
+using hebi::kinematics::Matrix4fVector;
+
+const int DOFS = 6;
+const double STEP = 1e-2;
+
+double nowNs(){
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void build(Kinematics& arm){
+	for(int j = 0; j < DOFS; j++){
+		arm.addBody(KinematicBody::createX5());
+		arm.addBody(KinematicBody::createX5Link(0.25f, (j % 2) ? 0.0f : (float)M_PI / 2));
+	}
+	Eigen::Matrix4f tip = Eigen::Matrix4f::Identity();
+	tip(2, 3) = 0.05f;
+	arm.addBody(KinematicBody::createGenericLink(Eigen::Vector3f(0.02f, 0.01f, 0.03f), tip, 0.5f));
+	//a tilted base, so gravity is not along any joint axis
+	Eigen::Matrix4f base = Eigen::Matrix4f::Identity();
+	base.topLeftCorner<3, 3>() = Eigen::AngleAxisf(0.4f, Eigen::Vector3f(1, -1, 0.5f).normalized()).toRotationMatrix();
+	base.topRightCorner<3, 1>() << 0.1f, 0.2f, 0.3f;
+	arm.setBaseFrame(base);
+}
+
+//the energies of every body at one configuration, from the C API's frames
+struct Energies{
+	const Kinematics& arm;
+	Eigen::Vector3d gravity;
+	Matrix4fVector frames;
+
+	Energies(const Kinematics& arm, const Eigen::Vector3d& gravity) : arm(arm), gravity(gravity) {}
+
+	double potential(const Eigen::VectorXd& q){
+		arm.getFK(FrameTypeCenterOfMass, q, frames);
+		double energy = 0;
+		for(size_t b = 0; b < frames.size(); b++){
+			energy -= arm.getBodies()[b].mass * gravity.dot(frames[b].topRightCorner<3, 1>().cast<double>());
+		}
+		return energy;
+	}
+
+	//every body is rigid with its input frame: the output frame of the body before it, or the base frame
+	double kinetic(const Eigen::VectorXd& q, const Eigen::VectorXd& qd){
+		Matrix4fVector coms[2], outputs[2];
+		for(int side = 0; side < 2; side++){
+			Eigen::VectorXd moved = q + (side ? STEP : -STEP) * qd;
+			arm.getFK(FrameTypeCenterOfMass, moved, coms[side]);
+			arm.getFK(FrameTypeOutput, moved, outputs[side]);
+		}
+		arm.getFK(FrameTypeOutput, q, frames);
+		double energy = 0;
+		for(size_t b = 0; b < coms[0].size(); b++){
+			const KinematicBody::Parameters& body = arm.getBodies()[b];
+			Eigen::Vector3d velocity = (coms[1][b] - coms[0][b]).topRightCorner<3, 1>().cast<double>() / (2 * STEP);
+			Eigen::Matrix3d rotation, rate;
+			if(b == 0){
+				rotation = arm.getBaseFrame().topLeftCorner<3, 3>().cast<double>();
+				rate.setZero();
+			}
+			else{
+				rotation = frames[b - 1].topLeftCorner<3, 3>().cast<double>();
+				rate = (outputs[1][b - 1] - outputs[0][b - 1]).topLeftCorner<3, 3>().cast<double>() / (2 * STEP);
+			}
+			Eigen::Matrix3d spin = rate * rotation.transpose();
+			Eigen::Vector3d omega(spin(2, 1) - spin(1, 2), spin(0, 2) - spin(2, 0), spin(1, 0) - spin(0, 1));
+			omega /= 2;
+			const float* i = body.inertia;
+			Eigen::Matrix3d inertia;
+			inertia << i[0], i[3], i[4],
+			           i[3], i[1], i[5],
+			           i[4], i[5], i[2];
+			inertia = rotation * inertia * rotation.transpose();
+			energy += 0.5 * body.mass * velocity.squaredNorm() + 0.5 * omega.dot(inertia * omega);
+		}
+		return energy;
+	}
+};
+
+double relative(const Eigen::VectorXd& expected, const Eigen::VectorXd& actual){
+	return (expected - actual).norm() / std::max(expected.norm(), 1e-9);
+}
+
+template<typename Dynamics, typename Vector>
+double timeGravity(const Dynamics& dynamics, const std::vector<Vector, Eigen::aligned_allocator<Vector> >& q, size_t iterations, volatile double& sink){
+	Vector torques;
+	double start = nowNs();
+	for(size_t n = 0; n < iterations; n++){
+		dynamics.getGravityTorques(q[n % q.size()], torques);
+		sink = sink + torques[0];
+	}
+	return (nowNs() - start) / (double)iterations / 1e3;
+}
+
+template<typename Dynamics, typename Vector>
+double timeTorques(const Dynamics& dynamics, const std::vector<Vector, Eigen::aligned_allocator<Vector> >& q, size_t iterations, volatile double& sink){
+	Vector torques;
+	double start = nowNs();
+	for(size_t n = 0; n < iterations; n++){
+		const Vector& x = q[n % q.size()];
+		dynamics.getTorques(x, x, x, torques);
+		sink = sink + torques[0];
+	}
+	return (nowNs() - start) / (double)iterations / 1e3;
+}
+
+}
+
+int main(int argc, char** argv){
+	size_t iterations = 200000;
+	if(argc == 3 && std::string(argv[1]) == "--iterations"){
+		iterations = (size_t)std::atol(argv[2]);
+	}
+	else if(argc != 1 || iterations == 0){
+		std::fprintf(stderr, "usage: dynamics_bench [--iterations 200000]\n");
+		return 1;
+	}
+
+	Kinematics arm;
+	build(arm);
+	std::unique_ptr<InverseDynamics<> > dynamics = InverseDynamics<>::create(arm);
+	std::unique_ptr<InverseDynamics<DOFS> > fixed = InverseDynamics<DOFS>::create(arm);
+	if(!dynamics || !fixed || InverseDynamics<DOFS - 1>::create(arm)){
+		std::printf("could not build the models\n");
+		return 1;
+	}
+	Energies energies(arm, dynamics->getGravity());
+
+	std::mt19937 random(7);
+	std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+	std::uniform_real_distribution<double> rate(-2, 2);
+	double gravityError = 0, massError = 0, coriolisError = 0, fullError = 0, fixedError = 0, asymmetry = 0;
+	for(int c = 0; c < 32; c++){
+		Eigen::VectorXd q(DOFS), qd(DOFS), qdd(DOFS);
+		for(int j = 0; j < DOFS; j++){
+			q[j] = angle(random);
+			qd[j] = rate(random);
+			qdd[j] = rate(random);
+		}
+
+		Eigen::VectorXd gravity, expected(DOFS);
+		dynamics->getGravityTorques(q, gravity);
+		for(int j = 0; j < DOFS; j++){
+			Eigen::VectorXd plus = q, minus = q;
+			plus[j] += STEP;
+			minus[j] -= STEP;
+			expected[j] = (energies.potential(plus) - energies.potential(minus)) / (2 * STEP);
+		}
+		gravityError = std::max(gravityError, relative(expected, gravity));
+
+		Eigen::MatrixXd mass;
+		dynamics->getMassMatrix(q, mass);
+		asymmetry = std::max(asymmetry, (mass - mass.transpose()).cwiseAbs().maxCoeff());
+		double kinetic = energies.kinetic(q, qd);
+		massError = std::max(massError, std::abs(0.5 * qd.dot(mass * qd) - kinetic) / kinetic);
+
+		//dM/dt along qd, and the gradient of qd' M qd
+		Eigen::MatrixXd ahead, behind;
+		dynamics->getMassMatrix(q + STEP * qd, ahead);
+		dynamics->getMassMatrix(q - STEP * qd, behind);
+		Eigen::VectorXd coriolis = (ahead - behind) / (2 * STEP) * qd;
+		for(int j = 0; j < DOFS; j++){
+			Eigen::VectorXd plus = q, minus = q;
+			plus[j] += STEP;
+			minus[j] -= STEP;
+			dynamics->getMassMatrix(plus, ahead);
+			dynamics->getMassMatrix(minus, behind);
+			coriolis[j] -= 0.5 * qd.dot((ahead - behind) * qd) / (2 * STEP);
+		}
+		Eigen::VectorXd torques;
+		dynamics->getTorques(q, qd, Eigen::VectorXd::Zero(DOFS), torques);
+		coriolisError = std::max(coriolisError, relative(coriolis, torques - gravity));
+
+		Eigen::VectorXd exact;
+		dynamics->getTorques(q, qd, qdd, torques);
+		dynamics->getTorques(q, qd, Eigen::VectorXd::Zero(DOFS), exact);
+		fullError = std::max(fullError, relative(mass * qdd + exact, torques));
+
+		InverseDynamics<DOFS>::Vector fixedTorques, fixedGravity;
+		fixed->getTorques(q, qd, qdd, fixedTorques);
+		fixed->getGravityTorques(q, fixedGravity);
+		fixedError = std::max(fixedError, std::max((fixedTorques - torques).cwiseAbs().maxCoeff(), (fixedGravity - gravity).cwiseAbs().maxCoeff()));
+	}
+	std::printf("relative errors: gravity %.2e, mass matrix %.2e (asymmetry %.2e), coriolis %.2e, full %.2e; fixed against dynamic %.2e\n",
+		gravityError, massError, asymmetry, coriolisError, fullError, fixedError);
+
+	typedef InverseDynamics<DOFS>::Vector Fixed;
+	std::vector<Fixed, Eigen::aligned_allocator<Fixed> > fixedQ(64);
+	std::vector<Eigen::VectorXd, Eigen::aligned_allocator<Eigen::VectorXd> > dynamicQ(64);
+	for(size_t c = 0; c < fixedQ.size(); c++){
+		for(int j = 0; j < DOFS; j++){
+			fixedQ[c][j] = angle(random);
+		}
+		dynamicQ[c] = fixedQ[c];
+	}
+	volatile double sink = 0;
+	std::printf("%-24s %8.3f us\n", "gravity, fixed", timeGravity(*fixed, fixedQ, iterations, sink));
+	std::printf("%-24s %8.3f us\n", "gravity, dynamic", timeGravity(*dynamics, dynamicQ, iterations, sink));
+	std::printf("%-24s %8.3f us\n", "full, fixed", timeTorques(*fixed, fixedQ, iterations, sink));
+	std::printf("%-24s %8.3f us\n", "full, dynamic", timeTorques(*dynamics, dynamicQ, iterations, sink));
+
+	bool ok = gravityError < 3e-3 && massError < 3e-3 && asymmetry < 1e-9 && coriolisError < 3e-3 && fullError < 1e-9 && fixedError < 1e-9;
+	return ok && sink != 12345.0 ? 0 : 1;
+}
@@ -0,0 +1,288 @@
+//feedback bus against a unix socket for a reader in another process on the same host
+//
+//  publish idle   FeedbackBus::onFrame with nobody waiting: one frame into the shared region and the futex word
+//  publish        the same while the reader sleeps on the futex; includes waking it (on one core, running it)
+//  bus wake       publish to a reader having the newest sample in view, woken through the futex
+//  bus view       reader walks the position column of the newest sample in place (Eigen::Map) and checks it
+//  bus copy       reader copies the newest sample out (FeedbackBusReader::copyLatest)
+//  socket send    the same slot bytes written to a unix socket pair per reader
+//  socket wake    write to the reader having read them
+//readers are forked processes, only the first one reports; the publish clock goes to the reader in the voltage of module 0. it is taken
+//before onFrame, so bus wake includes writing the frame, while socket wake starts with the bytes ready
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -pthread -I. -Isrc -idirafter include bench/FeedbackBusBench.cpp FeedbackBus.cpp
+//    FeedbackBusReader.cpp FeedBackManager.cpp LatencyHistogram.cpp Metrics.cpp Trace.cpp LockProfile.cpp
+//    ThreadPool.cpp sim/*.cpp src/*.cpp -Llib/linux_x86-64 -l:libhebi.so.0.16 -o bus_bench
+//
+//usage: bus_bench [--modules 1,30,100] [--rate 1000] [--samples 5000] [--capacity 256] [--readers 1]
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FeedbackBus.h"
+#include "FeedbackBusReader.h"
+#include "LatencyHistogram.h"
+
+namespace {
+
+struct Options{
+	std::vector<size_t> moduleCounts;
+	double rate;
+	size_t samples;
+	size_t capacity;
+	size_t readers;
+
+	Options() : rate(1000.0), samples(5000), capacity(256), readers(1) {}
+};
+
+std::vector<size_t> parseList(const std::string& text){
+	std::vector<size_t> values;
+	std::stringstream items(text);
+	std::string item;
+	while(std::getline(items, item, ',')){
+		if(!item.empty()){
+			values.push_back((size_t)std::atol(item.c_str()));
+		}
+	}
+	return values;
+}
+
+bool parse(int argc, char** argv, Options& options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(i + 1 >= argc){
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--modules") options.moduleCounts = parseList(value);
+		else if(arg == "--rate") options.rate = std::atof(value.c_str());
+		else if(arg == "--samples") options.samples = (size_t)std::atol(value.c_str());
+		else if(arg == "--capacity") options.capacity = (size_t)std::atol(value.c_str());
+		else if(arg == "--readers") options.readers = (size_t)std::atol(value.c_str());
+		else return false;
+	}
+	if(options.moduleCounts.empty()){
+		options.moduleCounts = parseList("1,30,100");
+	}
+	return options.rate > 0 && options.samples > 0 && options.capacity > 0 && options.readers > 0;
+}
+
+//steady_clock is CLOCK_MONOTONIC on linux, the same in both processes
+int64_t nowNs(){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void report(const char* name, size_t modules, const LatencyHistogram& histogram){
+	std::printf("%-12s modules %4zu  n %6llu  mean %8.2f us  p50 %7.2f  p99 %7.2f  max %8.2f\n", name, modules,
+		(unsigned long long)histogram.count(), histogram.mean() / 1e3, histogram.percentile(50) / 1e3,
+		histogram.percentile(99) / 1e3, histogram.max() / 1e3);
+	std::fflush(stdout);
+}
+
+void fill(GroupFeedbackFrame& frame, size_t n){
+	for(size_t m = 0; m < frame.modules.size(); m++){
+		FeedbackSample& sample = frame.modules[m];
+		sample.present = (1u << FieldCount) - 1;
+		for(int f = 0; f < FieldCount; f++){
+			sample.values[f] = (double)(n + m) + f * 0.5;
+		}
+	}
+	frame.timestampUs = (int64_t)n;
+	frame.modules[0].values[FieldVoltage] = (double)nowNs();
+}
+
+//the forked reader of the bus: wakes for every sample it can and times it
+int readBus(const std::string& groupKey, size_t modules, size_t samples, bool print){
+	FeedbackBusReader reader;
+	while(!reader.open(groupKey, "rmcs_bench")){
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	int voltage = reader.fieldIndex("voltage");
+	int position = reader.fieldIndex("position");
+	LatencyHistogram wake(10 * 1000000000LL), view(10 * 1000000000LL), copy(10 * 1000000000LL);
+	FeedbackBusView sample;
+	FeedbackBusSample copied;
+	//the samples published before the reader came are not timed
+	uint64_t seen = reader.getPublished();
+	uint64_t end = seen + samples - 1;
+	size_t bad = 0, missed = 0;
+	while(seen < end){
+		if(!reader.wait(seen, 2000000)){
+			break;
+		}
+		int64_t woken = nowNs();
+		if(!reader.latest(sample)){
+			continue;
+		}
+		wake.record(woken - (int64_t)sample.values()(0, voltage));
+		int64_t start = nowNs();
+		//positions were written as n + m
+		Eigen::Map<const Eigen::VectorXd> positions = sample.field(position);
+		double expected = (double)sample.getTimestampUs() * (double)modules + (double)(modules * (modules - 1) / 2);
+		bool ok = positions.sum() == expected;
+		view.record(nowNs() - start);
+		if(sample.isValid() && !ok){
+			bad++;
+		}
+		start = nowNs();
+		reader.copyLatest(copied);
+		copy.record(nowNs() - start);
+		missed += (size_t)(sample.getIndex() - seen);
+		seen = sample.getIndex() + 1;
+	}
+	if(!print){
+		return bad ? 1 : 0;
+	}
+	report("bus wake", modules, wake);
+	report("bus view", modules, view);
+	report("bus copy", modules, copy);
+	std::printf("reader: %zu of %zu samples read, %zu skipped behind, %zu bad\n", (size_t)wake.count(), samples - 1, missed, bad);
+	return bad ? 1 : 0;
+}
+
+int readSocket(int socket, size_t bytes, size_t modules, size_t samples, bool print){
+	std::vector<char> buffer(bytes);
+	LatencyHistogram wake(10 * 1000000000LL);
+	for(size_t n = 0; n < samples; n++){
+		size_t got = 0;
+		while(got < bytes){
+			ssize_t r = ::read(socket, &buffer[got], bytes - got);
+			if(r <= 0){
+				return 1;
+			}
+			got += (size_t)r;
+		}
+		int64_t woken = nowNs();
+		double sent;
+		std::memcpy(&sent, &buffer[0], sizeof(sent));
+		wake.record(woken - (int64_t)sent);
+	}
+	if(print){
+		report("socket wake", modules, wake);
+	}
+	return 0;
+}
+
+int join(const std::vector<pid_t>& children){
+	int status = 0;
+	for(size_t c = 0; c < children.size(); c++){
+		int childStatus;
+		waitpid(children[c], &childStatus, 0);
+		status |= WIFEXITED(childStatus) ? WEXITSTATUS(childStatus) : 1;
+	}
+	return status;
+}
+
+void pace(int64_t start, size_t n, double rate){
+	int64_t due = start + (int64_t)((double)n * 1e9 / rate);
+	while(nowNs() < due){
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+}
+
+}
+
+int main(int argc, char** argv){
+	Options options;
+	if(!parse(argc, argv, options)){
+		std::fprintf(stderr, "usage: bus_bench [--modules 1,30,100] [--rate 1000] [--samples 5000] [--capacity 256] [--readers 1]\n");
+		return 1;
+	}
+	int status = 0;
+	for(size_t i = 0; i < options.moduleCounts.size(); i++){
+		size_t modules = options.moduleCounts[i];
+		GroupFeedbackFrame frame;
+		frame.groupKey = "bench";
+		std::shared_ptr<std::vector<std::string> > keys = std::make_shared<std::vector<std::string> >();
+		for(size_t m = 0; m < modules; m++){
+			std::ostringstream key;
+			key<<"arm/j"<<m;
+			keys->push_back(key.str());
+		}
+		frame.moduleKeys = keys;
+		frame.modules.resize(modules);
+
+		FeedbackBusConfig config;
+		config.prefix = "rmcs_bench";
+		config.capacity = options.capacity;
+		FeedbackBus bus(config);
+		fill(frame, 0);
+		bus.onFrame(frame); //creates the region before the reader looks for it
+		LatencyHistogram idle(10 * 1000000000LL);
+		for(size_t n = 0; n < options.samples; n++){
+			int64_t before = nowNs();
+			bus.onFrame(frame);
+			idle.record(nowNs() - before);
+		}
+		report("publish idle", modules, idle);
+		std::vector<pid_t> children;
+		for(size_t r = 0; r < options.readers; r++){
+			pid_t child = fork();
+			if(child == 0){
+				_exit(readBus(frame.groupKey, modules, options.samples, r == 0));
+			}
+			children.push_back(child);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		LatencyHistogram publish(10 * 1000000000LL);
+		int64_t start = nowNs();
+		for(size_t n = 1; n < options.samples; n++){
+			pace(start, n, options.rate);
+			fill(frame, n);
+			int64_t before = nowNs();
+			bus.onFrame(frame);
+			publish.record(nowNs() - before);
+		}
+		status |= join(children);
+		report("publish", modules, publish);
+
+		//baseline: the slot's bytes through a socket per reader, the publish clock in front
+		size_t bytes = feedbackBusSlotSize(modules, FieldCount);
+		std::vector<int> sockets;
+		children.clear();
+		for(size_t r = 0; r < options.readers; r++){
+			int pair[2];
+			if(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0){
+				return 1;
+			}
+			pid_t child = fork();
+			if(child == 0){
+				::close(pair[0]);
+				_exit(readSocket(pair[1], bytes, modules, options.samples, r == 0));
+			}
+			::close(pair[1]);
+			sockets.push_back(pair[0]);
+			children.push_back(child);
+		}
+		std::vector<char> message(bytes);
+		LatencyHistogram send(10 * 1000000000LL);
+		start = nowNs();
+		for(size_t n = 0; n < options.samples; n++){
+			pace(start, n, options.rate);
+			int64_t before = nowNs();
+			double sent = (double)before;
+			std::memcpy(&message[0], &sent, sizeof(sent));
+			for(size_t r = 0; r < sockets.size(); r++){
+				if(::write(sockets[r], &message[0], bytes) != (ssize_t)bytes){
+					return 1;
+				}
+			}
+			send.record(nowNs() - before);
+		}
+		join(children);
+		report("socket send", modules, send);
+		for(size_t r = 0; r < sockets.size(); r++){
+			::close(sockets[r]);
+		}
+	}
+	return status;
+}
@@ -0,0 +1,217 @@
+//end-to-end GravityCompensator against the simulated backend (sim/): the stage runs on a group of 6 modules,
+//while a second group of the same modules holds them at a few poses in turn
+//
+//  torques  once a pose settles, the torque command the modules report against the sum over bodies of
+//           J_b' m_b (-gravity), J_b the linear rows of the C API's center of mass Jacobian (Kinematics::getJ)
+//  timing   compute and feedback-to-send time, deadline misses and overruns at --rate
+//  allocs   heap allocations on the compute thread and inside the stage's feedback handler after the first
+//           pose; must be 0
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -pthread -I. -Isrc -idirafter include bench/GravityCompensationBench.cpp
+//    GravityCompensator.cpp FeedBackManager.cpp LatencyHistogram.cpp Metrics.cpp Trace.cpp LockProfile.cpp
+//    ThreadPool.cpp sim/*.cpp src/*.cpp
+//    -Llib/linux_x86-64 -l:libhebi.so.0.16 -o gravity_bench
+//(the sim objects provide the messaging api; libhebi only supplies the kinematics symbols src/ needs)
+//
+//usage: gravity_bench [--rate 1000] [--poses 4] [--seconds 0.5] [--cpu 0]
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include "GravityCompensator.h"
+#include "Metrics.h"
+#include "lookup.hpp"
+#include "sim/HebiSim.h"
+
+namespace {
+
+//heap allocations are counted on every thread but main and the group's feedback thread, and on the feedback
+//thread only between the two marker handlers around the stage's own
+std::atomic<bool> counting(false);
+std::atomic<uint64_t> allocations(0);
+thread_local bool excluded = false;
+thread_local bool dispatching = false;
+
+}
+
+//every allocation, operator new and Eigen's included, goes through malloc (glibc)
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+
+extern "C" void* malloc(size_t size){
+	if(counting && (!excluded || dispatching)){
+		allocations++;
+	}
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size){
+	if(counting && (!excluded || dispatching)){
+		allocations++;
+	}
+	return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* p, size_t size){
+	if(counting && (!excluded || dispatching)){
+		allocations++;
+	}
+	return __libc_realloc(p, size);
+}
+
+namespace {
+
+using hebi::kinematics::KinematicBody;
+using hebi::kinematics::Kinematics;
+using hebi::kinematics::MatrixXfVector;
+
+const int DOFS = 6;
+
+struct Options{
+	float rate;
+	int poses;
+	double seconds;
+	int cpu;
+
+	Options() : rate(1000), poses(4), seconds(0.5), cpu(0) {}
+};
+
+bool parse(int argc, char** argv, Options& options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(i + 1 >= argc){
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--rate") options.rate = (float)std::atof(value.c_str());
+		else if(arg == "--poses") options.poses = std::atoi(value.c_str());
+		else if(arg == "--seconds") options.seconds = std::atof(value.c_str());
+		else if(arg == "--cpu") options.cpu = std::atoi(value.c_str());
+		else return false;
+	}
+	return options.rate > 0 && options.poses > 0 && options.seconds > 0;
+}
+
+void build(Kinematics& arm){
+	for(int j = 0; j < DOFS; j++){
+		arm.addBody(KinematicBody::createX5());
+		arm.addBody(KinematicBody::createX5Link(0.25f, (j % 2) ? 0.0f : (float)M_PI / 2));
+	}
+	Eigen::Matrix4f tip = Eigen::Matrix4f::Identity();
+	tip(2, 3) = 0.05f;
+	arm.addBody(KinematicBody::createGenericLink(Eigen::Vector3f(0, 0, 0.03f), tip, 0.5f));
+}
+
+//J' F for gravity, from the C API: the torques that hold every body's weight
+Eigen::VectorXd holdingTorques(const Kinematics& arm, const Eigen::VectorXd& q, const Eigen::Vector3d& gravity){
+	MatrixXfVector jacobians;
+	arm.getJ(FrameTypeCenterOfMass, q, jacobians);
+	Eigen::VectorXd torques = Eigen::VectorXd::Zero(q.size());
+	for(size_t b = 0; b < jacobians.size(); b++){
+		Eigen::Vector3d weight = -arm.getBodies()[b].mass * gravity;
+		torques += jacobians[b].topRows<3>().cast<double>().transpose() * weight;
+	}
+	return torques;
+}
+
+void printMetric(MetricId id){
+	MetricSummary summary;
+	Metrics::summary(id, summary);
+	std::printf("%-16s %8llu samples, mean %8.2f us, p99 %8.2f us, max %8.2f us\n", Metrics::name(id),
+		(unsigned long long)summary.count, summary.meanNs() / 1e3, summary.percentileNs(99) / 1e3, summary.maxNs() / 1e3);
+}
+
+}
+
+int main(int argc, char** argv){
+	excluded = true;
+	Options options;
+	if(!parse(argc, argv, options)){
+		std::fprintf(stderr, "usage: gravity_bench [--rate 1000] [--poses 4] [--seconds 0.5] [--cpu 0]\n");
+		return 1;
+	}
+	SimConfig config;
+	config.addFamily("Arm", DOFS);
+	config.timeConstantS = 0.02;
+	if(!simConfigure(config)){
+		std::printf("could not configure the simulation\n");
+		return 1;
+	}
+
+	Kinematics arm;
+	build(arm);
+	hebi::Lookup lookup;
+	std::shared_ptr<hebi::Group> group(lookup.getGroupFromFamily("Arm").release());
+	std::unique_ptr<hebi::Group> mover = lookup.getGroupFromFamily("Arm");
+	if(!group || !mover || group->size() != DOFS){
+		std::printf("no simulated group\n");
+		return 1;
+	}
+	group->setFeedbackFrequencyHz(options.rate);
+
+	GravityCompensatorConfig stageConfig;
+	stageConfig.cpu = options.cpu;
+	GravityCompensator stage(group, arm, stageConfig);
+	group->addFeedbackHandler([](const hebi::GroupFeedback*){
+		excluded = true;
+		dispatching = true;
+	});
+	if(!stage.start()){
+		std::printf("could not start the stage\n");
+		return 1;
+	}
+	group->addFeedbackHandler([](const hebi::GroupFeedback*){
+		dispatching = false;
+	});
+
+	std::mt19937 random(3);
+	std::uniform_real_distribution<double> angle(-1.5, 1.5);
+	hebi::GroupCommand hold(DOFS);
+	hebi::GroupFeedback feedback(DOFS);
+	double worst = 0;
+	for(int p = 0; p < options.poses; p++){
+		Eigen::VectorXd target(DOFS);
+		for(int j = 0; j < DOFS; j++){
+			target[j] = angle(random);
+			hold[j].actuator().position().set(target[j]);
+		}
+		mover->sendCommand(hold);
+		std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(options.seconds * 1e6)));
+		if(!mover->requestFeedback(&feedback, 100)){
+			std::printf("pose %d: no feedback\n", p);
+			return 1;
+		}
+		Eigen::VectorXd q = feedback.getPosition();
+		Eigen::VectorXd expected = holdingTorques(arm, q, stageConfig.gravity);
+		double error = (feedback.getTorqueCommand() - expected).norm() / expected.norm();
+		worst = std::max(worst, error);
+		std::printf("pose %d: |torque| %.3f N*m, relative error against J'F %.2e\n", p, expected.norm(), error);
+		if(p == 0){
+			//everything after the first pose runs warm
+			stage.resetStats();
+			counting = true;
+		}
+	}
+	counting = false;
+	stage.stop();
+	group->setFeedbackFrequencyHz(0);
+
+	GravityCompensatorStats stats = stage.getStats();
+	std::printf("%llu frames, %llu sent, %llu send failures, %llu invalid, %llu overruns, %llu deadline misses (%lld us)\n",
+		(unsigned long long)stats.frames, (unsigned long long)stats.sent, (unsigned long long)stats.sendFailures,
+		(unsigned long long)stats.invalid, (unsigned long long)stats.overruns, (unsigned long long)stats.deadlineMisses,
+		(long long)stage.getDeadlineUs());
+	std::printf("compute max %.2f us, cycle max %.2f us, pinned %s, allocations %llu\n", stats.maxComputeNs / 1e3,
+		stats.maxCycleNs / 1e3, stats.pinned ? "yes" : "no", (unsigned long long)allocations.load());
+	printMetric(MetricGravityCompute);
+	printMetric(MetricGravityCycle);
+
+	bool ok = worst < 1e-2 && allocations == 0 && stats.sent > 0 && stats.sendFailures == 0 && stats.invalid == 0;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+//cost of the json snapshots of FeedbackJson.h against an ostringstream encoding of the same fields,
+//and a check that every number JsonWriter prints reads back to the same float or double
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -I. -Isrc -idirafter include bench/JsonWriterBench.cpp JsonWriter.cpp FeedbackJson.cpp
+//    sim/SimMessages.cpp src/group_feedback.cpp src/group_info.cpp src/feedback.cpp src/info.cpp -o json_bench
+//
+//usage: json_bench [--modules 1,30,100] [--iterations 20000] [--verify 2000000]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "FeedbackJson.h"
+#include "sim/SimMessages.h"
+
+namespace {
+
+struct Options{
+	std::vector<size_t> moduleCounts;
+	size_t iterations;
+	size_t verify;
+
+	Options() : iterations(20000), verify(2000000) {}
+};
+
+std::vector<size_t> parseList(const std::string& text){
+	std::vector<size_t> values;
+	std::stringstream items(text);
+	std::string item;
+	while(std::getline(items, item, ',')){
+		if(!item.empty()){
+			values.push_back((size_t)std::atol(item.c_str()));
+		}
+	}
+	return values;
+}
+
+bool parse(int argc, char** argv, Options& options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(i + 1 >= argc){
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--modules") options.moduleCounts = parseList(value);
+		else if(arg == "--iterations") options.iterations = (size_t)std::atol(value.c_str());
+		else if(arg == "--verify") options.verify = (size_t)std::atol(value.c_str());
+		else return false;
+	}
+	if(options.moduleCounts.empty()){
+		options.moduleCounts = parseList("1,30,100");
+	}
+	return options.iterations > 0;
+}
+
+double nowNs(){
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//what an X5 actuator reports every cycle: all floats, both angles, imu and led
+void fill(hebi::GroupFeedback& feedback, std::mt19937& random){
+	std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+	for(int m = 0; m < feedback.size(); m++){
+		_HebiFeedback& module = feedback.internal_->modules[m];
+		module.clear();
+		for(int f = FeedbackFloatBoardTemperature; f <= FeedbackFloatMotorHousingTemperature; f++){
+			module.setFloat((FeedbackFloatField)f, value(random));
+		}
+		module.setAngle(FeedbackHighResAnglePosition, value(random));
+		module.setAngle(FeedbackHighResAnglePositionCommand, value(random));
+		module.setVector(FeedbackVector3fAccelerometer, value(random), value(random), 9.81f);
+		module.setVector(FeedbackVector3fGyro, value(random), value(random), value(random));
+		module.hasLed = true;
+		module.led[0] = 0;
+		module.led[1] = 255;
+		module.led[2] = 0;
+	}
+}
+
+void fill(hebi::GroupInfo& info, std::mt19937& random){
+	std::uniform_real_distribution<float> value(0.0f, 1.0f);
+	for(int m = 0; m < info.size(); m++){
+		_HebiInfo& module = info.internal_->modules[m];
+		module.clear();
+		for(int f = InfoFloatPositionKp; f <= InfoFloatSpringConstant; f++){
+			module.floats[f] = value(random);
+			module.floatMask |= 1ULL << f;
+		}
+		module.boolMask = 7;
+		module.bools = 5;
+		std::ostringstream name;
+		name<<"j"<<m;
+		module.hasString[InfoStringName] = true;
+		module.strings[InfoStringName] = name.str();
+		module.hasString[InfoStringFamily] = true;
+		module.strings[InfoStringFamily] = "arm";
+		module.hasControlStrategy = true;
+		module.controlStrategy = 3;
+	}
+}
+
+//the obvious encoding: an ostringstream per snapshot, 17 digits so doubles survive
+std::string streamFeedback(const hebi::GroupFeedback& feedback, const std::vector<std::string>& keys, int64_t timestampUs){
+	std::ostringstream out;
+	out<<std::setprecision(17)<<"{\"t\":"<<timestampUs<<",\"modules\":[";
+	for(int m = 0; m < feedback.size(); m++){
+		HebiFeedbackPtr module = hebiGroupFeedbackGetModuleFeedback(feedback.internal_, m);
+		out<<(m ? "," : "")<<"{\"module\":\""<<keys[m]<<"\"";
+		for(int f = FeedbackFloatBoardTemperature; f <= FeedbackFloatMotorHousingTemperature; f++){
+			if(hebiFeedbackHasFloat(module, (FeedbackFloatField)f)){
+				out<<",\"f"<<f<<"\":"<<hebiFeedbackGetFloat(module, (FeedbackFloatField)f);
+			}
+		}
+		for(int a = FeedbackHighResAnglePosition; a <= FeedbackHighResAnglePositionCommand; a++){
+			if(hebiFeedbackHasHighResAngle(module, (FeedbackHighResAngleField)a)){
+				int64_t revolutions;
+				float offset;
+				hebiFeedbackGetHighResAngle(module, (FeedbackHighResAngleField)a, &revolutions, &offset);
+				out<<",\"a"<<a<<"\":"<<simJoinAngle(revolutions, offset);
+			}
+		}
+		for(int v = FeedbackVector3fAccelerometer; v <= FeedbackVector3fGyro; v++){
+			if(hebiFeedbackHasVector3f(module, (FeedbackVector3fField)v)){
+				HebiVector3f vector = hebiFeedbackGetVector3f(module, (FeedbackVector3fField)v);
+				out<<",\"v"<<v<<"\":["<<vector.x<<","<<vector.y<<","<<vector.z<<"]";
+			}
+		}
+		out<<"}";
+	}
+	out<<"]}";
+	return out.str();
+}
+
+void report(const char* name, size_t modules, size_t bytes, size_t iterations, double elapsedNs){
+	double perOp = elapsedNs / (double)iterations;
+	std::printf("%-18s modules %4zu  bytes %7zu  %9.2f us/op  %8.1f MB/s\n", name, modules, bytes, perOp / 1e3, (double)bytes * 1e3 / perOp);
+}
+
+//random bit patterns through the formatter and back through strtod/strtof; returns the number of mismatches
+size_t verify(size_t count){
+	std::mt19937_64 random(7);
+	char text[32];
+	size_t bad = 0;
+	for(size_t i = 0; i < count; i++){
+		uint64_t bits = random();
+		double d;
+		std::memcpy(&d, &bits, sizeof(d));
+		if(d == d && d != std::numeric_limits<double>::infinity() && d != -std::numeric_limits<double>::infinity()){
+			text[JsonWriter::formatDouble(d, text)] = '\0';
+			if(std::strtod(text, NULL) != d){
+				if(bad++ < 5) std::printf("mismatch %.17g -> %s\n", d, text);
+			}
+		}
+		uint32_t narrow = (uint32_t)bits;
+		float f;
+		std::memcpy(&f, &narrow, sizeof(f));
+		if(f == f && f != std::numeric_limits<float>::infinity() && f != -std::numeric_limits<float>::infinity()){
+			text[JsonWriter::formatFloat(f, text)] = '\0';
+			if(std::strtof(text, NULL) != f){
+				if(bad++ < 5) std::printf("mismatch %.9g -> %s\n", f, text);
+			}
+		}
+	}
+	return bad;
+}
+
+}
+
+int main(int argc, char** argv){
+	Options options;
+	if(!parse(argc, argv, options)){
+		std::fprintf(stderr, "usage: json_bench [--modules 1,30,100] [--iterations 20000] [--verify 2000000]\n");
+		return 1;
+	}
+	std::mt19937 random(1);
+	volatile size_t sink = 0;
+	for(size_t i = 0; i < options.moduleCounts.size(); i++){
+		size_t modules = options.moduleCounts[i];
+		hebi::GroupFeedback feedback((int)modules);
+		hebi::GroupInfo info((int)modules);
+		fill(feedback, random);
+		fill(info, random);
+		std::vector<std::string> keys;
+		for(size_t m = 0; m < modules; m++){
+			std::ostringstream key;
+			key<<"arm/j"<<m;
+			keys.push_back(key.str());
+		}
+
+		//one buffer for the whole run, as a consumer thread would keep it
+		std::string buffer;
+		JsonWriter w(buffer);
+		double start = nowNs();
+		for(size_t n = 0; n < options.iterations; n++){
+			w.clear();
+			writeGroupFeedback(w, feedback, &keys, (int64_t)n);
+			w.finish();
+			sink = sink + buffer.size();
+		}
+		report("feedback writer", modules, buffer.size(), options.iterations, nowNs() - start);
+		if(i == 0){
+			std::printf("%.*s\n", (int)std::min<size_t>(buffer.size(), 600), buffer.c_str());
+		}
+
+		start = nowNs();
+		std::string streamed;
+		for(size_t n = 0; n < options.iterations; n++){
+			streamed = streamFeedback(feedback, keys, (int64_t)n);
+			sink = sink + streamed.size();
+		}
+		report("feedback ostream", modules, streamed.size(), options.iterations, nowNs() - start);
+
+		start = nowNs();
+		for(size_t n = 0; n < options.iterations; n++){
+			w.clear();
+			writeGroupInfo(w, info);
+			w.finish();
+			sink = sink + buffer.size();
+		}
+		report("info writer", modules, buffer.size(), options.iterations, nowNs() - start);
+	}
+	if(options.verify){
+		size_t bad = verify(options.verify);
+		std::printf("round trip: %zu random doubles and floats, %zu mismatches\n", options.verify, bad);
+		if(bad){
+			return 1;
+		}
+	}
+	return sink == 1 ? 2 : 0;
+}
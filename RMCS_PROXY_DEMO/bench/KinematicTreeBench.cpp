@@ -0,0 +1,273 @@
+//one KinematicTree for a two-armed robot against one chain per arm
+//
+//the robot: a waist of --waist X5 joints, a torso (static body, one output per arm), then --arms arms of 6 X5 joints.
+//  tree evaluate    every frame of the whole robot in one traversal, then each arm's end effector Jacobian
+//  per arm trees    the same from one KinematicTree chain per arm (waist and torso recomputed for each)
+//  per arm C API    Kinematics::getEndEffectorAndJ on one chain per arm
+//every arm's end effector and Jacobian from the tree is checked against its Kinematics chain, and a tree built as
+//a chain is checked frame by frame (outputs and centers of mass) against Kinematics::getFK
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -pthread -I. -Isrc -idirafter include bench/KinematicTreeBench.cpp src/kinematic_tree.cpp
+//    src/kinematics.cpp ThreadPool.cpp LockProfile.cpp Metrics.cpp -Llib/linux_x86-64 -l:libhebi.so.0.16 -o tree_bench
+//
+//usage: tree_bench [--waist 2] [--arms 2] [--iterations 2000]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include "kinematic_tree.hpp"
+#include "kinematics.hpp"
+
+namespace {
+
+using hebi::kinematics::KinematicBody;
+using hebi::kinematics::KinematicTree;
+using hebi::kinematics::KinematicTreeState;
+using hebi::kinematics::Kinematics;
+using hebi::kinematics::KinematicsWorkspace;
+using hebi::kinematics::Matrix4fVector;
+
+const size_t ARM_DOFS = 6;
+
+struct Options{
+	size_t waist;
+	size_t arms;
+	size_t iterations;
+
+	Options() : waist(2), arms(2), iterations(2000) {}
+};
+
+bool parse(int argc, char** argv, Options& options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(i + 1 >= argc){
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--waist") options.waist = (size_t)std::atol(value.c_str());
+		else if(arg == "--arms") options.arms = (size_t)std::atol(value.c_str());
+		else if(arg == "--iterations") options.iterations = (size_t)std::atol(value.c_str());
+		else return false;
+	}
+	return options.arms > 0 && options.iterations > 0;
+}
+
+double nowNs(){
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//the shoulder of arm a, spread around the torso
+Eigen::Matrix4f shoulder(size_t arm, size_t arms){
+	Eigen::Matrix4f output = Eigen::Matrix4f::Identity();
+	float angle = 2 * (float)M_PI * (float)arm / (float)arms;
+	output.topLeftCorner<3, 3>() = Eigen::AngleAxisf(angle, Eigen::Vector3f::UnitZ()).toRotationMatrix() *
+		Eigen::AngleAxisf((float)M_PI / 2, Eigen::Vector3f::UnitX()).toRotationMatrix();
+	output.topRightCorner<3, 1>() << 0.2f * std::cos(angle), 0.2f * std::sin(angle), 0.4f;
+	return output;
+}
+
+//actuator, link, ... with alternating twists
+template<typename Add>
+void addJoints(size_t dofs, Add add){
+	for(size_t j = 0; j < dofs; j++){
+		add(KinematicBody::createX5());
+		add(KinematicBody::createX5Link(0.25f, (j % 2) ? 0.0f : (float)M_PI / 2));
+	}
+}
+
+//the degrees of freedom of arm a in the whole robot: the waist's, then the arm's own
+std::vector<size_t> armDoFs(size_t arm, size_t waist){
+	std::vector<size_t> dofs;
+	for(size_t j = 0; j < waist; j++){
+		dofs.push_back(j);
+	}
+	for(size_t j = 0; j < ARM_DOFS; j++){
+		dofs.push_back(waist + arm * ARM_DOFS + j);
+	}
+	return dofs;
+}
+
+//the tree and one chain per arm (tree and Kinematics) of the same robot
+struct Robot{
+	KinematicTree tree;
+	std::vector<std::unique_ptr<KinematicTree> > armTrees;
+	std::vector<std::unique_ptr<Kinematics> > armChains;
+};
+
+void build(Robot& robot, size_t waist, size_t arms){
+	Matrix4fVector shoulders;
+	for(size_t a = 0; a < arms; a++){
+		shoulders.push_back(shoulder(a, arms));
+	}
+	addJoints(waist, [&](std::unique_ptr<KinematicBody> body){ robot.tree.addBody(std::move(body)); });
+	robot.tree.addStaticBody(Eigen::Vector3f(0, 0, 0.2f), shoulders);
+	size_t torso = robot.tree.getBodyCount() - 1;
+	for(size_t a = 0; a < arms; a++){
+		//the arm's first body goes on its shoulder, the rest follow it
+		bool first = true;
+		addJoints(ARM_DOFS, [&](std::unique_ptr<KinematicBody> body){
+			if(first){
+				robot.tree.addBody(std::move(body), torso, a);
+				first = false;
+			}
+			else{
+				robot.tree.addBody(std::move(body));
+			}
+		});
+
+		std::unique_ptr<KinematicTree> armTree(new KinematicTree());
+		std::unique_ptr<Kinematics> armChain(new Kinematics());
+		auto add = [&](std::unique_ptr<KinematicBody> body){
+			armTree->addBody(KinematicBody::create(body->getParameters()));
+			armChain->addBody(std::move(body));
+		};
+		addJoints(waist, add);
+		add(KinematicBody::createGenericLink(Eigen::Vector3f(0, 0, 0.2f), shoulders[a]));
+		addJoints(ARM_DOFS, add);
+		robot.armTrees.push_back(std::move(armTree));
+		robot.armChains.push_back(std::move(armChain));
+	}
+}
+
+float worst(const Eigen::MatrixXf& expected, const Eigen::MatrixXf& actual){
+	return (expected - actual).cwiseAbs().maxCoeff();
+}
+
+//a tree built as a chain against the C API, every frame of both types
+float compareChain(size_t dofs, const std::vector<Eigen::VectorXd>& configurations){
+	Kinematics chain;
+	KinematicTree tree;
+	addJoints(dofs, [&](std::unique_ptr<KinematicBody> body){
+		tree.addBody(KinematicBody::create(body->getParameters()));
+		chain.addBody(std::move(body));
+	});
+	Eigen::Matrix4f base = Eigen::Matrix4f::Identity();
+	base.topLeftCorner<3, 3>() = Eigen::AngleAxisf(0.3f, Eigen::Vector3f(1, 2, 3).normalized()).toRotationMatrix();
+	base.topRightCorner<3, 1>() << 0.1f, -0.2f, 0.3f;
+	chain.setBaseFrame(base);
+	tree.setBaseFrame(base);
+	KinematicTreeState state;
+	Matrix4fVector frames;
+	float error = 0;
+	for(size_t c = 0; c < configurations.size(); c++){
+		Eigen::VectorXd q = configurations[c].head(dofs);
+		tree.evaluate(q, state);
+		HebiFrameType types[] = { FrameTypeOutput, FrameTypeCenterOfMass };
+		for(size_t t = 0; t < 2; t++){
+			chain.getFK(types[t], q, frames);
+			const Matrix4fVector& mine = state.getFrames(types[t]);
+			if(mine.size() != frames.size()){
+				return 1e9f;
+			}
+			for(size_t f = 0; f < frames.size(); f++){
+				error = std::max(error, worst(frames[f], mine[f]));
+			}
+		}
+	}
+	return error;
+}
+
+}
+
+int main(int argc, char** argv){
+	Options options;
+	if(!parse(argc, argv, options)){
+		std::fprintf(stderr, "usage: tree_bench [--waist 2] [--arms 2] [--iterations 2000]\n");
+		return 1;
+	}
+	Robot robot;
+	build(robot, options.waist, options.arms);
+	size_t dofs = robot.tree.getDoFCount();
+	std::printf("%zu bodies, %zu dofs, %zu output frames, %zu end effectors\n", robot.tree.getBodyCount(), dofs,
+		robot.tree.getFrameCount(FrameTypeOutput), robot.tree.getEndEffectorCount());
+	if(robot.tree.getEndEffectorCount() != options.arms || dofs != options.waist + options.arms * ARM_DOFS){
+		std::printf("robot built wrong\n");
+		return 1;
+	}
+
+	std::mt19937 random(11);
+	std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+	std::vector<Eigen::VectorXd> configurations(64, Eigen::VectorXd(dofs));
+	for(size_t c = 0; c < configurations.size(); c++){
+		for(size_t j = 0; j < dofs; j++){
+			configurations[c][j] = angle(random);
+		}
+	}
+
+	std::vector<std::vector<size_t> > maps;
+	for(size_t a = 0; a < options.arms; a++){
+		maps.push_back(armDoFs(a, options.waist));
+	}
+
+	//the tree against each arm's chain
+	KinematicTreeState state, armState;
+	KinematicsWorkspace workspace(*robot.armChains[0]);
+	Eigen::MatrixXf jacobian, expectedJacobian;
+	Eigen::Matrix4f expectedTip;
+	Eigen::VectorXd armPositions(options.waist + ARM_DOFS);
+	float tipError = 0, jacobianError = 0;
+	for(size_t c = 0; c < configurations.size(); c++){
+		robot.tree.evaluate(configurations[c], state);
+		for(size_t a = 0; a < options.arms; a++){
+			const std::vector<size_t>& map = maps[a];
+			for(size_t j = 0; j < map.size(); j++){
+				armPositions[j] = configurations[c][map[j]];
+			}
+			robot.armChains[a]->getEndEffectorAndJ(FrameTypeOutput, armPositions, expectedTip, expectedJacobian, workspace);
+			tipError = std::max(tipError, worst(expectedTip, state.getEndEffector(a)));
+			state.getJEndEffector(a, jacobian);
+			for(size_t j = 0; j < map.size(); j++){
+				jacobianError = std::max(jacobianError, worst(expectedJacobian.col(j), jacobian.col(map[j])));
+			}
+		}
+	}
+	float chainError = compareChain(ARM_DOFS, configurations);
+	std::printf("tree against Kinematics: end effectors %.2e, jacobians %.2e, chain frames %.2e\n", tipError, jacobianError, chainError);
+
+	volatile float sink = 0;
+	double start = nowNs();
+	for(size_t n = 0; n < options.iterations; n++){
+		robot.tree.evaluate(configurations[n % configurations.size()], state);
+		for(size_t a = 0; a < options.arms; a++){
+			state.getJEndEffector(a, jacobian);
+			sink = sink + jacobian(0, 0) + state.getEndEffector(a)(0, 3);
+		}
+	}
+	std::printf("%-20s %8.3f us/configuration\n", "tree evaluate", (nowNs() - start) / (double)options.iterations / 1e3);
+
+	start = nowNs();
+	for(size_t n = 0; n < options.iterations; n++){
+		const Eigen::VectorXd& q = configurations[n % configurations.size()];
+		for(size_t a = 0; a < options.arms; a++){
+			const std::vector<size_t>& map = maps[a];
+			for(size_t j = 0; j < map.size(); j++){
+				armPositions[j] = q[map[j]];
+			}
+			robot.armTrees[a]->evaluate(armPositions, armState);
+			armState.getJEndEffector(0, jacobian);
+			sink = sink + jacobian(0, 0) + armState.getEndEffector(0)(0, 3);
+		}
+	}
+	std::printf("%-20s %8.3f us/configuration\n", "per arm trees", (nowNs() - start) / (double)options.iterations / 1e3);
+
+	size_t chainIterations = options.iterations / 50 + 1;
+	start = nowNs();
+	for(size_t n = 0; n < chainIterations; n++){
+		const Eigen::VectorXd& q = configurations[n % configurations.size()];
+		for(size_t a = 0; a < options.arms; a++){
+			const std::vector<size_t>& map = maps[a];
+			for(size_t j = 0; j < map.size(); j++){
+				armPositions[j] = q[map[j]];
+			}
+			robot.armChains[a]->getEndEffectorAndJ(FrameTypeOutput, armPositions, expectedTip, expectedJacobian, workspace);
+			sink = sink + expectedJacobian(0, 0);
+		}
+	}
+	std::printf("%-20s %8.3f us/configuration\n", "per arm C API", (nowNs() - start) / (double)chainIterations / 1e3);
+
+	bool ok = tipError < 1e-5f && jacobianError < 1e-4f && chainError < 1e-5f;
+	return ok && sink != 12345.0f ? 0 : 1;
+}
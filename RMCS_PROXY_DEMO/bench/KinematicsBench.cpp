@@ -0,0 +1,439 @@
+//per-call cost and heap allocations of the hebi::kinematics::Kinematics calls on a 6-DoF X5 arm,
+//with a fresh workspace per call (the plain overloads) and with one KinematicsWorkspace reused.
+//then --batch configurations at once through KinematicsBatch, on one thread and on every hardware thread,
+//against a loop of single calls; the batch results are checked against the loop.
+//for 1 to 7 dofs, FixedKinematics is timed as well and checked against the C API (transforms) and against
+//central differences of its own transforms (Jacobians), and against Kinematics::getEndEffectorAndJ. the C API's
+//own Jacobians (getJ) are numerical, so they are only compared loosely.
+//InverseKinematics is timed on reachable poses from a cold seed and from a warm one (the pose's own
+//configuration, perturbed), and on a streamed path (--path poses, smooth in joint space), solved point by point
+//and with solvePath
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -I. -Isrc -idirafter include bench/KinematicsBench.cpp src/kinematics.cpp src/inverse_kinematics.cpp
+//    ThreadPool.cpp LockProfile.cpp Metrics.cpp -pthread -Llib/linux_x86-64 -l:libhebi.so.0.16 -o kinematics_bench
+//
+//usage: kinematics_bench [--dofs 6] [--iterations 5000] [--batch 1000] [--path 1000]
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include "fixed_kinematics.hpp"
+#include "inverse_kinematics.hpp"
+#include "kinematics.hpp"
+
+namespace {
+
+std::atomic<uint64_t> allocations(0);
+
+}
+
+//every heap allocation of the process is counted. every form of new and delete is replaced, and kept out of line:
+//inlined, gcc would see free() on a pointer from operator new (-Wmismatched-new-delete)
+#define REPLACED __attribute__((noinline))
+
+REPLACED void* operator new(size_t size){
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = std::malloc(size ? size : 1);
+	if(!p){
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+REPLACED void* operator new[](size_t size){
+	return operator new(size);
+}
+
+REPLACED void operator delete(void* p) noexcept{
+	std::free(p);
+}
+
+REPLACED void operator delete[](void* p) noexcept{
+	std::free(p);
+}
+
+REPLACED void operator delete(void* p, size_t) noexcept{
+	std::free(p);
+}
+
+REPLACED void operator delete[](void* p, size_t) noexcept{
+	std::free(p);
+}
+
+namespace {
+
+using hebi::kinematics::FixedKinematics;
+using hebi::kinematics::IKResult;
+using hebi::kinematics::InverseKinematics;
+using hebi::kinematics::KinematicBody;
+using hebi::kinematics::Kinematics;
+using hebi::kinematics::KinematicsBatch;
+using hebi::kinematics::KinematicsWorkspace;
+using hebi::kinematics::Matrix4fVector;
+
+struct Options{
+	size_t dofs;
+	size_t iterations;
+	size_t batch;
+	size_t path;
+
+	Options() : dofs(6), iterations(5000), batch(1000), path(1000) {}
+};
+
+bool parse(int argc, char** argv, Options& options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(i + 1 >= argc){
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--dofs") options.dofs = (size_t)std::atol(value.c_str());
+		else if(arg == "--iterations") options.iterations = (size_t)std::atol(value.c_str());
+		else if(arg == "--batch") options.batch = (size_t)std::atol(value.c_str());
+		else if(arg == "--path") options.path = (size_t)std::atol(value.c_str());
+		else return false;
+	}
+	return options.dofs > 0 && options.iterations > 0;
+}
+
+double nowNs(){
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//actuator, link, actuator, link, ... with alternating twists so every joint matters
+void buildArm(Kinematics& arm, size_t dofs){
+	for(size_t j = 0; j < dofs; j++){
+		arm.addBody(KinematicBody::createX5());
+		arm.addBody(KinematicBody::createX5Link(0.3f, (j % 2) ? 0.0f : (float)M_PI / 2));
+	}
+}
+
+template<typename Configurations, typename Call>
+void run(const char* name, size_t iterations, const Configurations& configurations, Call call){
+	uint64_t before = allocations.load();
+	double start = nowNs();
+	for(size_t n = 0; n < iterations; n++){
+		call(configurations[n % configurations.size()]);
+	}
+	double elapsed = nowNs() - start;
+	double perCall = (double)(allocations.load() - before) / (double)iterations;
+	std::printf("%-28s %8.3f us/call  %6.2f allocations/call\n", name, elapsed / (double)iterations / 1e3, perCall);
+}
+
+//one pass over every column, reported per configuration
+template<typename Call>
+void runBatch(const char* name, size_t configurations, Call call){
+	double start = nowNs();
+	call();
+	double elapsed = nowNs() - start;
+	std::printf("%-28s %8.3f us/configuration  %8.2f ms total\n", name, elapsed / (double)configurations / 1e3, elapsed / 1e6);
+}
+
+size_t mismatches(const Matrix4fVector& expected, const Matrix4fVector& actual){
+	if(expected.size() != actual.size()){
+		return expected.size() + actual.size();
+	}
+	size_t bad = 0;
+	for(size_t i = 0; i < expected.size(); i++){
+		if(expected[i] != actual[i]){
+			bad++;
+		}
+	}
+	return bad;
+}
+
+//the rotation error as the angle of expected^T * actual
+float rotationError(const Eigen::Matrix4f& expected, const Eigen::Matrix4f& actual){
+	Eigen::Matrix3f difference = expected.topLeftCorner<3, 3>().transpose() * actual.topLeftCorner<3, 3>();
+	return Eigen::AngleAxisf(difference).angle();
+}
+
+template<int N>
+int compareFixed(const Kinematics& arm, size_t iterations, const std::vector<Eigen::VectorXd>& configurations){
+	std::unique_ptr<FixedKinematics<N> > fixed = FixedKinematics<N>::create(arm);
+	if(!fixed){
+		std::printf("FixedKinematics<%d> refused the arm\n", N);
+		return 1;
+	}
+	typedef Eigen::Matrix<double, N, 1> Positions;
+	std::vector<Positions, Eigen::aligned_allocator<Positions> > fixedConfigurations(configurations.size());
+	for(size_t c = 0; c < configurations.size(); c++){
+		fixedConfigurations[c] = configurations[c];
+	}
+	Eigen::Matrix4f tip, expectedTip;
+	typename FixedKinematics<N>::Jacobian jacobian;
+	Eigen::MatrixXf expectedJacobian;
+	hebi::kinematics::MatrixXfVector numericJacobians;
+	volatile float sink = 0;
+	std::printf("\n");
+	run("fixed getEndEffector", iterations * 100, fixedConfigurations, [&](const Positions& q){
+		fixed->getEndEffector(q, tip);
+		sink = sink + tip(0, 3);
+	});
+	run("fixed getJEndEffector", iterations * 100, fixedConfigurations, [&](const Positions& q){
+		fixed->getJEndEffector(q, jacobian);
+		sink = sink + jacobian(0, 0);
+	});
+	run("fixed getEndEffectorAndJ", iterations * 100, fixedConfigurations, [&](const Positions& q){
+		fixed->getEndEffectorAndJ(q, tip, jacobian);
+		sink = sink + jacobian(0, 0) + tip(0, 3);
+	});
+
+	float position = 0, rotation = 0, numeric = 0, againstKinematics = 0, againstC = 0;
+	const double step = 1e-3;
+	for(size_t c = 0; c < configurations.size(); c++){
+		const Eigen::VectorXd& q = configurations[c];
+		arm.getEndEffector(FrameTypeOutput, q, expectedTip);
+		fixed->getEndEffectorAndJ(q, tip, jacobian);
+		position = std::max(position, (expectedTip.topRightCorner<3, 1>() - tip.topRightCorner<3, 1>()).norm());
+		rotation = std::max(rotation, rotationError(expectedTip, tip));
+		//central differences of the fixed transform: d position and the skew part of dR * R^T
+		for(int j = 0; j < N; j++){
+			Eigen::Matrix4f plus, minus;
+			Eigen::VectorXd moved = q;
+			moved[j] += step;
+			fixed->getEndEffector(moved, plus);
+			moved[j] -= 2 * step;
+			fixed->getEndEffector(moved, minus);
+			Eigen::Matrix4f derivative = (plus - minus) / (float)(2 * step);
+			Eigen::Matrix3f spin = derivative.topLeftCorner<3, 3>() * tip.topLeftCorner<3, 3>().transpose();
+			Eigen::Matrix<float, 6, 1> column;
+			column << derivative.topRightCorner<3, 1>(), spin(2, 1), spin(0, 2), spin(1, 0);
+			numeric = std::max(numeric, (column - jacobian.col(j)).cwiseAbs().maxCoeff());
+		}
+		arm.getEndEffectorAndJ(FrameTypeOutput, q, expectedTip, expectedJacobian);
+		againstKinematics = std::max(againstKinematics, (expectedJacobian - jacobian).cwiseAbs().maxCoeff());
+		arm.getJ(FrameTypeOutput, q, numericJacobians);
+		againstC = std::max(againstC, (numericJacobians.back() - jacobian).cwiseAbs().maxCoeff());
+	}
+	std::printf("fixed against C API: position %.2e m, rotation %.2e rad, getJ tip %.2e (numerical)\n", position, rotation, againstC);
+	std::printf("fixed jacobian against central differences %.2e, against getEndEffectorAndJ %.2e\n", numeric, againstKinematics);
+	bool ok = position < 1e-5f && rotation < 1e-4f && numeric < 1e-3f && againstKinematics < 1e-5f && againstC < 1e-2f;
+	return ok && sink != 12345.0f ? 0 : 1;
+}
+
+int compareFixed(const Kinematics& arm, size_t iterations, const std::vector<Eigen::VectorXd>& configurations){
+	switch(arm.getDoFCount()){
+	case 1: return compareFixed<1>(arm, iterations, configurations);
+	case 2: return compareFixed<2>(arm, iterations, configurations);
+	case 3: return compareFixed<3>(arm, iterations, configurations);
+	case 4: return compareFixed<4>(arm, iterations, configurations);
+	case 5: return compareFixed<5>(arm, iterations, configurations);
+	case 6: return compareFixed<6>(arm, iterations, configurations);
+	case 7: return compareFixed<7>(arm, iterations, configurations);
+	default: return 0;
+	}
+}
+
+struct SolveStats{
+	size_t solves;
+	size_t converged;
+	size_t evaluations;
+	int maxEvaluations;
+	double worstResidual;
+	double maxUs;
+	double totalUs;
+
+	SolveStats() : solves(0), converged(0), evaluations(0), maxEvaluations(0), worstResidual(0), maxUs(0), totalUs(0) {}
+	void add(const IKResult& result, double us){
+		solves++;
+		converged += result.converged ? 1 : 0;
+		evaluations += (size_t)result.evaluations;
+		maxEvaluations = std::max(maxEvaluations, result.evaluations);
+		worstResidual = std::max(worstResidual, result.residual);
+		maxUs = std::max(maxUs, us);
+		totalUs += us;
+	}
+	void print(const char* name) const{
+		std::printf("%-28s %8.1f us/solve (max %8.1f)  %5.1f evaluations (max %3d)  %zu/%zu converged  worst residual %.1e\n",
+			name, totalUs / (double)solves, maxUs, (double)evaluations / (double)solves, maxEvaluations, converged, solves, worstResidual);
+	}
+};
+
+int compareIK(const Kinematics& arm, size_t iterations, size_t pathLength){
+	InverseKinematics ik(arm);
+	size_t dofs = arm.getDoFCount();
+	std::mt19937 random(7);
+	std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+	std::normal_distribution<double> nudge(0.0, 0.05);
+	Eigen::VectorXd goal(dofs), seed(dofs), solution(dofs);
+	Eigen::Matrix4f target;
+	IKResult result;
+	SolveStats cold, warm;
+	std::printf("\n");
+	for(size_t n = 0; n < iterations / 50 + 1; n++){
+		for(size_t j = 0; j < dofs; j++){
+			goal[j] = angle(random);
+			seed[j] = goal[j] + nudge(random);
+		}
+		arm.getEndEffector(FrameTypeOutput, goal, target);
+		double start = nowNs();
+		ik.solve(target, seed, solution, &result);
+		warm.add(result, (nowNs() - start) / 1e3);
+		seed.setZero();
+		start = nowNs();
+		ik.solve(target, seed, solution, &result);
+		cold.add(result, (nowNs() - start) / 1e3);
+	}
+	warm.print("solve warm (5 cm/rad seed)");
+	cold.print("solve cold (zero seed)");
+
+	//a smooth joint-space sweep, so every pose is reachable and close to the one before; kept off zero, where
+	//the alternating twists line joints up and a local solver can follow a second branch into a singularity
+	hebi::kinematics::Matrix4fVector path(pathLength);
+	Eigen::MatrixXd expected(dofs, pathLength);
+	for(size_t i = 0; i < pathLength; i++){
+		double t = (double)i / (double)pathLength;
+		for(size_t j = 0; j < dofs; j++){
+			expected(j, i) = 0.9 + 0.4 * std::sin(2 * M_PI * t * (1.0 + 0.3 * (double)j) + (double)j);
+		}
+		arm.getEndEffector(FrameTypeOutput, expected.col(i), path[i]);
+	}
+	SolveStats streamed;
+	solution = expected.col(0);
+	for(size_t i = 0; i < pathLength; i++){
+		double start = nowNs();
+		ik.solve(path[i], solution, solution, &result);
+		streamed.add(result, (nowNs() - start) / 1e3);
+	}
+	streamed.print("path point by point");
+	Eigen::MatrixXd solved;
+	std::vector<IKResult> results;
+	double start = nowNs();
+	size_t converged = ik.solvePath(path, expected.col(0), solved, &results);
+	double elapsed = nowNs() - start;
+	double jump = 0;
+	for(size_t i = 1; i < pathLength; i++){
+		jump = std::max(jump, (solved.col(i) - solved.col(i - 1)).cwiseAbs().maxCoeff());
+	}
+	std::printf("solvePath, %zu threads        %8.1f us/pose  %zu/%zu converged  largest joint step %.3f rad\n",
+		ik.getThreadCount(), elapsed / 1e3 / (double)pathLength, converged, pathLength, jump);
+	//poses closest to a singularity may stall just above the tolerance; a branch jump shows as a large joint step
+	bool ok = warm.converged == warm.solves && converged * 100 >= pathLength * 99 && streamed.converged * 100 >= pathLength * 99;
+	return ok && jump < 0.2 ? 0 : 1;
+}
+
+//N single calls against KinematicsBatch on one thread and on all of them; exit status 1 if any result differs
+int compareBatch(const Kinematics& arm, size_t count){
+	std::mt19937 random(5);
+	std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+	Eigen::MatrixXd positions(arm.getDoFCount(), count);
+	for(size_t c = 0; c < count; c++){
+		for(size_t j = 0; j < (size_t)positions.rows(); j++){
+			positions(j, c) = angle(random);
+		}
+	}
+	size_t frameCount = arm.getFrameCount(FrameTypeOutput);
+	KinematicsBatch single(arm, 1);
+	KinematicsBatch parallel(arm);
+	std::printf("\nbatch of %zu configurations, %zu threads\n", count, parallel.getThreadCount());
+
+	Matrix4fVector loopTips(count), loopFrames(count * frameCount);
+	Matrix4fVector frames;
+	KinematicsWorkspace workspace(arm);
+	Eigen::VectorXd q(arm.getDoFCount());
+	runBatch("getEndEffector loop", count, [&](){
+		for(size_t c = 0; c < count; c++){
+			q = positions.col(c);
+			arm.getEndEffector(FrameTypeOutput, q, loopTips[c]);
+		}
+	});
+	runBatch("getFK loop", count, [&](){
+		for(size_t c = 0; c < count; c++){
+			q = positions.col(c);
+			arm.getFK(FrameTypeOutput, q, frames, workspace);
+			std::copy(frames.begin(), frames.end(), loopFrames.begin() + c * frameCount);
+		}
+	});
+
+	Matrix4fVector tips, all;
+	size_t bad = 0;
+	runBatch("batch getEndEffectors 1", count, [&](){ single.getEndEffectors(FrameTypeOutput, positions, tips); });
+	bad += mismatches(loopTips, tips);
+	runBatch("batch getFK 1", count, [&](){ single.getFK(FrameTypeOutput, positions, all); });
+	bad += mismatches(loopFrames, all);
+	runBatch("batch getEndEffectors all", count, [&](){ parallel.getEndEffectors(FrameTypeOutput, positions, tips); });
+	bad += mismatches(loopTips, tips);
+	runBatch("batch getFK all", count, [&](){ parallel.getFK(FrameTypeOutput, positions, all); });
+	bad += mismatches(loopFrames, all);
+	std::printf("%zu transforms differ from the single calls\n", bad);
+	return bad ? 1 : 0;
+}
+
+}
+
+int main(int argc, char** argv){
+	Options options;
+	if(!parse(argc, argv, options)){
+		std::fprintf(stderr, "usage: kinematics_bench [--dofs 6] [--iterations 5000] [--batch 1000] [--path 1000]\n");
+		return 1;
+	}
+	Kinematics arm;
+	buildArm(arm, options.dofs);
+	std::mt19937 random(3);
+	std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+	std::vector<Eigen::VectorXd> configurations(64, Eigen::VectorXd(options.dofs));
+	for(size_t c = 0; c < configurations.size(); c++){
+		for(size_t j = 0; j < options.dofs; j++){
+			configurations[c][j] = angle(random);
+		}
+	}
+	std::printf("%zu dofs, %zu output frames\n", arm.getDoFCount(), arm.getFrameCount(FrameTypeOutput));
+
+	hebi::kinematics::Matrix4fVector frames;
+	hebi::kinematics::MatrixXfVector jacobians;
+	Eigen::Matrix4f tip;
+	Eigen::MatrixXf jacobian;
+	Eigen::VectorXd solution(options.dofs);
+	Eigen::Vector3f target(0.3f, 0.2f, 0.1f);
+	KinematicsWorkspace workspace(arm);
+	volatile float sink = 0;
+
+	run("getFK", options.iterations, configurations, [&](const Eigen::VectorXd& q){
+		arm.getFK(FrameTypeOutput, q, frames);
+		sink = sink + frames.back()(0, 3);
+	});
+	run("getFK workspace", options.iterations, configurations, [&](const Eigen::VectorXd& q){
+		arm.getFK(FrameTypeOutput, q, frames, workspace);
+		sink = sink + frames.back()(0, 3);
+	});
+	run("getEndEffector", options.iterations, configurations, [&](const Eigen::VectorXd& q){
+		arm.getEndEffector(FrameTypeOutput, q, tip);
+		sink = sink + tip(0, 3);
+	});
+	run("getJ", options.iterations, configurations, [&](const Eigen::VectorXd& q){
+		arm.getJ(FrameTypeOutput, q, jacobians);
+		sink = sink + jacobians.back()(0, 0);
+	});
+	run("getJ workspace", options.iterations, configurations, [&](const Eigen::VectorXd& q){
+		arm.getJ(FrameTypeOutput, q, jacobians, workspace);
+		sink = sink + jacobians.back()(0, 0);
+	});
+	run("getJEndEffector", options.iterations, configurations, [&](const Eigen::VectorXd& q){
+		arm.getJEndEffector(FrameTypeOutput, q, jacobian);
+		sink = sink + jacobian(0, 0);
+	});
+	run("getJEndEffector workspace", options.iterations, configurations, [&](const Eigen::VectorXd& q){
+		arm.getJEndEffector(FrameTypeOutput, q, jacobian, workspace);
+		sink = sink + jacobian(0, 0);
+	});
+	run("getEndEffectorAndJ workspace", options.iterations, configurations, [&](const Eigen::VectorXd& q){
+		arm.getEndEffectorAndJ(FrameTypeOutput, q, tip, jacobian, workspace);
+		sink = sink + jacobian(0, 0) + tip(0, 3);
+	});
+	run("solveIK", options.iterations / 20 + 1, configurations, [&](const Eigen::VectorXd& q){
+		arm.solveIK(target, q, solution);
+		sink = sink + (float)solution[0];
+	});
+	if(sink == 12345.0f){
+		return 2;
+	}
+	int status = compareFixed(arm, options.iterations, configurations);
+	status |= compareIK(arm, options.iterations, options.path);
+	return compareBatch(arm, options.batch) | status;
+}
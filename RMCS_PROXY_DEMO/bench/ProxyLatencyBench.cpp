@@ -0,0 +1,397 @@
+//end-to-end latency of the proxy pipeline against the simulated backend (sim/) or a recording
+//
+//stages, all in microseconds from the moment the group feedback callback fired:
+//  dispatch   frame decoded and handed to the first consumer
+//  cache      frame visible in the CacheManager history
+//  database   frame inserted by the DataBaseManager thread; frames that waited longer than its max queue delay
+//             are dropped instead and counted in databaseDropped
+//  apiCache   age of the newest sample a client reads through CacheManager::lastSeconds
+//  apiQuery   duration of a one second ServerApiManager::queryTelemetry (not an age)
+//  command    client push to the return of hebiGroupSendCommand (CommandCustomer)
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -pthread -I. -Isrc -idirafter include bench/ProxyLatencyBench.cpp
+//    CacheManager.cpp HistoryRing.cpp DataBaseManager.cpp ThreadPool.cpp ServerApiManager.cpp ApiConnection.cpp
+//    WireFormat.cpp JsonWriter.cpp CommandParser.cpp FeedBackManager.cpp FeedBackRecorder.cpp CommandCustomer.cpp
+//    CommandJournal.cpp CThread.cpp LatencyHistogram.cpp Metrics.cpp Trace.cpp LockProfile.cpp sim/*.cpp src/*.cpp
+//    -Llib/linux_x86-64 -l:libhebi.so.0.16 -o proxy_bench
+//(the sim objects provide the messaging api; libhebi only supplies the kinematics symbols src/ needs)
+//
+//usage: proxy_bench [--modules 10,100,1000] [--group-size 100] [--rate 1000] [--seconds 5]
+//                   [--latency-us 0] [--jitter-us 0] [--loss 0] [--db /tmp/proxy_bench]
+//                   [--replay file --speed 0] [--out result.json]
+#include <sys/stat.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CacheManager.h"
+#include "CommandCustomer.h"
+#include "DataBaseManager.h"
+#include "FeedBackManager.h"
+#include "FeedBackRecorder.h"
+#include "LatencyHistogram.h"
+#include "ServerApiManager.h"
+#include "lookup.hpp"
+#include "sim/HebiSim.h"
+
+namespace {
+
+struct Options{
+	std::vector<size_t> moduleCounts;
+	size_t groupSize;
+	double rateHz;
+	double seconds;
+	int64_t latencyUs;
+	int64_t jitterUs;
+	double loss;
+	std::string dbRoot;
+	std::string replay;
+	double speed;
+	std::string out;
+
+	Options() : groupSize(100), rateHz(1000), seconds(5), latencyUs(0), jitterUs(0), loss(0),
+		dbRoot("/tmp/proxy_bench"), speed(0) {}
+};
+
+struct Stage{
+	std::mutex lock;
+	LatencyHistogram histogram;
+
+	void record(int64_t us){
+		std::lock_guard<std::mutex> guard(lock);
+		histogram.record(us);
+	}
+};
+
+const char* const STAGES[] = {"dispatch", "cache", "database", "apiCache", "apiQuery", "command"};
+const size_t STAGE_COUNT = sizeof(STAGES) / sizeof(STAGES[0]);
+
+struct RunResult{
+	size_t modules;
+	size_t groups;
+	uint64_t frames;
+	double seconds;
+	SimStats sim;
+	uint64_t databaseDropped; //frames the database queue dropped, too many or waiting too long
+	std::map<std::string, std::string> stages; //name -> histogram json
+};
+
+std::vector<size_t> parseList(const std::string& text){
+	std::vector<size_t> values;
+	std::stringstream items(text);
+	std::string item;
+	while(std::getline(items, item, ',')){
+		if(!item.empty()){
+			values.push_back((size_t)std::atol(item.c_str()));
+		}
+	}
+	return values;
+}
+
+bool parse(int argc, char** argv, Options& options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(i + 1 >= argc){
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--modules") options.moduleCounts = parseList(value);
+		else if(arg == "--group-size") options.groupSize = (size_t)std::atol(value.c_str());
+		else if(arg == "--rate") options.rateHz = std::atof(value.c_str());
+		else if(arg == "--seconds") options.seconds = std::atof(value.c_str());
+		else if(arg == "--latency-us") options.latencyUs = std::atoll(value.c_str());
+		else if(arg == "--jitter-us") options.jitterUs = std::atoll(value.c_str());
+		else if(arg == "--loss") options.loss = std::atof(value.c_str());
+		else if(arg == "--db") options.dbRoot = value;
+		else if(arg == "--replay") options.replay = value;
+		else if(arg == "--speed") options.speed = std::atof(value.c_str());
+		else if(arg == "--out") options.out = value;
+		else return false;
+	}
+	if(options.moduleCounts.empty()){
+		options.moduleCounts = parseList("10,100,500,1000");
+	}
+	return options.groupSize > 0 && options.rateHz > 0;
+}
+
+//the consumers of one run, wired the way the proxy wires them
+struct Pipeline{
+	FeedBackManager feedback;
+	CacheManager cache;
+	DataBaseManager database;
+	ServerApiManager api;
+	CommandCustomer commands;
+	Stage stages[STAGE_COUNT];
+	std::atomic<uint64_t> frames;
+
+	Pipeline() : api(database, cache), frames(0) {}
+
+	bool start(const std::string& dbRoot){
+		mkdir(dbRoot.c_str(), 0755);
+		if(!database.init(dbRoot)){
+			return false;
+		}
+		feedback.addFrameHandler([this](const GroupFeedbackFrame& frame){
+			stages[0].record(FeedBackManager::nowUs() - frame.timestampUs);
+		});
+		feedback.addFrameHandler([this](const GroupFeedbackFrame& frame){
+			cache.onFrame(frame);
+			api.onFrame(frame);
+			stages[1].record(FeedBackManager::nowUs() - frame.timestampUs);
+		});
+		feedback.addFrameHandler([this](const GroupFeedbackFrame& frame){
+			database.push(frame);
+			frames++;
+		});
+		database.setInsertedHandler([this](const GroupFeedbackFrame& frame){
+			stages[2].record(FeedBackManager::nowUs() - frame.timestampUs);
+		});
+		commands.setSentHandler([this](const CommandElement& element, bool){
+			stages[5].record(FeedBackManager::nowUs() - element.createdUs);
+		});
+		database.start();
+		commands.start();
+		return true;
+	}
+
+	void stop(){
+		commands.shutdown();
+		database.shutdown();
+	}
+};
+
+//a client polling recent history through the cache and the database api
+void apiClient(Pipeline& pipeline, const std::vector<std::string>& modules, const std::atomic<bool>& done){
+	std::vector<FeedbackField> fields;
+	fields.push_back(FieldPosition);
+	fields.push_back(FieldVelocity);
+	HistorySnapshot snapshot;
+	TelemetryResult result;
+	size_t next = 0;
+	int tick = 0;
+	while(!done && !modules.empty()){
+		const std::string& module = modules[next++ % modules.size()];
+		if(pipeline.cache.lastSeconds(module, 1.0, fields, snapshot) && snapshot.size()){
+			pipeline.stages[3].record(FeedBackManager::nowUs() - snapshot.timestamps.back());
+		}
+		if(++tick % 100 == 0){
+			TelemetryQuery query;
+			query.modules.push_back(module);
+			query.fields = fields;
+			query.endUs = FeedBackManager::nowUs();
+			query.startUs = query.endUs - 1000000;
+			int64_t start = FeedBackManager::nowUs();
+			pipeline.api.queryTelemetry(query, result);
+			pipeline.stages[4].record(FeedBackManager::nowUs() - start);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void collect(Pipeline& pipeline, RunResult& result){
+	for(size_t s = 0; s < STAGE_COUNT; s++){
+		std::lock_guard<std::mutex> guard(pipeline.stages[s].lock);
+		result.stages[STAGES[s]] = pipeline.stages[s].histogram.toJson();
+	}
+	result.frames = pipeline.frames;
+	result.databaseDropped = pipeline.database.getDroppedFrames();
+}
+
+bool runSimulated(const Options& options, size_t moduleCount, const std::string& dbRoot, RunResult& result){
+	SimConfig config;
+	size_t groups = (moduleCount + options.groupSize - 1) / options.groupSize;
+	for(size_t g = 0; g < groups; g++){
+		std::ostringstream family;
+		family<<"Bench"<<g;
+		size_t remaining = moduleCount - g * options.groupSize;
+		config.addFamily(family.str(), remaining < options.groupSize ? remaining : options.groupSize);
+	}
+	config.latencyUs = options.latencyUs;
+	config.jitterUs = options.jitterUs;
+	config.feedbackLoss = config.commandLoss = options.loss;
+	if(!simConfigure(config)){
+		return false;
+	}
+	simResetStats();
+
+	Pipeline pipeline;
+	if(!pipeline.start(dbRoot)){
+		return false;
+	}
+	std::vector<std::string> moduleKeys;
+	{
+		hebi::Lookup lookup;
+		std::vector<std::shared_ptr<hebi::Group> > groupList;
+		std::vector<std::shared_ptr<const std::vector<std::string> > > keyList;
+		for(size_t g = 0; g < config.families.size(); g++){
+			const SimFamily& family = config.families[g];
+			std::shared_ptr<hebi::Group> group(lookup.getGroupFromFamily(family.family).release());
+			if(!group){
+				pipeline.stop();
+				return false;
+			}
+			std::shared_ptr<std::vector<std::string> > keys = std::make_shared<std::vector<std::string> >();
+			for(size_t n = 0; n < family.names.size(); n++){
+				keys->push_back(family.family + "/" + family.names[n]);
+				moduleKeys.push_back(keys->back());
+			}
+			std::string groupKey = family.family;
+			FeedBackManager* feedback = &pipeline.feedback;
+			std::shared_ptr<const std::vector<std::string> > constKeys = keys;
+			group->addFeedbackHandler([feedback, groupKey, constKeys](const hebi::GroupFeedback* groupFeedback){
+				feedback->onGroupFeedback(groupKey, constKeys, *groupFeedback);
+			});
+			group->setFeedbackFrequencyHz((float)options.rateHz);
+			groupList.push_back(group);
+			keyList.push_back(constKeys);
+		}
+
+		std::atomic<bool> done(false);
+		std::thread client(apiClient, std::ref(pipeline), std::cref(moduleKeys), std::cref(done));
+		//one client command per group every 10 ms
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() +
+			std::chrono::microseconds((int64_t)(options.seconds * 1e6));
+		double target = 0;
+		while(std::chrono::steady_clock::now() < end){
+			target += 0.01;
+			for(size_t g = 0; g < groupList.size(); g++){
+				CommandElement element;
+				element.groupKey = config.families[g].family;
+				element.moduleKeys = keyList[g];
+				element.group = groupList[g];
+				element.command = std::make_shared<hebi::GroupCommand>(groupList[g]->size());
+				for(int m = 0; m < groupList[g]->size(); m++){
+					(*element.command)[m].actuator().position().set(target);
+				}
+				element.createdUs = FeedBackManager::nowUs();
+				pipeline.commands.push(element);
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		for(size_t g = 0; g < groupList.size(); g++){
+			groupList[g]->setFeedbackFrequencyHz(0);
+			groupList[g]->clearFeedbackHandlers();
+		}
+		done = true;
+		client.join();
+		pipeline.stop();
+	}
+	result.modules = moduleCount;
+	result.groups = groups;
+	result.seconds = options.seconds;
+	result.sim = simGetStats();
+	collect(pipeline, result);
+	return true;
+}
+
+bool runReplay(const Options& options, const std::string& dbRoot, RunResult& result){
+	Pipeline pipeline;
+	FeedBackReplayer replayer(pipeline.feedback);
+	if(!replayer.load(options.replay) || !pipeline.start(dbRoot)){
+		return false;
+	}
+	replayer.setSpeed(options.speed);
+	std::set<std::string> groups;
+	std::set<std::string> moduleSet;
+	const std::vector<GroupFeedbackFrame>& frames = replayer.getFrames();
+	for(size_t i = 0; i < frames.size(); i++){
+		if(groups.insert(frames[i].groupKey).second && frames[i].moduleKeys){
+			moduleSet.insert(frames[i].moduleKeys->begin(), frames[i].moduleKeys->end());
+		}
+	}
+	std::vector<std::string> moduleKeys(moduleSet.begin(), moduleSet.end());
+	std::atomic<bool> done(false);
+	std::thread client(apiClient, std::ref(pipeline), std::cref(moduleKeys), std::cref(done));
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	replayer.run();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	done = true;
+	client.join();
+	pipeline.stop();
+	result.modules = moduleKeys.size();
+	result.groups = groups.size();
+	result.seconds = seconds;
+	std::memset(&result.sim, 0, sizeof(result.sim));
+	collect(pipeline, result);
+	return true;
+}
+
+std::string toJson(const Options& options, const std::vector<RunResult>& runs){
+	std::ostringstream out;
+	out<<"{\"benchmark\":\"proxy_latency\",\"unit\":\"us\",\"source\":\""<<(options.replay.empty() ? "sim" : "replay")<<"\"";
+	out<<",\"rateHz\":"<<options.rateHz<<",\"groupSize\":"<<options.groupSize;
+	out<<",\"latencyUs\":"<<options.latencyUs<<",\"jitterUs\":"<<options.jitterUs<<",\"loss\":"<<options.loss;
+	out<<",\"runs\":[";
+	for(size_t r = 0; r < runs.size(); r++){
+		const RunResult& run = runs[r];
+		double framesPerSec = run.seconds > 0 ? run.frames / run.seconds : 0;
+		out<<(r ? "," : "")<<"{\"modules\":"<<run.modules<<",\"groups\":"<<run.groups;
+		out<<",\"seconds\":"<<run.seconds<<",\"frames\":"<<run.frames;
+		out<<",\"framesPerSec\":"<<framesPerSec<<",\"samplesPerSec\":"<<framesPerSec * (run.groups ? (double)run.modules / run.groups : 0);
+		out<<",\"feedbackDropped\":"<<run.sim.feedbackDropped<<",\"missedTicks\":"<<run.sim.missedTicks;
+		out<<",\"databaseDropped\":"<<run.databaseDropped;
+		out<<",\"stages\":{";
+		for(size_t s = 0; s < STAGE_COUNT; s++){
+			std::map<std::string, std::string>::const_iterator it = run.stages.find(STAGES[s]);
+			out<<(s ? "," : "")<<"\""<<STAGES[s]<<"\":"<<(it != run.stages.end() ? it->second : "{}");
+		}
+		out<<"}}";
+	}
+	out<<"]}";
+	return out.str();
+}
+
+}
+
+int main(int argc, char** argv){
+	Options options;
+	if(!parse(argc, argv, options)){
+		std::cerr<<"usage: proxy_bench [--modules 10,100,1000] [--group-size 100] [--rate 1000] [--seconds 5]"
+			" [--latency-us 0] [--jitter-us 0] [--loss 0] [--db dir] [--replay file --speed 0] [--out file]"<<std::endl;
+		return 2;
+	}
+	std::vector<RunResult> runs;
+	if(!options.replay.empty()){
+		RunResult result;
+		if(!runReplay(options, options.dbRoot + "/replay", result)){
+			std::cerr<<"cannot replay "<<options.replay<<std::endl;
+			return 1;
+		}
+		runs.push_back(result);
+	}
+	else{
+		mkdir(options.dbRoot.c_str(), 0755);
+		for(size_t i = 0; i < options.moduleCounts.size(); i++){
+			std::ostringstream dir;
+			dir<<options.dbRoot<<"/run_"<<options.moduleCounts[i]<<"_"<<FeedBackManager::nowUs();
+			RunResult result;
+			if(!runSimulated(options, options.moduleCounts[i], dir.str(), result)){
+				std::cerr<<"run with "<<options.moduleCounts[i]<<" modules failed"<<std::endl;
+				return 1;
+			}
+			runs.push_back(result);
+			std::cerr<<options.moduleCounts[i]<<" modules: "<<result.frames<<" frames, database "<<result.stages["database"]
+				<<", "<<result.databaseDropped<<" dropped"<<std::endl;
+		}
+	}
+	std::string json = toJson(options, runs);
+	if(options.out.empty()){
+		std::cout<<json<<std::endl;
+	}
+	else{
+		std::ofstream file(options.out.c_str());
+		file<<json<<std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,193 @@
+//time-range telemetry queries over the local segment store (DataBaseConnection::query on a ThreadPool)
+//
+//--minutes of feedback of --modules modules at --rate Hz, every field present, are written into a fresh store
+//under --root, then queried for --fields fields over the whole range:
+//  raw        every sample
+//  1 s        mean per second
+//  window     the last tenth of the range, raw
+//each query is the best of --repeat runs into one TelemetryResult, as a polling client keeps it; the first run, which
+//also allocates the result columns, is printed too. the sample count (and every raw value) is checked, and the raw
+//query must stay under --limit ms. the segment files stay in the page cache after writing, so this is local disk at
+//its warmest
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -pthread -I. -Isrc -idirafter include bench/TelemetryQueryBench.cpp DataBaseManager.cpp
+//    ThreadPool.cpp FeedBackManager.cpp CThread.cpp LatencyHistogram.cpp Metrics.cpp Trace.cpp LockProfile.cpp
+//    sim/*.cpp src/*.cpp -Llib/linux_x86-64 -l:libhebi.so.0.16 -o telemetry_query_bench
+//
+//usage: telemetry_query_bench [--root /tmp/telemetry_query_bench] [--minutes 60] [--modules 10] [--rate 100]
+//         [--fields 3] [--threads 0] [--repeat 5] [--limit 100]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "DataBaseManager.h"
+
+namespace {
+
+struct Options{
+	std::string root;
+	double minutes;
+	int modules;
+	double rate;
+	int fields;
+	size_t threads;
+	int repeat;
+	double limitMs;
+
+	Options() : root("/tmp/telemetry_query_bench"), minutes(60), modules(10), rate(100), fields(3), threads(0), repeat(5),
+		limitMs(100) {}
+};
+
+bool parse(int argc, char** argv, Options& options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(i + 1 >= argc){
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--root") options.root = value;
+		else if(arg == "--minutes") options.minutes = std::atof(value.c_str());
+		else if(arg == "--modules") options.modules = std::atoi(value.c_str());
+		else if(arg == "--rate") options.rate = std::atof(value.c_str());
+		else if(arg == "--fields") options.fields = std::atoi(value.c_str());
+		else if(arg == "--threads") options.threads = (size_t)std::atol(value.c_str());
+		else if(arg == "--repeat") options.repeat = std::atoi(value.c_str());
+		else if(arg == "--limit") options.limitMs = std::atof(value.c_str());
+		else return false;
+	}
+	return options.minutes > 0 && options.modules > 0 && options.rate > 0 && options.fields > 0 &&
+		options.fields <= FieldCount && options.repeat > 0;
+}
+
+double nowNs(){
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double valueAt(size_t frame, size_t module, int field){
+	return (double)(frame % 1000) * 0.001 + module + field;
+}
+
+//best and first of repeat runs in ms; false if any run failed or returned other than expected samples per module.
+//firstFrame >= 0 also checks every value of a raw query that starts there
+bool timeQuery(DataBaseConnection& store, ThreadPool& pool, const TelemetryQuery& query, size_t expected, int repeat,
+	long long firstFrame, double* bestMs, double* firstMs)
+{
+	*bestMs = 1e300;
+	TelemetryResult result;
+	for(int r = 0; r < repeat; r++){
+		double start = nowNs();
+		bool ok = store.query(query, pool, result);
+		double elapsed = (nowNs() - start) / 1e6;
+		if(!ok || result.series.size() != query.modules.size()){
+			return false;
+		}
+		for(size_t s = 0; s < result.series.size(); s++){
+			if(result.series[s].timestamps.size() != expected || result.series[s].columns.size() != query.fields.size()){
+				std::printf("%s: %zu samples, expected %zu\n", result.series[s].module.c_str(),
+					result.series[s].timestamps.size(), expected);
+				return false;
+			}
+			for(size_t i = 0; firstFrame >= 0 && i < expected; i++){
+				for(size_t q = 0; q < query.fields.size(); q++){
+					if(result.series[s].columns[q][i] != valueAt((size_t)firstFrame + i, s, query.fields[q])){
+						std::printf("%s: wrong value at sample %zu\n", result.series[s].module.c_str(), i);
+						return false;
+					}
+				}
+			}
+		}
+		if(r == 0){
+			*firstMs = elapsed;
+		}
+		*bestMs = std::min(*bestMs, elapsed);
+	}
+	return true;
+}
+
+}
+
+int main(int argc, char** argv){
+	Options options;
+	if(!parse(argc, argv, options)){
+		std::fprintf(stderr, "usage: telemetry_query_bench [--root /tmp/telemetry_query_bench] [--minutes 60] [--modules 10]"
+			" [--rate 100] [--fields 3] [--threads 0] [--repeat 5] [--limit 100]\n");
+		return 1;
+	}
+	std::string command = "rm -rf '" + options.root + "'";
+	if(std::system(command.c_str()) != 0 || mkdir(options.root.c_str(), 0755) != 0){
+		std::printf("could not create %s\n", options.root.c_str());
+		return 1;
+	}
+
+	DataBaseConnection store;
+	if(!store.init(options.root)){
+		std::printf("could not open the store\n");
+		return 1;
+	}
+	GroupFeedbackFrame frame;
+	frame.groupKey = "Arm";
+	std::shared_ptr<std::vector<std::string> > keys = std::make_shared<std::vector<std::string> >();
+	for(int m = 0; m < options.modules; m++){
+		char key[32];
+		std::snprintf(key, sizeof(key), "Arm/j%04d", m); //series come back sorted by key
+		keys->push_back(key);
+	}
+	frame.moduleKeys = keys;
+	frame.modules.resize(options.modules);
+	const int64_t startUs = 1000000000000000LL;
+	const int64_t periodUs = (int64_t)(1e6 / options.rate);
+	const size_t frames = (size_t)(options.minutes * 60 * options.rate);
+	double start = nowNs();
+	for(size_t i = 0; i < frames; i++){
+		frame.timestampUs = startUs + (int64_t)i * periodUs;
+		for(int m = 0; m < options.modules; m++){
+			FeedbackSample& sample = frame.modules[m];
+			sample.present = (1u << FieldCount) - 1;
+			for(int f = 0; f < FieldCount; f++){
+				sample.values[f] = valueAt(i, m, f);
+			}
+		}
+		if(!store.insert(frame)){
+			std::printf("insert failed\n");
+			return 1;
+		}
+	}
+	if(!store.flush()){
+		std::printf("flush failed\n");
+		return 1;
+	}
+	std::printf("%zu frames of %d modules written in %.1f s\n", frames, options.modules, (nowNs() - start) / 1e9);
+
+	ThreadPool pool(options.threads);
+	TelemetryQuery query;
+	query.modules = *keys;
+	for(int f = 0; f < options.fields; f++){
+		query.fields.push_back((FeedbackField)f);
+	}
+	query.startUs = startUs;
+	query.endUs = startUs + (int64_t)frames * periodUs;
+
+	double raw, perSecond, window, first;
+	bool ok = timeQuery(store, pool, query, frames, options.repeat, 0, &raw, &first);
+	std::printf("%-8s %9.2f ms  (first %.2f ms)  %zu samples x %d modules x %d fields, %zu threads\n", "raw", raw, first,
+		frames, options.modules, options.fields, pool.size());
+
+	query.resolutionUs = 1000000;
+	size_t seconds = (size_t)((query.endUs - query.startUs + query.resolutionUs - 1) / query.resolutionUs);
+	ok = timeQuery(store, pool, query, seconds, options.repeat, -1, &perSecond, &first) && ok;
+	std::printf("%-8s %9.2f ms  (first %.2f ms)  %zu buckets\n", "1 s", perSecond, first, seconds);
+
+	query.resolutionUs = 0;
+	query.startUs = query.endUs - (int64_t)(frames / 10) * periodUs;
+	ok = timeQuery(store, pool, query, frames / 10, options.repeat,
+		(long long)(frames - frames / 10), &window, &first) && ok;
+	std::printf("%-8s %9.2f ms  (first %.2f ms)  %zu samples\n", "window", window, first, frames / 10);
+
+	std::system(command.c_str());
+	std::printf("raw query %s %.0f ms\n", raw < options.limitMs ? "under" : "OVER", options.limitMs);
+	return ok && raw < options.limitMs ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+//pre-rendering a trajectory: the C library's per-call states against Trajectory::getState and sampleMany
+//
+//a --seconds long trajectory of --joints joints through one waypoint per second, sampled at --rate. the same
+//waypoints also go to hebiTrajectoryCreateUnconstrainedQp, one C trajectory per joint, as the reference
+//  c getState          hebiTrajectoryGetState per joint and time, copied into joints x times matrices
+//  getState            Trajectory::getState per time, copied the same way
+//  sampleMany p        positions only, one thread
+//  sampleMany p,v,a    every derivative, one thread, then --threads threads
+//every result is checked against the C states, relative to 1 + |value|; must be <= 1e-4
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -pthread -Isrc -idirafter include bench/TrajectoryBench.cpp src/trajectory.cpp
+//    -Llib/linux_x86-64 -l:libhebi.so.0.16 -o trajectory_bench
+//
+//usage: trajectory_bench [--joints 7] [--seconds 10] [--rate 1000] [--threads 0] [--repeat 5]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "trajectory.hpp"
+
+namespace {
+
+using hebi::trajectory::Trajectory;
+
+struct Options{
+	int joints;
+	double seconds;
+	double rate;
+	size_t threads;
+	int repeat;
+
+	Options() : joints(7), seconds(10), rate(1000), threads(0), repeat(5) {}
+};
+
+bool parse(int argc, char** argv, Options& options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(i + 1 >= argc){
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--joints") options.joints = std::atoi(value.c_str());
+		else if(arg == "--seconds") options.seconds = std::atof(value.c_str());
+		else if(arg == "--rate") options.rate = std::atof(value.c_str());
+		else if(arg == "--threads") options.threads = (size_t)std::atol(value.c_str());
+		else if(arg == "--repeat") options.repeat = std::atoi(value.c_str());
+		else return false;
+	}
+	return options.joints > 0 && options.seconds >= 1 && options.rate > 0 && options.repeat > 0;
+}
+
+double nowNs(){
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//best of repeat runs, in ms
+template<typename Work>
+double best(int repeat, Work work){
+	double fastest = 1e300;
+	for(int r = 0; r < repeat; r++){
+		double start = nowNs();
+		work();
+		fastest = std::min(fastest, (nowNs() - start) / 1e6);
+	}
+	return fastest;
+}
+
+//largest |got - expected| / (1 + |expected|)
+double difference(const Eigen::MatrixXd& expected, const Eigen::MatrixXd& got){
+	double worst = 0;
+	for(int i = 0; i < expected.size(); i++){
+		worst = std::max(worst, std::abs(got(i) - expected(i)) / (1 + std::abs(expected(i))));
+	}
+	return worst;
+}
+
+}
+
+int main(int argc, char** argv){
+	Options options;
+	if(!parse(argc, argv, options)){
+		std::fprintf(stderr, "usage: trajectory_bench [--joints 7] [--seconds 10] [--rate 1000] [--threads 0] [--repeat 5]\n");
+		return 1;
+	}
+	//rest to rest, one random waypoint per second
+	int waypoints = (int)options.seconds + 1;
+	Eigen::VectorXd time(waypoints);
+	Eigen::MatrixXd positions(options.joints, waypoints);
+	Eigen::MatrixXd velocities = Eigen::MatrixXd::Constant(options.joints, waypoints, NAN);
+	Eigen::MatrixXd accelerations = Eigen::MatrixXd::Constant(options.joints, waypoints, NAN);
+	std::mt19937 random(5);
+	std::uniform_real_distribution<double> angle(-1.5, 1.5);
+	for(int w = 0; w < waypoints; w++){
+		time[w] = options.seconds * w / (waypoints - 1);
+		for(int j = 0; j < options.joints; j++){
+			positions(j, w) = angle(random);
+		}
+	}
+	velocities.col(0).setZero();
+	velocities.col(waypoints - 1).setZero();
+	accelerations.col(0).setZero();
+	accelerations.col(waypoints - 1).setZero();
+	std::unique_ptr<Trajectory> trajectory = Trajectory::createUnconstrainedQp(time, positions, &velocities, &accelerations);
+	std::vector<HebiTrajectoryPtr> reference(options.joints, nullptr);
+	{
+		Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> p = positions, v = velocities, a = accelerations;
+		for(int j = 0; j < options.joints; j++){
+			reference[j] = hebiTrajectoryCreateUnconstrainedQp(waypoints, p.data() + j * waypoints, v.data() + j * waypoints,
+				a.data() + j * waypoints, time.data());
+		}
+	}
+	if(!trajectory || std::find(reference.begin(), reference.end(), nullptr) != reference.end()){
+		std::printf("could not create the trajectories\n");
+		return 1;
+	}
+
+	int samples = (int)(options.seconds * options.rate) + 1;
+	Eigen::VectorXd times(samples);
+	for(int i = 0; i < samples; i++){
+		times[i] = std::min(options.seconds, i / options.rate);
+	}
+	std::printf("%d joints, %d times\n", options.joints, samples);
+
+	//the reference, and the baseline
+	Eigen::MatrixXd p(options.joints, samples), v(options.joints, samples), a(options.joints, samples);
+	bool ok = true;
+	double loop = best(options.repeat, [&](){
+		for(int i = 0; i < samples; i++){
+			for(int j = 0; j < options.joints; j++){
+				ok = hebiTrajectoryGetState(reference[j], times[i], &p(j, i), &v(j, i), &a(j, i)) == 0 && ok;
+			}
+		}
+	});
+	std::printf("%-24s %9.3f ms\n", "c getState", loop);
+
+	Eigen::MatrixXd sp(options.joints, samples), sv(options.joints, samples), sa(options.joints, samples);
+	double single = best(options.repeat, [&](){
+		Eigen::VectorXd position(options.joints), velocity(options.joints), acceleration(options.joints);
+		for(int i = 0; i < samples; i++){
+			ok = trajectory->getState(times[i], &position, &velocity, &acceleration) && ok;
+			sp.col(i) = position;
+			sv.col(i) = velocity;
+			sa.col(i) = acceleration;
+		}
+	});
+	double worst = std::max(difference(p, sp), std::max(difference(v, sv), difference(a, sa)));
+	std::printf("%-24s %9.3f ms  %5.2fx\n", "getState", single, loop / single);
+
+	sp.setZero();
+	double positionsOnly = best(options.repeat, [&](){ ok = trajectory->sampleMany(times, &sp, nullptr, nullptr, 1) && ok; });
+	worst = std::max(worst, difference(p, sp));
+	std::printf("%-24s %9.3f ms  %5.2fx\n", "sampleMany p", positionsOnly, loop / positionsOnly);
+
+	sp.setZero();
+	sv.setZero();
+	sa.setZero();
+	single = best(options.repeat, [&](){ ok = trajectory->sampleMany(times, &sp, &sv, &sa, 1) && ok; });
+	worst = std::max(worst, std::max(difference(p, sp), std::max(difference(v, sv), difference(a, sa))));
+	std::printf("%-24s %9.3f ms  %5.2fx\n", "sampleMany p,v,a", single, loop / single);
+
+	size_t threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+	sp.setZero();
+	sv.setZero();
+	sa.setZero();
+	double parallel = best(options.repeat, [&](){ ok = trajectory->sampleMany(times, &sp, &sv, &sa, threads) && ok; });
+	worst = std::max(worst, std::max(difference(p, sp), std::max(difference(v, sv), difference(a, sa))));
+	std::printf("sampleMany p,v,a x%-5zu %9.3f ms  %5.2fx\n", threads, parallel, loop / parallel);
+
+	for(int j = 0; j < options.joints; j++){
+		hebiTrajectoryRelease(reference[j]);
+	}
+	std::printf("largest relative difference from the C states %.3e\n", worst);
+	return ok && worst <= 1e-4 ? 0 : 1;
+}
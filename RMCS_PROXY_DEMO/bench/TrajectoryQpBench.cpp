@@ -0,0 +1,199 @@
+//replanning: Trajectory::createUnconstrainedQp, solved natively, against one hebiTrajectoryCreateUnconstrainedQp
+//per joint (how it was solved before)
+//
+//--joints joints through --waypoints waypoints, rest to rest, free velocities and accelerations in between;
+//every other joint also passes its middle waypoint at a given velocity, so two systems are shared
+//  c        one C trajectory per joint, created and released
+//  cold     native, new times on every replan so no factorization is reused
+//  warm     native, the same times and new positions on every replan
+//  accuracy the native states against the C ones at --samples times, relative to 1 + |value|; must be <= 1e-4
+//  fallback positions all free (no unique minimum): native and C must agree on whether there is a trajectory
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -pthread -Isrc -idirafter include bench/TrajectoryQpBench.cpp src/trajectory.cpp
+//    -Llib/linux_x86-64 -l:libhebi.so.0.16 -o trajectory_qp_bench
+//
+//usage: trajectory_qp_bench [--joints 30] [--waypoints 10] [--samples 1000] [--repeat 200]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "trajectory.hpp"
+
+namespace {
+
+using hebi::trajectory::Trajectory;
+
+struct Options{
+	int joints;
+	int waypoints;
+	int samples;
+	int repeat;
+
+	Options() : joints(30), waypoints(10), samples(1000), repeat(200) {}
+};
+
+bool parse(int argc, char** argv, Options& options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(i + 1 >= argc){
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--joints") options.joints = std::atoi(value.c_str());
+		else if(arg == "--waypoints") options.waypoints = std::atoi(value.c_str());
+		else if(arg == "--samples") options.samples = std::atoi(value.c_str());
+		else if(arg == "--repeat") options.repeat = std::atoi(value.c_str());
+		else return false;
+	}
+	return options.joints > 0 && options.waypoints >= 3 && options.samples > 1 && options.repeat > 0;
+}
+
+double nowNs(){
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Plan{
+	Eigen::VectorXd time;
+	Eigen::MatrixXd positions;
+	Eigen::MatrixXd velocities;
+	Eigen::MatrixXd accelerations;
+};
+
+Plan makePlan(const Options& options, std::mt19937& random){
+	std::uniform_real_distribution<double> angle(-1.5, 1.5);
+	std::uniform_real_distribution<double> gap(0.5, 1.5);
+	int w = options.waypoints;
+	Plan plan;
+	plan.time.resize(w);
+	plan.positions.resize(options.joints, w);
+	plan.velocities = Eigen::MatrixXd::Constant(options.joints, w, NAN);
+	plan.accelerations = Eigen::MatrixXd::Constant(options.joints, w, NAN);
+	plan.time[0] = 0;
+	for(int i = 1; i < w; i++){
+		plan.time[i] = plan.time[i - 1] + gap(random);
+	}
+	for(int j = 0; j < options.joints; j++){
+		for(int i = 0; i < w; i++){
+			plan.positions(j, i) = angle(random);
+		}
+		if(j % 2){
+			plan.velocities(j, w / 2) = angle(random);
+		}
+	}
+	plan.velocities.col(0).setZero();
+	plan.velocities.col(w - 1).setZero();
+	plan.accelerations.col(0).setZero();
+	plan.accelerations.col(w - 1).setZero();
+	return plan;
+}
+
+//the per-joint C solve; false if any joint failed
+bool solveC(const Plan& plan, std::vector<HebiTrajectoryPtr>& trajectories){
+	int joints = (int)plan.positions.rows();
+	int w = (int)plan.time.size();
+	Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> p = plan.positions, v = plan.velocities,
+		a = plan.accelerations;
+	Eigen::VectorXd time = plan.time;
+	trajectories.assign(joints, nullptr);
+	bool ok = true;
+	for(int j = 0; j < joints; j++){
+		trajectories[j] = hebiTrajectoryCreateUnconstrainedQp(w, p.data() + j * w, v.data() + j * w, a.data() + j * w,
+			time.data());
+		ok = ok && trajectories[j] != nullptr;
+	}
+	return ok;
+}
+
+void release(std::vector<HebiTrajectoryPtr>& trajectories){
+	for(size_t j = 0; j < trajectories.size(); j++){
+		if(trajectories[j]){
+			hebiTrajectoryRelease(trajectories[j]);
+		}
+	}
+	trajectories.clear();
+}
+
+}
+
+int main(int argc, char** argv){
+	Options options;
+	if(!parse(argc, argv, options)){
+		std::fprintf(stderr, "usage: trajectory_qp_bench [--joints 30] [--waypoints 10] [--samples 1000] [--repeat 200]\n");
+		return 1;
+	}
+	std::mt19937 random(7);
+	std::vector<Plan> plans;
+	for(int r = 0; r < options.repeat; r++){
+		plans.push_back(makePlan(options, random));
+	}
+	std::printf("%d joints, %d waypoints, %d replans\n", options.joints, options.waypoints, options.repeat);
+
+	//accuracy first, on the first plan
+	Plan& first = plans[0];
+	std::vector<HebiTrajectoryPtr> reference;
+	std::unique_ptr<Trajectory> native = Trajectory::createUnconstrainedQp(first.time, first.positions,
+		&first.velocities, &first.accelerations);
+	if(!solveC(first, reference) || !native){
+		std::printf("could not create the trajectories\n");
+		return 1;
+	}
+	double worst = 0;
+	double end = first.time[first.time.size() - 1];
+	Eigen::VectorXd p(options.joints), v(options.joints), a(options.joints);
+	for(int i = 0; i < options.samples; i++){
+		double t = end * i / (options.samples - 1);
+		native->getState(t, &p, &v, &a);
+		for(int j = 0; j < options.joints; j++){
+			double cp, cv, ca;
+			hebiTrajectoryGetState(reference[j], t, &cp, &cv, &ca);
+			worst = std::max(worst, std::abs(p[j] - cp) / (1 + std::abs(cp)));
+			worst = std::max(worst, std::abs(v[j] - cv) / (1 + std::abs(cv)));
+			worst = std::max(worst, std::abs(a[j] - ca) / (1 + std::abs(ca)));
+		}
+	}
+	release(reference);
+	std::printf("largest relative difference from the C trajectories %.3e\n", worst);
+
+	//replans
+	double start = nowNs();
+	bool ok = true;
+	for(int r = 0; r < options.repeat; r++){
+		std::vector<HebiTrajectoryPtr> trajectories;
+		ok = solveC(plans[r], trajectories) && ok;
+		release(trajectories);
+	}
+	double c = (nowNs() - start) / options.repeat / 1e3;
+	std::printf("%-8s %9.2f us per replan\n", "c", c);
+
+	start = nowNs();
+	for(int r = 0; r < options.repeat; r++){
+		ok = (bool)Trajectory::createUnconstrainedQp(plans[r].time, plans[r].positions, &plans[r].velocities,
+			&plans[r].accelerations) && ok;
+	}
+	double cold = (nowNs() - start) / options.repeat / 1e3;
+	std::printf("%-8s %9.2f us per replan  %5.2fx\n", "cold", cold, c / cold);
+
+	start = nowNs();
+	for(int r = 0; r < options.repeat; r++){
+		ok = (bool)Trajectory::createUnconstrainedQp(first.time, plans[r].positions, &first.velocities,
+			&first.accelerations) && ok;
+	}
+	double warm = (nowNs() - start) / options.repeat / 1e3;
+	std::printf("%-8s %9.2f us per replan  %5.2fx\n", "warm", warm, c / warm);
+
+	//no unique minimum: handed to the C library
+	Plan loose = first;
+	loose.positions.setConstant(NAN);
+	std::vector<HebiTrajectoryPtr> looseC;
+	bool cAccepts = solveC(loose, looseC);
+	release(looseC);
+	bool nativeAccepts = (bool)Trajectory::createUnconstrainedQp(loose.time, loose.positions, &loose.velocities,
+		&loose.accelerations);
+	std::printf("all positions free: C %s, native %s\n", cAccepts ? "solves" : "fails", nativeAccepts ? "solves" : "fails");
+
+	return ok && worst <= 1e-4 && cAccepts == nativeAccepts ? 0 : 1;
+}
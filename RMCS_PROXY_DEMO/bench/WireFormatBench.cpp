@@ -0,0 +1,171 @@
+//encode and decode cost of the WireFormat.h frames
+//
+//build on linux from RMCS_PROXY_DEMO, e.g.:
+//  g++ -std=c++11 -O2 -I. -Isrc -idirafter include bench/WireFormatBench.cpp WireFormat.cpp -o wire_bench
+//
+//usage: wire_bench [--modules 1,30,100] [--fields 3] [--iterations 200000]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "WireFormat.h"
+
+namespace {
+
+struct Options{
+	std::vector<size_t> moduleCounts;
+	size_t fieldCount;
+	size_t iterations;
+
+	Options() : fieldCount(3), iterations(200000) {}
+};
+
+std::vector<size_t> parseList(const std::string& text){
+	std::vector<size_t> values;
+	std::stringstream items(text);
+	std::string item;
+	while(std::getline(items, item, ',')){
+		if(!item.empty()){
+			values.push_back((size_t)std::atol(item.c_str()));
+		}
+	}
+	return values;
+}
+
+bool parse(int argc, char** argv, Options& options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(i + 1 >= argc){
+			return false;
+		}
+		std::string value = argv[++i];
+		if(arg == "--modules") options.moduleCounts = parseList(value);
+		else if(arg == "--fields") options.fieldCount = (size_t)std::atol(value.c_str());
+		else if(arg == "--iterations") options.iterations = (size_t)std::atol(value.c_str());
+		else return false;
+	}
+	if(options.moduleCounts.empty()){
+		options.moduleCounts = parseList("1,30,100");
+	}
+	return options.fieldCount > 0 && options.fieldCount <= WIRE_MAX_FIELDS && options.fieldCount <= FieldCount && options.iterations > 0;
+}
+
+double nowNs(){
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+GroupFeedbackFrame makeFrame(size_t modules){
+	GroupFeedbackFrame frame;
+	frame.groupKey = "bench";
+	std::shared_ptr<std::vector<std::string> > keys = std::make_shared<std::vector<std::string> >();
+	frame.timestampUs = 1;
+	frame.modules.resize(modules);
+	for(size_t m = 0; m < modules; m++){
+		std::ostringstream name;
+		name<<"arm/j"<<m;
+		keys->push_back(name.str());
+		FeedbackSample& sample = frame.modules[m];
+		sample.present = 0;
+		for(int f = 0; f < FieldCount; f++){
+			sample.values[f] = NAN;
+		}
+		for(int f = 0; f < FieldCount; f += 2){ //every other field, like a module without an imu
+			sample.present |= 1u << f;
+			sample.values[f] = 0.001 * (double)(m * 31 + f);
+		}
+	}
+	frame.moduleKeys = keys;
+	return frame;
+}
+
+void report(const char* name, size_t modules, size_t bytes, size_t iterations, double elapsedNs){
+	double perOp = elapsedNs / (double)iterations;
+	std::printf("%-16s modules %4zu  bytes %6zu  %9.1f ns/op  %8.1f MB/s\n", name, modules, bytes, perOp, (double)bytes * 1e3 / perOp);
+}
+
+}
+
+int main(int argc, char** argv){
+	Options options;
+	if(!parse(argc, argv, options)){
+		std::fprintf(stderr, "usage: wire_bench [--modules 1,30,100] [--fields 3] [--iterations 200000]\n");
+		return 1;
+	}
+	std::vector<FeedbackField> fields;
+	for(size_t f = 0; f < options.fieldCount; f++){
+		fields.push_back((FeedbackField)f);
+	}
+	volatile double sink = 0;
+	for(size_t i = 0; i < options.moduleCounts.size(); i++){
+		size_t modules = options.moduleCounts[i];
+		GroupFeedbackFrame frame = makeFrame(modules);
+		std::vector<int> moduleIndex;
+		for(size_t m = 0; m < modules; m++){
+			moduleIndex.push_back((int)m);
+		}
+
+		//the server reuses nothing between frames: every encode gets a fresh buffer
+		std::string buffer;
+		double start = nowNs();
+		for(size_t n = 0; n < options.iterations; n++){
+			std::string out;
+			frame.timestampUs = (int64_t)n;
+			wireEncodeFeedback(out, frame, moduleIndex, fields);
+			buffer.swap(out);
+		}
+		report("encode feedback", modules, buffer.size(), options.iterations, nowNs() - start);
+
+		start = nowNs();
+		for(size_t n = 0; n < options.iterations; n++){
+			WireSamplesView view;
+			if(!view.parse(buffer.data(), buffer.size())){
+				std::fprintf(stderr, "decode failed\n");
+				return 1;
+			}
+			double sum = (double)view.timeUs();
+			for(size_t m = 0; m < view.moduleCount(); m++){
+				for(size_t f = 0; f < view.fieldCount(); f++){
+					if(view.has(m, f)){
+						sum += view.value(m, f);
+					}
+				}
+			}
+			sink = sink + sum;
+		}
+		report("decode feedback", modules, buffer.size(), options.iterations, nowNs() - start);
+
+		std::vector<uint32_t> present(modules, (1u << WireCommandFieldCount) - 1);
+		std::vector<double> values(modules * WireCommandFieldCount, 0.5);
+		start = nowNs();
+		for(size_t n = 0; n < options.iterations; n++){
+			std::string out;
+			wireEncodeSamples(out, (int64_t)n, WireFlagAcknowledge, modules, WireCommandFieldCount, &present[0], &values[0]);
+			buffer.swap(out);
+		}
+		report("encode command", modules, buffer.size(), options.iterations, nowNs() - start);
+
+		std::vector<uint8_t> fieldIds(fields.begin(), fields.end());
+		size_t schemaIterations = options.iterations / 10 + 1;
+		start = nowNs();
+		for(size_t n = 0; n < schemaIterations; n++){
+			std::string out;
+			wireEncodeSchema(out, WireFeedback, frame.groupKey, *frame.moduleKeys, &fieldIds[0], fieldIds.size());
+			buffer.swap(out);
+		}
+		report("encode schema", modules, buffer.size(), schemaIterations, nowNs() - start);
+
+		start = nowNs();
+		for(size_t n = 0; n < schemaIterations; n++){
+			WireSchemaInfo schema;
+			if(!wireDecodeSchema(buffer.data(), buffer.size(), schema) || schema.modules.size() != modules){
+				std::fprintf(stderr, "schema decode failed\n");
+				return 1;
+			}
+		}
+		report("decode schema", modules, buffer.size(), schemaIterations, nowNs() - start);
+	}
+	return sink == 12345.0 ? 2 : 0;
+}
@@ -0,0 +1,60 @@
+#ifndef HEBISIM_H
+#define HEBISIM_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//simulated libhebi: the same C api as lib/*/libhebi (lookup, group, command, feedback, info)
+//backed by virtual modules instead of the network, for load tests without hardware
+//
+//built as a drop-in replacement for the shared library, e.g. on linux:
+//  g++ -std=c++11 -O2 -shared -fPIC -pthread -idirafter include sim/*.cpp -o libhebi.so.0.16
+//(-idirafter: include/ holds a pthread.h of its own that must not shadow the system one)
+//kinematics and trajectory are not simulated (they never touch the network); programs that need
+//them link this library ahead of the real one, the real one then only provides those symbols
+//
+//without a call to simConfigure() the world is read from the environment on the first lookup:
+//  HEBI_SIM_MODULES      families and modules, "Arm:6;Leg:hip,knee" (count or names), default "Sim:8"
+//  HEBI_SIM_TAU_MS       actuator time constant
+//  HEBI_SIM_LATENCY_US   one-way latency, both directions
+//  HEBI_SIM_JITTER_US    extra one-way latency, uniform in [0, jitter]
+//  HEBI_SIM_LOSS         probability a command or feedback packet is dropped
+//  HEBI_SIM_FEEDBACK_HZ  feedback rate of new groups (the api default is 0, i.e. off)
+//  HEBI_SIM_SEED         random seed for jitter and loss
+
+struct SimFamily{
+	std::string family;
+	std::vector<std::string> names;
+};
+
+struct SimConfig{
+	std::vector<SimFamily> families;
+	double timeConstantS;   //first-order response of position, velocity and torque
+	int64_t latencyUs;
+	int64_t jitterUs;
+	double feedbackLoss;    //0..1
+	double commandLoss;     //0..1, also used for acknowledgements
+	float defaultFeedbackHz;
+	float maxFeedbackHz;
+	uint32_t seed;
+
+	SimConfig();
+	void addFamily(const std::string& family, size_t count); //modules named "module1".."moduleN"
+	static SimConfig fromEnvironment();
+};
+
+struct SimStats{
+	uint64_t feedbackSent;     //group feedback packets handed to handlers
+	uint64_t feedbackDropped;
+	uint64_t commandsApplied;  //group commands that reached their modules
+	uint64_t commandsDropped;
+	uint64_t missedTicks;      //feedback periods skipped because a group thread fell behind
+};
+
+//replaces the virtual modules; fails while any group is alive
+bool simConfigure(const SimConfig& config);
+SimConfig simGetConfig();
+SimStats simGetStats();
+void simResetStats();
+
+#endif
@@ -0,0 +1,506 @@
+#include <cmath>
+#include <cstring>
+#include "SimMessages.h"
+
+namespace {
+
+const double TWO_PI = 6.283185307179586476925286766559;
+
+bool validChannel(int number){
+	return number >= 1 && number <= SimDebugChannels;
+}
+
+//-1 if the bank or pin is out of range
+int pinSlot(int bank, unsigned int pin){
+	if(bank < 0 || bank >= 6 || pin < 1 || pin > 8){
+		return -1;
+	}
+	return bank * 8 + (int)(pin - 1);
+}
+
+//copies text into buffer following the api contract: 0 if it fit, else the size needed
+int copyString(const std::string& text, char* buffer, int length){
+	int required = (int)text.size() + 1;
+	if(buffer == NULL || length < required){
+		return required;
+	}
+	std::memcpy(buffer, text.c_str(), required);
+	return 0;
+}
+
+}
+
+void simSplitAngle(double radians, int64_t* revolutions, float* offset){
+	double whole;
+	double fraction = std::modf(radians / TWO_PI, &whole);
+	*revolutions = std::isnan(whole) ? 0 : (int64_t)whole;
+	*offset = (float)(fraction * TWO_PI);
+}
+
+double simJoinAngle(int64_t revolutions, float offset){
+	return (double)revolutions * TWO_PI + (double)offset;
+}
+
+_HebiCommand::_HebiCommand(){
+	clear();
+}
+
+void _HebiCommand::clear(){
+	floatMask = 0;
+	hasPosition = false;
+	debugMask = 0;
+	boolMask = 0;
+	bools = 0;
+	for(int i = 0; i <= CommandStringFamily; i++){
+		hasString[i] = false;
+		strings[i].clear();
+	}
+	saveSettings = false;
+	hasControlStrategy = false;
+	ioIntMask = 0;
+	ioFloatMask = 0;
+	ledMode = SimLedNone;
+}
+
+_HebiFeedback::_HebiFeedback(){
+	clear();
+}
+
+void _HebiFeedback::clear(){
+	floatMask = 0;
+	angleMask = 0;
+	debugMask = 0;
+	vectorMask = 0;
+	ioIntMask = 0;
+	ioFloatMask = 0;
+	hasLed = false;
+}
+
+void _HebiFeedback::setFloat(FeedbackFloatField field, float value){
+	floats[field] = value;
+	floatMask |= (1u << field);
+}
+
+void _HebiFeedback::setAngle(FeedbackHighResAngleField field, double radians){
+	simSplitAngle(radians, &angleRevolutions[field], &angleOffsets[field]);
+	angleMask |= (uint8_t)(1u << field);
+}
+
+void _HebiFeedback::setVector(FeedbackVector3fField field, float x, float y, float z){
+	vectors[field].x = x;
+	vectors[field].y = y;
+	vectors[field].z = z;
+	vectorMask |= (uint8_t)(1u << field);
+}
+
+_HebiInfo::_HebiInfo(){
+	clear();
+}
+
+void _HebiInfo::clear(){
+	floatMask = 0;
+	boolMask = 0;
+	bools = 0;
+	for(int i = 0; i <= InfoStringFamily; i++){
+		hasString[i] = false;
+		strings[i].clear();
+	}
+	saveSettings = false;
+	hasControlStrategy = false;
+	hasLed = false;
+}
+
+extern "C" {
+
+//---- command ----
+
+float hebiCommandGetFloat(HebiCommandPtr cmd, CommandFloatField field){
+	return (cmd->floatMask >> field) & 1 ? cmd->floats[field] : 0.0f;
+}
+
+int hebiCommandHasFloat(HebiCommandPtr cmd, CommandFloatField field){
+	return (int)((cmd->floatMask >> field) & 1);
+}
+
+void hebiCommandSetFloat(HebiCommandPtr cmd, CommandFloatField field, float value){
+	cmd->floats[field] = value;
+	cmd->floatMask |= (1ull << field);
+}
+
+void hebiCommandClearFloat(HebiCommandPtr cmd, CommandFloatField field){
+	cmd->floatMask &= ~(1ull << field);
+}
+
+void hebiCommandGetHighResAngle(HebiCommandPtr cmd, CommandHighResAngleField, int64_t* int_part, float* dec_part){
+	*int_part = cmd->hasPosition ? cmd->positionRevolutions : 0;
+	*dec_part = cmd->hasPosition ? cmd->positionOffset : 0.0f;
+}
+
+int hebiCommandHasHighResAngle(HebiCommandPtr cmd, CommandHighResAngleField){
+	return cmd->hasPosition ? 1 : 0;
+}
+
+void hebiCommandSetHighResAngle(HebiCommandPtr cmd, CommandHighResAngleField, int64_t int_part, float dec_part){
+	cmd->positionRevolutions = int_part;
+	cmd->positionOffset = dec_part;
+	cmd->hasPosition = true;
+}
+
+void hebiCommandClearHighResAngle(HebiCommandPtr cmd, CommandHighResAngleField){
+	cmd->hasPosition = false;
+}
+
+float hebiCommandGetNumberedFloat(HebiCommandPtr cmd, CommandNumberedFloatField, int number){
+	return validChannel(number) && ((cmd->debugMask >> (number - 1)) & 1) ? cmd->debug[number - 1] : 0.0f;
+}
+
+int hebiCommandHasNumberedFloat(HebiCommandPtr cmd, CommandNumberedFloatField, int number){
+	return validChannel(number) ? (int)((cmd->debugMask >> (number - 1)) & 1) : 0;
+}
+
+void hebiCommandSetNumberedFloat(HebiCommandPtr cmd, CommandNumberedFloatField, int number, float value){
+	if(validChannel(number)){
+		cmd->debug[number - 1] = value;
+		cmd->debugMask |= (uint16_t)(1u << (number - 1));
+	}
+}
+
+void hebiCommandClearNumberedFloat(HebiCommandPtr cmd, CommandNumberedFloatField, int number){
+	if(validChannel(number)){
+		cmd->debugMask &= (uint16_t)~(1u << (number - 1));
+	}
+}
+
+int hebiCommandGetBool(HebiCommandPtr cmd, CommandBoolField field){
+	return (int)((cmd->bools >> field) & 1);
+}
+
+int hebiCommandHasBool(HebiCommandPtr cmd, CommandBoolField field){
+	return (int)((cmd->boolMask >> field) & 1);
+}
+
+void hebiCommandSetBool(HebiCommandPtr cmd, CommandBoolField field, int value){
+	cmd->boolMask |= (uint8_t)(1u << field);
+	if(value){
+		cmd->bools |= (uint8_t)(1u << field);
+	}
+	else{
+		cmd->bools &= (uint8_t)~(1u << field);
+	}
+}
+
+void hebiCommandClearBool(HebiCommandPtr cmd, CommandBoolField field){
+	cmd->boolMask &= (uint8_t)~(1u << field);
+}
+
+int hebiCommandGetString(HebiCommandPtr cmd, CommandStringField field, char* buffer, int length){
+	return copyString(cmd->strings[field], buffer, length);
+}
+
+int hebiCommandHasString(HebiCommandPtr cmd, CommandStringField field){
+	return cmd->hasString[field] ? 1 : 0;
+}
+
+void hebiCommandSetString(HebiCommandPtr cmd, CommandStringField field, const char* value){
+	cmd->strings[field] = value ? value : "";
+	cmd->hasString[field] = true;
+}
+
+void hebiCommandClearString(HebiCommandPtr cmd, CommandStringField field){
+	cmd->hasString[field] = false;
+	cmd->strings[field].clear();
+}
+
+int hebiCommandHasFlag(HebiCommandPtr cmd, CommandFlagField){
+	return cmd->saveSettings ? 1 : 0;
+}
+
+void hebiCommandSetFlag(HebiCommandPtr cmd, CommandFlagField, int value){
+	cmd->saveSettings = value != 0;
+}
+
+int hebiCommandGetEnum(HebiCommandPtr cmd, CommandEnumField){
+	return cmd->hasControlStrategy ? cmd->controlStrategy : 0;
+}
+
+int hebiCommandHasEnum(HebiCommandPtr cmd, CommandEnumField){
+	return cmd->hasControlStrategy ? 1 : 0;
+}
+
+void hebiCommandSetEnum(HebiCommandPtr cmd, CommandEnumField, int value){
+	cmd->controlStrategy = value;
+	cmd->hasControlStrategy = true;
+}
+
+void hebiCommandClearEnum(HebiCommandPtr cmd, CommandEnumField){
+	cmd->hasControlStrategy = false;
+}
+
+int64_t hebiCommandGetIoPinInt(HebiCommandPtr cmd, CommandIoPinBank bank, unsigned int pin_number){
+	int slot = pinSlot(bank, pin_number);
+	return slot >= 0 && ((cmd->ioIntMask >> slot) & 1) ? cmd->ioInts[slot] : 0;
+}
+
+float hebiCommandGetIoPinFloat(HebiCommandPtr cmd, CommandIoPinBank bank, unsigned int pin_number){
+	int slot = pinSlot(bank, pin_number);
+	return slot >= 0 && ((cmd->ioFloatMask >> slot) & 1) ? cmd->ioFloats[slot] : 0.0f;
+}
+
+int hebiCommandHasIoPinInt(HebiCommandPtr cmd, CommandIoPinBank bank, unsigned int pin_number){
+	int slot = pinSlot(bank, pin_number);
+	return slot >= 0 ? (int)((cmd->ioIntMask >> slot) & 1) : 0;
+}
+
+int hebiCommandHasIoPinFloat(HebiCommandPtr cmd, CommandIoPinBank bank, unsigned int pin_number){
+	int slot = pinSlot(bank, pin_number);
+	return slot >= 0 ? (int)((cmd->ioFloatMask >> slot) & 1) : 0;
+}
+
+void hebiCommandSetIoPinInt(HebiCommandPtr cmd, CommandIoPinBank bank, unsigned int pin_number, int64_t value){
+	int slot = pinSlot(bank, pin_number);
+	if(slot >= 0){
+		cmd->ioInts[slot] = value;
+		cmd->ioIntMask |= (1ull << slot);
+		cmd->ioFloatMask &= ~(1ull << slot); //a pin holds either kind
+	}
+}
+
+void hebiCommandSetIoPinFloat(HebiCommandPtr cmd, CommandIoPinBank bank, unsigned int pin_number, float value){
+	int slot = pinSlot(bank, pin_number);
+	if(slot >= 0){
+		cmd->ioFloats[slot] = value;
+		cmd->ioFloatMask |= (1ull << slot);
+		cmd->ioIntMask &= ~(1ull << slot);
+	}
+}
+
+void hebiCommandClearIoPin(HebiCommandPtr cmd, CommandIoPinBank bank, unsigned int pin_number){
+	int slot = pinSlot(bank, pin_number);
+	if(slot >= 0){
+		cmd->ioIntMask &= ~(1ull << slot);
+		cmd->ioFloatMask &= ~(1ull << slot);
+	}
+}
+
+void hebiCommandGetLedColor(HebiCommandPtr cmd, CommandLedField, uint8_t* r, uint8_t* g, uint8_t* b){
+	*r = cmd->led[0];
+	*g = cmd->led[1];
+	*b = cmd->led[2];
+}
+
+int hebiCommandHasLedColor(HebiCommandPtr cmd, CommandLedField){
+	return cmd->ledMode == SimLedColor ? 1 : 0;
+}
+
+int hebiCommandHasLedModuleControl(HebiCommandPtr cmd, CommandLedField){
+	return cmd->ledMode == SimLedModuleControl ? 1 : 0;
+}
+
+void hebiCommandSetLedOverrideColor(HebiCommandPtr cmd, CommandLedField, uint8_t r, uint8_t g, uint8_t b){
+	cmd->led[0] = r;
+	cmd->led[1] = g;
+	cmd->led[2] = b;
+	cmd->ledMode = SimLedColor;
+}
+
+void hebiCommandSetLedModuleControl(HebiCommandPtr cmd, CommandLedField){
+	cmd->ledMode = SimLedModuleControl;
+}
+
+void hebiCommandClearLed(HebiCommandPtr cmd, CommandLedField){
+	cmd->ledMode = SimLedNone;
+}
+
+//---- feedback ----
+
+float hebiFeedbackGetFloat(HebiFeedbackPtr fbk, FeedbackFloatField field){
+	return (fbk->floatMask >> field) & 1 ? fbk->floats[field] : 0.0f;
+}
+
+int hebiFeedbackHasFloat(HebiFeedbackPtr fbk, FeedbackFloatField field){
+	return (int)((fbk->floatMask >> field) & 1);
+}
+
+void hebiFeedbackGetHighResAngle(HebiFeedbackPtr fbk, FeedbackHighResAngleField field, int64_t* int_part, float* dec_part){
+	bool has = ((fbk->angleMask >> field) & 1) != 0;
+	*int_part = has ? fbk->angleRevolutions[field] : 0;
+	*dec_part = has ? fbk->angleOffsets[field] : 0.0f;
+}
+
+int hebiFeedbackHasHighResAngle(HebiFeedbackPtr fbk, FeedbackHighResAngleField field){
+	return (int)((fbk->angleMask >> field) & 1);
+}
+
+float hebiFeedbackGetNumberedFloat(HebiFeedbackPtr fbk, FeedbackNumberedFloatField, int number){
+	return validChannel(number) && ((fbk->debugMask >> (number - 1)) & 1) ? fbk->debug[number - 1] : 0.0f;
+}
+
+int hebiFeedbackHasNumberedFloat(HebiFeedbackPtr fbk, FeedbackNumberedFloatField, int number){
+	return validChannel(number) ? (int)((fbk->debugMask >> (number - 1)) & 1) : 0;
+}
+
+HebiVector3f hebiFeedbackGetVector3f(HebiFeedbackPtr fbk, FeedbackVector3fField field){
+	if((fbk->vectorMask >> field) & 1){
+		return fbk->vectors[field];
+	}
+	HebiVector3f zero = {0, 0, 0};
+	return zero;
+}
+
+int hebiFeedbackHasVector3f(HebiFeedbackPtr fbk, FeedbackVector3fField field){
+	return (int)((fbk->vectorMask >> field) & 1);
+}
+
+int64_t hebiFeedbackGetIoPinInt(HebiFeedbackPtr fbk, FeedbackIoPinBank bank, unsigned int pin_number){
+	int slot = pinSlot(bank, pin_number);
+	return slot >= 0 && ((fbk->ioIntMask >> slot) & 1) ? fbk->ioInts[slot] : 0;
+}
+
+float hebiFeedbackGetIoPinFloat(HebiFeedbackPtr fbk, FeedbackIoPinBank bank, unsigned int pin_number){
+	int slot = pinSlot(bank, pin_number);
+	return slot >= 0 && ((fbk->ioFloatMask >> slot) & 1) ? fbk->ioFloats[slot] : 0.0f;
+}
+
+int hebiFeedbackHasIoPinInt(HebiFeedbackPtr fbk, FeedbackIoPinBank bank, unsigned int pin_number){
+	int slot = pinSlot(bank, pin_number);
+	return slot >= 0 ? (int)((fbk->ioIntMask >> slot) & 1) : 0;
+}
+
+int hebiFeedbackHasIoPinFloat(HebiFeedbackPtr fbk, FeedbackIoPinBank bank, unsigned int pin_number){
+	int slot = pinSlot(bank, pin_number);
+	return slot >= 0 ? (int)((fbk->ioFloatMask >> slot) & 1) : 0;
+}
+
+void hebiFeedbackGetLedColor(HebiFeedbackPtr fbk, FeedbackLedField, uint8_t* r, uint8_t* g, uint8_t* b){
+	*r = fbk->led[0];
+	*g = fbk->led[1];
+	*b = fbk->led[2];
+}
+
+int hebiFeedbackHasLedColor(HebiFeedbackPtr fbk, FeedbackLedField){
+	return fbk->hasLed ? 1 : 0;
+}
+
+//---- info ----
+
+float hebiInfoGetFloat(HebiInfoPtr info, InfoFloatField field){
+	return (info->floatMask >> field) & 1 ? info->floats[field] : 0.0f;
+}
+
+int hebiInfoHasFloat(HebiInfoPtr info, InfoFloatField field){
+	return (int)((info->floatMask >> field) & 1);
+}
+
+int hebiInfoGetBool(HebiInfoPtr info, InfoBoolField field){
+	return (int)((info->bools >> field) & 1);
+}
+
+int hebiInfoHasBool(HebiInfoPtr info, InfoBoolField field){
+	return (int)((info->boolMask >> field) & 1);
+}
+
+int hebiInfoGetString(HebiInfoPtr info, InfoStringField field, char* buffer, int length){
+	return copyString(info->strings[field], buffer, length);
+}
+
+int hebiInfoHasString(HebiInfoPtr info, InfoStringField field){
+	return info->hasString[field] ? 1 : 0;
+}
+
+int hebiInfoHasFlag(HebiInfoPtr info, InfoFlagField){
+	return info->saveSettings ? 1 : 0;
+}
+
+int hebiInfoGetEnum(HebiInfoPtr info, InfoEnumField){
+	return info->hasControlStrategy ? info->controlStrategy : 0;
+}
+
+int hebiInfoHasEnum(HebiInfoPtr info, InfoEnumField){
+	return info->hasControlStrategy ? 1 : 0;
+}
+
+void hebiInfoGetLedColor(HebiInfoPtr info, InfoLedField, uint8_t* r, uint8_t* g, uint8_t* b){
+	*r = info->led[0];
+	*g = info->led[1];
+	*b = info->led[2];
+}
+
+int hebiInfoHasLedColor(HebiInfoPtr info, InfoLedField){
+	return info->hasLed ? 1 : 0;
+}
+
+//---- group messages ----
+
+HebiGroupCommandPtr hebiGroupCommandCreate(int number_of_modules){
+	if(number_of_modules < 1){
+		return NULL;
+	}
+	HebiGroupCommandPtr command = new _HebiGroupCommand();
+	command->modules.resize(number_of_modules);
+	return command;
+}
+
+int hebiGroupCommandGetNumModules(HebiGroupCommandPtr command){
+	return (int)command->modules.size();
+}
+
+HebiCommandPtr hebiGroupCommandGetModuleCommand(HebiGroupCommandPtr command, int module_index){
+	if(module_index < 0 || module_index >= (int)command->modules.size()){
+		return NULL;
+	}
+	return &command->modules[module_index];
+}
+
+void hebiGroupCommandRelease(HebiGroupCommandPtr command){
+	delete command;
+}
+
+HebiGroupFeedbackPtr hebiGroupFeedbackCreate(int number_of_modules){
+	if(number_of_modules < 1){
+		return NULL;
+	}
+	HebiGroupFeedbackPtr feedback = new _HebiGroupFeedback();
+	feedback->modules.resize(number_of_modules);
+	return feedback;
+}
+
+int hebiGroupFeedbackGetNumModules(HebiGroupFeedbackPtr feedback){
+	return (int)feedback->modules.size();
+}
+
+HebiFeedbackPtr hebiGroupFeedbackGetModuleFeedback(HebiGroupFeedbackPtr feedback, int module_index){
+	if(module_index < 0 || module_index >= (int)feedback->modules.size()){
+		return NULL;
+	}
+	return &feedback->modules[module_index];
+}
+
+void hebiGroupFeedbackRelease(HebiGroupFeedbackPtr feedback){
+	delete feedback;
+}
+
+HebiGroupInfoPtr hebiGroupInfoCreate(int number_of_modules){
+	if(number_of_modules < 1){
+		return NULL;
+	}
+	HebiGroupInfoPtr info = new _HebiGroupInfo();
+	info->modules.resize(number_of_modules);
+	return info;
+}
+
+int hebiGroupInfoGetNumModules(HebiGroupInfoPtr info){
+	return (int)info->modules.size();
+}
+
+HebiInfoPtr hebiGroupInfoGetModuleInfo(HebiGroupInfoPtr info, int module_index){
+	if(module_index < 0 || module_index >= (int)info->modules.size()){
+		return NULL;
+	}
+	return &info->modules[module_index];
+}
+
+void hebiGroupInfoRelease(HebiGroupInfoPtr info){
+	delete info;
+}
+
+}
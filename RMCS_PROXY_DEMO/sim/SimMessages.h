@@ -0,0 +1,108 @@
+#ifndef SIMMESSAGES_H
+#define SIMMESSAGES_H
+#include "hebi_group_command.h"
+#include "hebi_group_feedback.h"
+#include "hebi_group_info.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//storage behind the opaque message handles of the simulated hebi C API
+//each field kind keeps a presence mask next to its values, like the real messages
+
+const int SimCommandFloats = CommandFloatSpringConstant + 1;
+const int SimFeedbackFloats = FeedbackFloatMotorHousingTemperature + 1;
+const int SimInfoFloats = InfoFloatSpringConstant + 1;
+const int SimDebugChannels = 9;
+const int SimIoPins = 6 * 8; //banks a-f, pins 1-8
+
+enum SimLedMode{
+	SimLedNone,
+	SimLedColor,
+	SimLedModuleControl
+};
+
+struct _HebiCommand{
+	uint64_t floatMask;
+	float floats[SimCommandFloats];
+	bool hasPosition;
+	int64_t positionRevolutions; //the int part of the high-res angle
+	float positionOffset;
+	uint16_t debugMask;
+	float debug[SimDebugChannels];
+	uint8_t boolMask;
+	uint8_t bools;
+	bool hasString[CommandStringFamily + 1];
+	std::string strings[CommandStringFamily + 1];
+	bool saveSettings;
+	bool hasControlStrategy;
+	int controlStrategy;
+	uint64_t ioIntMask;
+	uint64_t ioFloatMask;
+	int64_t ioInts[SimIoPins];
+	float ioFloats[SimIoPins];
+	uint8_t ledMode;
+	uint8_t led[3];
+
+	_HebiCommand();
+	void clear();
+};
+
+struct _HebiFeedback{
+	uint32_t floatMask;
+	float floats[SimFeedbackFloats];
+	uint8_t angleMask;
+	int64_t angleRevolutions[FeedbackHighResAnglePositionCommand + 1];
+	float angleOffsets[FeedbackHighResAnglePositionCommand + 1];
+	uint16_t debugMask;
+	float debug[SimDebugChannels];
+	uint8_t vectorMask;
+	HebiVector3f vectors[FeedbackVector3fGyro + 1];
+	uint64_t ioIntMask;
+	uint64_t ioFloatMask;
+	int64_t ioInts[SimIoPins];
+	float ioFloats[SimIoPins];
+	bool hasLed;
+	uint8_t led[3];
+
+	_HebiFeedback();
+	void clear();
+	void setFloat(FeedbackFloatField field, float value);
+	void setAngle(FeedbackHighResAngleField field, double radians);
+	void setVector(FeedbackVector3fField field, float x, float y, float z);
+};
+
+struct _HebiInfo{
+	uint64_t floatMask;
+	float floats[SimInfoFloats];
+	uint8_t boolMask;
+	uint8_t bools;
+	bool hasString[InfoStringFamily + 1];
+	std::string strings[InfoStringFamily + 1];
+	bool saveSettings;
+	bool hasControlStrategy;
+	int controlStrategy;
+	bool hasLed;
+	uint8_t led[3];
+
+	_HebiInfo();
+	void clear();
+};
+
+struct _HebiGroupCommand{
+	std::vector<_HebiCommand> modules;
+};
+
+struct _HebiGroupFeedback{
+	std::vector<_HebiFeedback> modules;
+};
+
+struct _HebiGroupInfo{
+	std::vector<_HebiInfo> modules;
+};
+
+//splits a high-res angle the way the api does: whole revolutions plus a remainder in radians
+void simSplitAngle(double radians, int64_t* revolutions, float* offset);
+double simJoinAngle(int64_t revolutions, float offset);
+
+#endif
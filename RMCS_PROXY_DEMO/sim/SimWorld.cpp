@@ -0,0 +1,827 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include "HebiSim.h"
+#include "SimMessages.h"
+#include "hebi_lookup.h"
+
+typedef std::chrono::steady_clock SimClock;
+
+namespace {
+
+const int COMMAND_GAIN_OFFSET = CommandFloatPositionKp - InfoFloatPositionKp; //gains share their order in both enums
+const double DEFAULT_SPRING_CONSTANT = 100.0; //N*m/rad
+const double GEAR_RATIO = 762.22;
+const double TORQUE_PER_AMP = 3.0;
+
+//one virtual actuator; groups sharing a module share this state
+struct SimModule{
+	std::string name;
+	std::string family;
+	HebiMacAddress mac;
+	std::mutex lock;
+	double position;
+	double velocity;
+	double torque;
+	bool hasPositionTarget;
+	bool hasVelocityTarget;
+	bool hasTorqueTarget;
+	double positionTarget;
+	double velocityTarget;
+	double torqueTarget;
+	int32_t lifetimeMs;       //of the last command, <= 0 never expires
+	SimClock::time_point lastStep;
+	SimClock::time_point lastCommand;
+	_HebiInfo settings;       //gains, strings, control strategy, led
+
+	SimModule(const std::string& family, const std::string& name, size_t index);
+	void step(SimClock::time_point now, double timeConstantS);
+	void apply(const _HebiCommand& command, int32_t lifetime, SimClock::time_point now);
+	void fill(_HebiFeedback& feedback) const;
+};
+
+SimModule::SimModule(const std::string& family, const std::string& name, size_t index)
+	: name(name), family(family), position(0), velocity(0), torque(0),
+	hasPositionTarget(false), hasVelocityTarget(false), hasTorqueTarget(false),
+	positionTarget(0), velocityTarget(0), torqueTarget(0), lifetimeMs(0),
+	lastStep(SimClock::now()), lastCommand(lastStep)
+{
+	mac.bytes_[0] = 0x00;
+	mac.bytes_[1] = 0x1E;
+	mac.bytes_[2] = 0xC0;
+	mac.bytes_[3] = (uint8_t)(index >> 16);
+	mac.bytes_[4] = (uint8_t)(index >> 8);
+	mac.bytes_[5] = (uint8_t)index;
+	settings.strings[InfoStringName] = name;
+	settings.strings[InfoStringFamily] = family;
+	settings.hasString[InfoStringName] = true;
+	settings.hasString[InfoStringFamily] = true;
+	settings.floats[InfoFloatSpringConstant] = (float)DEFAULT_SPRING_CONSTANT;
+	settings.floatMask |= (1ull << InfoFloatSpringConstant);
+	settings.controlStrategy = 3;
+	settings.hasControlStrategy = true;
+}
+
+void SimModule::step(SimClock::time_point now, double timeConstantS){
+	double dt = std::chrono::duration<double>(now - lastStep).count();
+	if(dt <= 0){
+		return;
+	}
+	lastStep = now;
+	if(lifetimeMs > 0 && now - lastCommand > std::chrono::milliseconds(lifetimeMs)){
+		//command lifetime ran out: the module stops tracking, like the hardware
+		hasPositionTarget = false;
+		hasVelocityTarget = false;
+		hasTorqueTarget = false;
+	}
+	double a = timeConstantS > 0 ? 1.0 - std::exp(-dt / timeConstantS) : 1.0;
+	if(hasPositionTarget){
+		double next = position + (positionTarget - position) * a;
+		velocity = (next - position) / dt;
+		position = next;
+	}
+	else{
+		double target = hasVelocityTarget ? velocityTarget : 0.0;
+		velocity += (target - velocity) * a;
+		position += velocity * dt;
+	}
+	torque += ((hasTorqueTarget ? torqueTarget : 0.0) - torque) * a;
+}
+
+void SimModule::apply(const _HebiCommand& command, int32_t lifetime, SimClock::time_point now){
+	//the caller has already stepped the module up to now
+	lastCommand = now;
+	lifetimeMs = lifetime;
+	if(command.hasPosition){
+		positionTarget = simJoinAngle(command.positionRevolutions, command.positionOffset);
+		hasPositionTarget = !std::isnan(positionTarget);
+	}
+	if((command.floatMask >> CommandFloatVelocity) & 1){
+		velocityTarget = command.floats[CommandFloatVelocity];
+		hasVelocityTarget = !std::isnan(velocityTarget);
+	}
+	if((command.floatMask >> CommandFloatTorque) & 1){
+		torqueTarget = command.floats[CommandFloatTorque];
+		hasTorqueTarget = !std::isnan(torqueTarget);
+	}
+	for(int f = CommandFloatPositionKp; f <= CommandFloatSpringConstant; f++){
+		if((command.floatMask >> f) & 1){
+			settings.floats[f - COMMAND_GAIN_OFFSET] = command.floats[f];
+			settings.floatMask |= (1ull << (f - COMMAND_GAIN_OFFSET));
+		}
+	}
+	settings.boolMask |= command.boolMask;
+	settings.bools = (uint8_t)((settings.bools & ~command.boolMask) | (command.bools & command.boolMask));
+	if(command.hasControlStrategy){
+		settings.controlStrategy = command.controlStrategy;
+	}
+	if(command.ledMode == SimLedColor){
+		std::memcpy(settings.led, command.led, 3);
+		settings.hasLed = true;
+	}
+	else if(command.ledMode == SimLedModuleControl){
+		settings.hasLed = false;
+	}
+}
+
+void SimModule::fill(_HebiFeedback& feedback) const{
+	feedback.clear();
+	double springConstant = settings.floats[InfoFloatSpringConstant] != 0 ? settings.floats[InfoFloatSpringConstant] : DEFAULT_SPRING_CONSTANT;
+	feedback.setAngle(FeedbackHighResAnglePosition, position);
+	if(hasPositionTarget){
+		feedback.setAngle(FeedbackHighResAnglePositionCommand, positionTarget);
+	}
+	feedback.setFloat(FeedbackFloatVelocity, (float)velocity);
+	feedback.setFloat(FeedbackFloatTorque, (float)torque);
+	if(hasVelocityTarget){
+		feedback.setFloat(FeedbackFloatVelocityCommand, (float)velocityTarget);
+	}
+	if(hasTorqueTarget){
+		feedback.setFloat(FeedbackFloatTorqueCommand, (float)torqueTarget);
+	}
+	feedback.setFloat(FeedbackFloatDeflection, (float)(torque / springConstant));
+	feedback.setFloat(FeedbackFloatDeflectionVelocity, 0.0f);
+	feedback.setFloat(FeedbackFloatMotorVelocity, (float)(velocity * GEAR_RATIO));
+	feedback.setFloat(FeedbackFloatMotorCurrent, (float)(torque / TORQUE_PER_AMP));
+	feedback.setFloat(FeedbackFloatMotorWindingCurrent, (float)(torque / TORQUE_PER_AMP));
+	feedback.setFloat(FeedbackFloatMotorSensorTemperature, 38.0f);
+	feedback.setFloat(FeedbackFloatMotorWindingTemperature, (float)(40.0 + std::fabs(torque)));
+	feedback.setFloat(FeedbackFloatMotorHousingTemperature, 36.0f);
+	feedback.setFloat(FeedbackFloatBoardTemperature, 35.0f);
+	feedback.setFloat(FeedbackFloatProcessorTemperature, 45.0f);
+	feedback.setFloat(FeedbackFloatVoltage, 48.0f);
+	feedback.setVector(FeedbackVector3fAccelerometer, 0.0f, 0.0f, 9.81f);
+	feedback.setVector(FeedbackVector3fGyro, 0.0f, 0.0f, (float)velocity);
+	if(settings.hasLed){
+		std::memcpy(feedback.led, settings.led, 3);
+		feedback.hasLed = true;
+	}
+}
+
+struct SimWorld{
+	std::mutex lock;
+	bool configured;
+	SimConfig config;
+	std::vector<std::unique_ptr<SimModule> > modules;
+	int liveGroups;
+	std::atomic<uint64_t> feedbackSent;
+	std::atomic<uint64_t> feedbackDropped;
+	std::atomic<uint64_t> commandsApplied;
+	std::atomic<uint64_t> commandsDropped;
+	std::atomic<uint64_t> missedTicks;
+
+	SimWorld() : configured(false), liveGroups(0),
+		feedbackSent(0), feedbackDropped(0), commandsApplied(0), commandsDropped(0), missedTicks(0) {}
+
+	//call with lock held
+	void build(const SimConfig& simConfig){
+		config = simConfig;
+		modules.clear();
+		for(size_t f = 0; f < config.families.size(); f++){
+			for(size_t n = 0; n < config.families[f].names.size(); n++){
+				modules.push_back(std::unique_ptr<SimModule>(new SimModule(config.families[f].family, config.families[f].names[n], modules.size() + 1)));
+			}
+		}
+		configured = true;
+	}
+	void ensureConfigured(){
+		if(!configured){
+			build(SimConfig::fromEnvironment());
+		}
+	}
+	SimModule* find(const std::string& family, const std::string& name){
+		for(size_t i = 0; i < modules.size(); i++){
+			if(modules[i]->name == name && modules[i]->family == family){
+				return modules[i].get();
+			}
+		}
+		return NULL;
+	}
+	SimModule* find(const HebiMacAddress& mac){
+		for(size_t i = 0; i < modules.size(); i++){
+			if(std::memcmp(modules[i]->mac.bytes_, mac.bytes_, sizeof(mac.bytes_)) == 0){
+				return modules[i].get();
+			}
+		}
+		return NULL;
+	}
+};
+
+SimWorld& world(){
+	static SimWorld instance;
+	return instance;
+}
+
+}
+
+SimConfig::SimConfig()
+	: timeConstantS(0.05), latencyUs(0), jitterUs(0), feedbackLoss(0), commandLoss(0),
+	defaultFeedbackHz(0), maxFeedbackHz(10000), seed(1)
+{
+}
+
+void SimConfig::addFamily(const std::string& family, size_t count){
+	SimFamily entry;
+	entry.family = family;
+	for(size_t i = 1; i <= count; i++){
+		std::ostringstream name;
+		name<<"module"<<i;
+		entry.names.push_back(name.str());
+	}
+	families.push_back(entry);
+}
+
+SimConfig SimConfig::fromEnvironment(){
+	SimConfig config;
+	const char* modules = std::getenv("HEBI_SIM_MODULES");
+	std::string spec = modules ? modules : "Sim:8";
+	std::stringstream families(spec);
+	std::string item;
+	while(std::getline(families, item, ';')){
+		size_t colon = item.find(':');
+		if(colon == std::string::npos || colon == 0){
+			continue;
+		}
+		std::string family = item.substr(0, colon);
+		std::string rest = item.substr(colon + 1);
+		if(!rest.empty() && rest.find_first_not_of("0123456789") == std::string::npos){
+			config.addFamily(family, (size_t)std::atoi(rest.c_str()));
+			continue;
+		}
+		SimFamily entry;
+		entry.family = family;
+		std::stringstream names(rest);
+		std::string name;
+		while(std::getline(names, name, ',')){
+			if(!name.empty()){
+				entry.names.push_back(name);
+			}
+		}
+		config.families.push_back(entry);
+	}
+	const char* value;
+	if((value = std::getenv("HEBI_SIM_TAU_MS")) != NULL){
+		config.timeConstantS = std::atof(value) * 1e-3;
+	}
+	if((value = std::getenv("HEBI_SIM_LATENCY_US")) != NULL){
+		config.latencyUs = std::atoll(value);
+	}
+	if((value = std::getenv("HEBI_SIM_JITTER_US")) != NULL){
+		config.jitterUs = std::atoll(value);
+	}
+	if((value = std::getenv("HEBI_SIM_LOSS")) != NULL){
+		config.feedbackLoss = config.commandLoss = std::atof(value);
+	}
+	if((value = std::getenv("HEBI_SIM_FEEDBACK_HZ")) != NULL){
+		config.defaultFeedbackHz = (float)std::atof(value);
+	}
+	if((value = std::getenv("HEBI_SIM_SEED")) != NULL){
+		config.seed = (uint32_t)std::atol(value);
+	}
+	return config;
+}
+
+bool simConfigure(const SimConfig& config){
+	SimWorld& w = world();
+	std::lock_guard<std::mutex> lock(w.lock);
+	if(w.liveGroups > 0){
+		return false;
+	}
+	w.build(config);
+	return true;
+}
+
+SimConfig simGetConfig(){
+	SimWorld& w = world();
+	std::lock_guard<std::mutex> lock(w.lock);
+	w.ensureConfigured();
+	return w.config;
+}
+
+SimStats simGetStats(){
+	SimWorld& w = world();
+	SimStats stats;
+	stats.feedbackSent = w.feedbackSent.load();
+	stats.feedbackDropped = w.feedbackDropped.load();
+	stats.commandsApplied = w.commandsApplied.load();
+	stats.commandsDropped = w.commandsDropped.load();
+	stats.missedTicks = w.missedTicks.load();
+	return stats;
+}
+
+void simResetStats(){
+	SimWorld& w = world();
+	w.feedbackSent = 0;
+	w.feedbackDropped = 0;
+	w.commandsApplied = 0;
+	w.commandsDropped = 0;
+	w.missedTicks = 0;
+}
+
+struct _HebiLookup{
+};
+
+struct _HebiLookupEntryList{
+	std::vector<std::string> names;
+	std::vector<std::string> families;
+	std::vector<HebiMacAddress> macs;
+};
+
+//one group: a feedback thread at the requested rate, plus the delayed command and feedback queues
+struct _HebiGroup{
+	typedef std::pair<GroupFeedbackHandlerFunction, void*> Handler;
+
+	std::vector<SimModule*> modules;
+	SimConfig config;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::vector<Handler> handlers;
+	std::vector<Handler> calling; //copy used while the lock is released
+	bool delivering;              //calling is in use; clearing the handlers waits for it
+	std::condition_variable delivered;
+	float feedbackHz;
+	int32_t lifetimeMs;
+	bool stopping;
+	std::mt19937 random;
+	std::multimap<SimClock::time_point, std::unique_ptr<_HebiGroupCommand> > pendingCommands;
+	std::multimap<SimClock::time_point, std::unique_ptr<_HebiGroupFeedback> > pendingFeedback;
+	std::vector<std::unique_ptr<_HebiGroupFeedback> > feedbackPool;
+	std::vector<std::unique_ptr<_HebiGroupCommand> > commandPool;
+	std::thread thread;
+
+	_HebiGroup(const std::vector<SimModule*>& members, const SimConfig& simConfig, uint32_t seed);
+	~_HebiGroup();
+	void run();
+	bool lost(double probability);
+	SimClock::duration delay(); //one-way latency plus jitter
+	void applyCommand(const _HebiGroupCommand& command, SimClock::time_point now);
+	void sample(_HebiGroupFeedback& feedback, SimClock::time_point now);
+	void deliver(std::unique_lock<std::mutex>& held, _HebiGroupFeedback& feedback);
+};
+
+_HebiGroup::_HebiGroup(const std::vector<SimModule*>& members, const SimConfig& simConfig, uint32_t seed)
+	: modules(members), config(simConfig), delivering(false), feedbackHz(simConfig.defaultFeedbackHz), lifetimeMs(0),
+	stopping(false), random(seed)
+{
+	thread = std::thread(&_HebiGroup::run, this);
+}
+
+_HebiGroup::~_HebiGroup(){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	thread.join();
+}
+
+bool _HebiGroup::lost(double probability){
+	return probability > 0 && std::uniform_real_distribution<double>(0.0, 1.0)(random) < probability;
+}
+
+SimClock::duration _HebiGroup::delay(){
+	int64_t us = config.latencyUs;
+	if(config.jitterUs > 0){
+		us += std::uniform_int_distribution<int64_t>(0, config.jitterUs)(random);
+	}
+	return std::chrono::microseconds(us);
+}
+
+void _HebiGroup::applyCommand(const _HebiGroupCommand& command, SimClock::time_point now){
+	for(size_t i = 0; i < modules.size(); i++){
+		std::lock_guard<std::mutex> guard(modules[i]->lock);
+		modules[i]->step(now, config.timeConstantS);
+		modules[i]->apply(command.modules[i], lifetimeMs, now);
+	}
+	world().commandsApplied++;
+}
+
+void _HebiGroup::sample(_HebiGroupFeedback& feedback, SimClock::time_point now){
+	feedback.modules.resize(modules.size());
+	for(size_t i = 0; i < modules.size(); i++){
+		std::lock_guard<std::mutex> guard(modules[i]->lock);
+		modules[i]->step(now, config.timeConstantS);
+		modules[i]->fill(feedback.modules[i]);
+	}
+}
+
+void _HebiGroup::deliver(std::unique_lock<std::mutex>& held, _HebiGroupFeedback& feedback){
+	//handlers run without the group lock so they can send commands
+	calling = handlers;
+	delivering = true;
+	held.unlock();
+	for(size_t i = 0; i < calling.size(); i++){
+		calling[i].first(&feedback, calling[i].second);
+	}
+	held.lock();
+	delivering = false;
+	delivered.notify_all();
+	world().feedbackSent++;
+}
+
+void _HebiGroup::run(){
+	std::unique_lock<std::mutex> held(lock);
+	SimClock::time_point nextTick = SimClock::now();
+	bool wasTicking = false;
+	while(!stopping){
+		bool ticking = feedbackHz > 0 && !handlers.empty();
+		if(ticking && !wasTicking){
+			nextTick = SimClock::now();
+		}
+		wasTicking = ticking;
+		SimClock::time_point wakeAt = SimClock::time_point::max();
+		if(ticking){
+			wakeAt = nextTick;
+		}
+		if(!pendingCommands.empty() && pendingCommands.begin()->first < wakeAt){
+			wakeAt = pendingCommands.begin()->first;
+		}
+		if(!pendingFeedback.empty() && pendingFeedback.begin()->first < wakeAt){
+			wakeAt = pendingFeedback.begin()->first;
+		}
+		if(wakeAt == SimClock::time_point::max()){
+			wake.wait(held);
+			continue;
+		}
+		if(SimClock::now() < wakeAt){
+			wake.wait_until(held, wakeAt);
+			continue; //rates, handlers or queues may have changed
+		}
+		SimClock::time_point now = SimClock::now();
+
+		while(!pendingCommands.empty() && pendingCommands.begin()->first <= now){
+			std::unique_ptr<_HebiGroupCommand> command = std::move(pendingCommands.begin()->second);
+			pendingCommands.erase(pendingCommands.begin());
+			applyCommand(*command, now);
+			commandPool.push_back(std::move(command));
+		}
+
+		if(ticking && now >= nextTick){
+			SimClock::duration period = std::chrono::duration_cast<SimClock::duration>(std::chrono::duration<double>(1.0 / feedbackHz));
+			nextTick += period;
+			if(nextTick <= now){
+				//fell behind: skip the missed periods instead of bursting
+				uint64_t missed = (uint64_t)((now - nextTick) / period) + 1;
+				world().missedTicks += missed;
+				nextTick += period * (int64_t)missed;
+			}
+			if(lost(config.feedbackLoss)){
+				world().feedbackDropped++;
+			}
+			else{
+				std::unique_ptr<_HebiGroupFeedback> feedback;
+				if(feedbackPool.empty()){
+					feedback.reset(new _HebiGroupFeedback());
+				}
+				else{
+					feedback = std::move(feedbackPool.back());
+					feedbackPool.pop_back();
+				}
+				sample(*feedback, now);
+				pendingFeedback.insert(std::make_pair(now + delay(), std::move(feedback)));
+			}
+		}
+
+		while(!stopping && !pendingFeedback.empty() && pendingFeedback.begin()->first <= SimClock::now()){
+			std::unique_ptr<_HebiGroupFeedback> feedback = std::move(pendingFeedback.begin()->second);
+			pendingFeedback.erase(pendingFeedback.begin());
+			deliver(held, *feedback);
+			feedbackPool.push_back(std::move(feedback));
+		}
+	}
+}
+
+namespace {
+
+HebiGroupPtr createGroup(const std::vector<SimModule*>& members){
+	if(members.empty()){
+		return NULL;
+	}
+	SimWorld& w = world();
+	//caller holds the world lock
+	w.liveGroups++;
+	return new _HebiGroup(members, w.config, w.config.seed + (uint32_t)w.liveGroups * 7919u);
+}
+
+void sleepFor(SimClock::duration duration){
+	if(duration > SimClock::duration::zero()){
+		std::this_thread::sleep_for(duration);
+	}
+}
+
+//round trip for request/acknowledge calls; false (after the timeout) if either packet is lost
+bool roundTrip(HebiGroupPtr group, int timeout_ms, double loss){
+	SimClock::duration wait;
+	bool dropped;
+	{
+		std::lock_guard<std::mutex> guard(group->lock);
+		dropped = group->lost(loss) || group->lost(loss);
+		wait = group->delay() + group->delay();
+	}
+	SimClock::duration timeout = std::chrono::milliseconds(timeout_ms > 0 ? timeout_ms : 0);
+	if(dropped || wait > timeout){
+		sleepFor(timeout);
+		return false;
+	}
+	sleepFor(wait);
+	return true;
+}
+
+std::unique_ptr<_HebiGroupCommand> copyCommand(HebiGroupPtr group, HebiGroupCommandPtr command){
+	std::unique_ptr<_HebiGroupCommand> copy;
+	if(group->commandPool.empty()){
+		copy.reset(new _HebiGroupCommand());
+	}
+	else{
+		copy = std::move(group->commandPool.back());
+		group->commandPool.pop_back();
+	}
+	copy->modules = command->modules;
+	return copy;
+}
+
+}
+
+extern "C" {
+
+//---- lookup ----
+
+HebiLookupPtr hebiLookupCreate(){
+	SimWorld& w = world();
+	std::lock_guard<std::mutex> lock(w.lock);
+	w.ensureConfigured();
+	return new _HebiLookup();
+}
+
+void hebiLookupRelease(HebiLookupPtr lookup){
+	delete lookup;
+}
+
+void hebiCleanup(){
+}
+
+HebiGroupPtr hebiCreateGroupFromMacs(HebiLookupPtr, const HebiMacAddress* addresses, int num_addresses, long){
+	SimWorld& w = world();
+	std::lock_guard<std::mutex> lock(w.lock);
+	std::vector<SimModule*> members;
+	for(int i = 0; i < num_addresses; i++){
+		SimModule* module = w.find(addresses[i]);
+		if(!module){
+			return NULL;
+		}
+		members.push_back(module);
+	}
+	return createGroup(members);
+}
+
+HebiGroupPtr hebiCreateGroupFromNames(HebiLookupPtr, const char* const* names, int num_names, const char* const* families, int num_families, long){
+	if(num_families != 1 && num_families != num_names){
+		return NULL;
+	}
+	SimWorld& w = world();
+	std::lock_guard<std::mutex> lock(w.lock);
+	std::vector<SimModule*> members;
+	for(int i = 0; i < num_names; i++){
+		SimModule* module = w.find(families[num_families == 1 ? 0 : i], names[i]);
+		if(!module){
+			return NULL;
+		}
+		members.push_back(module);
+	}
+	return createGroup(members);
+}
+
+HebiGroupPtr hebiCreateGroupFromFamily(HebiLookupPtr, const char* family, long){
+	SimWorld& w = world();
+	std::lock_guard<std::mutex> lock(w.lock);
+	std::vector<SimModule*> members;
+	for(size_t i = 0; i < w.modules.size(); i++){
+		if(w.modules[i]->family == family){
+			members.push_back(w.modules[i].get());
+		}
+	}
+	return createGroup(members);
+}
+
+//the modules of one family form one daisy chain in the simulation
+HebiGroupPtr hebiCreateConnectedGroupFromMac(HebiLookupPtr lookup, const HebiMacAddress* address, long timeout_ms){
+	std::string family;
+	{
+		SimWorld& w = world();
+		std::lock_guard<std::mutex> lock(w.lock);
+		SimModule* module = w.find(*address);
+		if(!module){
+			return NULL;
+		}
+		family = module->family;
+	}
+	return hebiCreateGroupFromFamily(lookup, family.c_str(), timeout_ms);
+}
+
+HebiGroupPtr hebiCreateConnectedGroupFromName(HebiLookupPtr lookup, const char* name, const char* family, long timeout_ms){
+	{
+		SimWorld& w = world();
+		std::lock_guard<std::mutex> lock(w.lock);
+		if(!w.find(family, name)){
+			return NULL;
+		}
+	}
+	return hebiCreateGroupFromFamily(lookup, family, timeout_ms);
+}
+
+void hebiPrintLookupTable(HebiLookupPtr){
+	SimWorld& w = world();
+	std::lock_guard<std::mutex> lock(w.lock);
+	std::printf("Simulated modules: %u\n", (unsigned)w.modules.size());
+	for(size_t i = 0; i < w.modules.size(); i++){
+		const HebiMacAddress& mac = w.modules[i]->mac;
+		std::printf("%02X:%02X:%02X:%02X:%02X:%02X  %s / %s\n", mac.bytes_[0], mac.bytes_[1], mac.bytes_[2],
+			mac.bytes_[3], mac.bytes_[4], mac.bytes_[5], w.modules[i]->family.c_str(), w.modules[i]->name.c_str());
+	}
+}
+
+HebiLookupEntryListPtr hebiLookupCreateLookupEntryList(HebiLookupPtr){
+	SimWorld& w = world();
+	std::lock_guard<std::mutex> lock(w.lock);
+	HebiLookupEntryListPtr list = new _HebiLookupEntryList();
+	for(size_t i = 0; i < w.modules.size(); i++){
+		list->names.push_back(w.modules[i]->name);
+		list->families.push_back(w.modules[i]->family);
+		list->macs.push_back(w.modules[i]->mac);
+	}
+	return list;
+}
+
+int hebiLookupEntryListGetNumberOfEntries(HebiLookupEntryListPtr lookup_list){
+	return (int)lookup_list->names.size();
+}
+
+int hebiLookupEntryListGetName(HebiLookupEntryListPtr lookup_list, int index, char* buffer, int length){
+	const std::string& name = lookup_list->names[index];
+	if(buffer == NULL || length < (int)name.size() + 1){
+		return (int)name.size() + 1;
+	}
+	std::memcpy(buffer, name.c_str(), name.size() + 1);
+	return 0;
+}
+
+int hebiLookupEntryListGetFamily(HebiLookupEntryListPtr lookup_list, int index, char* buffer, int length){
+	const std::string& family = lookup_list->families[index];
+	if(buffer == NULL || length < (int)family.size() + 1){
+		return (int)family.size() + 1;
+	}
+	std::memcpy(buffer, family.c_str(), family.size() + 1);
+	return 0;
+}
+
+HebiMacAddress hebiLookupEntryListGetMacAddress(HebiLookupEntryListPtr lookup_list, int index){
+	return lookup_list->macs[index];
+}
+
+void hebiLookupEntryListRelease(HebiLookupEntryListPtr lookup_list){
+	delete lookup_list;
+}
+
+void hebiGroupRelease(HebiGroupPtr group){
+	delete group;
+	SimWorld& w = world();
+	std::lock_guard<std::mutex> lock(w.lock);
+	w.liveGroups--;
+}
+
+//---- group ----
+
+int hebiGroupGetNumberOfModules(HebiGroupPtr group){
+	return (int)group->modules.size();
+}
+
+int hebiGroupSendCommandWithAcknowledgement(HebiGroupPtr group, HebiGroupCommandPtr command, int timeout_ms){
+	if(command->modules.size() != group->modules.size()){
+		return 1;
+	}
+	if(!roundTrip(group, timeout_ms, group->config.commandLoss)){
+		world().commandsDropped++;
+		return 1;
+	}
+	std::lock_guard<std::mutex> guard(group->lock);
+	group->applyCommand(*command, SimClock::now());
+	return 0;
+}
+
+int hebiGroupSendCommand(HebiGroupPtr group, HebiGroupCommandPtr command){
+	if(command->modules.size() != group->modules.size()){
+		return 1;
+	}
+	{
+		std::lock_guard<std::mutex> guard(group->lock);
+		if(group->lost(group->config.commandLoss)){
+			world().commandsDropped++;
+			return 0; //the send itself succeeded, the packet just never arrives
+		}
+		if(group->config.latencyUs <= 0 && group->config.jitterUs <= 0){
+			group->applyCommand(*command, SimClock::now());
+			return 0;
+		}
+		SimClock::time_point due = SimClock::now() + group->delay();
+		group->pendingCommands.insert(std::make_pair(due, copyCommand(group, command)));
+	}
+	group->wake.notify_all();
+	return 0;
+}
+
+int hebiGroupSetCommandLifetime(HebiGroupPtr group, int32_t lifetime_ms){
+	if(lifetime_ms > 65535){
+		return -1;
+	}
+	std::lock_guard<std::mutex> guard(group->lock);
+	group->lifetimeMs = lifetime_ms;
+	return 0;
+}
+
+int32_t hebiGroupGetCommandLifetime(HebiGroupPtr group){
+	std::lock_guard<std::mutex> guard(group->lock);
+	return group->lifetimeMs;
+}
+
+int hebiGroupSetFeedbackFrequencyHz(HebiGroupPtr group, float frequency){
+	if(!(frequency >= 0) || frequency > group->config.maxFeedbackHz){
+		return -1;
+	}
+	{
+		std::lock_guard<std::mutex> guard(group->lock);
+		group->feedbackHz = frequency;
+	}
+	group->wake.notify_all();
+	return 0;
+}
+
+float hebiGroupGetFeedbackFrequencyHz(HebiGroupPtr group){
+	std::lock_guard<std::mutex> guard(group->lock);
+	return group->feedbackHz;
+}
+
+void hebiGroupRegisterFeedbackHandler(HebiGroupPtr group, GroupFeedbackHandlerFunction handler, void* user_data){
+	{
+		std::lock_guard<std::mutex> guard(group->lock);
+		group->handlers.push_back(std::make_pair(handler, user_data));
+	}
+	group->wake.notify_all();
+}
+
+void hebiGroupClearFeedbackHandlers(HebiGroupPtr group){
+	std::unique_lock<std::mutex> held(group->lock);
+	group->handlers.clear();
+	//as with libhebi, no handler runs once this returns, so their user data may go; a handler clearing
+	//from the feedback thread itself cannot wait for the delivery it is part of
+	if(std::this_thread::get_id() != group->thread.get_id()){
+		while(group->delivering){
+			group->delivered.wait(held);
+		}
+	}
+}
+
+int hebiGroupRequestFeedback(HebiGroupPtr group, HebiGroupFeedbackPtr feedback, int timeout_ms){
+	if(feedback->modules.size() != group->modules.size()){
+		return 1;
+	}
+	if(!roundTrip(group, timeout_ms, group->config.feedbackLoss)){
+		return 1;
+	}
+	group->sample(*feedback, SimClock::now());
+	return 0;
+}
+
+int hebiGroupRequestInfo(HebiGroupPtr group, HebiGroupInfoPtr info, int timeout_ms){
+	if(info->modules.size() != group->modules.size()){
+		return 1;
+	}
+	if(!roundTrip(group, timeout_ms, group->config.feedbackLoss)){
+		return 1;
+	}
+	for(size_t i = 0; i < group->modules.size(); i++){
+		std::lock_guard<std::mutex> guard(group->modules[i]->lock);
+		info->modules[i] = group->modules[i]->settings;
+	}
+	return 0;
+}
+
+//no log files are written by the simulation
+int hebiGroupStartLog(HebiGroupPtr, const char*){
+	return 1;
+}
+
+int hebiGroupStopLog(HebiGroupPtr){
+	return 1;
+}
+
+}
@@ -0,0 +1,222 @@
+#ifndef FIXED_KINEMATICS_HPP
+#define FIXED_KINEMATICS_HPP
+
+#include "kinematics.hpp"
+#include <cmath>
+
+namespace hebi {
+namespace kinematics {
+
+/**
+ * \brief Native, fixed-size forward kinematics and end effector Jacobian of a
+ * serial chain with N rotary joints.
+ *
+ * The chain is taken from a Kinematics object once (see create), and
+ * evaluated in Eigen without the C API. Static bodies are folded into the
+ * joints around them, and each joint frame is rotated so that the joint turns
+ * about its z axis; a configuration then costs N rotations about z and N rigid
+ * products, all of fixed size, with no allocation.
+ *
+ * The results are in the output frames of the C API (FrameTypeOutput); the
+ * end effector is the output of the last body. The Jacobian is analytic, with
+ * the linear velocity in rows 0-2 and the angular velocity in rows 3-5, both in
+ * the world frame; the C API estimates the same Jacobian numerically, so the
+ * two differ by about 1e-3.
+ *
+ * An object is immutable once created; several threads may use one at the
+ * same time.
+ */
+template<int N>
+class FixedKinematics final
+{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    typedef Eigen::Matrix<float, 6, N> Jacobian;
+
+    /**
+     * \brief Builds the native chain of a kinematics object.
+     *
+     * \returns nullptr unless the object has exactly N actuators and all of
+     * its bodies were created through the KinematicBody factory methods. Later
+     * changes to the kinematics object are not seen.
+     */
+    static std::unique_ptr<FixedKinematics> create(const Kinematics& kinematics)
+    {
+      const std::vector<KinematicBody::Parameters>& bodies = kinematics.getBodies();
+      if (kinematics.getDoFCount() != N || bodies.size() != kinematics.getFrameCount(FrameTypeOutput))
+        return nullptr;
+
+      std::unique_ptr<FixedKinematics> chain(new FixedKinematics());
+      Eigen::Matrix4f base = kinematics.getBaseFrame();
+      Eigen::Matrix3f rotation = base.topLeftCorner<3, 3>();
+      Eigen::Vector3f translation = base.topRightCorner<3, 1>();
+      int joint = 0;
+      for (const auto& body : bodies)
+      {
+        if (body.type == KinematicBody::Parameters::StaticBody)
+        {
+          compose(rotation, translation, body.output);
+        }
+        else if (body.type == KinematicBody::Parameters::Actuator)
+        {
+          compose(rotation, translation, body.input_to_joint);
+          // Turn the joint axis onto z, and back again after the joint
+          Eigen::Matrix3f align = Eigen::Quaternionf::FromTwoVectors(
+            Eigen::Vector3f::UnitZ(), Eigen::Map<const Eigen::Vector3f>(body.joint_rotation_axis)).toRotationMatrix();
+          chain->rotations_[joint] = rotation * align;
+          chain->translations_[joint] = translation;
+          ++joint;
+          rotation = align.transpose();
+          translation.setZero();
+          compose(rotation, translation, body.output);
+        }
+        else
+        {
+          return nullptr;
+        }
+      }
+      chain->tip_rotation_ = rotation;
+      chain->tip_translation_ = translation;
+      return chain;
+    }
+
+    /**
+     * \brief Generates the end effector transform.
+     *
+     * \param positions The N joint angles in radians; any Eigen vector type.
+     */
+    template<typename Derived>
+    void getEndEffector(const Eigen::MatrixBase<Derived>& positions, Eigen::Matrix4f& transform) const
+    {
+      Eigen::Matrix3f rotation;
+      Eigen::Vector3f translation;
+      forward(positions, rotation, translation, nullptr, nullptr);
+      setTransform(rotation, translation, transform);
+    }
+
+    /**
+     * \brief Generates the end effector Jacobian.
+     *
+     * \param positions The N joint angles in radians; any Eigen vector type.
+     */
+    template<typename Derived>
+    void getJEndEffector(const Eigen::MatrixBase<Derived>& positions, Jacobian& jacobian) const
+    {
+      Eigen::Matrix3f rotation;
+      Eigen::Vector3f translation;
+      Eigen::Matrix<float, 3, N> axes;
+      Eigen::Matrix<float, 3, N> origins;
+      forward(positions, rotation, translation, &axes, &origins);
+      setJacobian(translation, axes, origins, jacobian);
+    }
+
+    /**
+     * \brief Generates the end effector transform and Jacobian in one pass
+     * over the chain.
+     *
+     * \param positions The N joint angles in radians; any Eigen vector type.
+     */
+    template<typename Derived>
+    void getEndEffectorAndJ(const Eigen::MatrixBase<Derived>& positions, Eigen::Matrix4f& transform, Jacobian& jacobian) const
+    {
+      Eigen::Matrix3f rotation;
+      Eigen::Vector3f translation;
+      Eigen::Matrix<float, 3, N> axes;
+      Eigen::Matrix<float, 3, N> origins;
+      forward(positions, rotation, translation, &axes, &origins);
+      setTransform(rotation, translation, transform);
+      setJacobian(translation, axes, origins, jacobian);
+    }
+
+  private:
+    FixedKinematics() = default;
+
+    /**
+     * (rotation, translation) = (rotation, translation) * transform, for a
+     * row-major 4x4 transform of the C API.
+     */
+    static void compose(Eigen::Matrix3f& rotation, Eigen::Vector3f& translation, const float* transform)
+    {
+      Eigen::Map<const Eigen::Matrix<float, 4, 4, Eigen::RowMajor> > tmp(transform);
+      translation += rotation * tmp.topRightCorner<3, 1>();
+      rotation = rotation * tmp.topLeftCorner<3, 3>();
+    }
+
+    static void setTransform(const Eigen::Matrix3f& rotation, const Eigen::Vector3f& translation, Eigen::Matrix4f& transform)
+    {
+      transform.topLeftCorner<3, 3>() = rotation;
+      transform.topRightCorner<3, 1>() = translation;
+      transform.row(3) << 0, 0, 0, 1;
+    }
+
+    /**
+     * A rotary joint about z contributes axis x (tip - origin) to the linear
+     * velocity and its axis to the angular velocity.
+     */
+    static void setJacobian(const Eigen::Vector3f& tip, const Eigen::Matrix<float, 3, N>& axes,
+      const Eigen::Matrix<float, 3, N>& origins, Jacobian& jacobian)
+    {
+      for (int j = 0; j < N; ++j)
+      {
+        jacobian.template block<3, 1>(0, j) = axes.col(j).cross(tip - origins.col(j));
+        jacobian.template block<3, 1>(3, j) = axes.col(j);
+      }
+    }
+
+    /**
+     * Walks the chain to the end effector, keeping each joint's world axis and
+     * origin when asked for them.
+     */
+    template<typename Derived>
+    void forward(const Eigen::MatrixBase<Derived>& positions, Eigen::Matrix3f& rotation, Eigen::Vector3f& translation,
+      Eigen::Matrix<float, 3, N>* axes, Eigen::Matrix<float, 3, N>* origins) const
+    {
+      rotation = rotations_[0];
+      translation = translations_[0];
+      for (int j = 0; j < N; ++j)
+      {
+        if (j > 0)
+        {
+          translation += rotation * translations_[j];
+          rotation = rotation * rotations_[j];
+        }
+        if (axes)
+        {
+          axes->col(j) = rotation.col(2);
+          origins->col(j) = translation;
+        }
+        // Turning about z only mixes the x and y columns
+        float c = std::cos((float)positions(j));
+        float s = std::sin((float)positions(j));
+        Eigen::Vector3f x = rotation.col(0);
+        rotation.col(0) = c * x + s * rotation.col(1);
+        rotation.col(1) = c * rotation.col(1) - s * x;
+      }
+      translation += rotation * tip_translation_;
+      rotation = rotation * tip_rotation_;
+    }
+
+    /**
+     * Joint j's frame (before turning it) in the frame of joint j - 1 (after
+     * turning it); joint 0's is in the world frame.
+     */
+    Eigen::Matrix3f rotations_[N];
+    Eigen::Vector3f translations_[N];
+
+    /**
+     * The end effector in the frame of the last joint, after turning it.
+     */
+    Eigen::Matrix3f tip_rotation_;
+    Eigen::Vector3f tip_translation_;
+
+    /**
+     * Disable copy and move constructors and assignment operators
+     */
+    HEBI_DISABLE_COPY_MOVE(FixedKinematics)
+};
+
+} // namespace kinematics
+} // namespace hebi
+
+#endif // FIXED_KINEMATICS_HPP
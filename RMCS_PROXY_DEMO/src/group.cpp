@@ -1,5 +1,7 @@
 #include "group.hpp"
 #include "hebi_lookup.h" // For hebiGroupRelease
+#include "../Metrics.h"
+#include "../Trace.h"
 
 namespace hebi {
 
@@ -12,17 +14,31 @@ void callbackWrapper(HebiGroupFeedbackPtr group_feedback, void* user_data)
 
 void Group::callAttachedHandlers(HebiGroupFeedbackPtr group_feedback)
 {
-  // Wrap this:
-  GroupFeedback wrapped_fbk(group_feedback);
+  METRIC_SCOPE(MetricFeedbackDispatch);
+  TRACE_THREAD("hebi feedback");
+  TRACE_SCOPE("feedback_dispatch");
+  std::lock_guard<ProxyMutex> lock_guard(LOCK_SITE(handler_lock_));
+  // Wrap this, unless it is the object wrapped last time:
+  int num_modules = hebiGroupFeedbackGetNumModules(group_feedback);
+  bool same = wrapped_feedback_ && wrapped_feedback_->internal_ == group_feedback &&
+    (int)wrapped_modules_.size() == num_modules;
+  for (int i = 0; same && i < num_modules; i++)
+    same = wrapped_modules_[i] == hebiGroupFeedbackGetModuleFeedback(group_feedback, i);
+  if (!same)
+  {
+    wrapped_feedback_.reset(new GroupFeedback(group_feedback));
+    wrapped_modules_.resize(num_modules);
+    for (int i = 0; i < num_modules; i++)
+      wrapped_modules_[i] = hebiGroupFeedbackGetModuleFeedback(group_feedback, i);
+  }
   // Call handlers:
-  std::lock_guard<std::mutex> lock_guard(handler_lock_);
   for (unsigned int i = 0; i < handlers_.size(); i++)
   {
-    GroupFeedbackHandler handler = handlers_[i];
+    const GroupFeedbackHandler& handler = handlers_[i];
     // TODO: be sure to catch exceptions!
     try
     {
-      handler(&wrapped_fbk);
+      handler(wrapped_feedback_.get());
     }
     catch (...)
     {
@@ -55,11 +71,15 @@ bool Group::setCommandLifetimeMs(int ms)
 
 bool Group::sendCommand(const GroupCommand& group_command)
 {
+  METRIC_SCOPE(MetricSendCommand);
+  TRACE_SCOPE("send_command");
   return (hebiGroupSendCommand(internal_, group_command.internal_) == 0);
 }
 
 bool Group::sendCommandWithAcknowledgement(const GroupCommand& group_command, int timeout_ms)
 {
+  METRIC_SCOPE(MetricSendCommandAck);
+  TRACE_SCOPE("send_command_ack");
   return (hebiGroupSendCommandWithAcknowledgement(internal_, group_command.internal_, timeout_ms) == 0);
 }
     
@@ -95,7 +115,7 @@ float Group::getFeedbackFrequencyHz()
 
 void Group::addFeedbackHandler(GroupFeedbackHandler handler)
 {
-  std::lock_guard<std::mutex> lock_guard(handler_lock_);
+  std::lock_guard<ProxyMutex> lock_guard(LOCK_SITE(handler_lock_));
   handlers_.push_back(handler);
   if (handlers_.size() == 1) // (i.e., this was the first one)
     hebiGroupRegisterFeedbackHandler(internal_, callbackWrapper, (void*)this);
@@ -103,7 +123,7 @@ void Group::addFeedbackHandler(GroupFeedbackHandler handler)
 
 void Group::clearFeedbackHandlers()
 {
-  std::lock_guard<std::mutex> lock_guard(handler_lock_);
+  std::lock_guard<ProxyMutex> lock_guard(LOCK_SITE(handler_lock_));
   hebiGroupClearFeedbackHandlers(internal_);
   handlers_.clear();
 }
@@ -6,8 +6,10 @@
 #include "group_feedback.hpp"
 #include "group_info.hpp"
 #include "util.hpp"
+#include "../LockProfile.h"
 
 #include <functional>
+#include <memory>
 #include <mutex>
 
 namespace hebi {
@@ -59,7 +61,7 @@ class Group final
     /**
      * Protects access to the group feedback handler vector.
      */
-    std::mutex handler_lock_;
+    ProxyMutex handler_lock_;
 
     /**
      * A list of handler functions that are called when the internal C API
@@ -67,6 +69,15 @@ class Group final
      */
     std::vector<GroupFeedbackHandler> handlers_;
 
+    /**
+     * The wrapper of the C feedback object last handed to the handlers, and
+     * the module feedback objects it wraps; reused while the C library passes
+     * the same ones, so dispatching feedback does not allocate. Protected by
+     * handler_lock_.
+     */
+    std::unique_ptr<GroupFeedback> wrapped_feedback_;
+    std::vector<HebiFeedbackPtr> wrapped_modules_;
+
     #ifndef DOXYGEN_OMIT_INTERNAL
     /**
      * Intermediary to convert C-style function callbacks to C++ style, and
@@ -0,0 +1,306 @@
+#ifndef INVERSE_DYNAMICS_HPP
+#define INVERSE_DYNAMICS_HPP
+
+#include "kinematics.hpp"
+#include <cmath>
+#include <vector>
+
+namespace hebi {
+namespace kinematics {
+
+/**
+ * \brief Joint torques of a serial chain of rotary joints for given positions,
+ * velocities and accelerations, by the recursive Newton-Euler algorithm.
+ *
+ * The chain, with the mass and inertia of every body (see
+ * KinematicBody::Parameters), is taken from a Kinematics object once (see
+ * create). The bodies between two joints are lumped into one rigid link; an
+ * actuator (its housing) belongs to the link before its joint, and bodies
+ * before the first joint carry no load.
+ *
+ * With N fixed, every vector and matrix is fixed-size and nothing is
+ * allocated; with N = Eigen::Dynamic (the default), the chain may have any
+ * number of joints, and calls allocate their scratch space unless given a
+ * Workspace.
+ *
+ * An object is immutable once created, apart from setGravity; several threads
+ * may compute with one at the same time.
+ */
+template<int N = Eigen::Dynamic>
+class InverseDynamics final
+{
+  private:
+    typedef Eigen::Matrix<double, 3, N> Vectors;
+    typedef Eigen::Matrix<double, 3, N == Eigen::Dynamic ? Eigen::Dynamic : 3 * N> Rotations;
+
+  public:
+    typedef Eigen::Matrix<double, N, 1> Vector;
+    typedef Eigen::Matrix<double, N, N> Matrix;
+
+    /**
+     * \brief Scratch space for the calls of one thread on one model; with it,
+     * a dynamic-size model does not allocate either.
+     */
+    class Workspace final
+    {
+      friend class InverseDynamics;
+
+      public:
+        explicit Workspace(const InverseDynamics& model)
+          : to_parent_(3, 3 * model.getDoFCount()), forces_(3, model.getDoFCount()), moments_(3, model.getDoFCount())
+        {
+        }
+
+      private:
+        Rotations to_parent_;
+        Vectors forces_;
+        Vectors moments_;
+    };
+
+    /**
+     * \brief Builds the dynamic model of a kinematics object.
+     *
+     * \returns nullptr unless all of its bodies were created through the
+     * KinematicBody factory methods and, for a fixed N, it has N actuators.
+     * Later changes to the kinematics object are not seen.
+     */
+    static std::unique_ptr<InverseDynamics> create(const Kinematics& kinematics)
+    {
+      const std::vector<KinematicBody::Parameters>& bodies = kinematics.getBodies();
+      size_t num_dofs = kinematics.getDoFCount();
+      if ((N != Eigen::Dynamic && num_dofs != (size_t)N) || bodies.size() != kinematics.getFrameCount(FrameTypeOutput))
+        return nullptr;
+
+      std::unique_ptr<InverseDynamics> model(new InverseDynamics());
+      model->rotations_.resize(num_dofs);
+      model->translations_.resize(num_dofs);
+      model->masses_.assign(num_dofs, 0.0);
+      model->coms_.resize(num_dofs);
+      model->inertias_.resize(num_dofs);
+      // First and second moments of each link, about its frame's origin
+      std::vector<Eigen::Vector3d> moments(num_dofs, Eigen::Vector3d::Zero());
+      std::vector<Eigen::Matrix3d> second_moments(num_dofs, Eigen::Matrix3d::Zero());
+
+      // The frame bodies attach to, relative to the current link frame (the
+      // world before the first joint)
+      Eigen::Matrix4d base = kinematics.getBaseFrame().cast<double>();
+      Eigen::Matrix3d rotation = base.topLeftCorner<3, 3>();
+      Eigen::Vector3d translation = base.topRightCorner<3, 1>();
+      int link = -1;
+      for (const auto& body : bodies)
+      {
+        if (body.type != KinematicBody::Parameters::StaticBody && body.type != KinematicBody::Parameters::Actuator)
+          return nullptr;
+        // The body's mass belongs to the link it is fixed to: for an actuator,
+        // the housing, fixed to its input
+        if (link >= 0 && body.mass > 0)
+        {
+          const float* i = body.inertia;
+          Eigen::Matrix3d inertia;
+          inertia << i[0], i[3], i[4],
+                     i[3], i[1], i[5],
+                     i[4], i[5], i[2];
+          inertia = rotation * inertia * rotation.transpose();
+          Eigen::Vector3d com = translation + rotation * Eigen::Map<const Eigen::Vector3f>(body.com).cast<double>();
+          double mass = body.mass;
+          model->masses_[link] += mass;
+          moments[link] += mass * com;
+          second_moments[link] += inertia + mass * (com.squaredNorm() * Eigen::Matrix3d::Identity() - com * com.transpose());
+        }
+
+        Eigen::Map<const Eigen::Matrix<float, 4, 4, Eigen::RowMajor> > output(body.output);
+        if (body.type == KinematicBody::Parameters::Actuator)
+        {
+          // Each link frame is its joint frame, with the joint axis as z,
+          // turned by the joint
+          Eigen::Map<const Eigen::Matrix<float, 4, 4, Eigen::RowMajor> > input_to_joint(body.input_to_joint);
+          Eigen::Matrix3d align = Eigen::Quaterniond::FromTwoVectors(
+            Eigen::Vector3d::UnitZ(), Eigen::Map<const Eigen::Vector3f>(body.joint_rotation_axis).cast<double>()).toRotationMatrix();
+          ++link;
+          model->translations_[link] = translation + rotation * input_to_joint.topRightCorner<3, 1>().cast<double>();
+          model->rotations_[link] = rotation * input_to_joint.topLeftCorner<3, 3>().cast<double>() * align;
+          rotation = align.transpose();
+          translation = Eigen::Vector3d::Zero();
+        }
+        translation += rotation * output.topRightCorner<3, 1>().cast<double>();
+        rotation = rotation * output.topLeftCorner<3, 3>().cast<double>();
+      }
+      for (size_t j = 0; j < num_dofs; ++j)
+      {
+        double mass = model->masses_[j];
+        Eigen::Vector3d com = mass > 0 ? Eigen::Vector3d(moments[j] / mass) : Eigen::Vector3d::Zero();
+        model->coms_[j] = com;
+        model->inertias_[j] = second_moments[j] - mass * (com.squaredNorm() * Eigen::Matrix3d::Identity() - com * com.transpose());
+      }
+      return model;
+    }
+
+    size_t getDoFCount() const { return masses_.size(); }
+
+    /**
+     * \brief Sets the gravitational acceleration, in the world frame; defaults
+     * to (0, 0, -9.81) m/s^2.
+     */
+    void setGravity(const Eigen::Vector3d& gravity) { gravity_ = gravity; }
+    const Eigen::Vector3d& getGravity() const { return gravity_; }
+
+    /**
+     * \brief The torques that produce the given accelerations at the given
+     * positions and velocities, against gravity: M(q) qdd + C(q, qd) qd + g(q).
+     *
+     * \param torques Any Eigen vector; resized to the number of dofs if
+     * necessary.
+     * \param workspace Optional; made for this model, used by one thread at a
+     * time.
+     */
+    template<typename Positions, typename Velocities, typename Accelerations, typename Torques>
+    void getTorques(const Eigen::MatrixBase<Positions>& positions, const Eigen::MatrixBase<Velocities>& velocities,
+      const Eigen::MatrixBase<Accelerations>& accelerations, const Eigen::MatrixBase<Torques>& torques) const
+    {
+      Workspace workspace(*this);
+      rnea<true>(positions, &velocities, &accelerations, gravity_, torques, workspace);
+    }
+    template<typename Positions, typename Velocities, typename Accelerations, typename Torques>
+    void getTorques(const Eigen::MatrixBase<Positions>& positions, const Eigen::MatrixBase<Velocities>& velocities,
+      const Eigen::MatrixBase<Accelerations>& accelerations, const Eigen::MatrixBase<Torques>& torques, Workspace& workspace) const
+    {
+      rnea<true>(positions, &velocities, &accelerations, gravity_, torques, workspace);
+    }
+
+    /**
+     * \brief The torques that hold the chain still at the given positions:
+     * g(q).
+     *
+     * \param torques Any Eigen vector; resized to the number of dofs if
+     * necessary.
+     * \param workspace Optional; made for this model, used by one thread at a
+     * time.
+     */
+    template<typename Positions, typename Torques>
+    void getGravityTorques(const Eigen::MatrixBase<Positions>& positions, const Eigen::MatrixBase<Torques>& torques) const
+    {
+      Workspace workspace(*this);
+      getGravityTorques(positions, torques, workspace);
+    }
+    template<typename Positions, typename Torques>
+    void getGravityTorques(const Eigen::MatrixBase<Positions>& positions, const Eigen::MatrixBase<Torques>& torques, Workspace& workspace) const
+    {
+      rnea<false>(positions, static_cast<const Vector*>(nullptr), static_cast<const Vector*>(nullptr), gravity_, torques, workspace);
+    }
+
+    /**
+     * \brief The joint-space mass matrix M(q), one inverse dynamics pass per
+     * column.
+     */
+    template<typename Positions>
+    void getMassMatrix(const Eigen::MatrixBase<Positions>& positions, Matrix& mass_matrix) const
+    {
+      const int n = (int)getDoFCount();
+      mass_matrix.resize(n, n);
+      Vector zero = Vector::Zero(n);
+      Vector unit = Vector::Zero(n);
+      Workspace workspace(*this);
+      for (int j = 0; j < n; ++j)
+      {
+        unit[j] = 1;
+        rnea<true>(positions, &zero, &unit, Eigen::Vector3d::Zero(), mass_matrix.col(j), workspace);
+        unit[j] = 0;
+      }
+    }
+
+  private:
+    InverseDynamics() : gravity_(0, 0, -9.81) {}
+
+    /**
+     * Outward: each link's velocity, acceleration and the force and moment
+     * that accelerate it; inward: the force and moment each joint transmits.
+     * Link frames are the joint frames turned by the joint, so every joint
+     * axis is z. Gravity enters as an upward acceleration of the base.
+     */
+    template<bool Moving, typename Positions, typename Velocities, typename Accelerations, typename Torques>
+    void rnea(const Eigen::MatrixBase<Positions>& positions, const Velocities* velocities, const Accelerations* accelerations,
+      const Eigen::Vector3d& gravity, const Eigen::MatrixBase<Torques>& out, Workspace& workspace) const
+    {
+      const int n = N == Eigen::Dynamic ? (int)getDoFCount() : N;
+      Eigen::MatrixBase<Torques>& torques = const_cast<Eigen::MatrixBase<Torques>&>(out);
+      torques.derived().resize(n);
+      Rotations& to_parent = workspace.to_parent_;
+      Vectors& forces = workspace.forces_;
+      Vectors& moments = workspace.moments_;
+
+      Eigen::Vector3d omega = Eigen::Vector3d::Zero();
+      Eigen::Vector3d alpha = Eigen::Vector3d::Zero();
+      Eigen::Vector3d acceleration = -gravity;
+      for (int j = 0; j < n; ++j)
+      {
+        double c = std::cos((double)positions(j));
+        double s = std::sin((double)positions(j));
+        Eigen::Matrix3d rotation = rotations_[j];
+        Eigen::Vector3d x = rotation.col(0);
+        rotation.col(0) = c * x + s * rotation.col(1);
+        rotation.col(1) = c * rotation.col(1) - s * x;
+        to_parent.template block<3, 3>(0, 3 * j) = rotation;
+
+        const Eigen::Vector3d& offset = translations_[j];
+        acceleration = rotation.transpose() * acceleration;
+        if (Moving)
+        {
+          acceleration += rotation.transpose() * (alpha.cross(offset) + omega.cross(omega.cross(offset)));
+          double rate = (double)(*velocities)(j);
+          Eigen::Vector3d spin = rotation.transpose() * omega;
+          omega = spin + Eigen::Vector3d(0, 0, rate);
+          alpha = rotation.transpose() * alpha + spin.cross(Eigen::Vector3d(0, 0, rate)) + Eigen::Vector3d(0, 0, (double)(*accelerations)(j));
+          Eigen::Vector3d com_acceleration = acceleration + alpha.cross(coms_[j]) + omega.cross(omega.cross(coms_[j]));
+          forces.col(j) = masses_[j] * com_acceleration;
+          moments.col(j) = inertias_[j] * alpha + omega.cross(inertias_[j] * omega);
+        }
+        else
+        {
+          forces.col(j) = masses_[j] * acceleration;
+          moments.col(j).setZero();
+        }
+      }
+
+      Eigen::Vector3d force = Eigen::Vector3d::Zero();
+      Eigen::Vector3d moment = Eigen::Vector3d::Zero();
+      for (int j = n - 1; j >= 0; --j)
+      {
+        // The force and moment from the child, in this link's frame
+        if (j + 1 < n)
+        {
+          const auto child = to_parent.template block<3, 3>(0, 3 * (j + 1));
+          force = child * force;
+          moment = child * moment + translations_[j + 1].cross(force);
+        }
+        moment += moments.col(j) + coms_[j].cross(forces.col(j));
+        force += forces.col(j);
+        torques(j) = moment.z();
+      }
+    }
+
+    /**
+     * Joint j's frame (before turning it) in link j - 1's frame; joint 0's is
+     * in the world frame.
+     */
+    std::vector<Eigen::Matrix3d> rotations_;
+    std::vector<Eigen::Vector3d> translations_;
+
+    /**
+     * Each link's mass, center of mass and inertia about it, in its frame.
+     */
+    std::vector<double> masses_;
+    std::vector<Eigen::Vector3d> coms_;
+    std::vector<Eigen::Matrix3d> inertias_;
+
+    Eigen::Vector3d gravity_;
+
+    /**
+     * Disable copy and move constructors and assignment operators
+     */
+    HEBI_DISABLE_COPY_MOVE(InverseDynamics)
+};
+
+} // namespace kinematics
+} // namespace hebi
+
+#endif // INVERSE_DYNAMICS_HPP
@@ -0,0 +1,260 @@
+#include "inverse_kinematics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace hebi {
+namespace kinematics {
+
+namespace {
+// Below this many targets per thread, a path is not worth splitting further
+const size_t MIN_TARGETS_PER_THREAD = 8;
+// solvePath solves every PATH_STRIDE-th pose in order before splitting the path
+const size_t PATH_STRIDE = 4;
+
+// The weighted pose error of transform against target, rotation as an axis
+// times angle in the world frame
+void poseError(const Eigen::Matrix4f& target, const Eigen::Matrix4f& transform,
+  const Eigen::Matrix<double, 6, 1>& weights, Eigen::Matrix<double, 6, 1>& error)
+{
+  error.head<3>() = (target.topRightCorner<3, 1>() - transform.topRightCorner<3, 1>()).cast<double>();
+  Eigen::Matrix3d rotation = (target.topLeftCorner<3, 3>() * transform.topLeftCorner<3, 3>().transpose()).cast<double>();
+  Eigen::AngleAxisd difference(rotation);
+  error.tail<3>() = difference.angle() * difference.axis();
+  error = error.cwiseProduct(weights);
+}
+}
+
+IKOptions::IKOptions()
+  : tolerance(1e-4),
+    max_evaluations(100),
+    max_step(0.5),
+    initial_damping(1e-3),
+    min_damping(1e-9),
+    max_damping(1e6)
+{
+  task_weights.setOnes();
+}
+
+struct InverseKinematics::Worker
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  Worker(std::unique_ptr<Kinematics> clone, const Kinematics& kinematics, size_t num_dofs)
+    : clone_(std::move(clone)),
+      kinematics_(clone_ ? *clone_ : kinematics),
+      workspace_(kinematics_),
+      jacobian_(6, num_dofs),
+      trial_jacobian_(6, num_dofs),
+      weighted_jacobian_(6, num_dofs),
+      normal_(num_dofs, num_dofs),
+      system_(num_dofs, num_dofs),
+      gradient_(num_dofs),
+      step_(num_dofs),
+      current_(num_dofs),
+      trial_(num_dofs),
+      seed_(num_dofs),
+      solver_(num_dofs)
+  {
+  }
+
+  std::unique_ptr<Kinematics> clone_;
+  const Kinematics& kinematics_;
+  KinematicsWorkspace workspace_;
+  Eigen::Matrix4f transform_;
+  Eigen::Matrix4f trial_transform_;
+  Eigen::MatrixXf jacobian_;
+  Eigen::MatrixXf trial_jacobian_;
+  Eigen::MatrixXd weighted_jacobian_;
+  Eigen::MatrixXd normal_;
+  Eigen::MatrixXd system_;
+  Eigen::VectorXd gradient_;
+  Eigen::VectorXd step_;
+  Eigen::VectorXd current_;
+  Eigen::VectorXd trial_;
+  Eigen::VectorXd seed_;
+  Eigen::LDLT<Eigen::MatrixXd> solver_;
+};
+
+InverseKinematics::InverseKinematics(const Kinematics& kinematics, size_t threads)
+  : num_dofs_(kinematics.getDoFCount())
+{
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t i = 0; i < threads; ++i)
+  {
+    auto copy = kinematics.clone();
+    if (!copy)
+    {
+      workers_.clear();
+      workers_.emplace_back(new Worker(nullptr, kinematics, num_dofs_));
+      return;
+    }
+    workers_.emplace_back(new Worker(std::move(copy), kinematics, num_dofs_));
+  }
+}
+
+InverseKinematics::~InverseKinematics() noexcept
+{
+}
+
+bool InverseKinematics::setOptions(const IKOptions& options)
+{
+  auto fits = [this](const Eigen::VectorXd& vector) { return vector.size() == 0 || (size_t)vector.size() == num_dofs_; };
+  if (!fits(options.joint_weights) || !fits(options.min_positions) || !fits(options.max_positions))
+    return false;
+  options_ = options;
+  return true;
+}
+
+bool InverseKinematics::solve(const Eigen::Matrix4f& target, const Eigen::VectorXd& seed, Eigen::VectorXd& result, IKResult* info)
+{
+  if ((size_t)seed.size() != num_dofs_)
+    return false;
+  // Solve in a copy: result may be the seed
+  Worker& worker = *workers_[0];
+  worker.seed_ = seed;
+  IKResult res = solve(worker, target, worker.seed_);
+  result.resize(num_dofs_);
+  result = worker.seed_;
+  if (info)
+    *info = res;
+  return res.converged;
+}
+
+IKResult InverseKinematics::solve(Worker& worker, const Eigen::Matrix4f& target, Eigen::Ref<Eigen::VectorXd> positions) const
+{
+  const IKOptions& options = options_;
+  const double infinity = std::numeric_limits<double>::infinity();
+  auto clamp = [&options, infinity](Eigen::VectorXd& q)
+  {
+    for (int j = 0; j < q.size(); ++j)
+    {
+      double low = options.min_positions.size() ? options.min_positions[j] : -infinity;
+      double high = options.max_positions.size() ? options.max_positions[j] : infinity;
+      q[j] = std::min(std::max(q[j], low), high);
+    }
+  };
+
+  IKResult res;
+  Eigen::Matrix<double, 6, 1> error, trial_error;
+  worker.current_ = positions;
+  clamp(worker.current_);
+  worker.kinematics_.getEndEffectorAndJ(FrameTypeOutput, worker.current_, worker.transform_, worker.jacobian_, worker.workspace_);
+  poseError(target, worker.transform_, options.task_weights, error);
+  res.evaluations = 1;
+  res.residual = error.norm();
+
+  double damping = options.initial_damping;
+  while (res.residual > options.tolerance && res.evaluations < options.max_evaluations)
+  {
+    worker.weighted_jacobian_.noalias() = options.task_weights.asDiagonal() * worker.jacobian_.cast<double>();
+    worker.normal_.noalias() = worker.weighted_jacobian_.transpose() * worker.weighted_jacobian_;
+    worker.gradient_.noalias() = worker.weighted_jacobian_.transpose() * error;
+
+    // Retry with more damping until a step reduces the error
+    bool improved = false;
+    while (!improved && res.evaluations < options.max_evaluations && damping <= options.max_damping)
+    {
+      worker.system_ = worker.normal_;
+      if (options.joint_weights.size())
+        worker.system_.diagonal() += damping * options.joint_weights;
+      else
+        worker.system_.diagonal().array() += damping;
+      worker.solver_.compute(worker.system_);
+      worker.step_ = worker.solver_.solve(worker.gradient_);
+      // A long step near a singularity can cross to another solution branch
+      double longest = worker.step_.cwiseAbs().maxCoeff();
+      if (longest > options.max_step)
+        worker.step_ *= options.max_step / longest;
+      worker.trial_ = worker.current_ + worker.step_;
+      clamp(worker.trial_);
+      worker.kinematics_.getEndEffectorAndJ(FrameTypeOutput, worker.trial_, worker.trial_transform_, worker.trial_jacobian_, worker.workspace_);
+      ++res.evaluations;
+      poseError(target, worker.trial_transform_, options.task_weights, trial_error);
+      double trial_residual = trial_error.norm();
+      if (trial_residual < res.residual)
+      {
+        improved = true;
+        worker.current_.swap(worker.trial_);
+        worker.jacobian_.swap(worker.trial_jacobian_);
+        worker.transform_ = worker.trial_transform_;
+        error = trial_error;
+        res.residual = trial_residual;
+        damping = std::max(damping * 0.5, options.min_damping);
+      }
+      else
+      {
+        damping *= 4;
+      }
+    }
+    if (!improved)
+      break;
+  }
+  res.converged = res.residual <= options.tolerance;
+  positions = worker.current_;
+  return res;
+}
+
+size_t InverseKinematics::solvePath(const Matrix4fVector& targets, const Eigen::VectorXd& seed, Eigen::MatrixXd& positions,
+  std::vector<IKResult>* info)
+{
+  size_t count = targets.size();
+  if ((size_t)seed.size() != num_dofs_)
+    return 0;
+  if ((size_t)positions.rows() != num_dofs_ || (size_t)positions.cols() != count)
+    positions.resize(num_dofs_, count);
+  if (info && info->size() != count)
+    info->resize(count);
+  if (count == 0)
+    return 0;
+
+  size_t threads = std::min(workers_.size(), std::max<size_t>(1, count / MIN_TARGETS_PER_THREAD));
+  // Segments start on a skeleton pose
+  size_t chunk = (count + threads - 1) / threads;
+  chunk = (chunk + PATH_STRIDE - 1) / PATH_STRIDE * PATH_STRIDE;
+  std::vector<IKResult> local;
+  std::vector<IKResult>& results = info ? *info : local;
+  if (results.size() != count)
+    results.resize(count);
+
+  // Every PATH_STRIDE-th pose first, in path order from the seed: seeds taken
+  // from far along the path could land on another solution branch
+  positions.col(0) = seed;
+  for (size_t i = 0; i < count; i += PATH_STRIDE)
+  {
+    if (i > 0)
+      positions.col(i) = positions.col(i - PATH_STRIDE);
+    results[i] = solve(*workers_[0], targets[i], positions.col(i));
+  }
+
+  // Then the poses in between, each segment on a thread, every pose seeded
+  // with the one before
+  auto segment = [this, &targets, &positions, &results, count, chunk](size_t t)
+  {
+    size_t begin = t * chunk;
+    size_t end = std::min(count, begin + chunk);
+    for (size_t i = begin + 1; i < end; ++i)
+    {
+      if (i % PATH_STRIDE == 0)
+        continue;
+      positions.col(i) = positions.col(i - 1);
+      results[i] = solve(*workers_[t], targets[i], positions.col(i));
+    }
+  };
+  std::vector<std::thread> helpers;
+  for (size_t t = 1; t < threads && t * chunk < count; ++t)
+    helpers.emplace_back(segment, t);
+  segment(0);
+  for (auto& helper : helpers)
+    helper.join();
+
+  size_t converged = 0;
+  for (const auto& res : results)
+    converged += res.converged ? 1 : 0;
+  return converged;
+}
+
+} // namespace kinematics
+} // namespace hebi
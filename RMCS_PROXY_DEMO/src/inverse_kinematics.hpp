@@ -0,0 +1,181 @@
+#ifndef INVERSE_KINEMATICS_HPP
+#define INVERSE_KINEMATICS_HPP
+
+#include "kinematics.hpp"
+#include <vector>
+#include <memory>
+
+namespace hebi {
+namespace kinematics {
+
+/**
+ * \brief Settings for InverseKinematics; the defaults solve for the full end
+ * effector pose with every joint free.
+ */
+struct IKOptions
+{
+  /**
+   * Weights of the end effector error: x, y, z position (per meter) then x, y,
+   * z rotation (per radian), in the world frame. Zero leaves a component free;
+   * e.g. (1, 1, 1, 0, 0, 0) solves for position only.
+   */
+  Eigen::Matrix<double, 6, 1> task_weights;
+
+  /**
+   * Per joint; a joint with a larger weight moves less. Empty: all 1.
+   */
+  Eigen::VectorXd joint_weights;
+
+  /**
+   * Per joint limits (radians); empty or infinite for none. Every step is
+   * clamped to them.
+   */
+  Eigen::VectorXd min_positions;
+  Eigen::VectorXd max_positions;
+
+  /**
+   * Stop once the weighted error norm is below this.
+   */
+  double tolerance;
+
+  /**
+   * At most this many end effector + Jacobian evaluations per target, counting
+   * the initial one and every retried step; this bounds the cost of a solve.
+   */
+  int max_evaluations;
+
+  /**
+   * No joint moves more than this (radians) in one iteration; the step is
+   * scaled down to it.
+   */
+  double max_step;
+
+  /**
+   * The damping of the least squares step starts at initial_damping; it is
+   * halved after a step that reduces the error and quadrupled (and the step
+   * retried) after one that does not, within [min_damping, max_damping].
+   */
+  double initial_damping;
+  double min_damping;
+  double max_damping;
+
+  IKOptions();
+};
+
+/**
+ * \brief How a solve went.
+ */
+struct IKResult
+{
+  int evaluations;  //!< end effector + Jacobian evaluations, retried steps included
+  double residual;  //!< weighted error norm of the returned positions
+  bool converged;   //!< residual <= tolerance
+};
+
+/**
+ * \brief Solves for joint positions that put the end effector (output frame)
+ * of a kinematic chain at a given pose, with damped least squares.
+ *
+ * Each iteration takes the end effector transform and Jacobian from
+ * Kinematics::getEndEffectorAndJ and solves
+ * (Jw^T Jw + damping * diag(joint_weights)) dq = Jw^T ew,
+ * where Jw and ew are the Jacobian and pose error scaled by the task weights;
+ * the damping adapts to the progress made (see IKOptions). Start from the
+ * previous solution (warm start) and a streamed target usually converges in a
+ * few iterations.
+ *
+ * The solver works on its own clones of the chain (see Kinematics::clone), one
+ * per thread; they are made when the solver is created, so later changes to
+ * the source object are not seen. Calls on one solver must not overlap.
+ * Once created, single solves do not allocate.
+ */
+class InverseKinematics final
+{
+  public:
+    /**
+     * \brief Prepares a solver for the given chain.
+     *
+     * \param kinematics The chain to solve for; if it cannot be cloned, the
+     * solver uses it directly on one thread, and it must outlive the solver.
+     * \param threads How many threads solvePath may use, including the
+     * calling one; 0 uses one per hardware thread.
+     */
+    InverseKinematics(const Kinematics& kinematics, size_t threads = 0);
+
+    /**
+     * \brief Destructor; the clones are released.
+     */
+    ~InverseKinematics() noexcept;
+
+    const IKOptions& getOptions() const { return options_; }
+    /**
+     * \brief Replaces the options; vectors that are not empty must have one
+     * entry per joint.
+     *
+     * \returns false (and keeps the current options) if a vector has the
+     * wrong size.
+     */
+    bool setOptions(const IKOptions& options);
+
+    size_t getThreadCount() const { return workers_.size(); }
+
+    /**
+     * \brief Solves for one end effector pose.
+     *
+     * \param target The 4x4 homogeneous transform of the end effector.
+     * \param seed Joint positions to start from; clamped to the limits first.
+     * \param result The solution, the best positions found even when not
+     * converged; resized as necessary. May be the seed itself.
+     * \param info Optional; filled in with the evaluation count and residual.
+     *
+     * \returns true if the solve converged.
+     */
+    bool solve(const Eigen::Matrix4f& target, const Eigen::VectorXd& seed, Eigen::VectorXd& result, IKResult* info = nullptr);
+
+    /**
+     * \brief Solves for a path of end effector poses, each seeded with the
+     * solution of the one before it.
+     *
+     * Every fourth pose is solved first, in order along the path from the
+     * seed, each seeded with the one four before. The path is then split into
+     * one contiguous segment per thread, and the poses in between are solved
+     * in parallel, each seeded with the one before it. On one thread this
+     * still costs one solve per pose.
+     *
+     * \param targets The end effector transforms, in path order.
+     * \param seed Joint positions to start the first pose from.
+     * \param positions Resized to (number of dofs x number of targets) if
+     * necessary; column i is the solution for target i.
+     * \param info Optional; resized to the number of targets and filled in
+     * with each solve's result.
+     *
+     * \returns how many of the poses converged.
+     */
+    size_t solvePath(const Matrix4fVector& targets, const Eigen::VectorXd& seed, Eigen::MatrixXd& positions,
+      std::vector<IKResult>* info = nullptr);
+
+  private:
+    /**
+     * A chain, workspace and scratch matrices for one thread.
+     */
+    struct Worker;
+
+    /**
+     * Solves target on one worker, in place in positions.
+     */
+    IKResult solve(Worker& worker, const Eigen::Matrix4f& target, Eigen::Ref<Eigen::VectorXd> positions) const;
+
+    IKOptions options_;
+    size_t num_dofs_;
+    std::vector<std::unique_ptr<Worker> > workers_;
+
+    /**
+     * Disable copy and move constructors and assignment operators
+     */
+    HEBI_DISABLE_COPY_MOVE(InverseKinematics)
+};
+
+} // namespace kinematics
+} // namespace hebi
+
+#endif // INVERSE_KINEMATICS_HPP
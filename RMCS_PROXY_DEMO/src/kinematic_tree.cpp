@@ -0,0 +1,201 @@
+#include "kinematic_tree.hpp"
+
+namespace hebi {
+namespace kinematics {
+
+////////////////////////// Kinematic Tree State
+
+KinematicTreeState::KinematicTreeState()
+  : tree_(nullptr)
+{
+}
+
+size_t KinematicTreeState::getEndEffectorCount() const
+{
+  return tree_ ? tree_->end_effectors_.size() : 0;
+}
+
+const Eigen::Matrix4f& KinematicTreeState::getEndEffector(size_t end_effector) const
+{
+  return output_frames_[tree_->end_effectors_[end_effector].frame];
+}
+
+void KinematicTreeState::getJEndEffector(size_t end_effector, Eigen::MatrixXf& jacobian) const
+{
+  jacobian.resize(6, axes_.cols());
+  jacobian.setZero();
+  const KinematicTree::EndEffector& tip = tree_->end_effectors_[end_effector];
+  Eigen::Vector3f position = output_frames_[tip.frame].topRightCorner<3, 1>();
+  for (size_t dof : tip.dofs)
+  {
+    jacobian.block<3, 1>(0, dof) = axes_.col(dof).cross(position - origins_.col(dof));
+    jacobian.block<3, 1>(3, dof) = axes_.col(dof);
+  }
+}
+
+////////////////////////// Kinematic Tree
+
+KinematicTree::KinematicTree()
+  : base_frame_(Eigen::Matrix4f::Identity()), num_dofs_(0), num_output_frames_(0)
+{
+}
+
+size_t KinematicTree::getFrameCount(HebiFrameType frame_type) const
+{
+  return frame_type == FrameTypeCenterOfMass ? bodies_.size() : num_output_frames_;
+}
+
+bool KinematicTree::addBody(std::unique_ptr<KinematicBody> new_body)
+{
+  if (bodies_.empty())
+    return addBody(std::move(new_body), (size_t)-1, 0);
+  return addBody(std::move(new_body), bodies_.size() - 1, 0);
+}
+
+bool KinematicTree::addBody(std::unique_ptr<KinematicBody> new_body, size_t parent, size_t output_index)
+{
+  if (!new_body)
+    return false;
+  const KinematicBody::Parameters& parameters = new_body->getParameters();
+  Body body;
+  body.com = Map<const Eigen::Vector3f>(parameters.com);
+  body.outputs.push_back(Map<const Matrix<float, 4, 4, RowMajor> >(parameters.output));
+  if (parameters.type == KinematicBody::Parameters::Actuator)
+  {
+    body.is_actuator = true;
+    body.input_to_joint = Map<const Matrix<float, 4, 4, RowMajor> >(parameters.input_to_joint);
+    body.axis = Map<const Eigen::Vector3f>(parameters.joint_rotation_axis).normalized();
+  }
+  else if (parameters.type == KinematicBody::Parameters::StaticBody)
+  {
+    body.is_actuator = false;
+  }
+  else
+  {
+    return false;
+  }
+  return attach(body, parent == (size_t)-1 ? -1 : (int)parent, output_index);
+}
+
+bool KinematicTree::addStaticBody(const Eigen::Vector3f& com, const Matrix4fVector& outputs)
+{
+  if (bodies_.empty())
+    return addStaticBody(com, outputs, (size_t)-1, 0);
+  return addStaticBody(com, outputs, bodies_.size() - 1, 0);
+}
+
+bool KinematicTree::addStaticBody(const Eigen::Vector3f& com, const Matrix4fVector& outputs, size_t parent, size_t output_index)
+{
+  if (outputs.empty())
+    return false;
+  Body body;
+  body.is_actuator = false;
+  body.com = com;
+  body.outputs = outputs;
+  return attach(body, parent == (size_t)-1 ? -1 : (int)parent, output_index);
+}
+
+bool KinematicTree::attach(Body& body, int parent, size_t output_index)
+{
+  // Only the first body is the root; every other one takes a free output
+  if (parent < 0 ? !bodies_.empty() : (size_t)parent >= bodies_.size())
+    return false;
+  if (parent >= 0)
+  {
+    const Body& existing = bodies_[parent];
+    if (output_index >= existing.children.size() || existing.children[output_index] >= 0)
+      return false;
+  }
+  body.parent = parent;
+  body.parent_output = output_index;
+  body.dof = body.is_actuator ? num_dofs_++ : 0;
+  body.children.assign(body.outputs.size(), -1);
+  bodies_.push_back(body);
+  if (parent >= 0)
+    bodies_[parent].children[output_index] = (int)bodies_.size() - 1;
+  index();
+  return true;
+}
+
+void KinematicTree::index()
+{
+  order_.clear();
+  end_effectors_.clear();
+  std::vector<size_t> dofs;
+  size_t output_frame = 0;
+  size_t com_frame = 0;
+  index(0, dofs, output_frame, com_frame);
+  num_output_frames_ = output_frame;
+}
+
+void KinematicTree::index(size_t body_index, std::vector<size_t>& dofs, size_t& output_frame, size_t& com_frame)
+{
+  Body& body = bodies_[body_index];
+  order_.push_back(body_index);
+  body.com_frame = com_frame++;
+  if (body.is_actuator)
+    dofs.push_back(body.dof);
+  body.frames.resize(body.outputs.size());
+  for (size_t k = 0; k < body.outputs.size(); ++k)
+  {
+    body.frames[k] = output_frame++;
+    if (body.children[k] >= 0)
+    {
+      index((size_t)body.children[k], dofs, output_frame, com_frame);
+    }
+    else
+    {
+      EndEffector tip;
+      tip.frame = body.frames[k];
+      tip.dofs = dofs;
+      end_effectors_.push_back(tip);
+    }
+  }
+  if (body.is_actuator)
+    dofs.pop_back();
+}
+
+void KinematicTree::evaluate(const Eigen::VectorXd& positions, KinematicTreeState& state) const
+{
+  state.tree_ = this;
+  if (state.output_frames_.size() != num_output_frames_)
+    state.output_frames_.resize(num_output_frames_);
+  if (state.com_frames_.size() != bodies_.size())
+    state.com_frames_.resize(bodies_.size());
+  if ((size_t)state.axes_.cols() != num_dofs_)
+  {
+    state.axes_.resize(3, num_dofs_);
+    state.origins_.resize(3, num_dofs_);
+  }
+
+  // Parents come first in order_, so every input frame is ready when needed
+  for (size_t body_index : order_)
+  {
+    const Body& body = bodies_[body_index];
+    const Eigen::Matrix4f& input = body.parent < 0
+      ? base_frame_
+      : state.output_frames_[bodies_[body.parent].frames[body.parent_output]];
+    if (body.is_actuator)
+    {
+      Eigen::Matrix4f joint = input * body.input_to_joint;
+      state.axes_.col(body.dof) = joint.topLeftCorner<3, 3>() * body.axis;
+      state.origins_.col(body.dof) = joint.topRightCorner<3, 1>();
+      joint.topLeftCorner<3, 3>() = joint.topLeftCorner<3, 3>() * Eigen::AngleAxisf((float)positions[body.dof], body.axis).toRotationMatrix();
+      state.output_frames_[body.frames[0]] = joint * body.outputs[0];
+    }
+    else
+    {
+      for (size_t k = 0; k < body.outputs.size(); ++k)
+        state.output_frames_[body.frames[k]] = input * body.outputs[k];
+    }
+    // The center of mass frame is placed in the input frame and turned as the
+    // first output, as in the C API
+    Eigen::Matrix4f& com = state.com_frames_[body.com_frame];
+    com.topLeftCorner<3, 3>() = state.output_frames_[body.frames[0]].topLeftCorner<3, 3>();
+    com.topRightCorner<3, 1>() = input.topLeftCorner<3, 3>() * body.com + input.topRightCorner<3, 1>();
+    com.row(3) << 0, 0, 0, 1;
+  }
+}
+
+} // namespace kinematics
+} // namespace hebi
@@ -0,0 +1,203 @@
+#ifndef KINEMATIC_TREE_HPP
+#define KINEMATIC_TREE_HPP
+
+#include "kinematics.hpp"
+#include <vector>
+#include <memory>
+
+namespace hebi {
+namespace kinematics {
+
+class KinematicTree;
+
+/**
+ * \brief Every frame of a KinematicTree for one configuration, as computed by
+ * KinematicTree::evaluate.
+ *
+ * Reuse one state per thread to keep evaluations allocation-free. The state
+ * refers to the tree that filled it in; it is stale once bodies are added to
+ * that tree.
+ */
+class KinematicTreeState final
+{
+  friend KinematicTree;
+
+  public:
+    KinematicTreeState();
+
+    /**
+     * \brief Returns the frames of the given type, in the depth-first order of
+     * Kinematics::getFK.
+     */
+    const Matrix4fVector& getFrames(HebiFrameType frame_type) const
+    {
+      return frame_type == FrameTypeCenterOfMass ? com_frames_ : output_frames_;
+    }
+
+    /**
+     * \brief Returns the number of end effectors: outputs with nothing
+     * attached, in depth-first order.
+     */
+    size_t getEndEffectorCount() const;
+
+    /**
+     * \brief Returns the transform of an end effector.
+     */
+    const Eigen::Matrix4f& getEndEffector(size_t end_effector) const;
+
+    /**
+     * \brief Generates the Jacobian of an end effector.
+     *
+     * \param jacobian Resized to (6 x number of dofs) as necessary; linear
+     * velocity in rows 0-2, angular in rows 3-5, both in the world frame. The
+     * columns of joints that do not move the end effector are zero.
+     */
+    void getJEndEffector(size_t end_effector, Eigen::MatrixXf& jacobian) const;
+
+  private:
+    const KinematicTree* tree_;
+    Matrix4fVector output_frames_;
+    Matrix4fVector com_frames_;
+    Eigen::Matrix3Xf axes_;
+    Eigen::Matrix3Xf origins_;
+};
+
+/**
+ * \brief A tree of kinematic bodies, evaluated natively in Eigen.
+ *
+ * The C kinematics object only handles chains. Here a body attaches to any
+ * free output of a body added before it, and a static body may have several
+ * outputs, so a robot with several limbs is one tree: the transforms it shares
+ * (e.g. a torso) are computed once per configuration, and every limb's end
+ * effector transform and Jacobian fall out of the same traversal.
+ *
+ * Bodies are numbered in the order they are added, and so are the degrees of
+ * freedom (one per actuator). Frames are ordered depth-first, as in
+ * Kinematics::getFK. An object may be evaluated from several threads at once,
+ * each with its own state.
+ */
+class KinematicTree final
+{
+  friend KinematicTreeState;
+
+  public:
+    /**
+     * \brief Creates a tree with no bodies and an identity base frame.
+     */
+    KinematicTree();
+
+    /**
+     * \brief Set the transform from the world coordinate system to the input
+     * of the root body.
+     */
+    void setBaseFrame(const Eigen::Matrix4f& base_frame) { base_frame_ = base_frame; }
+
+    /**
+     * \brief Returns the transform from the world coordinate system to the root
+     * body, as set by setBaseFrame.
+     */
+    const Eigen::Matrix4f& getBaseFrame() const { return base_frame_; }
+
+    size_t getBodyCount() const { return bodies_.size(); }
+    size_t getDoFCount() const { return num_dofs_; }
+    size_t getFrameCount(HebiFrameType frame_type) const;
+    size_t getEndEffectorCount() const { return end_effectors_.size(); }
+
+    /**
+     * \brief Adds a body to the first output of the last body added (or as the
+     * root, for the first body), as Kinematics::addBody does.
+     *
+     * \returns true if successful, false if the body was not created through a
+     * KinematicBody factory method or that output is taken.
+     */
+    bool addBody(std::unique_ptr<KinematicBody> new_body);
+
+    /**
+     * \brief Adds a body to an output of a body already in the tree.
+     *
+     * \param new_body The body to add; only its parameters are kept.
+     * \param parent The number of the body to attach to, in the order bodies
+     * were added.
+     * \param output_index Which output of the parent to attach to.
+     *
+     * \returns true if successful, false if the body was not created through a
+     * KinematicBody factory method, or the parent output does not exist or is
+     * taken.
+     */
+    bool addBody(std::unique_ptr<KinematicBody> new_body, size_t parent, size_t output_index);
+
+    /**
+     * \brief Adds a static body with several outputs (e.g. a torso with two
+     * shoulders) as the root, for the first body, or to an output of a body
+     * already in the tree.
+     *
+     * \param com The center of mass, in the body's input frame.
+     * \param outputs The transforms from the body's input to each output.
+     */
+    bool addStaticBody(const Eigen::Vector3f& com, const Matrix4fVector& outputs);
+    bool addStaticBody(const Eigen::Vector3f& com, const Matrix4fVector& outputs, size_t parent, size_t output_index);
+
+    /**
+     * \brief Computes every frame of the tree for one configuration, each
+     * shared transform once.
+     *
+     * \param positions One joint angle (radians) per degree of freedom.
+     * \param state Filled in; sized on first use, allocation-free afterwards.
+     */
+    void evaluate(const Eigen::VectorXd& positions, KinematicTreeState& state) const;
+
+    /**
+     * \brief Returns the degrees of freedom that move an end effector, root
+     * first.
+     */
+    const std::vector<size_t>& getEndEffectorDoFs(size_t end_effector) const { return end_effectors_[end_effector].dofs; }
+
+  private:
+    struct Body
+    {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      bool is_actuator;
+      Eigen::Vector3f com;
+      Eigen::Matrix4f input_to_joint;
+      Eigen::Vector3f axis;
+      Matrix4fVector outputs;       //!< joint to output for actuators
+      int parent;                   //!< -1 for the root
+      size_t parent_output;
+      size_t dof;                   //!< actuators only
+      std::vector<int> children;    //!< per output; -1 where free
+      std::vector<size_t> frames;   //!< per output, its output frame
+      size_t com_frame;
+    };
+
+    struct EndEffector
+    {
+      size_t frame;
+      std::vector<size_t> dofs;
+    };
+
+    bool attach(Body& body, int parent, size_t output_index);
+
+    /**
+     * Renumbers the frames depth-first and finds the end effectors.
+     */
+    void index();
+    void index(size_t body, std::vector<size_t>& dofs, size_t& output_frame, size_t& com_frame);
+
+    Eigen::Matrix4f base_frame_;
+    std::vector<Body, Eigen::aligned_allocator<Body> > bodies_;
+    std::vector<size_t> order_; //!< bodies, depth-first; parents come before children
+    std::vector<EndEffector> end_effectors_;
+    size_t num_dofs_;
+    size_t num_output_frames_;
+
+    /**
+     * Disable copy and move constructors and assignment operators
+     */
+    HEBI_DISABLE_COPY_MOVE(KinematicTree)
+};
+
+} // namespace kinematics
+} // namespace hebi
+
+#endif // KINEMATIC_TREE_HPP
@@ -1,39 +1,98 @@
 #include "kinematics.hpp"
 #include "hebi_kinematic_parameters.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
 
 namespace hebi {
 namespace kinematics {
 
 ////////////////////////// Kinematic Bodies
 //
+std::unique_ptr<KinematicBody> KinematicBody::create(const Parameters& parameters)
+{
+  HebiBodyPtr tmp = nullptr;
+  if (parameters.type == Parameters::Actuator)
+    tmp = hebiActuatorCreate(parameters.com, parameters.input_to_joint, parameters.joint_rotation_axis, parameters.output);
+  else if (parameters.type == Parameters::StaticBody)
+    tmp = hebiStaticBodyCreate(parameters.com, 1, parameters.output);
+  if (tmp == nullptr)
+    return nullptr;
+  return std::unique_ptr<KinematicBody>(new KinematicBody(tmp, parameters));
+}
+
 std::unique_ptr<KinematicBody> KinematicBody::createX5()
 {
-  auto tmp = hebiActuatorCreate(
-    hebiKinematicParametersX5.com,
-    hebiKinematicParametersX5.input_to_joint,
-    hebiKinematicParametersX5.joint_rotation_axis,
-    hebiKinematicParametersX5.joint_to_output);
-  return std::unique_ptr<KinematicBody>(new KinematicBody(tmp));
+  Parameters parameters;
+  parameters.type = Parameters::Actuator;
+  std::memcpy(parameters.com, hebiKinematicParametersX5.com, sizeof(parameters.com));
+  std::memcpy(parameters.input_to_joint, hebiKinematicParametersX5.input_to_joint, sizeof(parameters.input_to_joint));
+  std::memcpy(parameters.joint_rotation_axis, hebiKinematicParametersX5.joint_rotation_axis, sizeof(parameters.joint_rotation_axis));
+  std::memcpy(parameters.output, hebiKinematicParametersX5.joint_to_output, sizeof(parameters.output));
+  // Uniform 110 x 74 x 45 mm box
+  const float x = 0.110f, y = 0.074f, z = 0.045f;
+  parameters.mass = 0.315f;
+  parameters.inertia[0] = parameters.mass / 12 * (y * y + z * z);
+  parameters.inertia[1] = parameters.mass / 12 * (x * x + z * z);
+  parameters.inertia[2] = parameters.mass / 12 * (x * x + y * y);
+  parameters.inertia[3] = parameters.inertia[4] = parameters.inertia[5] = 0;
+  return create(parameters);
 }
 
 std::unique_ptr<KinematicBody> KinematicBody::createX5Link(float length, float twist)
 {
   auto link_params = hebiKinematicParametersX5Link(length, twist);
-  auto tmp = hebiStaticBodyCreate(link_params.com, 1, link_params.output);
-  return std::unique_ptr<KinematicBody>(new KinematicBody(tmp));
+  Parameters parameters;
+  parameters.type = Parameters::StaticBody;
+  std::memcpy(parameters.com, link_params.com, sizeof(parameters.com));
+  std::memcpy(parameters.output, link_params.output, sizeof(parameters.output));
+  // Uniform rod along the tube, 25 mm across
+  const float radius = 0.0125f;
+  parameters.mass = 0.4f * length + 0.26f;
+  parameters.inertia[0] = parameters.mass * radius * radius / 2;
+  parameters.inertia[1] = parameters.inertia[2] = parameters.mass * length * length / 12;
+  parameters.inertia[3] = parameters.inertia[4] = parameters.inertia[5] = 0;
+  return create(parameters);
 }
 
-std::unique_ptr<KinematicBody> KinematicBody::createGenericLink(const Eigen::Vector3f& com, const Eigen::Matrix4f& output)
+std::unique_ptr<KinematicBody> KinematicBody::createGenericLink(const Eigen::Vector3f& com, const Eigen::Matrix4f& output, float mass)
 {
-  float c_com[3];
-  float c_output[16];
-  Map<Matrix<float, 3, 1> > tmp_com(c_com);
-  Map<Matrix<float, 4, 4, RowMajor> > tmp_output(c_output);
+  Parameters parameters;
+  parameters.type = Parameters::StaticBody;
+  parameters.mass = mass;
+  std::fill(parameters.inertia, parameters.inertia + 6, 0.0f);
+  Map<Matrix<float, 3, 1> > tmp_com(parameters.com);
+  Map<Matrix<float, 4, 4, RowMajor> > tmp_output(parameters.output);
   tmp_com = com;
   tmp_output = output;
-  
-  auto tmp = hebiStaticBodyCreate(c_com, 1, c_output);
-  return std::unique_ptr<KinematicBody>(new KinematicBody(tmp));
+
+  return create(parameters);
+}
+
+////////////////////////// Kinematics Workspace
+
+KinematicsWorkspace::KinematicsWorkspace(const Kinematics& kinematics)
+{
+  resize(kinematics);
+}
+
+void KinematicsWorkspace::resize(const Kinematics& kinematics)
+{
+  size_t num_frames = std::max(kinematics.getFrameCount(FrameTypeCenterOfMass), kinematics.getFrameCount(FrameTypeOutput));
+  reserve(num_frames, kinematics.getDoFCount());
+}
+
+void KinematicsWorkspace::reserve(size_t num_frames, size_t num_dofs)
+{
+  if (frames_.size() < 16 * num_frames)
+    frames_.resize(16 * num_frames);
+  if (jacobians_.size() < 6 * num_dofs * num_frames)
+    jacobians_.resize(6 * num_dofs * num_frames);
+  // Keep data() valid for the C API even for an empty kinematics object
+  if (frames_.empty())
+    frames_.resize(16);
+  if (jacobians_.empty())
+    jacobians_.resize(6);
 }
 
 ////////////////////////// Kinematics
@@ -86,57 +145,68 @@ size_t Kinematics::getDoFCount() const
   return (size_t)res;
 }
 
-// TODO: handle trees/etc by passing in parent object here, and output index
+// The C API only builds chains (it ignores the parent and output index); trees
+// are handled natively by KinematicTree
 bool Kinematics::addBody(std::unique_ptr<KinematicBody> body)
 {
   bool was_added = (hebiKinematicsAddBody(internal_, nullptr, 0, body->getInternal()) == 0);
   if (was_added)
+  {
+    bodies_.push_back(body->getParameters());
     body->consume();
+  }
   // Destroy the C++ wrapper no matter what (this should automatically happen
   // anyway as we go out of scope...)
   body.reset(nullptr);
   return was_added;
 }
 
+std::unique_ptr<Kinematics> Kinematics::clone() const
+{
+  std::unique_ptr<Kinematics> copy(new Kinematics());
+  for (const auto& parameters : bodies_)
+  {
+    auto body = KinematicBody::create(parameters);
+    if (!body || !copy->addBody(std::move(body)))
+      return nullptr;
+  }
+  // Bodies added through a wrapped C object are missing from bodies_
+  if (copy->getDoFCount() != getDoFCount() || copy->getFrameCount(FrameTypeOutput) != getFrameCount(FrameTypeOutput))
+    return nullptr;
+  copy->setBaseFrame(getBaseFrame());
+  return copy;
+}
+
 void Kinematics::getForwardKinematics(HebiFrameType frame_type, const Eigen::VectorXd& positions, Matrix4fVector& frames) const
 {
   getFK(frame_type, positions, frames);
 }
 void Kinematics::getFK(HebiFrameType frame_type, const Eigen::VectorXd& positions, Matrix4fVector& frames) const
 {
-  // Put data into an array
-  double* positions_array = new double[positions.size()];
-  {
-    Map<Eigen::VectorXd> tmp(positions_array, positions.size());
-    tmp = positions;
-  }
-  int num_frames = getFrameCount(frame_type);
-  float* frame_array = new float[16 * num_frames];
-  // Get data from C API
-  hebiKinematicsGetForwardKinematics(internal_, frame_type, (double*)positions_array, (float*) frame_array);
-  delete[] positions_array;
+  KinematicsWorkspace workspace(*this);
+  getFK(frame_type, positions, frames, workspace);
+}
+void Kinematics::getFK(HebiFrameType frame_type, const Eigen::VectorXd& positions, Matrix4fVector& frames, KinematicsWorkspace& workspace) const
+{
+  // The positions are contiguous doubles already; the C API reads them in place
+  size_t num_frames = getFrameCount(frame_type);
+  workspace.reserve(num_frames, positions.size());
+  float* frame_array = workspace.frames_.data();
+  hebiKinematicsGetForwardKinematics(internal_, frame_type, positions.data(), frame_array);
   // Copy into vector of matrices passed in
-  frames.resize(num_frames);
-  for (int i = 0; i < num_frames; ++i)
+  if (frames.size() != num_frames)
+    frames.resize(num_frames);
+  for (size_t i = 0; i < num_frames; ++i)
   {
     Map<Matrix<float, 4, 4, RowMajor> > tmp(frame_array + i * 16);
     frames[i] = tmp;
   }
-  delete[] frame_array;
 }
 
 void Kinematics::getEndEffector(HebiFrameType frame_type, const Eigen::VectorXd& positions, Eigen::Matrix4f& transform) const
 {
-  // Put data into an array
-  double* positions_array = new double[positions.size()];
-  {
-    Map<Eigen::VectorXd> tmp(positions_array, positions.size());
-    tmp = positions;
-  }
-
   float transform_array[16];
-  hebiKinematicsGetEndEffector(internal_, frame_type, positions_array, transform_array);
-  delete[] positions_array;
+  hebiKinematicsGetEndEffector(internal_, frame_type, positions.data(), transform_array);
   {
     Map<Matrix<float, 4, 4, RowMajor> > tmp(transform_array);
     transform = tmp;
@@ -149,27 +219,15 @@ void Kinematics::solveInverseKinematics(const Eigen::Vector3f& target_xyz, const
 }
 void Kinematics::solveIK(const Eigen::Vector3f& target_xyz, const Eigen::VectorXd& initial_positions, Eigen::VectorXd& result) const
 {
-  // Put data into an array
-  float* target_xyz_array = new float[target_xyz.size()];
-  {
-    Map<Eigen::Vector3f> tmp(target_xyz_array);
-    tmp = target_xyz;
-  }
-  double* positions_array = new double[initial_positions.size()];
+  // The solution is written straight into result; it must not alias the seed
+  if (&result == &initial_positions)
   {
-    Map<Eigen::VectorXd> tmp(positions_array, initial_positions.size());
-    tmp = initial_positions;
+    Eigen::VectorXd seed = initial_positions;
+    solveIK(target_xyz, seed, result);
+    return;
   }
-  double* result_array = new double[initial_positions.size()];
-  hebiKinematicsSolveIK(internal_, (const float*)target_xyz_array, (const double*)positions_array, (double*) result_array);
-  delete[] target_xyz_array;
-  delete[] positions_array;
-
-  {
-    Map<Eigen::VectorXd> tmp(result_array, initial_positions.size());
-    result = tmp;
-  }
-  delete[] result_array;
+  result.resize(initial_positions.size());
+  hebiKinematicsSolveIK(internal_, target_xyz.data(), initial_positions.data(), result.data());
 }
 
 
@@ -179,27 +237,25 @@ void Kinematics::getJacobians(HebiFrameType frame_type, const Eigen::VectorXd& p
 }
 void Kinematics::getJ(HebiFrameType frame_type, const Eigen::VectorXd& positions, MatrixXfVector& jacobians) const
 {
-  // Put data into an array
-  double* positions_array = new double[positions.size()];
+  KinematicsWorkspace workspace(*this);
+  getJ(frame_type, positions, jacobians, workspace);
+}
+void Kinematics::getJ(HebiFrameType frame_type, const Eigen::VectorXd& positions, MatrixXfVector& jacobians, KinematicsWorkspace& workspace) const
+{
+  size_t num_frames = getFrameCount(frame_type);
+  size_t num_dofs = positions.size();
+  workspace.reserve(num_frames, num_dofs);
+  float* jacobians_array = workspace.jacobians_.data();
+  hebiKinematicsGetJacobians(internal_, frame_type, positions.data(), jacobians_array);
+  if (jacobians.size() != num_frames)
+    jacobians.resize(num_frames);
+  for (size_t i = 0; i < num_frames; ++i)
   {
-    Map<Eigen::VectorXd> tmp(positions_array, positions.size());
-    tmp = positions;
-  }
-
-  int num_frames = getFrameCount(frame_type);
-  int num_dofs = positions.size();
-  int rows = 6 * num_frames;
-  int cols = num_dofs;
-  float* jacobians_array = new float[rows * cols];
-  hebiKinematicsGetJacobians(internal_, frame_type, (const double*) positions_array, (float*) jacobians_array);
-  delete[] positions_array;
-  jacobians.resize(num_frames);
-  for (int i = 0; i < num_frames; ++i)
-  {
-    Map<Matrix<float, Dynamic, Dynamic, RowMajor> > tmp(jacobians_array + i * cols * 6, 6, cols);
+    Map<Matrix<float, Dynamic, Dynamic, RowMajor> > tmp(jacobians_array + i * num_dofs * 6, 6, num_dofs);
+    // Eigen only reallocates when the size differs
+    jacobians[i].resize(6, num_dofs);
     jacobians[i] = tmp;
   }
-  delete[] jacobians_array;
 }
 void Kinematics::getJacobianEndEffector(HebiFrameType frame_type, const Eigen::VectorXd& positions, Eigen::MatrixXf& jacobian) const
 {
@@ -207,15 +263,172 @@ void Kinematics::getJacobianEndEffector(HebiFrameType frame_type, const Eigen::V
 }
 void Kinematics::getJEndEffector(HebiFrameType frame_type, const Eigen::VectorXd& positions, Eigen::MatrixXf& jacobian) const
 {
-  MatrixXfVector tmp_jacobians;
-  getJacobians(frame_type, positions, tmp_jacobians);
-
-  // NOTE: could make this more efficient by writing additional lib function
-  // for this, instead of tossing away almost everything from the full one!
+  KinematicsWorkspace workspace(*this);
+  getJEndEffector(frame_type, positions, jacobian, workspace);
+}
+void Kinematics::getJEndEffector(HebiFrameType frame_type, const Eigen::VectorXd& positions, Eigen::MatrixXf& jacobian, KinematicsWorkspace& workspace) const
+{
+  Eigen::Matrix4f transform;
+  getEndEffectorAndJ(frame_type, positions, transform, jacobian, workspace);
+}
 
-  int num_dofs = positions.size();
+void Kinematics::getEndEffectorAndJ(HebiFrameType frame_type, const Eigen::VectorXd& positions, Eigen::Matrix4f& transform, Eigen::MatrixXf& jacobian) const
+{
+  KinematicsWorkspace workspace(*this);
+  getEndEffectorAndJ(frame_type, positions, transform, jacobian, workspace);
+}
+void Kinematics::getEndEffectorAndJ(HebiFrameType frame_type, const Eigen::VectorXd& positions, Eigen::Matrix4f& transform, Eigen::MatrixXf& jacobian, KinematicsWorkspace& workspace) const
+{
+  size_t num_frames = getFrameCount(FrameTypeOutput);
+  size_t num_dofs = positions.size();
+  workspace.reserve(std::max(num_frames, getFrameCount(FrameTypeCenterOfMass)), num_dofs);
   jacobian.resize(6, num_dofs);
-  jacobian = *tmp_jacobians.rbegin();
+  bool known = (bodies_.size() == num_frames && num_frames > 0);
+  for (const auto& body : bodies_)
+    known = known && body.type != KinematicBody::Parameters::Unknown;
+
+  if (!known)
+  {
+    // No joint frames to work from: keep the tip of the C API's Jacobians
+    getEndEffector(frame_type, positions, transform);
+    size_t num_jacobians = getFrameCount(frame_type);
+    if (num_jacobians == 0)
+      return;
+    float* jacobians_array = workspace.jacobians_.data();
+    hebiKinematicsGetJacobians(internal_, frame_type, positions.data(), jacobians_array);
+    Map<Matrix<float, Dynamic, Dynamic, RowMajor> > tmp(jacobians_array + (num_jacobians - 1) * num_dofs * 6, 6, num_dofs);
+    jacobian = tmp;
+    return;
+  }
+
+  float* frame_array = workspace.frames_.data();
+  hebiKinematicsGetForwardKinematics(internal_, FrameTypeOutput, positions.data(), frame_array);
+  if (frame_type == FrameTypeOutput)
+  {
+    Map<Matrix<float, 4, 4, RowMajor> > tmp(frame_array + (num_frames - 1) * 16);
+    transform = tmp;
+  }
+  else
+  {
+    getEndEffector(frame_type, positions, transform);
+  }
+  Eigen::Vector3f tip = transform.topRightCorner<3, 1>();
+
+  // Each joint's frame is its body's output frame without joint_to_output
+  size_t joint = 0;
+  for (size_t i = 0; i < num_frames && joint < num_dofs; ++i)
+  {
+    const KinematicBody::Parameters& body = bodies_[i];
+    if (body.type != KinematicBody::Parameters::Actuator)
+      continue;
+    Map<const Matrix<float, 4, 4, RowMajor> > output(frame_array + i * 16);
+    Map<const Matrix<float, 4, 4, RowMajor> > joint_to_output(body.output);
+    Eigen::Matrix3f rotation = output.topLeftCorner<3, 3>() * joint_to_output.topLeftCorner<3, 3>().transpose();
+    Eigen::Vector3f origin = output.topRightCorner<3, 1>() - rotation * joint_to_output.topRightCorner<3, 1>();
+    Eigen::Vector3f axis = rotation * Map<const Eigen::Vector3f>(body.joint_rotation_axis);
+    jacobian.block<3, 1>(0, joint) = axis.cross(tip - origin);
+    jacobian.block<3, 1>(3, joint) = axis;
+    ++joint;
+  }
+}
+
+////////////////////////// Kinematics Batch
+
+namespace {
+// Below this many configurations per range, handing it to the pool costs
+// more than it saves
+const size_t MIN_CONFIGURATIONS_PER_THREAD = 16;
+}
+
+KinematicsBatch::KinematicsBatch(const Kinematics& kinematics, size_t threads)
+  : source_(kinematics)
+{
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t i = 0; i < threads; ++i)
+  {
+    auto copy = kinematics.clone();
+    if (!copy)
+    {
+      clones_.clear();
+      workspaces_.clear();
+      workspaces_.emplace_back(new KinematicsWorkspace(kinematics));
+      return;
+    }
+    workspaces_.emplace_back(new KinematicsWorkspace(*copy));
+    clones_.push_back(std::move(copy));
+  }
+  // The calling thread takes a range itself, so the pool holds the others
+  if (threads > 1)
+    pool_.reset(new ThreadPool(threads - 1));
+}
+
+KinematicsBatch::~KinematicsBatch() noexcept
+{
+}
+
+template<typename Work>
+void KinematicsBatch::run(size_t count, Work work)
+{
+  size_t threads = std::min(getThreadCount(), std::max<size_t>(1, count / MIN_CONFIGURATIONS_PER_THREAD));
+  if (clones_.empty())
+  {
+    work(source_, *workspaces_[0], 0, count);
+    return;
+  }
+  size_t chunk = (count + threads - 1) / std::max<size_t>(1, threads);
+  if (threads == 1)
+  {
+    work(*clones_[0], *workspaces_[0], 0, count);
+    return;
+  }
+  // Range t always runs on clone t, whichever thread picks it up
+  pool_->parallelFor(threads, [this, &work, chunk, count](size_t t)
+  {
+    size_t begin = std::min(count, t * chunk);
+    size_t end = std::min(count, begin + chunk);
+    work(*clones_[t], *workspaces_[t], begin, end);
+  });
+}
+
+void KinematicsBatch::getEndEffectors(HebiFrameType frame_type, const Eigen::MatrixXd& positions, Matrix4fVector& transforms)
+{
+  size_t count = positions.cols();
+  if (transforms.size() != count)
+    transforms.resize(count);
+  run(count, [frame_type, &positions, &transforms](const Kinematics& kinematics, KinematicsWorkspace&, size_t begin, size_t end)
+  {
+    float transform_array[16];
+    for (size_t i = begin; i < end; ++i)
+    {
+      // Columns of a column-major matrix are contiguous; the C API reads them in place
+      hebiKinematicsGetEndEffector(kinematics.internal_, frame_type, positions.col(i).data(), transform_array);
+      Map<Matrix<float, 4, 4, RowMajor> > tmp(transform_array);
+      transforms[i] = tmp;
+    }
+  });
+}
+
+void KinematicsBatch::getFK(HebiFrameType frame_type, const Eigen::MatrixXd& positions, Matrix4fVector& frames)
+{
+  size_t count = positions.cols();
+  size_t num_frames = source_.getFrameCount(frame_type);
+  if (frames.size() != count * num_frames)
+    frames.resize(count * num_frames);
+  run(count, [frame_type, num_frames, &positions, &frames](const Kinematics& kinematics, KinematicsWorkspace& workspace, size_t begin, size_t end)
+  {
+    workspace.reserve(num_frames, positions.rows());
+    float* frame_array = workspace.frames_.data();
+    for (size_t i = begin; i < end; ++i)
+    {
+      hebiKinematicsGetForwardKinematics(kinematics.internal_, frame_type, positions.col(i).data(), frame_array);
+      for (size_t f = 0; f < num_frames; ++f)
+      {
+        Map<Matrix<float, 4, 4, RowMajor> > tmp(frame_array + f * 16);
+        frames[i * num_frames + f] = tmp;
+      }
+    }
+  });
 }
 
 } // namespace kinematics
@@ -4,6 +4,7 @@
 #include "hebi_kinematics.h"
 #include "Eigen/Eigen"
 #include "util.hpp"
+#include "../ThreadPool.h"
 #include <vector>
 #include <memory>
 
@@ -16,17 +17,98 @@ typedef std::vector<Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > Matrix
 typedef std::vector<MatrixXf, Eigen::aligned_allocator<Eigen::MatrixXf> > MatrixXfVector;
 
 class Kinematics;
+class KinematicsBatch;
+
+/**
+ * \brief Scratch space for the Kinematics calls that take one, so that they do
+ * not allocate.
+ *
+ * The C API writes transforms and Jacobians in row-major arrays; the workspace
+ * holds those arrays between calls. Size it once for a Kinematics object and
+ * reuse it on every call (one workspace per thread). If bodies are added later,
+ * the workspace grows on the next call that needs more room.
+ */
+class KinematicsWorkspace
+{
+  friend Kinematics;
+  friend KinematicsBatch;
+
+  public:
+    /**
+     * \brief Creates a workspace sized for the bodies currently in the given
+     * kinematics object.
+     */
+    explicit KinematicsWorkspace(const Kinematics& kinematics);
+
+    /**
+     * \brief Resizes the workspace for the bodies currently in the given
+     * kinematics object.
+     */
+    void resize(const Kinematics& kinematics);
+
+  private:
+    /**
+     * Grows the arrays if they cannot hold num_frames frames of num_dofs
+     * degrees of freedom; never shrinks them.
+     */
+    void reserve(size_t num_frames, size_t num_dofs);
+
+    std::vector<float> frames_;
+    std::vector<float> jacobians_;
+};
 
 class KinematicBody
 {
   friend Kinematics;
 
+  public:
+    /**
+     * \brief The parameters a body was created from, in the layout of the C
+     * API (transforms are 4x4 row-major).
+     *
+     * Kept so that a kinematic chain can be rebuilt or evaluated without the C
+     * objects; see Kinematics::clone.
+     */
+    struct Parameters
+    {
+      enum Type
+      {
+        Unknown,   //!< Wrapped from a C object directly; cannot be rebuilt
+        Actuator,  //!< One rotary joint: input_to_joint, rotation, joint_to_output
+        StaticBody //!< A fixed transform: output
+      };
+      Type type;
+      float com[3];
+      float input_to_joint[16];
+      float joint_rotation_axis[3];
+      float output[16]; //!< joint to output for actuators, input to output for static bodies
+      float mass;       //!< kg; only used for dynamics
+      float inertia[6]; //!< kg m^2 about the center of mass, in the input frame: xx, yy, zz, xy, xz, yz
+    };
+
+    /**
+     * \brief Creates a body from parameters, as returned by getParameters.
+     *
+     * Returns nullptr for a body of Unknown type.
+     */
+    static std::unique_ptr<KinematicBody> create(const Parameters& parameters);
+
+    /**
+     * \brief Returns the parameters this body was created from.
+     */
+    const Parameters& getParameters() const { return parameters_; }
+
   private:
     /**
      * C-style kinematic body object
      */
     HebiBodyPtr internal_;
 
+    /**
+     * How the body was created; type Unknown if not through a factory method.
+     */
+    Parameters parameters_;
+
     /**
      * 'true' if this object is responsible for cleaning up its internal C
      * object, false otherwise.
@@ -50,7 +132,11 @@ class KinematicBody
      * Base constructor called from factory methods to create instances of the
      * KinematicBody class; wraps a C kinematic body object.
      */
-    KinematicBody(HebiBodyPtr internal) : internal_(internal) {};
+    KinematicBody(HebiBodyPtr internal) : internal_(internal) { parameters_.type = Parameters::Unknown; };
+    /**
+     * Wraps a C kinematic body object created from the given parameters.
+     */
+    KinematicBody(HebiBodyPtr internal, const Parameters& parameters) : internal_(internal), parameters_(parameters) {};
     #endif // DOXYGEN_OMIT_INTERNAL
 
   public:
@@ -66,6 +152,8 @@ class KinematicBody
    
     /**
      * \brief Creates a body with the kinematics of an X5 actuator.
+     *
+     * Its mass is 0.315 kg, with the inertia of a uniform 110 x 74 x 45 mm box.
      */ 
     static std::unique_ptr<KinematicBody> createX5();
 
@@ -80,6 +168,9 @@ class KinematicBody
      * between the two actuators, and a pi radian rotation will result in the
      * actuator interfaces to this tube being in the same plane, but the
      * rotational axes being anti-parallel.
+     *
+     * Its mass is an estimate of 0.4 kg/m of tube plus 0.26 kg of brackets, with
+     * the inertia of a uniform rod along the tube.
      */ 
     static std::unique_ptr<KinematicBody> createX5Link(float length, float twist);
 
@@ -91,24 +182,34 @@ class KinematicBody
      * of the kinematic body.
      * \param output 4x4 matrix of the homogeneous transform to the output frame,
      * relative to the input frame of the kinematic body.
+     * \param mass The mass in kg, as a point mass at the center of mass; for
+     * dynamics only. Set Parameters::inertia and use create for a full inertia.
      */ 
-    static std::unique_ptr<KinematicBody> createGenericLink(const Eigen::Vector3f& com, const Eigen::Matrix4f& output);
+    static std::unique_ptr<KinematicBody> createGenericLink(const Eigen::Vector3f& com, const Eigen::Matrix4f& output, float mass = 0);
 };
 
 /**
  * \brief Represents a kinematic chain or tree of bodies (links and joints and
  * modules).
  *
- * (Currently, only kinematic chains are fully supported).
+ * (Currently, only kinematic chains are fully supported; see KinematicTree for
+ * trees).
  */
 class Kinematics final
 {
+  friend KinematicsBatch;
+
   private:
     /**
      * C-style kinematics object
      */
     const HebiKinematicsPtr internal_;
 
+    /**
+     * Parameters of the added bodies, in the order they were added.
+     */
+    std::vector<KinematicBody::Parameters> bodies_;
+
   public:
     /**
      * \brief Creates a kinematics object with no bodies and an identity base
@@ -170,6 +271,24 @@ class Kinematics final
      */
     bool addBody(std::unique_ptr<KinematicBody> new_body);
 
+    /**
+     * \brief Creates a separate kinematics object with the same bodies and
+     * base frame.
+     *
+     * The C kinematics object is not reentrant: calls on one object must not
+     * overlap, even the const ones. Give each thread its own clone instead.
+     *
+     * \returns nullptr if a body was not created through one of the
+     * KinematicBody factory methods, and so cannot be rebuilt.
+     */
+    std::unique_ptr<Kinematics> clone() const;
+
+    /**
+     * \brief Returns the parameters of the added bodies, in the order they
+     * were added.
+     */
+    const std::vector<KinematicBody::Parameters>& getBodies() const { return bodies_; }
+
     /**
      * \brief Generates the forward kinematics for the given kinematic tree.
      *
@@ -202,6 +321,14 @@ class Kinematics final
      * frame. Note that the number of frames depends on the frame type.
      */
     void getFK(HebiFrameType, const Eigen::VectorXd& positions, Matrix4fVector& frames) const;
+    /**
+     * \brief Generates the forward kinematics for the given kinematic tree
+     * without allocating.
+     *
+     * As getFK above; frames is only resized when its length differs from the
+     * number of frames, so reusing it and the workspace keeps calls heap-free.
+     */
+    void getFK(HebiFrameType, const Eigen::VectorXd& positions, Matrix4fVector& frames, KinematicsWorkspace& workspace) const;
 
     /**
      * \brief Generates the forward kinematics to the end effector (leaf node)
@@ -222,6 +349,8 @@ class Kinematics final
      * \param transform A 4x4 transform that is resized as necessary in the
      * function and filled in with the homogeneous transform to the end
      * effector frame.
+     *
+     * Does not allocate.
      */
     void getEndEffector(HebiFrameType, const Eigen::VectorXd& positions, Eigen::Matrix4f& transform) const;
 
@@ -247,6 +376,8 @@ class Kinematics final
      * \param result A vector equal in length to the number of DoFs of the
      * kinematic tree; this will be filled in with the IK solution (in SI units
      * of meters or radians), and resized as necessary.
+     *
+     * Does not allocate once result has the number of DoFs as its size.
      */
     void solveIK(const Eigen::Vector3f& target_xyz, const Eigen::VectorXd& initial_positions, Eigen::VectorXd& result) const;
 
@@ -270,6 +401,14 @@ class Kinematics final
      * necessary inside this function.
      */
     void getJ(HebiFrameType, const Eigen::VectorXd& positions, MatrixXfVector& jacobians) const;
+    /**
+     * \brief Generates the Jacobian for each frame in the given kinematic tree
+     * without allocating.
+     *
+     * As getJ above; jacobians and its matrices are only resized when their
+     * sizes differ, so reusing them and the workspace keeps calls heap-free.
+     */
+    void getJ(HebiFrameType, const Eigen::VectorXd& positions, MatrixXfVector& jacobians, KinematicsWorkspace& workspace) const;
 
     /**
      * \brief Generates the Jacobian for the end effector (leaf node) frames(s).
@@ -297,8 +436,46 @@ class Kinematics final
      * \param jacobian A (6 x number of dofs) jacobian matrix for the
      * corresponding end effector frame of reference on the robot.  This vector
      * is resized as necessary inside this function.
+     *
+     * Only the end effector's Jacobian is computed, analytically from one
+     * forward kinematics pass; see getEndEffectorAndJ.
      */
     void getJEndEffector(HebiFrameType, const Eigen::VectorXd& positions, Eigen::MatrixXf& jacobian) const;
+    /**
+     * \brief Generates the Jacobian for the end effector frame without
+     * allocating once jacobian has its (6 x number of dofs) size.
+     */
+    void getJEndEffector(HebiFrameType, const Eigen::VectorXd& positions, Eigen::MatrixXf& jacobian, KinematicsWorkspace& workspace) const;
+
+    /**
+     * \brief Generates the end effector transform and Jacobian together.
+     *
+     * Both come from a single forward kinematics pass over the output frames:
+     * each joint's world axis and origin are recovered from its body's output
+     * frame, and its column of the Jacobian is axis x (end effector - origin)
+     * over the axis (linear velocity in rows 0-2, angular in rows 3-5, in the
+     * world frame). This is exact, where getJ estimates every frame's Jacobian
+     * numerically; the two agree to about 1e-3.
+     *
+     * For a chain with a body that was not created through a KinematicBody
+     * factory method, the joint frames are unknown and this falls back on
+     * getJ and getEndEffector.
+     *
+     * \param frame_type Which type of frame to consider -- see HebiFrameType
+     * enum.
+     * \param positions A vector of joint positions/angles (in SI units of
+     * meters or radians) equal in length to the number of DoFs of the kinematic
+     * tree.
+     * \param transform The 4x4 homogeneous transform of the end effector frame.
+     * \param jacobian The (6 x number of dofs) jacobian of the end effector
+     * frame; resized as necessary.
+     */
+    void getEndEffectorAndJ(HebiFrameType, const Eigen::VectorXd& positions, Eigen::Matrix4f& transform, Eigen::MatrixXf& jacobian) const;
+    /**
+     * \brief Generates the end effector transform and Jacobian together,
+     * without allocating once jacobian has its (6 x number of dofs) size.
+     */
+    void getEndEffectorAndJ(HebiFrameType, const Eigen::VectorXd& positions, Eigen::Matrix4f& transform, Eigen::MatrixXf& jacobian, KinematicsWorkspace& workspace) const;
 
   private:
     /**
@@ -307,6 +484,92 @@ class Kinematics final
     HEBI_DISABLE_COPY_MOVE(Kinematics)
 };
 
+/**
+ * \brief Evaluates a kinematic chain for many joint configurations at once,
+ * on several threads.
+ *
+ * Each range of the configurations is evaluated on its own clone of the chain
+ * (see Kinematics::clone) with its own workspace, on the calling thread and
+ * the batch's ThreadPool. The clones and the pool are made when the batch is
+ * created; later changes to the source object are not seen. Calls on one
+ * batch must not overlap.
+ */
+class KinematicsBatch final
+{
+  public:
+    /**
+     * \brief Prepares a batch evaluator for the given chain.
+     *
+     * \param kinematics The chain to evaluate; every body must have been
+     * created through a KinematicBody factory method (otherwise the batch runs
+     * on one thread, on the source object itself, which must then outlive it).
+     * \param threads How many threads share a call, including the calling
+     * one; 0 uses one per hardware thread.
+     */
+    KinematicsBatch(const Kinematics& kinematics, size_t threads = 0);
+
+    /**
+     * \brief Destructor; the clones are released.
+     */
+    ~KinematicsBatch() noexcept;
+
+    /**
+     * \brief Returns how many threads share a call.
+     */
+    size_t getThreadCount() const { return clones_.empty() ? 1 : clones_.size(); }
+
+    /**
+     * \brief Generates the end effector transform for every configuration.
+     *
+     * \param frame_type Which type of frame to consider -- see HebiFrameType enum.
+     * \param positions A (number of dofs x N) matrix, one configuration of
+     * joint positions/angles (in SI units of meters or radians) per column.
+     * \param transforms Resized to N if necessary and filled in with the end
+     * effector transform of each column.
+     */
+    void getEndEffectors(HebiFrameType frame_type, const Eigen::MatrixXd& positions, Matrix4fVector& transforms);
+
+    /**
+     * \brief Generates the forward kinematics of every frame for every
+     * configuration.
+     *
+     * \param frame_type Which type of frame to consider -- see HebiFrameType enum.
+     * \param positions A (number of dofs x N) matrix, one configuration of
+     * joint positions/angles (in SI units of meters or radians) per column.
+     * \param frames Resized to N times the number of frames if necessary; the
+     * frames of column i are at [i * number of frames, (i + 1) * number of
+     * frames), in the order of Kinematics::getFK.
+     */
+    void getFK(HebiFrameType frame_type, const Eigen::MatrixXd& positions, Matrix4fVector& frames);
+
+  private:
+    /**
+     * Runs work(kinematics, workspace, begin, end) over [0, count), split in
+     * contiguous ranges, one per clone, through ThreadPool::parallelFor.
+     */
+    template<typename Work>
+    void run(size_t count, Work work);
+
+    /**
+     * The chain to fall back to when it cannot be cloned.
+     */
+    const Kinematics& source_;
+
+    std::vector<std::unique_ptr<Kinematics> > clones_;
+    std::vector<std::unique_ptr<KinematicsWorkspace> > workspaces_;
+
+    /**
+     * The helpers of the calling thread, one fewer than the clones; null when
+     * a call runs on one thread.
+     */
+    std::unique_ptr<ThreadPool> pool_;
+
+    /**
+     * Disable copy and move constructors and assignment operators
+     */
+    HEBI_DISABLE_COPY_MOVE(KinematicsBatch)
+};
+
 } // namespace kinematics
 } // namespace hebi
 
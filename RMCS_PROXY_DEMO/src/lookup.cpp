@@ -1,6 +1,7 @@
 #include "lookup.hpp"
 #include <algorithm> // For std::transform
 #include <iterator> // For std::back_inserter on Windows.
+#include "../Trace.h"
 
 namespace hebi {
 
@@ -21,6 +22,7 @@ void Lookup::printTable()
 
 std::unique_ptr<Group> Lookup::getGroupFromNames(const std::vector<std::string>& names, const std::vector<std::string>& families, long timeout_ms)
 {
+  TRACE_SCOPE("lookup_group");
   std::unique_ptr<Group> ptr;
   std::vector<const char *> names_cstrs;
   std::vector<const char *> families_cstrs;
@@ -113,6 +115,7 @@ int Lookup::EntryList::size()
 
 std::unique_ptr<Lookup::EntryList> Lookup::getEntryList()
 {
+  TRACE_SCOPE("lookup_entries");
   std::unique_ptr<Lookup::EntryList> ptr;
   auto entry_list = hebiLookupCreateLookupEntryList(lookup_);
   if (entry_list != nullptr)
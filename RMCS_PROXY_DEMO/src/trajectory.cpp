@@ -1,8 +1,254 @@
 #include "trajectory.hpp"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <thread>
 
 namespace hebi {
 namespace trajectory {
 
+namespace {
+// The quintic (constant term first, in the time since the segment's start)
+// with the given position, velocity and acceleration at both ends of a
+// segment h long
+void quinticFromStates(double h, double p0, double v0, double a0, double p1, double v1, double a1, double* c)
+{
+  double dp = p1 - (p0 + v0 * h + a0 * h * h / 2);
+  double dv = v1 - (v0 + a0 * h);
+  double da = a1 - a0;
+  c[0] = p0;
+  c[1] = v0;
+  c[2] = a0 / 2;
+  c[3] = (10 * dp - 4 * dv * h + da * h * h / 2) / (h * h * h);
+  c[4] = (-15 * dp + 7 * dv * h - da * h * h) / (h * h * h * h);
+  c[5] = (6 * dp - 3 * dv * h + da * h * h / 2) / (h * h * h * h * h);
+}
+
+// Position, velocity and acceleration of a quintic; nullptr outputs are
+// skipped
+inline void evaluateQuintic(const double* c, double x, double* position, double* velocity, double* acceleration)
+{
+  if (position != nullptr)
+    *position = ((((c[5] * x + c[4]) * x + c[3]) * x + c[2]) * x + c[1]) * x + c[0];
+  if (velocity != nullptr)
+    *velocity = (((5 * c[5] * x + 4 * c[4]) * x + 3 * c[3]) * x + 2 * c[2]) * x + c[1];
+  if (acceleration != nullptr)
+    *acceleration = ((20 * c[5] * x + 12 * c[4]) * x + 6 * c[3]) * x + 2 * c[2];
+}
+
+/**
+ * The minimum jerk problem through one time vector, for joints whose free
+ * (NAN) waypoint values are in the same places.
+ *
+ * The unknowns are the position, velocity and acceleration at every waypoint
+ * (value 3 * w + k, k = 0, 1, 2); each segment is the quintic between its
+ * end states, so these are continuous by construction. The integral of the
+ * squared jerk is quadratic in them, with a Hessian that depends on the times
+ * only; minimizing it over the free values, with the others given, is the
+ * linear system Hff x_free = -Hfk x_known.
+ */
+struct QpSystem
+{
+  VectorXd times;
+  std::vector<char> free;
+  std::vector<int> free_values;
+  std::vector<int> known_values;
+  LDLT<MatrixXd> factorization; // Hff
+  MatrixXd coupling;            // Hfk
+};
+
+// Times must be finite and increasing. Jerk does not see a quadratic through
+// all of them, so the known values must pin one down; otherwise there is no
+// unique minimum
+std::shared_ptr<const QpSystem> createQpSystem(const VectorXd& times, const std::vector<char>& free)
+{
+  const int num_waypoints = times.size();
+  const int num_values = 3 * num_waypoints;
+  if (num_waypoints < 2 || !std::isfinite(times[0]))
+    return nullptr;
+  for (int w = 1; w < num_waypoints; ++w)
+  {
+    if (!std::isfinite(times[w]) || !(times[w] > times[w - 1]))
+      return nullptr;
+  }
+
+  std::shared_ptr<QpSystem> system(new QpSystem());
+  system->times = times;
+  system->free = free;
+  double duration = times[num_waypoints - 1] - times[0];
+  MatrixXd quadratics(num_values, 3);
+  quadratics.setZero();
+  for (int value = 0; value < num_values; ++value)
+  {
+    if (free[value])
+    {
+      system->free_values.push_back(value);
+      continue;
+    }
+    system->known_values.push_back(value);
+    double t = (times[value / 3] - times[0]) / duration;
+    if (value % 3 == 0)
+      quadratics.row(value) << 1, t, t * t;
+    else if (value % 3 == 1)
+      quadratics.row(value) << 0, 1, 2 * t;
+    else
+      quadratics(value, 2) = 2;
+  }
+  if (ColPivHouseholderQR<MatrixXd>(quadratics).rank() < 3)
+    return nullptr;
+
+  // The jerk Hessian, segment by segment: G is that of the coefficients,
+  // M maps the end states to them
+  MatrixXd hessian = MatrixXd::Zero(num_values, num_values);
+  for (int s = 0; s + 1 < num_waypoints; ++s)
+  {
+    double h = times[s + 1] - times[s];
+    Matrix<double, 6, 6> m;
+    for (int k = 0; k < 6; ++k)
+    {
+      double states[6] = { 0, 0, 0, 0, 0, 0 };
+      states[k] = 1;
+      quinticFromStates(h, states[0], states[1], states[2], states[3], states[4], states[5], m.col(k).data());
+    }
+    Matrix<double, 6, 6> g = Matrix<double, 6, 6>::Zero();
+    g(3, 3) = 36 * h;
+    g(3, 4) = g(4, 3) = 72 * h * h;
+    g(3, 5) = g(5, 3) = 120 * h * h * h;
+    g(4, 4) = 192 * h * h * h;
+    g(4, 5) = g(5, 4) = 360 * h * h * h * h;
+    g(5, 5) = 720 * h * h * h * h * h;
+    hessian.block<6, 6>(3 * s, 3 * s) += m.transpose() * g * m;
+  }
+
+  const int num_free = system->free_values.size();
+  const int num_known = system->known_values.size();
+  MatrixXd free_block(num_free, num_free);
+  system->coupling.resize(num_free, num_known);
+  for (int i = 0; i < num_free; ++i)
+  {
+    for (int j = 0; j < num_free; ++j)
+      free_block(i, j) = hessian(system->free_values[i], system->free_values[j]);
+    for (int j = 0; j < num_known; ++j)
+      system->coupling(i, j) = hessian(system->free_values[i], system->known_values[j]);
+  }
+  if (num_free > 0)
+  {
+    system->factorization.compute(free_block);
+    if (system->factorization.info() != Success)
+      return nullptr;
+  }
+  return system;
+}
+
+// Systems of the last few time vectors and free value patterns, most recent
+// first; replanning through the same times reuses them
+const size_t QP_CACHE_SIZE = 8;
+std::mutex qp_cache_lock;
+std::vector<std::shared_ptr<const QpSystem> > qp_cache;
+
+std::shared_ptr<const QpSystem> findQpSystem(const VectorXd& times, const std::vector<char>& free)
+{
+  {
+    std::lock_guard<std::mutex> guard(qp_cache_lock);
+    for (size_t i = 0; i < qp_cache.size(); ++i)
+    {
+      std::shared_ptr<const QpSystem> system = qp_cache[i];
+      if (system->free == free && system->times.size() == times.size() && system->times == times)
+      {
+        qp_cache.erase(qp_cache.begin() + i);
+        qp_cache.insert(qp_cache.begin(), system);
+        return system;
+      }
+    }
+  }
+  // Factored outside the lock; two threads may both build one, which is
+  // harmless
+  std::shared_ptr<const QpSystem> system = createQpSystem(times, free);
+  if (system)
+  {
+    std::lock_guard<std::mutex> guard(qp_cache_lock);
+    qp_cache.insert(qp_cache.begin(), system);
+    if (qp_cache.size() > QP_CACHE_SIZE)
+      qp_cache.pop_back();
+  }
+  return system;
+}
+
+// Solves every joint natively: joints with the same free values share one
+// system, and are solved together as the columns of one right hand side.
+// False if any value is infinite or a system has no unique solution, which
+// is left to the C library
+bool solveMinimumJerk(const VectorXd& times, const MatrixXd& positions, const MatrixXd* velocities,
+  const MatrixXd* accelerations, MatrixXd& coefficients)
+{
+  const int num_joints = positions.rows();
+  const int num_waypoints = positions.cols();
+  const int num_values = 3 * num_waypoints;
+  const MatrixXd* given[3] = { &positions, velocities, accelerations };
+  MatrixXd values(num_values, num_joints);
+  std::vector<std::vector<char> > patterns;
+  std::vector<std::vector<int> > members;
+  for (int joint = 0; joint < num_joints; ++joint)
+  {
+    std::vector<char> free(num_values);
+    for (int value = 0; value < num_values; ++value)
+    {
+      const MatrixXd* matrix = given[value % 3];
+      double v = matrix == nullptr ? NAN : (*matrix)(joint, value / 3);
+      if (std::isinf(v))
+        return false;
+      free[value] = std::isnan(v);
+      values(value, joint) = v;
+    }
+    size_t group = std::find(patterns.begin(), patterns.end(), free) - patterns.begin();
+    if (group == patterns.size())
+    {
+      patterns.push_back(free);
+      members.push_back(std::vector<int>());
+    }
+    members[group].push_back(joint);
+  }
+
+  for (size_t group = 0; group < patterns.size(); ++group)
+  {
+    std::shared_ptr<const QpSystem> system = findQpSystem(times, patterns[group]);
+    if (!system)
+      return false;
+    const std::vector<int>& joints = members[group];
+    const int num_free = system->free_values.size();
+    const int num_known = system->known_values.size();
+    if (num_free == 0)
+      continue;
+    MatrixXd known(num_known, joints.size());
+    for (size_t j = 0; j < joints.size(); ++j)
+    {
+      for (int k = 0; k < num_known; ++k)
+        known(k, j) = values(system->known_values[k], joints[j]);
+    }
+    MatrixXd solved = system->factorization.solve(-system->coupling * known);
+    for (size_t j = 0; j < joints.size(); ++j)
+    {
+      for (int f = 0; f < num_free; ++f)
+        values(system->free_values[f], joints[j]) = solved(f, j);
+    }
+  }
+  if (!values.allFinite())
+    return false;
+
+  coefficients.resize(6 * (num_waypoints - 1), num_joints);
+  for (int joint = 0; joint < num_joints; ++joint)
+  {
+    const double* states = values.col(joint).data();
+    for (int s = 0; s + 1 < num_waypoints; ++s, states += 3)
+    {
+      quinticFromStates(times[s + 1] - times[s], states[0], states[1], states[2], states[3], states[4], states[5],
+        coefficients.col(joint).data() + 6 * s);
+    }
+  }
+  return true;
+}
+}
+
 Trajectory::Trajectory(std::vector<HebiTrajectoryPtr> trajectories, int number_of_waypoints, double start_time, double end_time)
   : trajectories_(trajectories),
     number_of_joints_ (trajectories.size()),
@@ -12,6 +258,16 @@ Trajectory::Trajectory(std::vector<HebiTrajectoryPtr> trajectories, int number_o
 {
 }
 
+Trajectory::Trajectory(const VectorXd& time_vector, MatrixXd& coefficients)
+  : number_of_joints_(coefficients.cols()),
+    number_of_waypoints_(time_vector.size()),
+    start_time_(time_vector[0]),
+    end_time_(time_vector[time_vector.size() - 1]),
+    segment_times_(time_vector)
+{
+  coefficients_.swap(coefficients);
+}
+
 std::unique_ptr<Trajectory> Trajectory::createUnconstrainedQp(
   const VectorXd& time_vector,
   const MatrixXd& positions,
@@ -25,41 +281,43 @@ std::unique_ptr<Trajectory> Trajectory::createUnconstrainedQp(
   int num_waypoints = positions.cols();
   if (time_vector.size() != num_waypoints)
     return res;
-  if (velocities != nullptr && (velocities->rows() != num_joints && velocities->cols() != num_waypoints))
+  if (velocities != nullptr && (velocities->rows() != num_joints || velocities->cols() != num_waypoints))
     return res;
-  if (accelerations != nullptr && (accelerations->rows() != num_joints && accelerations->cols() != num_waypoints))
+  if (accelerations != nullptr && (accelerations->rows() != num_joints || accelerations->cols() != num_waypoints))
     return res;
 
-  // Put data into C-style arrays:
-  double* time_vector_c = nullptr;
-  double* positions_c = nullptr;
-  double* velocities_c = nullptr;
-  double* accelerations_c = nullptr;
-  time_vector_c = new double[num_joints * num_waypoints];
+  // Solve natively if possible
+  if (num_joints > 0)
   {
-    Map<Matrix<double, Dynamic, Dynamic, RowMajor> > tmp(time_vector_c, num_waypoints, 1);
-    tmp = time_vector;
-  } 
-  positions_c = new double[num_joints * num_waypoints];
+    MatrixXd coefficients;
+    if (solveMinimumJerk(time_vector, positions, velocities, accelerations, coefficients))
+    {
+      res.reset(new Trajectory(time_vector, coefficients));
+      return res;
+    }
+  }
+
+  // Otherwise, let the C library solve (or reject) each joint. Put data into
+  // C-style arrays:
+  std::vector<double> time_vector_c(time_vector.data(), time_vector.data() + num_waypoints);
+  std::vector<double> positions_c(num_joints * num_waypoints);
   {
-    Map<Matrix<double, Dynamic, Dynamic, RowMajor> > tmp(positions_c, num_joints, num_waypoints);
+    Map<Matrix<double, Dynamic, Dynamic, RowMajor> > tmp(positions_c.data(), num_joints, num_waypoints);
     tmp = positions;
   } 
+  std::vector<double> velocities_c;
   if (velocities != nullptr)
   {
-    velocities_c = new double[num_joints * num_waypoints];
-    {
-      Map<Matrix<double, Dynamic, Dynamic, RowMajor> > tmp(velocities_c, num_joints, num_waypoints);
-      tmp = *velocities;
-    }
+    velocities_c.resize(num_joints * num_waypoints);
+    Map<Matrix<double, Dynamic, Dynamic, RowMajor> > tmp(velocities_c.data(), num_joints, num_waypoints);
+    tmp = *velocities;
   }
+  std::vector<double> accelerations_c;
   if (accelerations != nullptr)
   {
-    accelerations_c = new double[num_joints * num_waypoints];
-    {
-      Map<Matrix<double, Dynamic, Dynamic, RowMajor> > tmp(accelerations_c, num_joints, num_waypoints);
-      tmp = *accelerations;
-    }
+    accelerations_c.resize(num_joints * num_waypoints);
+    Map<Matrix<double, Dynamic, Dynamic, RowMajor> > tmp(accelerations_c.data(), num_joints, num_waypoints);
+    tmp = *accelerations;
   }
 
   // Build C trajectory objects
@@ -67,10 +325,10 @@ std::unique_ptr<Trajectory> Trajectory::createUnconstrainedQp(
   for (int i = 0; i < num_joints; ++i)
   {
     HebiTrajectoryPtr trajectory = hebiTrajectoryCreateUnconstrainedQp(num_waypoints,
-      (positions_c + i * num_waypoints),
-      velocities_c == nullptr ? nullptr : (velocities_c + i * num_waypoints),
-      accelerations_c == nullptr ? nullptr : (accelerations_c + i * num_waypoints),
-      time_vector_c);
+      positions_c.data() + i * num_waypoints,
+      velocities_c.empty() ? nullptr : velocities_c.data() + i * num_waypoints,
+      accelerations_c.empty() ? nullptr : accelerations_c.data() + i * num_waypoints,
+      time_vector_c.data());
     // Failure? cleanup previous trajectories
     if (trajectory == nullptr)
     {
@@ -83,14 +341,9 @@ std::unique_ptr<Trajectory> Trajectory::createUnconstrainedQp(
     trajectories[i] = trajectory;
   }
 
-  delete[] positions_c;
-  if (velocities_c != nullptr)
-    delete[] velocities_c;
-  if (accelerations_c != nullptr)
-    delete[] accelerations_c;
-
   // Create C++ wrapper
   res.reset(new Trajectory(trajectories, num_waypoints, time_vector[0], time_vector[time_vector.size() - 1]));
+  res->fitSegments(time_vector);
   return res;
 }
 
@@ -102,12 +355,28 @@ Trajectory::~Trajectory() noexcept
 
 double Trajectory::getDuration()
 {
+  if (trajectories_.empty())
+    return end_time_ - start_time_;
   // Note -- could use any joint here, as they all have the same time vector
   return hebiTrajectoryGetDuration(trajectories_[0]);
 }
 
 bool Trajectory::getState(double time, VectorXd* position, VectorXd* velocity, VectorXd* acceleration)
 {
+  if (trajectories_.empty())
+  {
+    int s = findSegment(time, 0);
+    double x = time - segment_times_[s];
+    for (int i = 0; i < number_of_joints_; ++i)
+    {
+      evaluateQuintic(coefficients_.col(i).data() + 6 * s, x,
+        position == nullptr ? nullptr : &(*position)[i],
+        velocity == nullptr ? nullptr : &(*velocity)[i],
+        acceleration == nullptr ? nullptr : &(*acceleration)[i]);
+    }
+    return true;
+  }
+
   double tmp_p, tmp_v, tmp_a;
   bool success = true;
   for (int i = 0; i < trajectories_.size(); ++i)
@@ -122,6 +391,150 @@ bool Trajectory::getState(double time, VectorXd* position, VectorXd* velocity, V
   return success;
 }
 
+int Trajectory::findSegment(double time, int segment) const
+{
+  // Times before the start or after the end extend the first or last
+  // segment, as in the C library
+  const int last = segment_times_.size() - 2;
+  const double* knots = segment_times_.data();
+  if ((segment == 0 || time >= knots[segment]) && (segment == last || time < knots[segment + 1]))
+    return segment;
+  return std::upper_bound(knots + 1, knots + last + 1, time) - (knots + 1);
+}
+
+namespace {
+// Below this many samples per thread, starting a thread costs more than it
+// saves
+const size_t MIN_SAMPLES_PER_THREAD = 4096;
+
+// Runs work(begin, end) over [0, count) on up to threads threads, the calling
+// one included; true if every call returned true
+template<typename Work>
+bool runSplit(int count, size_t threads, Work work)
+{
+  threads = std::max<size_t>(1, std::min(threads, (size_t)count));
+  int chunk = (count + (int)threads - 1) / (int)threads;
+  std::vector<std::thread> helpers;
+  std::vector<char> results(threads, 1);
+  helpers.reserve(threads - 1);
+  for (size_t t = 1; t < threads; ++t)
+  {
+    int begin = std::min(count, (int)t * chunk);
+    int end = std::min(count, begin + chunk);
+    char& result = results[t];
+    helpers.emplace_back([&work, &result, begin, end]() { result = work(begin, end); });
+  }
+  results[0] = work(0, std::min(count, chunk));
+  for (auto& helper : helpers)
+    helper.join();
+  return std::find(results.begin(), results.end(), 0) == results.end();
+}
+}
+
+void Trajectory::fitSegments(const VectorXd& time_vector)
+{
+  int num_segments = time_vector.size() - 1;
+  for (int s = 0; s < num_segments; ++s)
+  {
+    if (!(time_vector[s + 1] > time_vector[s]))
+      return;
+  }
+  MatrixXd coefficients(6 * num_segments, number_of_joints_);
+  for (int joint = 0; joint < number_of_joints_; ++joint)
+  {
+    for (int s = 0; s < num_segments; ++s)
+    {
+      // The quintic through the states at both ends of the segment...
+      double h = time_vector[s + 1] - time_vector[s];
+      double p0, v0, a0, p1, v1, a1;
+      if (hebiTrajectoryGetState(trajectories_[joint], time_vector[s], &p0, &v0, &a0) != 0 ||
+          hebiTrajectoryGetState(trajectories_[joint], time_vector[s + 1], &p1, &v1, &a1) != 0)
+        return;
+      double* c = coefficients.col(joint).data() + 6 * s;
+      quinticFromStates(h, p0, v0, a0, p1, v1, a1, c);
+
+      // ...must be the segment itself
+      double x = h / 2;
+      double p, v, a;
+      if (hebiTrajectoryGetState(trajectories_[joint], time_vector[s] + x, &p, &v, &a) != 0)
+        return;
+      double fit_p, fit_v, fit_a;
+      evaluateQuintic(c, x, &fit_p, &fit_v, &fit_a);
+      // (the C library's own states carry round-off of about 1e-9)
+      const double tolerance = 1e-6;
+      if (std::abs(fit_p - p) > tolerance * (1 + std::abs(p)) ||
+          std::abs(fit_v - v) > tolerance * (1 + std::abs(v)) ||
+          std::abs(fit_a - a) > tolerance * (1 + std::abs(a)))
+        return;
+    }
+  }
+  segment_times_ = time_vector;
+  coefficients_.swap(coefficients);
+}
+
+bool Trajectory::sampleMany(const VectorXd& times, MatrixXd* positions, MatrixXd* velocities, MatrixXd* accelerations,
+  size_t threads)
+{
+  const int num_times = times.size();
+  MatrixXd* outputs[3] = { positions, velocities, accelerations };
+  for (MatrixXd* output : outputs)
+  {
+    if (output != nullptr && (output->rows() != number_of_joints_ || output->cols() != num_times))
+      output->resize(number_of_joints_, num_times);
+  }
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t samples = (size_t)number_of_joints_ * num_times;
+  threads = std::min(threads, std::max<size_t>(1, samples / MIN_SAMPLES_PER_THREAD));
+
+  if (coefficients_.size() == 0)
+  {
+    // One C call per joint and time; each trajectory object stays on one
+    // thread. Derivatives that were not asked for all go to one scratch value
+    return runSplit(number_of_joints_, threads, [&](int begin, int end) -> bool
+    {
+      double scratch[3];
+      bool success = true;
+      for (int joint = begin; joint < end; ++joint)
+      {
+        double* out[3];
+        ptrdiff_t stride[3];
+        for (int k = 0; k < 3; ++k)
+        {
+          out[k] = outputs[k] == nullptr ? &scratch[k] : outputs[k]->data() + joint;
+          stride[k] = outputs[k] == nullptr ? 0 : number_of_joints_;
+        }
+        for (int i = 0; i < num_times; ++i)
+        {
+          success = (hebiTrajectoryGetState(trajectories_[joint], times[i],
+            out[0] + i * stride[0], out[1] + i * stride[1], out[2] + i * stride[2]) == 0) && success;
+        }
+      }
+      return success;
+    });
+  }
+
+  // The polynomials; each thread fills whole columns, so no two threads
+  // write to the same cache line
+  return runSplit(num_times, threads, [&](int begin, int end) -> bool
+  {
+    int s = 0;
+    for (int i = begin; i < end; ++i)
+    {
+      s = findSegment(times[i], s);
+      double x = times[i] - segment_times_[s];
+      for (int joint = 0; joint < number_of_joints_; ++joint)
+      {
+        evaluateQuintic(coefficients_.col(joint).data() + 6 * s, x,
+          positions == nullptr ? nullptr : &(*positions)(joint, i),
+          velocities == nullptr ? nullptr : &(*velocities)(joint, i),
+          accelerations == nullptr ? nullptr : &(*accelerations)(joint, i));
+      }
+    }
+    return true;
+  });
+}
+
 } // namespace trajectory
 } // namespace hebi
 
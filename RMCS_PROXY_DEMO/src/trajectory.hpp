@@ -19,7 +19,8 @@ class Trajectory final
 {
   private:
     /**
-     * C-style trajectory objects (one for each module)
+     * C-style trajectory objects (one for each module); empty if the
+     * trajectory was solved natively
      */
     std::vector<HebiTrajectoryPtr> trajectories_;
 
@@ -43,11 +44,27 @@ class Trajectory final
      */
     const double end_time_;
  
+    /**
+     * The waypoint times, and each joint's quintic polynomial on every segment
+     * between them: 6 coefficients per segment, constant term first, in the
+     * time since the segment's start; one column per joint. Either solved
+     * natively, or fitted to the C trajectories; empty if that fit failed
+     * (see fitSegments).
+     */
+    VectorXd segment_times_;
+    MatrixXd coefficients_;
+
     /**
      * Creates a Trajectory from a list of the underlying C-style objects.
      */
     Trajectory(std::vector<HebiTrajectoryPtr> trajectories, int number_of_waypoints, double start_time, double end_time);
 
+    /**
+     * Creates a Trajectory from natively solved polynomials (see
+     * coefficients_), which are taken over; coefficients is left empty.
+     */
+    Trajectory(const VectorXd& time_vector, MatrixXd& coefficients);
+
   public:
 
     /**
@@ -77,6 +94,15 @@ class Trajectory final
      * \returns A HebiTrajectory object if there were no errors, and the
      * trajectory has been created. A empty unique_ptr indicates that there was
      * an error in creating the trajectory.
+     *
+     * Each joint minimizes the integral of its squared jerk, moving along a
+     * quintic polynomial between each two waypoints. This is solved natively:
+     * the linear system depends only on the times and on which values are
+     * free, so it is factored once for all joints that share these, and kept
+     * for the last few time vectors, so that replanning through the same
+     * times only has to substitute the new values. Should the system have no
+     * unique solution, or a value be infinite, each joint is instead handed
+     * to the C library.
      */
     static std::unique_ptr<Trajectory> createUnconstrainedQp(
       const VectorXd& time_vector,
@@ -131,7 +157,47 @@ class Trajectory final
      */
     bool getState(double time, VectorXd* position, VectorXd* velocity, VectorXd* acceleration);
 
+    /**
+     * \brief Returns the position, velocity, and acceleration of every joint
+     * at many points in time, e.g. to pre-render a trajectory at a fixed rate.
+     *
+     * Each joint moves along a quintic polynomial between two waypoints; these
+     * are known once the trajectory is created, and evaluated here natively,
+     * computing only the derivatives asked for. The times are split between
+     * threads. For a trajectory solved by the C library whose polynomials
+     * could not be fitted, the joints are split between threads instead, each
+     * calling the C library for every sample.
+     *
+     * \param times The times for which the trajectory state is being queried,
+     * in any order. These should be between the start and end of the
+     * trajectory.
+     * \param positions If not nullptr, this (number of joints x number of
+     * times) matrix is filled in with the positions; column i is for times[i].
+     * It is only resized if its size differs.
+     * \param velocities As positions, for the velocities.
+     * \param accelerations As positions, for the accelerations.
+     * \param threads How many threads to use at most, including the calling
+     * one; 0 uses one per hardware thread. Short requests use fewer.
+     *
+     * \returns true if every sample succeeded.
+     */
+    bool sampleMany(const VectorXd& times, MatrixXd* positions, MatrixXd* velocities, MatrixXd* accelerations,
+      size_t threads = 0);
+
   private:
+    /**
+     * Fits a quintic to each joint's segment between two waypoints, from the
+     * C trajectory's states at both ends, and keeps them if they match it at
+     * every segment's midpoint.
+     */
+    void fitSegments(const VectorXd& time_vector);
+
+    /**
+     * The segment of coefficients_ that time falls in, trying the given one
+     * first.
+     */
+    int findSegment(double time, int segment) const;
+
     /**
      * Disable copy and move constructors and assignment operators
      */